@@ -0,0 +1,131 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <vector>
+#include <memory>
+#include <thread>
+
+#include <benchmark/benchmark.h>
+#include <eigen_conversions/eigen_msg.h>
+
+#include <msckf_vio/filter_host.h>
+#include <msckf_vio/synthetic_scenario.h>
+
+using namespace std;
+using namespace Eigen;
+using namespace msckf_vio;
+
+namespace {
+
+// Number of filter instances run by each benchmark case.
+const int kFilterNum = 16;
+
+/*
+ * @brief ScenarioMsgs A synthetic scenario converted to
+ *    msgs once, which are shared by all the instances.
+ */
+struct ScenarioMsgs {
+  MsckfVio::Config config;
+  vector<sensor_msgs::ImuConstPtr> imu_msgs;
+  vector<CameraMeasurementConstPtr> feature_msgs;
+  // Number of the IMU msgs before each frame.
+  vector<int> imu_msg_cntrs;
+
+  ScenarioMsgs() {
+    SyntheticScenario::Config scenario_config;
+    scenario_config.duration = 10.0;
+    scenario_config.max_feature_num = 150;
+    SyntheticScenario scenario(scenario_config);
+    scenario.generate();
+
+    config.publish_tf = false;
+    config.T_imu_cam0 = scenario_config.T_imu_cam0;
+    config.T_cam0_cam1 = scenario_config.T_cam0_cam1;
+    config.max_cam_state_size = 20;
+
+    const auto& imu_samples = scenario.imuSamples();
+    int imu_idx = 0;
+    for (const auto& frame : scenario.stereoFrames()) {
+      for (; imu_idx < static_cast<int>(imu_samples.size()) &&
+          imu_samples[imu_idx].time <= frame.time; ++imu_idx) {
+        sensor_msgs::ImuPtr imu_msg(new sensor_msgs::Imu);
+        imu_msg->header.stamp.fromSec(imu_samples[imu_idx].time);
+        tf::vectorEigenToMsg(imu_samples[imu_idx].angular_velocity,
+            imu_msg->angular_velocity);
+        tf::vectorEigenToMsg(imu_samples[imu_idx].linear_acceleration,
+            imu_msg->linear_acceleration);
+        imu_msgs.push_back(imu_msg);
+      }
+      imu_msg_cntrs.push_back(imu_msgs.size());
+
+      CameraMeasurementPtr feature_msg(new CameraMeasurement);
+      feature_msg->header.stamp.fromSec(frame.time);
+      for (const auto& feature : frame.features) {
+        FeatureMeasurement feature_measurement;
+        feature_measurement.id = feature.id;
+        feature_measurement.u0 = feature.measurement(0);
+        feature_measurement.v0 = feature.measurement(1);
+        feature_measurement.u1 = feature.measurement(2);
+        feature_measurement.v1 = feature.measurement(3);
+        feature_msg->features.push_back(feature_measurement);
+      }
+      feature_msgs.push_back(feature_msg);
+    }
+  }
+
+  void push(const int& filter_id, FilterHost& host) const {
+    int imu_idx = 0;
+    for (int k = 0; k < static_cast<int>(feature_msgs.size()); ++k) {
+      for (; imu_idx < imu_msg_cntrs[k]; ++imu_idx)
+        host.pushImu(filter_id, imu_msgs[imu_idx]);
+      host.pushFeatures(filter_id, feature_msgs[k]);
+    }
+    return;
+  }
+};
+
+const ScenarioMsgs& scenarioMsgs() {
+  static const ScenarioMsgs scenario_msgs;
+  return scenario_msgs;
+}
+
+// Run kFilterNum instances with the given number of threads.
+// The frame rate over all the instances should scale with
+// the number of threads up to the number of cores.
+void BM_filterHost(benchmark::State& state) {
+  const ScenarioMsgs& scenario_msgs = scenarioMsgs();
+  const int thread_num = state.range(0);
+
+  for (auto _ : state) {
+    // Exclude creating and destroying the instances.
+    state.PauseTiming();
+    unique_ptr<FilterHost> host(new FilterHost(thread_num));
+    for (int i = 0; i < kFilterNum; ++i) {
+      host->addFilter(scenario_msgs.config);
+      scenario_msgs.push(i, *host);
+    }
+    state.ResumeTiming();
+
+    host->run();
+
+    state.PauseTiming();
+    benchmark::DoNotOptimize(host->trajectory(0).size());
+    host.reset();
+    state.ResumeTiming();
+  }
+
+  state.counters["frames_per_second"] = benchmark::Counter(
+      state.iterations() * kFilterNum * scenario_msgs.feature_msgs.size(),
+      benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_filterHost)
+  ->RangeMultiplier(2)->Range(1, max(1u, thread::hardware_concurrency()))
+  ->UseRealTime()->Unit(benchmark::kMillisecond);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,469 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <cmath>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include <eigen3/Eigen/Dense>
+#include <eigen3/Eigen/Geometry>
+
+#include <benchmark/benchmark.h>
+
+#include <msckf_vio/msckf_vio.h>
+#include <msckf_vio/math_utils.hpp>
+
+using namespace std;
+using namespace Eigen;
+
+namespace msckf_vio {
+
+/*
+ * @brief MsckfVioBenchmark Sets up a synthetic sliding window
+ *    and feature map, and exposes the filter kernels of
+ *    MsckfVio to the benchmarks.
+ *
+ *    The camera states are placed along a straight line with
+ *    small rotations around the optical axis, and the features
+ *    are spread 4-8m in front of the cameras. Each feature is
+ *    tracked over (at most) 10 consecutive camera states.
+ */
+class MsckfVioBenchmark {
+public:
+  MsckfVioBenchmark() {}
+
+  /*
+   * @brief setup Create the sliding window and the features.
+   * @param window_size: number of camera states in the window.
+   * @param feature_num: number of features in the map.
+   */
+  void setup(const int& window_size, const int& feature_num);
+
+  /*
+   * @brief restore Reset the filter to the state right after
+   *    setup(). Should be called with the timing paused.
+   */
+  void restore() {
+    vio.state_server = initial_state_server;
+    vio.map_server = initial_map_server;
+    return;
+  }
+
+  // Kernels
+  void processModel(const double& dt) {
+    vio.processModel(vio.state_server.imu_state.time+dt, gyro, acc);
+  }
+  void predictNewState(const double& dt) {
+    vio.predictNewState(dt, gyro, acc);
+  }
+  void predictNewStateClosedForm(const double& dt) {
+    vio.predictNewStateClosedForm(dt, gyro, acc);
+  }
+  // Propagate over the IMU samples between two frames.
+  void batchImuProcessing(const int& sample_num, const double& dt) {
+    const double time = vio.state_server.imu_state.time;
+    for (int i = 1; i <= sample_num; ++i) {
+      MsckfVio::ImuSample sample;
+      sample.time = time + i*dt;
+      sample.gyro = gyro;
+      sample.acc = acc;
+      vio.imu_buffer.push_back(sample);
+    }
+    vio.batchImuProcessing(time + sample_num*dt);
+  }
+  void stateAugmentation(const double& time) {
+    vio.stateAugmentation(time);
+  }
+  void featureJacobian(const FeatureIDType& feature_id,
+      MatrixXd& H_x, VectorXd& r) {
+    vio.featureJacobian(feature_id, cam_state_ids[feature_id], H_x, r);
+  }
+  bool gatingTest(const FeatureIDType& feature_id) {
+    return vio.gatingTest(feature_H[feature_id], feature_r[feature_id],
+        cam_state_ids[feature_id].size()-1);
+  }
+  void measurementUpdate() {
+    vio.measurementUpdate(stacked_H, stacked_r);
+  }
+  void pruneCamStateBuffer() {
+    vio.pruneCamStateBuffer();
+  }
+  bool initializePosition(const FeatureIDType& feature_id) {
+    Feature& feature = uninitialized_features[feature_id];
+    feature.is_initialized = false;
+    return feature.initializePosition(vio.state_server.cam_states,
+        vio.T_cam0_cam1, vio.optimization_config);
+  }
+
+  int stateSize() const {
+    return vio.state_server.state_cov.rows();
+  }
+  int featureNum() const {
+    return vio.map_server.size();
+  }
+  int stackedRowSize() const {
+    return stacked_H.rows();
+  }
+
+private:
+  MsckfVio vio;
+
+  // Snapshot of the filter right after setup().
+  MsckfVio::StateServer initial_state_server;
+  MapServer initial_map_server;
+
+  // Camera states observing each of the features.
+  vector<vector<StateIDType> > cam_state_ids;
+
+  // Jacobians and residuals of each feature, and the stacked
+  // ones of all the features.
+  vector<MatrixXd> feature_H;
+  vector<VectorXd> feature_r;
+  MatrixXd stacked_H;
+  VectorXd stacked_r;
+
+  // Copies of the features without 3d positions.
+  vector<Feature> uninitialized_features;
+
+  // IMU measurement used in the propagation.
+  Vector3d gyro;
+  Vector3d acc;
+};
+
+void MsckfVioBenchmark::setup(
+    const int& window_size, const int& feature_num) {
+  // The noise and stereo configuration follow the
+  // default launch files.
+  MsckfVio::Config config;
+  config.gyro_noise = 0.005;
+  config.acc_noise = 0.05;
+  config.gyro_bias_noise = 0.001;
+  config.acc_bias_noise = 0.01;
+  config.observation_noise = 0.035;
+  config.T_cam0_cam1.translation() = Vector3d(-0.1, 0.0, 0.0);
+  config.max_cam_state_size = window_size;
+  vio.initialize(config);
+
+  vio.tracking_rate = 1.0;
+  vio.is_gravity_set = true;
+  vio.is_first_img = false;
+
+  // Fixed seed so that all the runs see the same problem.
+  mt19937 generator(0);
+  normal_distribution<double> pixel_noise(0.0, 0.5/460.0);
+  uniform_real_distribution<double> lateral(-3.0, 3.0);
+  uniform_real_distribution<double> depth(4.0, 8.0);
+
+  const double dt = 0.05;
+  const double step = 0.05;
+
+  // Camera states along the x axis. The camera and the IMU
+  // frames coincide so that the camera poses are exactly
+  // the IMU poses.
+  MsckfVio::StateServer& state_server = vio.state_server;
+  state_server.cam_states.clear();
+  for (int i = 0; i < window_size; ++i) {
+    CAMState cam_state(i);
+    cam_state.time = i * dt;
+    cam_state.orientation = rotationToQuaternion(Matrix3d(
+          AngleAxisd(0.01*i, Vector3d::UnitZ()).toRotationMatrix()));
+    cam_state.position = Vector3d(step*i, 0.02*sin(0.5*i), 0.0);
+    cam_state.orientation_null = cam_state.orientation;
+    cam_state.position_null = cam_state.position;
+    state_server.cam_states[cam_state.id] = cam_state;
+  }
+
+  const CAMState& last_cam_state =
+    state_server.cam_states.rbegin()->second;
+  IMUState& imu_state = state_server.imu_state;
+  imu_state.id = window_size;
+  imu_state.time = last_cam_state.time;
+  imu_state.orientation = last_cam_state.orientation;
+  imu_state.position = last_cam_state.position;
+  imu_state.velocity = Vector3d(step/dt, 0.0, 0.0);
+  imu_state.gyro_bias = Vector3d::Zero();
+  imu_state.acc_bias = Vector3d::Zero();
+  imu_state.R_imu_cam0 = Matrix3d::Identity();
+  imu_state.t_cam0_imu = Vector3d::Zero();
+  imu_state.orientation_null = imu_state.orientation;
+  imu_state.position_null = imu_state.position;
+  imu_state.velocity_null = imu_state.velocity;
+  vio.next_state_id = imu_state.id + 1;
+
+  gyro = Vector3d(0.0, 0.0, 0.2);
+  acc = -vio.gravity + Vector3d(0.1, 0.0, 0.0);
+
+  // A well conditioned covariance with small correlations
+  // between the camera states.
+  const int state_size = 21 + 6*window_size;
+  MatrixXd A = MatrixXd::Identity(state_size, state_size) * 1e-2;
+  for (int i = 0; i < state_size-1; ++i)
+    A(i+1, i) = 1e-3;
+  state_server.state_cov = A * A.transpose();
+  for (int i = 3; i < 6; ++i)
+    state_server.state_cov(i, i) += 1e-4;
+  for (int i = 6; i < 9; ++i)
+    state_server.state_cov(i, i) += 0.25;
+  for (int i = 9; i < 12; ++i)
+    state_server.state_cov(i, i) += 1e-2;
+
+  // Features and their observations.
+  const int track_length = min(window_size, 10);
+  vio.map_server.clear();
+  cam_state_ids.assign(feature_num, vector<StateIDType>(0));
+  for (int j = 0; j < feature_num; ++j) {
+    const int first_state = j % (window_size-track_length+1);
+
+    Feature feature(j);
+    feature.position = Vector3d(
+        lateral(generator) + step*(first_state+0.5*track_length),
+        lateral(generator)*2.0/3.0, depth(generator));
+    feature.is_initialized = true;
+
+    for (int i = first_state; i < first_state+track_length; ++i) {
+      const CAMState& cam_state = state_server.cam_states[i];
+      const Matrix3d R_w_c0 = quaternionToRotation(cam_state.orientation);
+      const Vector3d p_c0 = R_w_c0 * (feature.position-cam_state.position);
+      const Vector3d p_c1 = config.T_cam0_cam1 * p_c0;
+      feature.observations[i] = Vector4d(
+          p_c0(0)/p_c0(2) + pixel_noise(generator),
+          p_c0(1)/p_c0(2) + pixel_noise(generator),
+          p_c1(0)/p_c1(2) + pixel_noise(generator),
+          p_c1(1)/p_c1(2) + pixel_noise(generator));
+      cam_state_ids[j].push_back(i);
+    }
+    vio.map_server[feature.id] = feature;
+  }
+
+  uninitialized_features.clear();
+  for (const auto& item : vio.map_server) {
+    uninitialized_features.push_back(item.second);
+    uninitialized_features.back().is_initialized = false;
+  }
+
+  // Jacobians of the features, stacked in the same way
+  // as in removeLostFeatures().
+  feature_H.assign(feature_num, MatrixXd());
+  feature_r.assign(feature_num, VectorXd());
+  int jacobian_row_size = 0;
+  for (int j = 0; j < feature_num; ++j) {
+    featureJacobian(j, feature_H[j], feature_r[j]);
+    jacobian_row_size += feature_H[j].rows();
+  }
+
+  stacked_H = MatrixXd::Zero(jacobian_row_size, state_size);
+  stacked_r = VectorXd::Zero(jacobian_row_size);
+  int stack_cntr = 0;
+  for (int j = 0; j < feature_num; ++j) {
+    stacked_H.block(stack_cntr, 0,
+        feature_H[j].rows(), feature_H[j].cols()) = feature_H[j];
+    stacked_r.segment(stack_cntr, feature_r[j].rows()) = feature_r[j];
+    stack_cntr += feature_H[j].rows();
+  }
+
+  initial_state_server = vio.state_server;
+  initial_map_server = vio.map_server;
+  return;
+}
+
+} // namespace msckf_vio
+
+using namespace msckf_vio;
+
+namespace {
+
+// Window sizes x feature numbers.
+void windowAndFeatureArgs(benchmark::internal::Benchmark* b) {
+  for (int window_size = 10; window_size <= 60; window_size += 10)
+    for (int feature_num = 50; feature_num <= 800; feature_num *= 2)
+      b->Args({window_size, feature_num});
+  return;
+}
+
+// Window sizes only, for the kernels which do not
+// depend on the features.
+void windowArgs(benchmark::internal::Benchmark* b) {
+  for (int window_size = 10; window_size <= 60; window_size += 10)
+    b->Args({window_size, 50});
+  return;
+}
+
+void setCounters(benchmark::State& state,
+    const MsckfVioBenchmark& fixture) {
+  state.counters["state_size"] = fixture.stateSize();
+  state.counters["feature_num"] = fixture.featureNum();
+  return;
+}
+
+void BM_processModel(benchmark::State& state) {
+  MsckfVioBenchmark fixture;
+  fixture.setup(state.range(0), state.range(1));
+  setCounters(state, fixture);
+
+  // The filter is restored after each propagation, so all
+  // the iterations start from the same state and covariance.
+  for (auto _ : state) {
+    fixture.processModel(0.005);
+    state.PauseTiming();
+    fixture.restore();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_processModel)->Apply(windowArgs);
+
+// 10 IMU samples at 200Hz between two frames at 20Hz
+void BM_batchImuProcessing(benchmark::State& state) {
+  MsckfVioBenchmark fixture;
+  fixture.setup(state.range(0), state.range(1));
+  setCounters(state, fixture);
+
+  for (auto _ : state) {
+    fixture.batchImuProcessing(10, 0.005);
+    state.PauseTiming();
+    fixture.restore();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations()*10);
+}
+BENCHMARK(BM_batchImuProcessing)->Apply(windowArgs);
+
+void BM_predictNewState(benchmark::State& state) {
+  MsckfVioBenchmark fixture;
+  fixture.setup(state.range(0), state.range(1));
+  setCounters(state, fixture);
+
+  for (auto _ : state)
+    fixture.predictNewState(0.005);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_predictNewState)->Args({10, 50});
+
+void BM_predictNewStateClosedForm(benchmark::State& state) {
+  MsckfVioBenchmark fixture;
+  fixture.setup(state.range(0), state.range(1));
+  setCounters(state, fixture);
+
+  for (auto _ : state)
+    fixture.predictNewStateClosedForm(0.005);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_predictNewStateClosedForm)->Args({10, 50});
+
+void BM_stateAugmentation(benchmark::State& state) {
+  MsckfVioBenchmark fixture;
+  fixture.setup(state.range(0), state.range(1));
+  setCounters(state, fixture);
+
+  for (auto _ : state) {
+    fixture.stateAugmentation(10.0);
+    state.PauseTiming();
+    fixture.restore();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_stateAugmentation)->Apply(windowArgs);
+
+void BM_featureJacobian(benchmark::State& state) {
+  MsckfVioBenchmark fixture;
+  fixture.setup(state.range(0), state.range(1));
+  setCounters(state, fixture);
+
+  // Jacobians of all the features in each iteration.
+  MatrixXd H_x;
+  VectorXd r;
+  const int feature_num = fixture.featureNum();
+  for (auto _ : state) {
+    for (int j = 0; j < feature_num; ++j) {
+      fixture.featureJacobian(j, H_x, r);
+      benchmark::DoNotOptimize(H_x.data());
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * feature_num);
+}
+BENCHMARK(BM_featureJacobian)->Apply(windowAndFeatureArgs)
+  ->Unit(benchmark::kMillisecond);
+
+void BM_gatingTest(benchmark::State& state) {
+  MsckfVioBenchmark fixture;
+  fixture.setup(state.range(0), state.range(1));
+  setCounters(state, fixture);
+
+  // Gating test of all the features in each iteration.
+  const int feature_num = fixture.featureNum();
+  int passed_num = 0;
+  for (auto _ : state) {
+    passed_num = 0;
+    for (int j = 0; j < feature_num; ++j)
+      if (fixture.gatingTest(j)) ++passed_num;
+    benchmark::DoNotOptimize(passed_num);
+  }
+  state.counters["passed_num"] = passed_num;
+  state.SetItemsProcessed(state.iterations() * feature_num);
+}
+BENCHMARK(BM_gatingTest)->Apply(windowAndFeatureArgs)
+  ->Unit(benchmark::kMillisecond);
+
+void BM_measurementUpdate(benchmark::State& state) {
+  MsckfVioBenchmark fixture;
+  fixture.setup(state.range(0), state.range(1));
+  setCounters(state, fixture);
+  state.counters["row_size"] = fixture.stackedRowSize();
+
+  for (auto _ : state) {
+    fixture.measurementUpdate();
+    state.PauseTiming();
+    fixture.restore();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_measurementUpdate)->Apply(windowAndFeatureArgs)
+  ->Unit(benchmark::kMillisecond);
+
+void BM_pruneCamStateBuffer(benchmark::State& state) {
+  MsckfVioBenchmark fixture;
+  fixture.setup(state.range(0), state.range(1));
+  setCounters(state, fixture);
+
+  for (auto _ : state) {
+    fixture.pruneCamStateBuffer();
+    state.PauseTiming();
+    fixture.restore();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_pruneCamStateBuffer)->Apply(windowAndFeatureArgs)
+  ->Unit(benchmark::kMillisecond);
+
+void BM_initializePosition(benchmark::State& state) {
+  MsckfVioBenchmark fixture;
+  fixture.setup(state.range(0), state.range(1));
+  setCounters(state, fixture);
+
+  // Triangulation of all the features in each iteration.
+  const int feature_num = fixture.featureNum();
+  for (auto _ : state) {
+    for (int j = 0; j < feature_num; ++j)
+      benchmark::DoNotOptimize(fixture.initializePosition(j));
+  }
+  state.SetItemsProcessed(state.iterations() * feature_num);
+}
+BENCHMARK(BM_initializePosition)->Apply(windowAndFeatureArgs);
+
+} // namespace
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -0,0 +1,135 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_BOUNDED_QUEUE_H
+#define MSCKF_VIO_BOUNDED_QUEUE_H
+
+#include <deque>
+#include <mutex>
+#include <cstddef>
+#include <condition_variable>
+
+namespace msckf_vio {
+
+/*
+ * @brief BoundedQueue A bounded blocking queue connecting two
+ *    stages of a pipeline. The producer blocks while the queue
+ *    is full, which propagates the backpressure of a slow stage
+ *    upstream, and the consumer blocks while it is empty. Once
+ *    closed, the remaining elements can still be popped.
+ */
+template <typename T>
+class BoundedQueue {
+public:
+  explicit BoundedQueue(const size_t& capacity):
+    max_size(capacity > 0 ? capacity : 1), is_closed(false) {
+    return;
+  }
+
+  // Disable copy and assign constructor
+  BoundedQueue(const BoundedQueue&) = delete;
+  BoundedQueue operator=(const BoundedQueue&) = delete;
+
+  /*
+   * @brief push Move an element into the queue, blocking
+   *    while the queue is full.
+   * @return False if the queue is closed, in which case the
+   *    element is left untouched.
+   */
+  bool push(T& value) {
+    std::unique_lock<std::mutex> lock(mutex);
+    not_full_cond.wait(lock, [this]() {
+        return is_closed || elements.size() < max_size; });
+    if (is_closed) return false;
+    elements.push_back(std::move(value));
+    lock.unlock();
+    not_empty_cond.notify_one();
+    return true;
+  }
+
+  /*
+   * @brief tryPush Move an element into the queue if it
+   *    is not full or closed.
+   */
+  bool tryPush(T& value) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (is_closed || elements.size() >= max_size) return false;
+      elements.push_back(std::move(value));
+    }
+    not_empty_cond.notify_one();
+    return true;
+  }
+
+  /*
+   * @brief pop Move the oldest element out of the queue,
+   *    blocking while the queue is empty.
+   * @return False if the queue is closed and empty.
+   */
+  bool pop(T& value) {
+    std::unique_lock<std::mutex> lock(mutex);
+    not_empty_cond.wait(lock, [this]() {
+        return is_closed || !elements.empty(); });
+    if (elements.empty()) return false;
+    value = std::move(elements.front());
+    elements.pop_front();
+    lock.unlock();
+    not_full_cond.notify_one();
+    return true;
+  }
+
+  /*
+   * @brief tryPop Move the oldest element out of the queue
+   *    if there is any.
+   */
+  bool tryPop(T& value) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (elements.empty()) return false;
+      value = std::move(elements.front());
+      elements.pop_front();
+    }
+    not_full_cond.notify_one();
+    return true;
+  }
+
+  /*
+   * @brief close Wake up all the blocked threads. Further
+   *    pushes fail.
+   */
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      is_closed = true;
+    }
+    not_full_cond.notify_all();
+    not_empty_cond.notify_all();
+    return;
+  }
+
+  size_t size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return elements.size();
+  }
+
+  size_t capacity() const {
+    return max_size;
+  }
+
+private:
+  const size_t max_size;
+
+  mutable std::mutex mutex;
+  std::condition_variable not_full_cond;
+  std::condition_variable not_empty_cond;
+  std::deque<T> elements;
+  bool is_closed;
+};
+
+} // namespace msckf_vio
+
+#endif // MSCKF_VIO_BOUNDED_QUEUE_H
@@ -0,0 +1,118 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_CHECKPOINT_H
+#define MSCKF_VIO_CHECKPOINT_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <eigen3/Eigen/Dense>
+
+#include "imu_state.h"
+#include "cam_state.h"
+#include "feature.hpp"
+
+namespace msckf_vio {
+
+/*
+ * @brief FilterSnapshot Everything that is needed to resume
+ *    the estimation of a filter: the IMU state, the camera
+ *    states in the sliding window, the state covariance and
+ *    the features being tracked. The noise parameters are
+ *    not included and are taken from the restored filter.
+ */
+struct FilterSnapshot {
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  // Id for the next IMU state
+  StateIDType next_state_id;
+  // Gravity vector in the world frame
+  Eigen::Vector3d gravity;
+
+  IMUState imu_state;
+  CamStateServer cam_states;
+  Eigen::MatrixXd state_cov;
+  MapServer map_server;
+
+  FilterSnapshot(): next_state_id(0),
+    gravity(0.0, 0.0, -GRAVITY_ACCELERATION) {}
+};
+
+/*
+ * @brief saveSnapshot Write a snapshot into a binary file.
+ *    The file is written through a memory mapping of a
+ *    temporary file, which is renamed to the given path
+ *    afterwards, so a reader never sees a partial file.
+ * @param snapshot: the snapshot to be written.
+ * @param file_name: path of the output file.
+ * @return True if the file is written successfully.
+ */
+bool saveSnapshot(const FilterSnapshot& snapshot,
+    const std::string& file_name);
+
+/*
+ * @brief loadSnapshot Read a snapshot written by saveSnapshot.
+ * @param file_name: path of the snapshot file.
+ * @return snapshot: the restored snapshot.
+ * @return True if the file exists, has the expected format
+ *    and passes the checksum.
+ */
+bool loadSnapshot(const std::string& file_name,
+    FilterSnapshot& snapshot);
+
+/*
+ * @brief CheckpointWriter Writes snapshots to a file on a
+ *    background thread. If a new snapshot arrives while the
+ *    previous one is still being written, only the latest
+ *    one is kept, so the filter thread is never blocked by
+ *    the file system.
+ */
+class CheckpointWriter {
+public:
+  explicit CheckpointWriter(const std::string& file_name);
+  // Writes the pending snapshot before returning.
+  ~CheckpointWriter();
+
+  // Disable copy and assign constructor
+  CheckpointWriter(const CheckpointWriter&) = delete;
+  CheckpointWriter operator=(const CheckpointWriter&) = delete;
+
+  /*
+   * @brief write Queue a snapshot to be written. The content
+   *    of the snapshot is moved and the argument is left with
+   *    an unspecified value.
+   */
+  void write(FilterSnapshot& snapshot);
+
+  /*
+   * @brief failedWriteNum Number of snapshots which could
+   *    not be written.
+   */
+  int failedWriteNum() const;
+
+private:
+  void writerLoop();
+
+  std::string file_name;
+
+  mutable std::mutex writer_mutex;
+  std::condition_variable writer_cond;
+  FilterSnapshot pending_snapshot;
+  bool has_pending_snapshot;
+  bool is_stopped;
+  int failed_write_num;
+
+  std::thread writer_thread;
+};
+
+} // namespace msckf_vio
+
+#endif // MSCKF_VIO_CHECKPOINT_H
@@ -0,0 +1,101 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_FAST_DETECTOR_H
+#define MSCKF_VIO_FAST_DETECTOR_H
+
+#include <vector>
+#include <cstddef>
+#include <opencv2/core/core.hpp>
+
+namespace msckf_vio {
+
+/*
+ * @brief FastDetector A FAST-9 corner detector for the grid
+ *    cells of the image processor.
+ *
+ *    The corners and their scores are the same as the ones of
+ *    cv::FAST with the 16 pixel circle and the non-maximal
+ *    suppression, restricted to a cell. The segment test is
+ *    vectorized with AVX2 (selected at runtime) or NEON, and
+ *    the scores are only computed for the pixels passing it.
+ *
+ *    A cell is scanned once: the rows are tested and scored
+ *    one after another, the previous row is suppressed against
+ *    its neighbours as soon as the next one is scored, and the
+ *    remaining corners go into a heap which keeps the ones with
+ *    the highest scores. No keypoints are created for the
+ *    whole cell, and the output is the flat arrays of points
+ *    and responses.
+ */
+class FastDetector {
+public:
+  /*
+   * @param use_simd: use the vectorized segment test if
+   *    available.
+   */
+  FastDetector(const bool& use_simd = true);
+
+  /*
+   * @brief detect Detect the corners inside a cell.
+   * @param img: 8-bit grayscale image.
+   * @param cell: region of the corners. The pixels around it
+   *    are used for the segment test and the suppression, so
+   *    the corners are the same as on the whole image.
+   * @param threshold: threshold of the segment test.
+   * @param occupancy: optional mask of the size of the cell,
+   *    whose nonzero pixels are not taken as corners.
+   * @param max_num: number of corners with the highest scores
+   *    which are returned.
+   * @return points, responses: the returned corners in the
+   *    image frame and their scores, in descending order of
+   *    the scores, which are appended to the arrays.
+   * @return The number of the corners in the cell which are
+   *    not occupied, before keeping max_num of them.
+   */
+  int detect(const cv::Mat& img, const cv::Rect& cell,
+      const int& threshold, const unsigned char* occupancy,
+      const int& max_num, std::vector<cv::Point2f>& points,
+      std::vector<float>& responses);
+
+  /*
+   * @brief simdName Name of the segment test in use, which
+   *    is one of "avx2", "neon" and "scalar".
+   */
+  const char* simdName() const {
+    return name;
+  }
+
+  /*
+   * @brief SegmentTest Tests the pixels of a row from ptr, and
+   *    sets mask to 0xff for the ones passing the test. It
+   *    returns the number of pixels tested, which may be less
+   *    than width for the vectorized tests.
+   */
+  typedef int (*SegmentTest)(const unsigned char* ptr,
+      const std::ptrdiff_t* offsets, const int& width,
+      const int& threshold, unsigned char* mask);
+
+private:
+  struct Corner {
+    float score;
+    int x;
+    int y;
+  };
+
+  SegmentTest segment_test;
+  const char* name;
+
+  // Buffers reused for the cells.
+  std::vector<unsigned char> scores;
+  std::vector<unsigned char> mask;
+  std::vector<Corner> corners;
+};
+
+} // namespace msckf_vio
+
+#endif // MSCKF_VIO_FAST_DETECTOR_H
@@ -81,12 +81,14 @@ struct Feature {
    *    a vector in c0 frame to ci frame.
    * @param x The current estimation.
    * @param z The actual measurement of the feature in ci frame.
+   * @param huber_epsilon Threshold of the huber kernel.
    * @return J The computed Jacobian.
    * @return r The computed residual.
    * @return w Weight induced by huber kernel.
    */
   inline void jacobian(const Eigen::Isometry3d& T_c0_ci,
       const Eigen::Vector3d& x, const Eigen::Vector2d& z,
+      const double& huber_epsilon,
       Eigen::Matrix<double, 2, 3>& J, Eigen::Vector2d& r,
       double& w) const;
 
@@ -108,17 +110,24 @@ struct Feature {
    *    there is enough translation to triangulate the feature
    *    positon.
    * @param cam_states : input camera poses.
+   * @param config : optimization configuration, of which the
+   *    translation threshold is used.
    * @return True if the translation between the input camera
    *    poses is sufficient.
    */
   inline bool checkMotion(
-      const CamStateServer& cam_states) const;
+      const CamStateServer& cam_states,
+      const OptimizationConfig& config) const;
 
   /*
    * @brief InitializePosition Intialize the feature position
    *    based on all current available measurements.
    * @param cam_states: A map containing the camera poses with its
    *    ID as the associated key value.
+   * @param T_cam0_cam1: Takes a vector from the cam0 frame to
+   *    the cam1 frame.
+   * @param config: Optimization configuration for solving
+   *    the 3d position.
    * @return The computed 3d position is used to set the position
    *    member variable. Note the resulted position is in world
    *    frame.
@@ -126,7 +135,9 @@ struct Feature {
    *    is valid.
    */
   inline bool initializePosition(
-      const CamStateServer& cam_states);
+      const CamStateServer& cam_states,
+      const Eigen::Isometry3d& T_cam0_cam1,
+      const OptimizationConfig& config);
 
 
   // An unique identifier for the feature.
@@ -135,9 +146,6 @@ struct Feature {
   // to avoid duplication.
   FeatureIDType id;
 
-  // id for next feature
-  static FeatureIDType next_id;
-
   // Store the observations of the features in the
   // state_id(key)-image_coordinates(value) manner.
   std::map<StateIDType, Eigen::Vector4d, std::less<StateIDType>,
@@ -150,13 +158,6 @@ struct Feature {
   // A indicator to show if the 3d postion of the feature
   // has been initialized or not.
   bool is_initialized;
-
-  // Noise for a normalized feature measurement.
-  static double observation_noise;
-
-  // Optimization configuration for solving the 3d position.
-  static OptimizationConfig optimization_config;
-
 };
 
 typedef Feature::FeatureIDType FeatureIDType;
@@ -189,6 +190,7 @@ void Feature::cost(const Eigen::Isometry3d& T_c0_ci,
 
 void Feature::jacobian(const Eigen::Isometry3d& T_c0_ci,
     const Eigen::Vector3d& x, const Eigen::Vector2d& z,
+    const double& huber_epsilon,
     Eigen::Matrix<double, 2, 3>& J, Eigen::Vector2d& r,
     double& w) const {
 
@@ -217,10 +219,10 @@ void Feature::jacobian(const Eigen::Isometry3d& T_c0_ci,
 
   // Compute the weight based on the residual.
   double e = r.norm();
-  if (e <= optimization_config.huber_epsilon)
+  if (e <= huber_epsilon)
     w = 1.0;
   else
-    w = optimization_config.huber_epsilon / (2*e);
+    w = huber_epsilon / (2*e);
 
   return;
 }
@@ -248,7 +250,8 @@ void Feature::generateInitialGuess(
 }
 
 bool Feature::checkMotion(
-    const CamStateServer& cam_states) const {
+    const CamStateServer& cam_states,
+    const OptimizationConfig& config) const {
 
   const StateIDType& first_cam_id = observations.begin()->first;
   const StateIDType& last_cam_id = (--observations.end())->first;
@@ -286,13 +289,15 @@ bool Feature::checkMotion(
     parallel_translation*feature_direction;
 
   if (orthogonal_translation.norm() >
-      optimization_config.translation_threshold)
+      config.translation_threshold)
     return true;
   else return false;
 }
 
 bool Feature::initializePosition(
-    const CamStateServer& cam_states) {
+    const CamStateServer& cam_states,
+    const Eigen::Isometry3d& T_cam0_cam1,
+    const OptimizationConfig& config) {
   // Organize camera poses and feature observations properly.
   std::vector<Eigen::Isometry3d,
     Eigen::aligned_allocator<Eigen::Isometry3d> > cam_poses(0);
@@ -318,7 +323,7 @@ bool Feature::initializePosition(
     cam0_pose.translation() = cam_state_iter->second.position;
 
     Eigen::Isometry3d cam1_pose;
-    cam1_pose = cam0_pose * CAMState::T_cam0_cam1.inverse();
+    cam1_pose = cam0_pose * T_cam0_cam1.inverse();
 
     cam_poses.push_back(cam0_pose);
     cam_poses.push_back(cam1_pose);
@@ -341,7 +346,7 @@ bool Feature::initializePosition(
       1.0/initial_position(2));
 
   // Apply Levenberg-Marquart method to solve for the 3d position.
-  double lambda = optimization_config.initial_damping;
+  double lambda = config.initial_damping;
   int inner_loop_cntr = 0;
   int outer_loop_cntr = 0;
   bool is_cost_reduced = false;
@@ -365,7 +370,8 @@ bool Feature::initializePosition(
       Eigen::Vector2d r;
       double w;
 
-      jacobian(cam_poses[i], solution, measurements[i], J, r, w);
+      jacobian(cam_poses[i], solution, measurements[i],
+          config.huber_epsilon, J, r, w);
 
       if (w == 1) {
         A += J.transpose() * J;
@@ -403,13 +409,13 @@ bool Feature::initializePosition(
       }
 
     } while (inner_loop_cntr++ <
-        optimization_config.inner_loop_max_iteration && !is_cost_reduced);
+        config.inner_loop_max_iteration && !is_cost_reduced);
 
     inner_loop_cntr = 0;
 
   } while (outer_loop_cntr++ <
-      optimization_config.outer_loop_max_iteration &&
-      delta_norm > optimization_config.estimation_precision);
+      config.outer_loop_max_iteration &&
+      delta_norm > config.estimation_precision);
 
   // Covert the feature position from inverse depth
   // representation to its 3d coordinate.
@@ -0,0 +1,140 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_FEATURE_BUDGET_CONTROLLER_H
+#define MSCKF_VIO_FEATURE_BUDGET_CONTROLLER_H
+
+namespace msckf_vio {
+
+/*
+ * @brief FeatureBudgetController Tunes the FAST threshold
+ *    and the per-cell feature numbers of the image processor
+ *    to a target number of features and a time budget of the
+ *    front end.
+ *
+ *    The number of features and the processing time of the
+ *    frames are smoothed with exponential moving averages and
+ *    checked every few frames. Above the time budget or the
+ *    target, the threshold is raised and the cells take one
+ *    feature less. Below the target, the threshold is lowered
+ *    and the cells take one feature more. The threshold is the
+ *    upper bound of the per-cell thresholds of the detector,
+ *    which still adapt to the texture of each cell.
+ */
+class FeatureBudgetController {
+public:
+  /*
+   * @brief Config Parameters of the controller.
+   */
+  struct Config {
+    // Target number of features in a frame, and the relative
+    // deviation from it which is tolerated.
+    int target_feature_num;
+    double tolerance;
+    // Time budget of the front end as a fraction of the
+    // frame period.
+    double time_budget;
+    // Bounds and step of the FAST threshold
+    int min_fast_threshold;
+    int max_fast_threshold;
+    int fast_threshold_step;
+    // Bounds of the number of features added to a cell
+    int min_cell_feature_num;
+    int max_cell_feature_num;
+    // Number of frames between two decisions
+    int period;
+    // Weight of the latest frame in the moving averages
+    double smoothing;
+
+    Config():
+      target_feature_num(200),
+      tolerance(0.1),
+      time_budget(0.5),
+      min_fast_threshold(5),
+      max_fast_threshold(40),
+      fast_threshold_step(2),
+      min_cell_feature_num(1),
+      max_cell_feature_num(8),
+      period(5),
+      smoothing(0.2) {
+      return;
+    }
+  };
+
+  enum Decision {
+    FEWER = -1,
+    KEEP = 0,
+    MORE = 1
+  };
+
+  /*
+   * @brief FeatureBudgetController
+   * @param config: parameters of the controller.
+   * @param frame_rate: frame rate of the images.
+   * @param fast_threshold: initial FAST threshold.
+   * @param grid_min_feature_num: initial number of features
+   *    added to a cell.
+   * @param grid_max_feature_num: initial number of features
+   *    kept in a cell. Its margin over grid_min_feature_num
+   *    is kept when the numbers change.
+   */
+  FeatureBudgetController(const Config& config,
+      const double& frame_rate, const int& fast_threshold,
+      const int& grid_min_feature_num,
+      const int& grid_max_feature_num);
+
+  /*
+   * @brief update Add the number of features and the
+   *    processing time of a frame.
+   * @return True if a decision is made with this frame.
+   */
+  bool update(const int& feature_num, const double& processing_time);
+
+  int fastThreshold() const {
+    return fast_threshold;
+  }
+  int gridMinFeatureNum() const {
+    return grid_min_feature_num;
+  }
+  int gridMaxFeatureNum() const {
+    return grid_min_feature_num + cell_margin;
+  }
+  // Smoothed number of features of a frame
+  double averageFeatureNum() const {
+    return average_feature_num;
+  }
+  // Smoothed processing time of a frame in seconds
+  double averageTime() const {
+    return average_time;
+  }
+  // Time budget of a frame in seconds
+  double budgetTime() const {
+    return budget_time;
+  }
+  // The latest decision
+  Decision decision() const {
+    return last_decision;
+  }
+
+private:
+  Config config;
+  double budget_time;
+
+  int fast_threshold;
+  int grid_min_feature_num;
+  int cell_margin;
+
+  double average_feature_num;
+  double average_time;
+  int frame_cntr;
+  bool is_first_frame;
+  Decision last_decision;
+};
+
+} // namespace msckf_vio
+
+#endif // MSCKF_VIO_FEATURE_BUDGET_CONTROLLER_H
@@ -0,0 +1,216 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_FEATURE_FRAME_H
+#define MSCKF_VIO_FEATURE_FRAME_H
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <condition_variable>
+#include <boost/shared_ptr.hpp>
+
+#include <ros/ros.h>
+
+#include "feature.hpp"
+#include "spsc_queue.h"
+
+namespace msckf_vio {
+
+/*
+ * @brief FeatureFrame The stereo feature measurements of a
+ *    frame as a structure of arrays, which replaces the
+ *    CameraMeasurement msg within a single process. The
+ *    coordinates are normalized.
+ */
+struct FeatureFrame {
+  ros::Time time;
+  std::vector<FeatureIDType> ids;
+  std::vector<float> u0;
+  std::vector<float> v0;
+  std::vector<float> u1;
+  std::vector<float> v1;
+
+  size_t size() const {
+    return ids.size();
+  }
+
+  // Keeps the capacity of the arrays.
+  void clear() {
+    ids.clear();
+    u0.clear();
+    v0.clear();
+    u1.clear();
+    v1.clear();
+    return;
+  }
+
+  void reserve(const size_t& num) {
+    ids.reserve(num);
+    u0.reserve(num);
+    v0.reserve(num);
+    u1.reserve(num);
+    v1.reserve(num);
+    return;
+  }
+
+  void push_back(const FeatureIDType& id,
+      const float& x0, const float& y0,
+      const float& x1, const float& y1) {
+    ids.push_back(id);
+    u0.push_back(x0);
+    v0.push_back(y0);
+    u1.push_back(x1);
+    v1.push_back(y1);
+    return;
+  }
+};
+
+typedef boost::shared_ptr<FeatureFrame> FeatureFramePtr;
+
+/*
+ * @brief FeatureFrameChannel Hands the feature frames from
+ *    the image processor to the filter in the same process.
+ *
+ *    The frames are preallocated in a pool on construction.
+ *    The producer acquires a free frame, fills it and sends
+ *    it, and the consumer receives it and releases it back
+ *    to the pool, both through lock-free SPSC queues. If
+ *    all the frames are being filled, queued or processed,
+ *    acquire() fails and the producer skips the frame, which
+ *    bounds the latency when the consumer falls behind.
+ */
+class FeatureFrameChannel {
+public:
+  /*
+   * @param frame_num: number of frames in the pool, e.g. two
+   *    queued ones, one being filled and one being processed.
+   * @param max_feature_num: number of features reserved in
+   *    each frame, above which the frames allocate.
+   */
+  FeatureFrameChannel(const size_t& frame_num,
+      const size_t& max_feature_num):
+    frame_queue(frame_num),
+    free_queue(frame_num),
+    is_closed(false) {
+    for (size_t i = 0; i < frame_num; ++i) {
+      FeatureFramePtr frame(new FeatureFrame());
+      frame->reserve(max_feature_num);
+      free_queue.tryPush(frame);
+    }
+    return;
+  }
+
+  // Disable copy and assign constructor
+  FeatureFrameChannel(const FeatureFrameChannel&) = delete;
+  FeatureFrameChannel operator=(const FeatureFrameChannel&) = delete;
+
+  /*
+   * @brief acquire Take a cleared frame from the pool. Only
+   *    called by the producer.
+   * @return False if the pool is exhausted.
+   */
+  bool acquire(FeatureFramePtr& frame) {
+    return free_queue.tryPop(frame);
+  }
+
+  /*
+   * @brief send Queue a filled frame. Only called by the
+   *    producer, with a frame from acquire(), so the queue
+   *    always has room for it since it holds the whole pool.
+   */
+  void send(FeatureFramePtr& frame) {
+    frame_queue.tryPush(frame);
+
+    // Locking the mutex makes sure the consumer is either
+    // before checking the queue or already waiting, so the
+    // notification can not be lost.
+    { std::lock_guard<std::mutex> lock(wakeup_mutex); }
+    wakeup_cond.notify_one();
+    return;
+  }
+
+  /*
+   * @brief receive Take the oldest queued frame, blocking
+   *    while there is none. Only called by the consumer.
+   * @return False if the channel is closed and empty.
+   */
+  bool receive(FeatureFramePtr& frame) {
+    while (!frame_queue.tryPop(frame)) {
+      std::unique_lock<std::mutex> lock(wakeup_mutex);
+      wakeup_cond.wait(lock, [this]() {
+          return is_closed || !frame_queue.empty(); });
+      if (is_closed && frame_queue.empty()) return false;
+    }
+    return true;
+  }
+
+  /*
+   * @brief receive Take the oldest queued frame, blocking
+   *    while there is none for at most the timeout. Only
+   *    called by the consumer.
+   * @return False if there is no frame before the timeout,
+   *    or the channel is closed and empty.
+   */
+  bool receive(FeatureFramePtr& frame,
+      const std::chrono::milliseconds& timeout) {
+    if (frame_queue.tryPop(frame)) return true;
+    {
+      std::unique_lock<std::mutex> lock(wakeup_mutex);
+      wakeup_cond.wait_for(lock, timeout, [this]() {
+          return is_closed || !frame_queue.empty(); });
+    }
+    return frame_queue.tryPop(frame);
+  }
+
+  /*
+   * @brief release Return a processed frame to the pool.
+   *    Only called by the consumer.
+   */
+  void release(FeatureFramePtr& frame) {
+    frame->clear();
+    free_queue.tryPush(frame);
+    frame.reset();
+    return;
+  }
+
+  /*
+   * @brief close Wake up the consumer, which still receives
+   *    the queued frames.
+   */
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(wakeup_mutex);
+      is_closed = true;
+    }
+    wakeup_cond.notify_all();
+    return;
+  }
+
+  bool isClosed() const {
+    return is_closed;
+  }
+
+  size_t frameNum() const {
+    return frame_queue.capacity();
+  }
+
+private:
+  SpscQueue<FeatureFramePtr> frame_queue;
+  SpscQueue<FeatureFramePtr> free_queue;
+
+  // Only used to wake up the consumer.
+  std::mutex wakeup_mutex;
+  std::condition_variable wakeup_cond;
+  std::atomic<bool> is_closed;
+};
+
+} // namespace msckf_vio
+
+#endif // MSCKF_VIO_FEATURE_FRAME_H
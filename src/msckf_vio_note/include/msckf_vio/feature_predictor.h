@@ -0,0 +1,105 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_FEATURE_PREDICTOR_H
+#define MSCKF_VIO_FEATURE_PREDICTOR_H
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+namespace msckf_vio {
+
+/*
+ * @brief FeaturePredictor Predicts the locations of the
+ *    features of the previous image in the current image,
+ *    which are the initial guesses of the temporal tracking.
+ *
+ *    A point x_p of the previous image with the inverse depth
+ *    rho is warped with
+ *      x_c ~ K * R_p_c * K^-1 * x_p + rho * K * t_p_c,
+ *    which is the rotation-only homography for the points of
+ *    unknown depth (rho = 0). All the points are warped at
+ *    once on structure-of-arrays coordinates, with AVX2
+ *    (selected at runtime) or NEON.
+ */
+class FeaturePredictor {
+public:
+  /*
+   * @param use_simd: use the vectorized kernel if available.
+   */
+  FeaturePredictor(const bool& use_simd = true);
+
+  /*
+   * @brief predict Predicts the points in the current image.
+   * @param points: points in the previous image.
+   * @param inverse_depths: inverse depths of the points in the
+   *    previous camera frame, 0 if unknown. If empty, only the
+   *    rotation is compensated.
+   * @param R_p_c: a rotation matrix takes a vector in the
+   *    previous camera frame to the current camera frame.
+   * @param t_p_c: position of the previous camera frame in the
+   *    current camera frame.
+   * @param intrinsics: intrinsics of the camera.
+   * @return predicted_points: predicted locations of the
+   *    points in the current image.
+   *
+   * Note that the input and output points are of pixel
+   * coordinates.
+   */
+  void predict(const std::vector<cv::Point2f>& points,
+      const std::vector<float>& inverse_depths,
+      const cv::Matx33f& R_p_c, const cv::Vec3f& t_p_c,
+      const cv::Vec4d& intrinsics,
+      std::vector<cv::Point2f>& predicted_points);
+
+  /*
+   * @brief stereoInverseDepth Triangulates a stereo feature.
+   * @param cam0_point, cam1_point: normalized coordinates of
+   *    the feature in cam0 and cam1.
+   * @param R_cam0_cam1, t_cam0_cam1: take a vector from the
+   *    cam0 frame to the cam1 frame.
+   * @return The inverse depth of the feature in the cam0
+   *    frame, or 0 if it is behind the cameras or too far to
+   *    be triangulated.
+   */
+  static float stereoInverseDepth(const cv::Point2f& cam0_point,
+      const cv::Point2f& cam1_point, const cv::Matx33f& R_cam0_cam1,
+      const cv::Vec3f& t_cam0_cam1);
+
+  /*
+   * @brief simdName Name of the kernel in use, which is one
+   *    of "avx2", "neon" and "scalar".
+   */
+  const char* simdName() const {
+    return name;
+  }
+
+  /*
+   * @brief WarpKernel Warps n points with the row-major 3x3
+   *    homography H and the translation term b,
+   *      (u, v, w) = H * (x, y, 1) + rho * b,
+   *    and writes (u/w, v/w). rhos may be NULL for the points
+   *    of unknown depth.
+   */
+  typedef void (*WarpKernel)(const float* H, const float* b,
+      const float* xs, const float* ys, const float* rhos,
+      const int& n, float* out_xs, float* out_ys);
+
+private:
+  WarpKernel kernel;
+  const char* name;
+
+  // Structure-of-arrays buffers reused for the frames.
+  std::vector<float> xs;
+  std::vector<float> ys;
+  std::vector<float> out_xs;
+  std::vector<float> out_ys;
+};
+
+} // namespace msckf_vio
+
+#endif // MSCKF_VIO_FEATURE_PREDICTOR_H
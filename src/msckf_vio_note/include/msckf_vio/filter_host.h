@@ -0,0 +1,124 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_FILTER_HOST_H
+#define MSCKF_VIO_FILTER_HOST_H
+
+#include <vector>
+#include <memory>
+
+#include <eigen3/Eigen/Dense>
+#include <eigen3/Eigen/StdVector>
+
+#include <sensor_msgs/Imu.h>
+
+#include "msckf_vio.h"
+#include "thread_pool.h"
+#include <msckf_vio/CameraMeasurement.h>
+
+namespace msckf_vio {
+
+/*
+ * @brief FilterHost Runs many independent MsckfVio instances,
+ *    e.g. on different sequences or with different parameters,
+ *    on a work-stealing thread pool.
+ *
+ *    The msgs of each instance are queued with pushImu() and
+ *    pushFeatures() in the order they would arrive on the
+ *    topics. run() processes the queued msgs of all the
+ *    instances. An instance is processed in chunks of frames,
+ *    each of which resubmits the next chunk of the same
+ *    instance, so that idle workers can steal the remaining
+ *    instances and no instance is processed by two workers
+ *    at the same time.
+ */
+class FilterHost {
+public:
+  /*
+   * @brief Pose The estimated IMU state after each frame.
+   */
+  struct Pose {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    double time;
+    Eigen::Vector4d orientation;
+    Eigen::Vector3d position;
+    Eigen::Vector3d velocity;
+  };
+
+  typedef std::vector<Pose,
+    Eigen::aligned_allocator<Pose> > Trajectory;
+
+  /*
+   * @brief FilterHost
+   * @param thread_num: number of workers. The number of
+   *    hardware threads is used if it is nonpositive.
+   * @param chunk_size: number of frames processed by a task.
+   */
+  FilterHost(const int& thread_num = 0, const int& chunk_size = 20);
+
+  // Disable copy and assign constructor
+  FilterHost(const FilterHost&) = delete;
+  FilterHost& operator=(const FilterHost&) = delete;
+
+  /*
+   * @brief addFilter Create a filter instance.
+   * @return The id of the instance.
+   */
+  int addFilter(const MsckfVio::Config& config);
+
+  void pushImu(const int& filter_id,
+      const sensor_msgs::ImuConstPtr& msg);
+  void pushFeatures(const int& filter_id,
+      const CameraMeasurementConstPtr& msg);
+
+  /*
+   * @brief run Process all the queued msgs. Blocks until
+   *    every instance has consumed its queue.
+   */
+  void run();
+
+  int filterNum() const {
+    return instances.size();
+  }
+  int threadNum() const {
+    return thread_pool.threadNum();
+  }
+  const MsckfVio& filter(const int& filter_id) const {
+    return *instances[filter_id]->filter;
+  }
+  const Trajectory& trajectory(const int& filter_id) const {
+    return instances[filter_id]->trajectory;
+  }
+
+private:
+  // A queued msg, either an IMU msg or a stereo frame.
+  struct Input {
+    sensor_msgs::ImuConstPtr imu;
+    CameraMeasurementConstPtr features;
+  };
+
+  struct Instance {
+    MsckfVioPtr filter;
+    std::vector<Input> inputs;
+    int next_input;
+    Trajectory trajectory;
+  };
+
+  // Process the next chunk of msgs of an instance.
+  void processChunk(const int& filter_id);
+
+  int frame_chunk_size;
+  std::vector<std::unique_ptr<Instance> > instances;
+
+  // Declared last so that the workers are stopped
+  // before the instances are destroyed.
+  ThreadPool thread_pool;
+};
+
+} // namespace msckf_vio
+
+#endif // MSCKF_VIO_FILTER_HOST_H
@@ -0,0 +1,293 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_GRID_FEATURE_TABLE_H
+#define MSCKF_VIO_GRID_FEATURE_TABLE_H
+
+#include <vector>
+#include <cassert>
+#include <algorithm>
+#include <opencv2/core/core.hpp>
+
+namespace msckf_vio {
+
+/*
+ * @brief GridFeatureTable Features of a frame organized by
+ *    the grid cells, stored as a structure of arrays.
+ *
+ *    The features are appended in any order, and bucket()
+ *    groups them by cell with a stable counting sort, after
+ *    which the features of a cell are in the index range
+ *    [cellBegin(code), cellEnd(code)). The columns can be
+ *    passed directly to the trackers.
+ *
+ *    Each feature also carries its normalized coordinates,
+ *    which are undistorted once when its pixel positions are
+ *    final and read by the RANSAC and the publisher.
+ *
+ *    The buffers are allocated for the given capacity once
+ *    and reused by clear(), so a table can be kept across
+ *    the frames without allocations.
+ */
+class GridFeatureTable {
+public:
+  typedef unsigned long long int FeatureIDType;
+
+  GridFeatureTable(const int& cell_num = 0, const int& capacity = 0):
+    cell_sizes(cell_num, 0),
+    cell_starts(cell_num+1, 0),
+    is_bucketed(true) {
+    reserve(capacity);
+    return;
+  }
+
+  /*
+   * @brief clear Remove all the features but keep the buffers.
+   */
+  void clear() {
+    codes.clear();
+    ids.clear();
+    lifetimes.clear();
+    responses.clear();
+    cam0_points.clear();
+    cam1_points.clear();
+    cam0_undistorted.clear();
+    cam1_undistorted.clear();
+    std::fill(cell_sizes.begin(), cell_sizes.end(), 0);
+    std::fill(cell_starts.begin(), cell_starts.end(), 0);
+    is_bucketed = true;
+    return;
+  }
+
+  /*
+   * @brief cellCode Code of the cell of a pixel in an image of
+   *    image_width x image_height split into grid_row x grid_col
+   *    cells. The cells are image_width/grid_col pixels wide and
+   *    image_height/grid_row pixels high, and the last column
+   *    and row also take the pixels left by the rounding.
+   */
+  static int cellCode(const cv::Point2f& point,
+      const int& image_width, const int& image_height,
+      const int& grid_row, const int& grid_col) {
+    const int row = std::min(std::max(0, static_cast<int>(
+            point.y / (image_height/grid_row))), grid_row-1);
+    const int col = std::min(std::max(0, static_cast<int>(
+            point.x / (image_width/grid_col))), grid_col-1);
+    return row*grid_col + col;
+  }
+
+  /*
+   * @brief cellRect Pixels of a cell in the image, which are
+   *    the ones cellCode() gives the code of the cell.
+   */
+  static cv::Rect cellRect(const int& code,
+      const int& image_width, const int& image_height,
+      const int& grid_row, const int& grid_col) {
+    const int cell_width = image_width / grid_col;
+    const int cell_height = image_height / grid_row;
+    const int row = code / grid_col;
+    const int col = code % grid_col;
+    const int x = col * cell_width;
+    const int y = row * cell_height;
+    return cv::Rect(x, y,
+        col == grid_col-1 ? image_width-x : cell_width,
+        row == grid_row-1 ? image_height-y : cell_height);
+  }
+
+  /*
+   * @brief add Append a feature to the given cell, with its
+   *    pixel and normalized coordinates in both cameras.
+   */
+  void add(const int& code, const FeatureIDType& id,
+      const int& lifetime, const float& response,
+      const cv::Point2f& cam0_point, const cv::Point2f& cam1_point,
+      const cv::Point2f& cam0_point_undistorted,
+      const cv::Point2f& cam1_point_undistorted) {
+    assert(code >= 0 && code < cellNum());
+    codes.push_back(code);
+    ids.push_back(id);
+    lifetimes.push_back(lifetime);
+    responses.push_back(response);
+    cam0_points.push_back(cam0_point);
+    cam1_points.push_back(cam1_point);
+    cam0_undistorted.push_back(cam0_point_undistorted);
+    cam1_undistorted.push_back(cam1_point_undistorted);
+    ++cell_sizes[code];
+    is_bucketed = false;
+    return;
+  }
+
+  /*
+   * @brief bucket Group the features by cell, keeping the
+   *    order of the features within each cell.
+   */
+  void bucket() {
+    if (is_bucketed) return;
+
+    cell_starts[0] = 0;
+    for (int code = 0; code < cellNum(); ++code)
+      cell_starts[code+1] = cell_starts[code] + cell_sizes[code];
+
+    order.resize(size());
+    next_slots.assign(cell_starts.begin(), cell_starts.end()-1);
+    for (int i = 0; i < size(); ++i)
+      order[next_slots[codes[i]]++] = i;
+
+    permute(order);
+    is_bucketed = true;
+    return;
+  }
+
+  /*
+   * @brief pruneCells Keep at most max_num features with the
+   *    longest lifetime in each cell. The features are bucketed
+   *    and sorted by lifetime within the crowded cells.
+   */
+  void pruneCells(const int& max_num) {
+    bucket();
+
+    order.clear();
+    for (int code = 0; code < cellNum(); ++code) {
+      const int begin = static_cast<int>(order.size());
+      for (int i = cell_starts[code]; i < cell_starts[code+1]; ++i)
+        order.push_back(i);
+      if (cell_sizes[code] <= max_num) continue;
+
+      // Stable on ties so that the result does not depend
+      // on the standard library.
+      std::stable_sort(order.begin()+begin, order.end(),
+          [this](const int& i, const int& j) {
+            return lifetimes[i] > lifetimes[j];
+          });
+      order.resize(begin+max_num);
+      cell_sizes[code] = max_num;
+    }
+
+    permute(order);
+    for (int code = 0; code < cellNum(); ++code)
+      cell_starts[code+1] = cell_starts[code] + cell_sizes[code];
+    return;
+  }
+
+  void reserve(const int& capacity) {
+    codes.reserve(capacity);
+    ids.reserve(capacity);
+    lifetimes.reserve(capacity);
+    responses.reserve(capacity);
+    cam0_points.reserve(capacity);
+    cam1_points.reserve(capacity);
+    cam0_undistorted.reserve(capacity);
+    cam1_undistorted.reserve(capacity);
+    order.reserve(capacity);
+    int_scratch.reserve(capacity);
+    id_scratch.reserve(capacity);
+    float_scratch.reserve(capacity);
+    point_scratch.reserve(capacity);
+    return;
+  }
+
+  int size() const {
+    return static_cast<int>(ids.size());
+  }
+  int cellNum() const {
+    return static_cast<int>(cell_sizes.size());
+  }
+  // Number of features in a cell, valid at any time.
+  int cellSize(const int& code) const {
+    return cell_sizes[code];
+  }
+  // Index range of a cell, valid after bucket().
+  int cellBegin(const int& code) const {
+    return cell_starts[code];
+  }
+  int cellEnd(const int& code) const {
+    return cell_starts[code+1];
+  }
+  bool bucketed() const {
+    return is_bucketed;
+  }
+
+  const std::vector<int>& getCodes() const {
+    return codes;
+  }
+  const std::vector<FeatureIDType>& getIds() const {
+    return ids;
+  }
+  const std::vector<int>& getLifetimes() const {
+    return lifetimes;
+  }
+  const std::vector<float>& getResponses() const {
+    return responses;
+  }
+  const std::vector<cv::Point2f>& getCam0Points() const {
+    return cam0_points;
+  }
+  const std::vector<cv::Point2f>& getCam1Points() const {
+    return cam1_points;
+  }
+  const std::vector<cv::Point2f>& getCam0Undistorted() const {
+    return cam0_undistorted;
+  }
+  const std::vector<cv::Point2f>& getCam1Undistorted() const {
+    return cam1_undistorted;
+  }
+
+private:
+  // Reorder all the columns as column[i] = column[indices[i]],
+  // which may also drop features.
+  void permute(const std::vector<int>& indices) {
+    permuteColumn(indices, codes, int_scratch);
+    permuteColumn(indices, ids, id_scratch);
+    permuteColumn(indices, lifetimes, int_scratch);
+    permuteColumn(indices, responses, float_scratch);
+    permuteColumn(indices, cam0_points, point_scratch);
+    permuteColumn(indices, cam1_points, point_scratch);
+    permuteColumn(indices, cam0_undistorted, point_scratch);
+    permuteColumn(indices, cam1_undistorted, point_scratch);
+    return;
+  }
+
+  // The gathered column is swapped with the scratch column,
+  // so the buffers are exchanged instead of reallocated.
+  template <typename T>
+  static void permuteColumn(const std::vector<int>& indices,
+      std::vector<T>& column, std::vector<T>& scratch) {
+    scratch.resize(indices.size());
+    for (int i = 0; i < indices.size(); ++i)
+      scratch[i] = column[indices[i]];
+    column.swap(scratch);
+    scratch.clear();
+    return;
+  }
+
+  // Columns of the features.
+  std::vector<int> codes;
+  std::vector<FeatureIDType> ids;
+  std::vector<int> lifetimes;
+  std::vector<float> responses;
+  std::vector<cv::Point2f> cam0_points;
+  std::vector<cv::Point2f> cam1_points;
+  std::vector<cv::Point2f> cam0_undistorted;
+  std::vector<cv::Point2f> cam1_undistorted;
+
+  // Per-cell index.
+  std::vector<int> cell_sizes;
+  std::vector<int> cell_starts;
+  bool is_bucketed;
+
+  // Buffers of the reordering.
+  std::vector<int> order;
+  std::vector<int> next_slots;
+  std::vector<int> int_scratch;
+  std::vector<FeatureIDType> id_scratch;
+  std::vector<float> float_scratch;
+  std::vector<cv::Point2f> point_scratch;
+};
+
+} // namespace msckf_vio
+
+#endif // MSCKF_VIO_GRID_FEATURE_TABLE_H
@@ -10,6 +10,10 @@
 
 #include <vector>
 #include <map>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
 #include <boost/shared_ptr.hpp>
 #include <opencv2/opencv.hpp>
 #include <opencv2/video.hpp>
@@ -22,6 +26,19 @@
 #include <message_filters/subscriber.h>
 #include <message_filters/time_synchronizer.h>
 
+#include "thread_pool.h"
+#include "bounded_queue.h"
+#include "klt_tracker.h"
+#include "two_point_ransac.h"
+#include "grid_feature_table.h"
+#include "point_undistorter.h"
+#include "rectified_stereo_matcher.h"
+#include "fast_detector.h"
+#include "feature_predictor.h"
+#include "feature_frame.h"
+#include "feature_budget_controller.h"
+#include <msckf_vio/FilterStatus.h>
+
 namespace msckf_vio {
 
 /*
@@ -42,6 +59,29 @@ public:
   // Initialize the object.
   bool initialize();
 
+  // Hand the features to a filter in the same process
+  // through the channel instead of publishing them.
+  void setFeatureChannel(
+      const boost::shared_ptr<FeatureFrameChannel>& channel) {
+    feature_channel = channel;
+  }
+
+  /*
+   * @brief integrateGyro Integrates the gyro readings one
+   *    after another between two images. Each sample holds
+   *    until the next one, the first one from the previous
+   *    image and the last one until the current image.
+   * @param begin_iter, end_iter: IMU msgs around the two
+   *    images, ordered by the time stamps.
+   * @param prev_stamp, curr_stamp: time of the two images.
+   * @return A rotation matrix which takes a vector from the
+   *    current IMU frame to the previous IMU frame.
+   */
+  static cv::Matx33d integrateGyro(
+      const std::vector<sensor_msgs::Imu>::const_iterator& begin_iter,
+      const std::vector<sensor_msgs::Imu>::const_iterator& end_iter,
+      const ros::Time& prev_stamp, const ros::Time& curr_stamp);
+
   typedef boost::shared_ptr<ImageProcessor> Ptr;
   typedef boost::shared_ptr<const ImageProcessor> ConstPtr;
 
@@ -64,31 +104,119 @@ private:
     double track_precision;
     double ransac_threshold;
     double stereo_threshold;
+
+    // Track with the KltTracker instead of OpenCV, and
+    // reject the points whose residual of the tracker is
+    // above max_track_residual if it is positive.
+    bool use_klt_tracker;
+    double max_track_residual;
+
+    // Upper bound of the RANSAC hypotheses, and whether the
+    // hypotheses are drawn from the features with the longest
+    // lifetime first.
+    int ransac_max_iteration;
+    bool use_prosac;
+    int ransac_seed;
+
+    // Undistort the points with lookup tables of grid_step
+    // pixels, whose cells over max_undistortion_error pixels
+    // against OpenCV are solved, and optionally refine them.
+    bool use_undistortion_table;
+    bool refine_undistortion;
+    double undistortion_grid_step;
+    double max_undistortion_error;
+
+    // Match the stereo points with a 1-D ZNCC search along the
+    // rectified scanlines instead of the KLT tracking, which
+    // also skips the pyramids of cam1.
+    bool use_rectified_stereo;
+    int stereo_max_disparity;
+    int stereo_patch_size;
+    double stereo_min_zncc;
+
+    // Pyramid levels on which cam0 is tracked and detected,
+    // and on which the stereo points are matched in cam1. The
+    // points tracked on a reduced level are refined on the
+    // full resolution with a patch of refine_patch_size.
+    int cam0_level;
+    int cam1_level;
+    int refine_patch_size;
+
+    // Predict the temporal tracking with the rotation integrated
+    // over the IMU samples instead of the mean angular velocity,
+    // and with the translation of the constant cam0 velocity for
+    // the stereo features closer than max_prediction_depth. With
+    // the tighter prediction, the temporal tracking may run with
+    // fewer pyramid levels and iterations than the stereo one.
+    bool preintegrate_rotation;
+    bool predict_translation;
+    double max_prediction_depth;
+    int temporal_pyramid_levels;
+    int temporal_max_iteration;
   };
 
   /*
    * @brief FeatureIDType An alias for unsigned long long int.
    */
-  typedef unsigned long long int FeatureIDType;
+  typedef GridFeatureTable::FeatureIDType FeatureIDType;
 
   /*
-   * @brief FeatureMetaData Contains necessary information
-   *    of a feature for easy access.
+   * @brief GridFeatures Organize features based on the grid
+   *    they belong to. Note that the cell is encoded by the
+   *    grid index.
    */
-  struct FeatureMetaData {
-    FeatureIDType id;
-    float response;
-    int lifetime;
-    cv::Point2f cam0_point;
-    cv::Point2f cam1_point;
+  typedef GridFeatureTable GridFeatures;
+
+  /*
+   * @brief FrameData Input of the tracking stage, which is
+   *    prepared on the image callback: the stereo images and
+   *    their pyramids. The frames are recycled to reuse the
+   *    pyramid buffers.
+   */
+  struct FrameData {
+    cv_bridge::CvImageConstPtr cam0_img_ptr;
+    cv_bridge::CvImageConstPtr cam1_img_ptr;
+    std::vector<cv::Mat> cam0_pyramid;
+    std::vector<cv::Mat> cam1_pyramid;
   };
 
   /*
-   * @brief GridFeatures Organize features based on the grid
-   *    they belong to. Note that the key is encoded by the
-   *    grid index.
+   * @brief OutputData Input of the publishing stage. The
+   *    feature tables are copied since the tracking stage
+   *    reuses its own, and the outputs are recycled to reuse
+   *    the buffers of the copies.
    */
-  typedef std::map<int, std::vector<FeatureMetaData> > GridFeatures;
+  struct OutputData {
+    cv_bridge::CvImageConstPtr cam0_img_ptr;
+    cv_bridge::CvImageConstPtr cam1_img_ptr;
+    GridFeatures prev_features;
+    GridFeatures curr_features;
+    int before_tracking;
+    int after_tracking;
+    int after_matching;
+    int after_ransac;
+    int after_detection;
+    double frontend_time;
+    int fast_threshold;
+    int grid_min_feature_num;
+    int grid_max_feature_num;
+  };
+
+  /*
+   * @brief DebugData Input of the debug thread: the images
+   *    and a snapshot of the feature ids and positions of the
+   *    previous and current frames.
+   */
+  struct DebugData {
+    cv_bridge::CvImageConstPtr cam0_img_ptr;
+    cv_bridge::CvImageConstPtr cam1_img_ptr;
+    std::vector<FeatureIDType> prev_ids;
+    std::vector<cv::Point2f> prev_cam0_points;
+    std::vector<cv::Point2f> prev_cam1_points;
+    std::vector<FeatureIDType> curr_ids;
+    std::vector<cv::Point2f> curr_cam0_points;
+    std::vector<cv::Point2f> curr_cam1_points;
+  };
 
   /*
    * @brief keyPointCompareByResponse
@@ -101,28 +229,6 @@ private:
     // beginning of the vector.
     return pt1.response > pt2.response;
   }
-  /*
-   * @brief featureCompareByResponse
-   *    Compare two features based on the response.
-   */
-  static bool featureCompareByResponse(
-      const FeatureMetaData& f1,
-      const FeatureMetaData& f2) {
-    // Features with higher response will be at the
-    // beginning of the vector.
-    return f1.response > f2.response;
-  }
-  /*
-   * @brief featureCompareByLifetime
-   *    Compare two features based on the lifetime.
-   */
-  static bool featureCompareByLifetime(
-      const FeatureMetaData& f1,
-      const FeatureMetaData& f2) {
-    // Features with longer lifetime will be at the
-    // beginning of the vector.
-    return f1.lifetime > f2.lifetime;
-  }
 
   /*
    * @brief loadParameters
@@ -138,7 +244,9 @@ private:
 
   /*
    * @brief stereoCallback
-   *    Callback function for the stereo images.
+   *    Callback function for the stereo images, which runs
+   *    the first stage of the pipeline and passes the frame
+   *    to the tracking stage.
    * @param cam0_img left image.
    * @param cam1_img right image.
    */
@@ -146,6 +254,35 @@ private:
       const sensor_msgs::ImageConstPtr& cam0_img,
       const sensor_msgs::ImageConstPtr& cam1_img);
 
+  /*
+   * @brief prepareFrame
+   *    Build the pyramids of the stereo images. Only depends
+   *    on the images, so it overlaps the tracking of the
+   *    previous frame.
+   */
+  void prepareFrame(FrameData& frame);
+
+  /*
+   * @brief processFrame
+   *    Track the features of the previous frame, match them
+   *    in cam1, add new features and assign their ids. The
+   *    frames are processed in order on a single thread, so
+   *    the ids are deterministic.
+   */
+  void processFrame(boost::shared_ptr<FrameData> frame);
+
+  /*
+   * @brief publishOutput
+   *    Publish the features of a frame, and hand it to the
+   *    debug thread if the debug image has subscribers.
+   */
+  void publishOutput(const OutputData& output);
+
+  // Loops of the tracking, publishing and debug threads.
+  void trackingLoop();
+  void publishingLoop();
+  void debugLoop();
+
   /*
    * @brief imuCallback
    *    Callback function for the imu message.
@@ -153,6 +290,20 @@ private:
    */
   void imuCallback(const sensor_msgs::ImuConstPtr& msg);
 
+  /*
+   * @brief filterStatusCallback
+   *    Acknowledge the frames processed by the filter.
+   * @param msg Filter status msg.
+   */
+  void filterStatusCallback(const FilterStatusConstPtr& msg);
+
+  /*
+   * @brief isFilterReady Whether a measurement frame can be
+   *    published, in which case it is counted as in flight
+   *    until the filter acknowledges it.
+   */
+  bool isFilterReady(const ros::Time& time);
+
   /*
    * @initializeFirstFrame
    *    Initialize the image processing sequence, which is
@@ -174,6 +325,44 @@ private:
    */
   void addNewFeatures();
 
+  /*
+   * @brief detectNewFeatures
+   *    Detect the FAST corners in the grid cells with less
+   *    than grid_min_feature_num features, so the cost scales
+   *    with the number of such cells instead of the image
+   *    area. The corners close to the existing features are
+   *    skipped with an occupancy map of the cell, and at most
+   *    grid_max_feature_num corners with the highest response
+   *    are kept in a cell.
+   * @return new_points, new_responses: new corners and their
+   *    responses, grouped by the cells.
+   */
+  void detectNewFeatures(std::vector<cv::Point2f>& new_points,
+      std::vector<float>& new_responses);
+
+  /*
+   * @brief cellCode Code of the grid cell of a point of the
+   *    cam0 image, which is clamped to the grid at the right
+   *    and bottom borders of the image.
+   */
+  int cellCode(const cv::Point2f& point) const;
+
+  /*
+   * @brief fillGridVacancies
+   *    Add the stereo matched new features to the cells with
+   *    less than grid_min_feature_num features, taking the
+   *    ones with the highest response first, and assign the
+   *    feature ids. The normalized coordinates of the features
+   *    are cached in the table with the pixel coordinates.
+   * @return Number of the added features.
+   */
+  int fillGridVacancies(
+      const std::vector<cv::Point2f>& cam0_points,
+      const std::vector<cv::Point2f>& cam1_points,
+      const std::vector<cv::Point2f>& cam0_points_undistorted,
+      const std::vector<cv::Point2f>& cam1_points_undistorted,
+      const std::vector<float>& responses);
+
   /*
    * @brief pruneGridFeatures
    *    Remove some of the features of a grid in case there are
@@ -182,12 +371,22 @@ private:
    */
   void pruneGridFeatures();
 
+  /*
+   * @brief updateFeatureBudget
+   *    Pass the number of features and the processing time of
+   *    the current frame to the feature budget controller, and
+   *    apply its detector threshold and feature numbers to the
+   *    next frames.
+   * @param frontend_time: processing time of the frame.
+   */
+  void updateFeatureBudget(const double& frontend_time);
+
   /*
    * @brief publish
    *    Publish the features on the current image including
    *    both the tracked and newly detected ones.
    */
-  void publish();
+  void publish(const OutputData& output);
 
   /*
    * @brief drawFeaturesMono
@@ -200,18 +399,28 @@ private:
    *    Draw tracked and newly detected features on the
    *    stereo images.
    */
-  void drawFeaturesStereo();
-
+  void drawFeaturesStereo(const DebugData& debug);
+  /*
+   * @brief queueDebugFrame Hand a snapshot of the output
+   *    to the debug thread, replacing the frame it has not
+   *    drawn yet.
+   */
+  void queueDebugFrame(const OutputData& output);
   /*
-   * @brief createImagePyramids
-   *    Create image pyramids used for klt tracking.
+   * @brief buildPyramid Build the klt pyramid of an image
+   *    into the given buffers. Levels of the same size are
+   *    reused, so no memory is allocated once the buffers
+   *    have been filled with an image of the same size.
    */
-  void createImagePyramids();
+  void buildPyramid(const cv::Mat& img,
+      std::vector<cv::Mat>& pyramid) const;
 
   /*
    * @brief integrateImuData Integrates the IMU gyro readings
    *    between the two consecutive images, which is used for
-   *    both tracking prediction and 2-point RANSAC.
+   *    both tracking prediction and 2-point RANSAC. The samples
+   *    are either averaged or integrated one after another if
+   *    preintegrate_rotation.
    * @return cam0_R_p_c: a rotation matrix which takes a vector
    *    from previous cam0 frame to current cam0 frame.
    * @return cam1_R_p_c: a rotation matrix which takes a vector
@@ -225,30 +434,64 @@ private:
    *    between consecutive camera frames so that feature
    *    tracking would be more robust and fast.
    * @param input_pts: features in the previous image to be tracked.
+   * @param inverse_depths: inverse depths of the features in the
+   *    previous camera frame, 0 if unknown, or empty.
    * @param R_p_c: a rotation matrix takes a vector in the previous
    *    camera frame to the current camera frame.
+   * @param t_p_c: position of the previous camera frame in the
+   *    current camera frame.
    * @param intrinsics: intrinsic matrix of the camera.
    * @return compensated_pts: predicted locations of the features
-   *    in the current image based on the provided rotation.
+   *    in the current image based on the provided motion.
    *
    * Note that the input and output points are of pixel coordinates.
    */
   void predictFeatureTracking(
       const std::vector<cv::Point2f>& input_pts,
+      const std::vector<float>& inverse_depths,
       const cv::Matx33f& R_p_c,
+      const cv::Vec3f& t_p_c,
       const cv::Vec4d& intrinsics,
       std::vector<cv::Point2f>& compenstated_pts);
 
+  /*
+   * @brief stereoInverseDepths Triangulates the stereo features
+   *    from their normalized coordinates.
+   * @return inverse_depths: inverse depths of the features in
+   *    the cam0 frame, 0 for the ones beyond
+   *    max_prediction_depth.
+   */
+  void stereoInverseDepths(
+      const std::vector<cv::Point2f>& cam0_points,
+      const std::vector<cv::Point2f>& cam1_points,
+      std::vector<float>& inverse_depths) const;
+
+  /*
+   * @brief updateCameraVelocity Estimates the velocity of cam0
+   *    from the features triangulated in both of the frames,
+   *    which predicts the translation of the next frame.
+   * @param R_p_c: rotation from the previous to the current
+   *    cam0 frame.
+   * @param dtime: time between the two frames.
+   */
+  void updateCameraVelocity(
+      const std::vector<cv::Point2f>& prev_cam0_points,
+      const std::vector<cv::Point2f>& prev_cam1_points,
+      const std::vector<cv::Point2f>& curr_cam0_points,
+      const std::vector<cv::Point2f>& curr_cam1_points,
+      const std::vector<int>& inlier_markers,
+      const cv::Matx33f& R_p_c, const double& dtime);
+
   /*
    * @brief twoPointRansac Applies two point ransac algorithm
    *    to mark the inliers in the input set.
-   * @param pts1: first set of points.
-   * @param pts2: second set of points.
+   * @param pts1: first set of undistorted points.
+   * @param pts2: second set of undistorted points.
+   * @param qualities: quality of the point pairs for the order
+   *    of the hypotheses, which may be empty.
    * @param R_p_c: a rotation matrix takes a vector in the previous
    *    camera frame to the current camera frame.
    * @param intrinsics: intrinsics of the camera.
-   * @param distortion_model: distortion model of the camera.
-   * @param distortion_coeffs: distortion coefficients.
    * @param inlier_error: acceptable error to be considered as an inlier.
    * @param success_probability: the required probability of success.
    * @return inlier_flag: 1 for inliers and 0 for outliers.
@@ -256,21 +499,17 @@ private:
   void twoPointRansac(
       const std::vector<cv::Point2f>& pts1,
       const std::vector<cv::Point2f>& pts2,
+      const std::vector<float>& qualities,
       const cv::Matx33f& R_p_c,
       const cv::Vec4d& intrinsics,
-      const std::string& distortion_model,
-      const cv::Vec4d& distortion_coeffs,
       const double& inlier_error,
       const double& success_probability,
       std::vector<int>& inlier_markers);
   void undistortPoints(
+      const PointUndistorter& undistorter,
       const std::vector<cv::Point2f>& pts_in,
-      const cv::Vec4d& intrinsics,
-      const std::string& distortion_model,
-      const cv::Vec4d& distortion_coeffs,
       std::vector<cv::Point2f>& pts_out,
-      const cv::Matx33d &rectification_matrix = cv::Matx33d::eye(),
-      const cv::Vec4d &new_intrinsics = cv::Vec4d(1,1,0,0));
+      const cv::Matx33d &rectification_matrix = cv::Matx33d::eye());
   void rescalePoints(
       std::vector<cv::Point2f>& pts1,
       std::vector<cv::Point2f>& pts2,
@@ -281,16 +520,56 @@ private:
       const std::string& distortion_model,
       const cv::Vec4d& distortion_coeffs);
 
+  /*
+   * @brief trackPoints Track the points between two pyramids
+   *    with the LK optical flow.
+   * @param tracker: tracker of the coarse tracking.
+   * @param prev_points: points in the previous image.
+   * @param curr_points: initial guess of the points in the
+   *    current image, replaced by the tracked points.
+   * @param level: finest pyramid level of the tracking. The
+   *    points tracked on a reduced level are refined on the
+   *    full resolution.
+   * @return inlier_markers: 1 if the point is tracked, 0 otherwise.
+   */
+  void trackPoints(
+      const KltTracker& tracker,
+      const std::vector<cv::Mat>& prev_pyramid,
+      const std::vector<cv::Mat>& curr_pyramid,
+      const std::vector<cv::Point2f>& prev_points,
+      std::vector<cv::Point2f>& curr_points,
+      std::vector<unsigned char>& inlier_markers,
+      const int& level = 0);
+
+  /*
+   * @brief lkTrack Run the KLT tracker, or OpenCV with the
+   *    same parameters, on the given pyramid levels.
+   * @return residuals: mean absolute difference of the patches.
+   */
+  void lkTrack(const KltTracker& tracker,
+      const std::vector<cv::Mat>& prev_pyramid,
+      const std::vector<cv::Mat>& curr_pyramid,
+      const std::vector<cv::Point2f>& prev_points,
+      std::vector<cv::Point2f>& curr_points,
+      std::vector<unsigned char>& inlier_markers,
+      std::vector<float>& residuals) const;
+
   /*
    * @brief stereoMatch Matches features with stereo image pairs.
    * @param cam0_points: points in the primary image.
    * @return cam1_points: points in the secondary image.
    * @return inlier_markers: 1 if the match is valid, 0 otherwise.
+   * @return cam0_points_undistorted, cam1_points_undistorted:
+   *    normalized coordinates of the points in both images,
+   *    which are computed once here since the pixel positions
+   *    are final after the matching.
    */
   void stereoMatch(
       const std::vector<cv::Point2f>& cam0_points,
       std::vector<cv::Point2f>& cam1_points,
-      std::vector<unsigned char>& inlier_markers);
+      std::vector<unsigned char>& inlier_markers,
+      std::vector<cv::Point2f>& cam0_points_undistorted,
+      std::vector<cv::Point2f>& cam1_points_undistorted);
 
   /*
    * @brief removeUnmarkedElements Remove the unmarked elements
@@ -320,15 +599,31 @@ private:
 
   // Indicate if this is the first image message.
   bool is_first_img;
+  // Set once the first image is received. The IMU msgs
+  // before that are discarded.
+  std::atomic<bool> has_received_img;
 
   // ID for the next new feature.
   FeatureIDType next_feature_id;
 
   // Feature detector
+  // The FAST threshold of each grid cell, which is lowered in
+  // the cells with too few corners down to half of the
+  // fast_threshold, and recovers in the cells with enough.
   ProcessorConfig processor_config;
-  cv::Ptr<cv::Feature2D> detector_ptr;
-
-  // IMU message buffer.
+  std::vector<int> grid_fast_thresholds;
+
+  // Tunes fast_threshold, grid_min_feature_num and
+  // grid_max_feature_num of processor_config after every
+  // frame if the feature budget is enabled.
+  bool use_feature_budget;
+  double frame_rate;
+  FeatureBudgetController::Config feature_budget_config;
+  boost::shared_ptr<FeatureBudgetController> feature_budget_controller;
+
+  // IMU message buffer, which is filled by the imu callback
+  // and consumed by the tracking stage.
+  std::mutex imu_mutex;
   std::vector<sensor_msgs::Imu> imu_msg_buffer;
 
   // Camera calibration parameters
@@ -354,15 +649,99 @@ private:
   cv_bridge::CvImageConstPtr cam0_curr_img_ptr;
   cv_bridge::CvImageConstPtr cam1_curr_img_ptr;
 
-  // Pyramids for previous and current image
+  // Pyramids for previous and current image. The buffers
+  // are kept across the frames, and the cam0 pyramids are
+  // swapped instead of copied.
   std::vector<cv::Mat> prev_cam0_pyramid_;
   std::vector<cv::Mat> curr_cam0_pyramid_;
   std::vector<cv::Mat> curr_cam1_pyramid_;
 
-  // Features in the previous and current image.
+  // Features in the previous and current image. The two
+  // tables are swapped on a new frame, and the current one
+  // is cleared for reuse.
   boost::shared_ptr<GridFeatures> prev_features_ptr;
   boost::shared_ptr<GridFeatures> curr_features_ptr;
 
+  // Persistent worker building the cam1 pyramid.
+  boost::shared_ptr<ThreadPool> pyramid_worker;
+
+  // KLT tracker for the temporal and stereo tracking.
+  boost::shared_ptr<KltTracker> klt_tracker;
+  // Single level tracker for the full resolution refinement
+  // of the points tracked on a reduced level.
+  boost::shared_ptr<KltTracker> refine_klt_tracker;
+  // Tracker of the temporal tracking, which may have fewer
+  // levels and iterations than klt_tracker.
+  boost::shared_ptr<KltTracker> temporal_klt_tracker;
+
+  // Prediction of the temporal tracking, and the velocity of
+  // cam0 in its frame for the predicted translation.
+  boost::shared_ptr<FeaturePredictor> feature_predictor;
+  bool cam0_velocity_valid;
+  cv::Vec3f cam0_velocity;
+
+  // FAST detector of the grid cells.
+  boost::shared_ptr<FastDetector> fast_detector;
+
+  // RANSAC of the temporal matches, which keeps its random
+  // generator and buffers across the frames.
+  boost::shared_ptr<TwoPointRansac> ransac;
+
+  // Undistortion of the points of each camera.
+  boost::shared_ptr<PointUndistorter> cam0_undistorter;
+  boost::shared_ptr<PointUndistorter> cam1_undistorter;
+
+  // Rectified stereo matching, if use_rectified_stereo.
+  boost::shared_ptr<RectifiedStereoMatcher> stereo_matcher;
+
+  // Pipeline of the front end. The image callback prepares
+  // the frames, the tracking thread processes them and the
+  // publishing thread publishes the results, connected by
+  // bounded queues. Without use_pipeline, all the stages
+  // run on the image callback.
+  bool use_pipeline;
+  int pipeline_queue_size;
+  boost::shared_ptr<BoundedQueue<
+    boost::shared_ptr<FrameData> > > frame_queue;
+  boost::shared_ptr<BoundedQueue<
+    boost::shared_ptr<FrameData> > > free_frame_queue;
+  boost::shared_ptr<BoundedQueue<
+    boost::shared_ptr<OutputData> > > output_queue;
+  boost::shared_ptr<BoundedQueue<
+    boost::shared_ptr<OutputData> > > free_output_queue;
+  std::thread tracking_thread;
+  std::thread publishing_thread;
+
+  // Debug images are drawn on a low priority thread, only
+  // while debug_stereo_image has subscribers. It keeps at
+  // most one pending frame, and the frames it cannot draw
+  // in time are dropped.
+  boost::shared_ptr<BoundedQueue<
+    boost::shared_ptr<DebugData> > > debug_queue;
+  boost::shared_ptr<BoundedQueue<
+    boost::shared_ptr<DebugData> > > free_debug_queue;
+  std::thread debug_thread;
+  std::atomic<unsigned long> dropped_debug_frames;
+
+  // Backpressure of the filter. Every frame is tracked, but
+  // its measurements are skipped while max_frames_in_flight
+  // published frames are not acknowledged by the filter. It
+  // is inactive if the filter does not report its status,
+  // and the frames not acknowledged within the timeout, e.g.
+  // while the filter resets, are given up.
+  bool use_backpressure;
+  int max_frames_in_flight;
+  double backpressure_timeout;
+  std::mutex filter_status_mutex;
+  std::deque<ros::Time> frames_in_flight;
+  double filter_latency;
+  unsigned long skipped_frames;
+
+  // Channel to the filter of the single process pipeline,
+  // which replaces the feature msgs if it is set. The frames
+  // are skipped while its pool is exhausted.
+  boost::shared_ptr<FeatureFrameChannel> feature_channel;
+
   // Number of features after each outlier removal step.
   int before_tracking;
   int after_tracking;
@@ -380,10 +759,15 @@ private:
   message_filters::TimeSynchronizer<
     sensor_msgs::Image, sensor_msgs::Image> stereo_sub;
   ros::Subscriber imu_sub;
+  ros::Subscriber filter_status_sub;
   ros::Publisher feature_pub;
   ros::Publisher tracking_info_pub;
   image_transport::Publisher debug_stereo_pub;
 
+  // Trace-event export
+  bool enable_tracing;
+  std::string trace_file;
+
   // Debugging
   std::map<FeatureIDType, int> feature_lifetime;
   void updateFeatureLifetime();
@@ -27,9 +27,6 @@ struct IMUState {
   // An unique identifier for the IMU state.
   StateIDType id;
 
-  // id for next IMU state
-  static StateIDType next_id;
-
   // Time when the state is recorded
   double time;
 
@@ -65,22 +62,6 @@ struct IMUState {
   Eigen::Vector3d position_null;
   Eigen::Vector3d velocity_null;
 
-  // Process noise
-  static double gyro_noise;
-  static double acc_noise;
-  static double gyro_bias_noise;
-  static double acc_bias_noise;
-
-  // Gravity vector in the world frame
-  static Eigen::Vector3d gravity;
-
-  // Transformation offset from the IMU frame to
-  // the body frame. The transformation takes a
-  // vector from the IMU frame to the body frame.
-  // The z axis of the body frame should point upwards.
-  // Normally, this transform should be identity.
-  static Eigen::Isometry3d T_imu_body;
-
   IMUState(): id(0), time(0),
     orientation(Eigen::Vector4d(0, 0, 0, 1)),
     position(Eigen::Vector3d::Zero()),
@@ -0,0 +1,145 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_KLT_TRACKER_H
+#define MSCKF_VIO_KLT_TRACKER_H
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+namespace msckf_vio {
+
+/*
+ * @brief KltTracker A pyramidal Lucas-Kanade tracker for
+ *    the fixed patch sizes of the image processor.
+ *
+ *    The tracker follows the iterations and the fixed-point
+ *    interpolation of cv::calcOpticalFlowPyrLK, and works on
+ *    the pyramids built by cv::buildOpticalFlowPyramid with
+ *    the Scharr gradients, which are reused instead of being
+ *    recomputed for every call. The patch kernels are
+ *    vectorized with AVX2 (selected at runtime) or NEON, and
+ *    unrolled for the 15x15 and 21x21 patches.
+ *
+ *    The points are tracked cell by cell, going through all
+ *    the pyramid levels for the points of one cell before the
+ *    next cell, so that the overlapping patches of the
+ *    neighbouring points are still in the cache.
+ */
+class KltTracker {
+public:
+  /*
+   * @brief Config Parameters of the tracker.
+   */
+  struct Config {
+    int patch_size;
+    int pyramid_levels;
+    int max_iteration;
+    double track_precision;
+    // Points with the minimum eigenvalue of the spatial
+    // gradient matrix below the threshold are not tracked.
+    double min_eigen_threshold;
+    // Size of the cells which are tracked as a batch. The
+    // points are tracked in the given order if the size is 0.
+    int cell_width;
+    int cell_height;
+    // Use the vectorized kernels if available.
+    bool use_simd;
+
+    Config():
+      patch_size(15),
+      pyramid_levels(3),
+      max_iteration(30),
+      track_precision(0.01),
+      min_eigen_threshold(1e-4),
+      cell_width(0),
+      cell_height(0),
+      use_simd(true) {
+      return;
+    }
+  };
+
+  KltTracker(const Config& config);
+
+  /*
+   * @brief track Track the points from the previous image
+   *    to the current image.
+   * @param prev_pyramid, curr_pyramid: pyramids built by
+   *    cv::buildOpticalFlowPyramid with the derivatives and a
+   *    window at least as large as the patch.
+   * @param prev_points: points in the previous image.
+   * @param curr_points: initial guess of the points in the
+   *    current image, e.g. predicted with the IMU, which is
+   *    replaced by the tracked points.
+   * @param status: 1 if a point is tracked, 0 otherwise.
+   * @param residuals: mean absolute intensity difference of
+   *    the patches of the tracked points, 0 for the others.
+   * @return False if the pyramids have no derivatives.
+   */
+  bool track(
+      const std::vector<cv::Mat>& prev_pyramid,
+      const std::vector<cv::Mat>& curr_pyramid,
+      const std::vector<cv::Point2f>& prev_points,
+      std::vector<cv::Point2f>& curr_points,
+      std::vector<unsigned char>& status,
+      std::vector<float>& residuals) const;
+
+  /*
+   * @brief simdName Name of the kernels in use, which is one
+   *    of "avx2", "neon" and "scalar".
+   */
+  const char* simdName() const;
+
+  const Config& getConfig() const {
+    return config;
+  }
+
+  /*
+   * @brief Kernels The patch kernels of an instruction set.
+   *    The image pointers point at the top-left pixel of the
+   *    patch, and weights are the bilinear weights in fixed
+   *    point. The patch and its gradients are kept in buffers
+   *    of patch_size*patch_size elements.
+   */
+  struct Kernels {
+    // Interpolates the patch in the previous image and sums
+    // the entries of the spatial gradient matrix.
+    void (*patch)(const unsigned char* img, const size_t& img_step,
+        const short* grad, const size_t& grad_step,
+        const int* weights, const int& size,
+        int* patch, int* patch_dx, int* patch_dy, long long* sums);
+    // Sums the mismatch vector between the patch in the
+    // current image and the previous one.
+    void (*mismatch)(const unsigned char* img, const size_t& img_step,
+        const int* weights, const int& size,
+        const int* patch, const int* patch_dx, const int* patch_dy,
+        long long* sums);
+    // Sums the absolute differences of the patches.
+    long long (*residual)(const unsigned char* img, const size_t& img_step,
+        const int* weights, const int& size, const int* patch);
+    const char* name;
+  };
+
+private:
+  // Track the points of one batch through all the levels.
+  void trackBatch(
+      const std::vector<cv::Mat>& prev_pyramid,
+      const std::vector<cv::Mat>& curr_pyramid,
+      const int& max_level,
+      const std::vector<cv::Point2f>& prev_points,
+      const int* indices, const int& index_num,
+      std::vector<cv::Point2f>& curr_points,
+      std::vector<unsigned char>& status,
+      std::vector<float>& residuals) const;
+
+  Config config;
+  Kernels kernels;
+};
+
+} // namespace msckf_vio
+
+#endif // MSCKF_VIO_KLT_TRACKER_H
@@ -110,6 +110,47 @@ inline Eigen::Matrix3d quaternionToRotation(
   return R;
 }
 
+/*
+ * @brief Compute the integrals of the exponential map of SO(3)
+ *    which appear in the closed-form integration of a constant
+ *    angular velocity and acceleration,
+ *      Gamma1 = int_0^1 Exp(t*phi) dt,
+ *      Gamma2 = int_0^1 int_0^s Exp(t*phi) dt ds.
+ *    Gamma1 is also the left Jacobian of SO(3).
+ * @note Series expansions are used for small rotation angles,
+ *    where the closed-form coefficients lose precision.
+ */
+inline void so3Integrals(const Eigen::Vector3d& phi,
+    Eigen::Matrix3d& Gamma1, Eigen::Matrix3d& Gamma2) {
+  const double theta_square = phi.squaredNorm();
+  const Eigen::Matrix3d phi_hat = skewSymmetric(phi);
+  const Eigen::Matrix3d phi_hat_square =
+    phi*phi.transpose() - theta_square*Eigen::Matrix3d::Identity();
+
+  // a = (1-cos(theta))/theta^2
+  // b = (theta-sin(theta))/theta^3
+  // c = (theta^2+2*cos(theta)-2)/(2*theta^4)
+  double a, b, c;
+  if (theta_square < 1e-2) {
+    const double t2 = theta_square;
+    a = 1.0/2.0 - t2/24.0 + t2*t2/720.0;
+    b = 1.0/6.0 - t2/120.0 + t2*t2/5040.0;
+    c = 1.0/24.0 - t2/720.0 + t2*t2/40320.0;
+  } else {
+    const double theta = std::sqrt(theta_square);
+    const double sin_theta = std::sin(theta);
+    const double cos_theta = std::cos(theta);
+    a = (1.0-cos_theta) / theta_square;
+    b = (theta-sin_theta) / (theta_square*theta);
+    c = (theta_square+2.0*cos_theta-2.0) /
+      (2.0*theta_square*theta_square);
+  }
+
+  Gamma1 = Eigen::Matrix3d::Identity() + a*phi_hat + b*phi_hat_square;
+  Gamma2 = 0.5*Eigen::Matrix3d::Identity() + b*phi_hat + c*phi_hat_square;
+  return;
+}
+
 /*
  * @brief Convert a rotation matrix to a quaternion.
  * @note Pay attention to the convention used. The function follows the
@@ -25,6 +25,10 @@
 #include "imu_state.h"
 #include "cam_state.h"
 #include "feature.hpp"
+#include "checkpoint.h"
+#include "output_publisher.h"
+#include "window_controller.h"
+#include "feature_frame.h"
 #include <msckf_vio/CameraMeasurement.h>
 
 namespace msckf_vio {
@@ -39,29 +43,194 @@ class MsckfVio {
   public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
+    /*
+     * @brief Integrator Integration of the IMU state between
+     *    two IMU samples. RK4 is the 4th order Runge-Kutta
+     *    integration of the original implementation. CLOSED_FORM
+     *    integrates the constant angular velocity and
+     *    acceleration exactly on SO(3) with the integrals of the
+     *    exponential map.
+     */
+    enum Integrator {
+      RK4,
+      CLOSED_FORM
+    };
+
+    /*
+     * @brief Config Parameters of a filter instance. The
+     *    fields have the same meaning and default values as
+     *    the ROS parameters. Noise values are standard
+     *    deviations.
+     */
+    struct Config {
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+      // Frame id
+      std::string fixed_frame_id;
+      std::string child_frame_id;
+      bool publish_tf;
+      // Publish the feature point cloud every n frames.
+      int feature_cloud_decimation;
+      double frame_rate;
+      double position_std_threshold;
+
+      // Threshold for determine keyframes
+      double rotation_threshold;
+      double translation_threshold;
+      double tracking_rate_threshold;
+
+      // Integrator of the IMU state
+      Integrator integrator;
+
+      // Feature optimization parameters
+      Feature::OptimizationConfig optimization_config;
+
+      // Noise related parameters
+      double gyro_noise;
+      double acc_noise;
+      double gyro_bias_noise;
+      double acc_bias_noise;
+      double observation_noise;
+
+      // Initial state and covariance
+      Eigen::Vector3d initial_velocity;
+      double velocity_cov;
+      double gyro_bias_cov;
+      double acc_bias_cov;
+      double extrinsic_rotation_cov;
+      double extrinsic_translation_cov;
+
+      // Takes a vector from the IMU frame to the cam0 frame.
+      Eigen::Isometry3d T_imu_cam0;
+      // Takes a vector from the cam0 frame to the cam1 frame.
+      Eigen::Isometry3d T_cam0_cam1;
+      // Takes a vector from the IMU frame to the body frame.
+      Eigen::Isometry3d T_imu_body;
+
+      int max_cam_state_size;
+
+      // Adapt the window size to the processing time within
+      // the bounds of window_control. max_cam_state_size is
+      // used as the initial size.
+      bool adaptive_window;
+      WindowController::Config window_control;
+
+      // Trace-event export
+      bool enable_tracing;
+      std::string trace_file;
+
+      // Checkpoint of the filter state. A checkpoint is written
+      // every checkpoint_period seconds if it is positive. With
+      // restore_checkpoint, the filter resumes from the file
+      // instead of initializing the gravity and bias, if the
+      // checkpoint is at most checkpoint_max_age seconds older
+      // than the first IMU msg.
+      std::string checkpoint_file;
+      double checkpoint_period;
+      bool restore_checkpoint;
+      double checkpoint_max_age;
+
+      Config();
+    };
+
     // Constructor
     MsckfVio(ros::NodeHandle& pnh);
+    // Constructor of an instance without any ROS IO. Such an
+    // instance is initialized with initialize(config) and fed
+    // with processImu() and processFeatures().
+    MsckfVio();
     // Disable copy and assign constructor
     MsckfVio(const MsckfVio&) = delete;
     MsckfVio operator=(const MsckfVio&) = delete;
 
     // Destructor
-    ~MsckfVio() {}
+    ~MsckfVio();
 
     /*
      * @brief initialize Initialize the VIO.
+     * @param subscribe_inputs: whether to subscribe the IMU
+     *    and feature msgs and advertise the reset service.
+     *    Otherwise only the outputs are published, and the
+     *    inputs are fed with processImu() and processFeatures()
+     *    on a single thread.
      */
-    bool initialize();
+    bool initialize(const bool& subscribe_inputs = true);
+
+    /*
+     * @brief initialize Initialize the VIO with the given
+     *    config instead of the parameter server. No ROS IO
+     *    is created. Several instances initialized this way
+     *    can run in the same process.
+     */
+    bool initialize(const Config& filter_config);
 
     /*
      * @brief reset Resets the VIO to initial status.
      */
     void reset();
 
+    /*
+     * @brief processImu, processFeatures
+     *    Feed the filter with the sensor msgs directly,
+     *    which is the same as receiving them on the topics.
+     */
+    void processImu(const sensor_msgs::ImuConstPtr& msg) {
+      imuCallback(msg);
+    }
+    void processFeatures(const CameraMeasurementConstPtr& msg) {
+      featureCallback(msg);
+    }
+    void processFeatures(const FeatureFrame& frame) {
+      processFeatureFrame(frame);
+    }
+
+    /*
+     * @brief isRunning True once the gravity is initialized
+     *    and the first image is processed.
+     */
+    bool isRunning() const {
+      return is_gravity_set && !is_first_img;
+    }
+
+    /*
+     * @brief getImuState The current IMU state.
+     */
+    const IMUState& getImuState() const {
+      return state_server.imu_state;
+    }
+
+    /*
+     * @brief getStateCov The current state covariance.
+     */
+    const Eigen::MatrixXd& getStateCov() const {
+      return state_server.state_cov;
+    }
+
+    /*
+     * @brief getSnapshot Copy the current filter state.
+     */
+    void getSnapshot(FilterSnapshot& snapshot) const;
+
+    /*
+     * @brief restore Resume the estimation from a snapshot
+     *    instead of initializing the gravity and bias. The
+     *    snapshot is applied when the next IMU msg arrives,
+     *    so the next frame is processed as usual. It is
+     *    discarded if it is more than checkpoint_max_age
+     *    seconds away from that IMU msg. Should be called
+     *    before the filter starts running.
+     */
+    void restore(const FilterSnapshot& snapshot);
+
     typedef boost::shared_ptr<MsckfVio> Ptr;
     typedef boost::shared_ptr<const MsckfVio> ConstPtr;
 
   private:
+    // The benchmark suite drives the filter kernels directly.
+    friend class MsckfVioBenchmark;
+    // The integrators are compared by the unit tests.
+    friend class ImuIntegrationTest;
+
     /*
      * @brief StateServer Store one IMU states and several
      *    camera states for constructing measurement
@@ -83,6 +252,19 @@ class MsckfVio {
      */
     bool loadParameters();
 
+    /*
+     * @brief applyConfig
+     *    Set up the filter with the given config.
+     */
+    void applyConfig(const Config& filter_config);
+
+    /*
+     * @brief resetStateCov
+     *    Set the state covariance to the initial covariance
+     *    of the IMU state.
+     */
+    void resetStateCov();
+
     /*
      * @brief createRosIO
      *    Create ros publisher and subscirbers.
@@ -104,7 +286,14 @@ class MsckfVio {
     void featureCallback(const CameraMeasurementConstPtr& msg);
 
     /*
-     * @brief publish Publish the results of VIO.
+     * @brief processFeatureFrame
+     *    Process the feature measurements of a frame.
+     */
+    void processFeatureFrame(const FeatureFrame& frame);
+
+    /*
+     * @brief publish Queue the results of VIO, which are
+     *    published by the output publisher thread.
      * @param time The time stamp of output msgs.
      */
     void publish(const ros::Time& time);
@@ -126,20 +315,43 @@ class MsckfVio {
     bool resetCallback(std_srvs::Trigger::Request& req,
         std_srvs::Trigger::Response& res);
 
+    /*
+     * @brief ImuSample An IMU msg converted on arrival.
+     */
+    struct ImuSample {
+      double time;
+      Eigen::Vector3d gyro;
+      Eigen::Vector3d acc;
+    };
+
     // Filter related functions
     // Propogate the state
     void batchImuProcessing(
         const double& time_bound);
+    // Propagate the state and the covariance with one IMU sample.
     void processModel(const double& time,
         const Eigen::Vector3d& m_gyro,
         const Eigen::Vector3d& m_acc);
+    // Propagate the IMU state and its covariance block with one
+    // IMU sample, and return the transition matrix of the step.
+    void propagateImuState(const double& time,
+        const Eigen::Vector3d& m_gyro,
+        const Eigen::Vector3d& m_acc,
+        Eigen::Matrix<double, 21, 21>& Phi);
+    // Propagate the covariance between the IMU state and
+    // the camera states with the given transition matrix.
+    void propagateCrossCovariance(
+        const Eigen::Matrix<double, 21, 21>& Phi);
     void predictNewState(const double& dt,
         const Eigen::Vector3d& gyro,
         const Eigen::Vector3d& acc);
+    void predictNewStateClosedForm(const double& dt,
+        const Eigen::Vector3d& gyro,
+        const Eigen::Vector3d& acc);
 
     // Measurement update
     void stateAugmentation(const double& time);
-    void addFeatureObservations(const CameraMeasurementConstPtr& msg);
+    void addFeatureObservations(const FeatureFrame& frame);
     // This function is used to compute the measurement Jacobian
     // for a single feature observed at a single camera frame.
     void measurementJacobian(const StateIDType& cam_state_id,
@@ -163,21 +375,71 @@ class MsckfVio {
     // Reset the system online if the uncertainty is too large.
     void onlineReset();
 
+    // Checkpoint related functions
+    // Apply the restored snapshot at the given time.
+    bool applySnapshot(const double& time);
+    // Queue a checkpoint if the period has passed.
+    void writeCheckpoint(const double& time);
+
+    // Acknowledge a feature msg to the image processor.
+    void publishStatus(const ros::Time& time,
+        const double& processing_time);
+
+    // Adapt the window size to the processing time of a frame.
+    void updateWindowSize(const ros::Time& time,
+        const double& processing_time);
+
+    // Config the filter is initialized with
+    Config config;
+
     // Chi squared test table.
-    static std::map<int, double> chi_squared_test_table;
+    std::map<int, double> chi_squared_test_table;
+
+    // Id for the next IMU state
+    StateIDType next_state_id;
+
+    // Process noise (variance)
+    double gyro_noise;
+    double acc_noise;
+    double gyro_bias_noise;
+    double acc_bias_noise;
+
+    // Noise (variance) for a normalized feature measurement.
+    double observation_noise;
+
+    // Optimization configuration for solving the 3d position.
+    Feature::OptimizationConfig optimization_config;
+
+    // Gravity vector in the world frame
+    Eigen::Vector3d gravity;
+
+    // Takes a vector from the cam0 frame to the cam1 frame.
+    Eigen::Isometry3d T_cam0_cam1;
+
+    // Transformation offset from the IMU frame to
+    // the body frame. The transformation takes a
+    // vector from the IMU frame to the body frame.
+    // The z axis of the body frame should point upwards.
+    // Normally, this transform should be identity.
+    Eigen::Isometry3d T_imu_body;
 
     // State vector
     StateServer state_server;
     // Maximum number of camera states
     int max_cam_state_size;
+    // Adapts max_cam_state_size if enabled
+    boost::shared_ptr<WindowController> window_controller;
 
     // Features used
     MapServer map_server;
 
     // IMU data buffer
     // This is buffer is used to handle the unsynchronization or
-    // transfer delay between IMU and Image messages.
-    std::vector<sensor_msgs::Imu> imu_msg_buffer;
+    // transfer delay between IMU and Image messages. The samples
+    // before imu_buffer_head are already used and are removed
+    // once they make up half of the buffer.
+    std::vector<ImuSample> imu_buffer;
+    size_t imu_buffer_head;
 
     // Indicate if the gravity vector is set.
     bool is_gravity_set;
@@ -201,15 +463,20 @@ class MsckfVio {
     double rotation_threshold;
     double tracking_rate_threshold;
 
-    // Ros node handle
-    ros::NodeHandle nh;
+    // Ros node handle, which is null if the filter
+    // runs without ROS IO.
+    boost::shared_ptr<ros::NodeHandle> nh;
 
     // Subscribers and publishers
     ros::Subscriber imu_sub;
     ros::Subscriber feature_sub;
-    ros::Publisher odom_pub;
-    ros::Publisher feature_pub;
-    tf::TransformBroadcaster tf_pub;
+    bool subscribe_inputs;
+    // The feature msgs are converted into this frame.
+    FeatureFrame feature_msg_frame;
+    boost::shared_ptr<OutputPublisher> output_publisher;
+    boost::shared_ptr<tf::TransformBroadcaster> tf_pub;
+    ros::Publisher diagnostics_pub;
+    ros::Publisher status_pub;
     ros::ServiceServer reset_srv;
 
     // Frame id
@@ -219,17 +486,41 @@ class MsckfVio {
     // Whether to publish tf or not.
     bool publish_tf;
 
+    // The feature point cloud is only built every n
+    // frames and if it has any subscriber.
+    int feature_cloud_decimation;
+    int feature_cloud_cntr;
+
     // Framte rate of the stereo images. This variable is
     // only used to determine the timing threshold of
     // each iteration of the filter.
     double frame_rate;
 
+    // Statistics of the processing time and online resets
+    int critical_time_cntr;
+    long long int online_reset_counter;
+
+    // Trace-event export
+    bool enable_tracing;
+    std::string trace_file;
+
+    // Checkpoint of the filter state
+    boost::shared_ptr<CheckpointWriter> checkpoint_writer;
+    double last_checkpoint_time;
+    // Snapshot waiting for the first IMU msg
+    FilterSnapshot restored_snapshot;
+    bool has_restored_snapshot;
+    // The first frame after restoring is checked for
+    // the feature ids restarted by the image processor.
+    bool has_restored_features;
+
     // Debugging variables and functions
     void mocapOdomCallback(
         const nav_msgs::OdometryConstPtr& msg);
 
     ros::Subscriber mocap_odom_sub;
     ros::Publisher mocap_odom_pub;
+    bool first_mocap_odom_msg;
     geometry_msgs::TransformStamped raw_mocap_odom_msg;
     Eigen::Isometry3d mocap_initial_frame;
 };
@@ -0,0 +1,129 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_OUTPUT_PUBLISHER_H
+#define MSCKF_VIO_OUTPUT_PUBLISHER_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+#include <eigen3/Eigen/Dense>
+#include <eigen3/Eigen/Geometry>
+#include <eigen3/Eigen/StdVector>
+#include <boost/shared_ptr.hpp>
+
+#include <ros/ros.h>
+#include <tf/transform_broadcaster.h>
+
+#include "spsc_queue.h"
+
+namespace msckf_vio {
+
+/*
+ * @brief OutputState The part of the filter state needed for
+ *    the output msgs, which is copied on the filter thread.
+ */
+struct OutputState {
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  ros::Time time;
+
+  // IMU state in the world frame
+  Eigen::Vector4d orientation;
+  Eigen::Vector3d position;
+  Eigen::Vector3d velocity;
+
+  // Covariance of the IMU pose in the order of position
+  // and orientation, and of the IMU velocity.
+  Eigen::Matrix<double, 6, 6> pose_cov;
+  Eigen::Matrix3d velocity_cov;
+
+  // Positions of the initialized features in the world
+  // frame, only valid with has_features.
+  bool has_features;
+  std::vector<Eigen::Vector3d,
+    Eigen::aligned_allocator<Eigen::Vector3d> > feature_positions;
+
+  OutputState(): has_features(false) {}
+};
+
+/*
+ * @brief OutputPublisher Publishes the tf, the odometry and
+ *    the feature point cloud of the filter on a dedicated
+ *    thread, which is fed through a lock-free queue, so the
+ *    filter thread only copies the state.
+ */
+class OutputPublisher {
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  /*
+   * @brief OutputPublisher
+   * @param nh: node handle to advertise the topics with.
+   * @param fixed_frame_id, child_frame_id: frame ids of the msgs.
+   * @param publish_tf: whether to publish the tf.
+   * @param T_imu_body: takes a vector from the IMU frame
+   *    to the body frame.
+   */
+  OutputPublisher(ros::NodeHandle& nh,
+      const std::string& fixed_frame_id,
+      const std::string& child_frame_id,
+      const bool& publish_tf,
+      const Eigen::Isometry3d& T_imu_body);
+  // Publishes the queued states before returning.
+  ~OutputPublisher();
+
+  // Disable copy and assign constructor
+  OutputPublisher(const OutputPublisher&) = delete;
+  OutputPublisher operator=(const OutputPublisher&) = delete;
+
+  /*
+   * @brief push Queue a state to be published. The state is
+   *    moved. If the queue is full, the state is dropped.
+   * @return True if the state is queued.
+   */
+  bool push(OutputState& state);
+
+  /*
+   * @brief hasFeatureSubscribers Whether the feature point
+   *    cloud has any subscriber.
+   */
+  bool hasFeatureSubscribers() const {
+    return feature_pub.getNumSubscribers() > 0;
+  }
+
+private:
+  void publisherLoop();
+  void publish(const OutputState& state);
+
+  std::string fixed_frame_id;
+  std::string child_frame_id;
+  bool publish_tf;
+  Eigen::Isometry3d T_imu_body;
+
+  ros::Publisher odom_pub;
+  ros::Publisher feature_pub;
+  tf::TransformBroadcaster tf_pub;
+
+  SpscQueue<OutputState,
+    Eigen::aligned_allocator<OutputState> > state_queue;
+
+  // Only used to wake up the publisher thread.
+  std::mutex wakeup_mutex;
+  std::condition_variable wakeup_cond;
+  std::atomic<bool> is_stopped;
+
+  std::thread publisher_thread;
+};
+
+} // namespace msckf_vio
+
+#endif // MSCKF_VIO_OUTPUT_PUBLISHER_H
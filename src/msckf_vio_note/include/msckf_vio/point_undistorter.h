@@ -0,0 +1,141 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_POINT_UNDISTORTER_H
+#define MSCKF_VIO_POINT_UNDISTORTER_H
+
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+namespace msckf_vio {
+
+/*
+ * @brief PointUndistorter Undistorts the points of a camera
+ *    to the normalized image plane with a lookup table.
+ *
+ *    The normalized coordinates of a grid over the image are
+ *    computed once with the iterative solvers of OpenCV, i.e.
+ *    cv::undistortPoints for radtan and
+ *    cv::fisheye::undistortPoints for equidistant. A point is
+ *    then undistorted with a bilinear lookup, optionally
+ *    followed by a Newton step on the distortion model. The
+ *    points out of the grid are passed to the solvers.
+ *
+ *    The interpolation is checked against the solvers at the
+ *    centers of the grid cells on construction, and the cells
+ *    over the tolerance are left to the solvers as well.
+ */
+class PointUndistorter {
+public:
+  /*
+   * @brief Config Parameters of the lookup table.
+   */
+  struct Config {
+    // Spacing of the grid in pixels.
+    double grid_step;
+    // Use the solvers for all the points if false.
+    bool use_table;
+    // Refine the interpolated points with a Newton step on the
+    // distortion model. The refined points converge further
+    // than the fixed iterations of cv::undistortPoints, so they
+    // may differ from it at strongly distorted image corners.
+    bool refine;
+    // Tolerance in pixels of the cells against the solvers.
+    double max_error;
+
+    Config():
+      grid_step(1.0),
+      use_table(true),
+      refine(false),
+      max_error(0.05) {
+      return;
+    }
+  };
+
+  /*
+   * @param resolution: width and height of the image.
+   * @param distortion_model: "radtan" or "equidistant", other
+   *    models are treated as radtan.
+   */
+  PointUndistorter(const cv::Vec2i& resolution,
+      const cv::Vec4d& intrinsics,
+      const std::string& distortion_model,
+      const cv::Vec4d& distortion_coeffs,
+      const Config& config = Config());
+
+  /*
+   * @brief undistort Undistort the points to the normalized
+   *    image plane, which is rotated by the rectification
+   *    matrix as in cv::undistortPoints.
+   */
+  void undistort(const std::vector<cv::Point2f>& pts_in,
+      std::vector<cv::Point2f>& pts_out,
+      const cv::Matx33d& rectification_matrix =
+        cv::Matx33d::eye()) const;
+
+  /*
+   * @brief getMaxError Largest difference in pixels between the
+   *    interpolation and the solver at the centers of the valid
+   *    cells, which is 0 without the table.
+   */
+  double getMaxError() const {
+    return max_error;
+  }
+
+  /*
+   * @brief project Project a normalized point to the image
+   *    with the distortion model.
+   */
+  cv::Point2d project(const cv::Point2d& pt) const;
+
+  const cv::Vec4d& getIntrinsics() const {
+    return intrinsics;
+  }
+
+  const Config& getConfig() const {
+    return config;
+  }
+
+private:
+  // Interpolates the normalized point in the table, which
+  // fails for the points out of the valid cells.
+  bool lookup(const cv::Point2f& pt, cv::Point2d& pt_out) const;
+
+  // Bilinear interpolation in a cell at the offsets a and b,
+  // which are between 0 and 1.
+  cv::Point2d interpolate(const int& col, const int& row,
+      const double& a, const double& b) const;
+
+  // One Newton step to the normalized point whose
+  // distortion is the given pixel.
+  void refine(const cv::Point2f& pt, cv::Point2d& pt_out) const;
+
+  // Distorts a normalized point on the normalized plane.
+  cv::Point2d distort(const cv::Point2d& pt) const;
+
+  // Undistorts with the iterative solver of OpenCV.
+  void solve(const std::vector<cv::Point2f>& pts_in,
+      std::vector<cv::Point2f>& pts_out) const;
+
+  Config config;
+  cv::Vec4d intrinsics;
+  cv::Vec4d distortion_coeffs;
+  bool is_equidistant;
+
+  // Normalized points of the grid, row by row, and whether
+  // each cell is within the tolerance.
+  std::vector<cv::Point2f> table;
+  std::vector<unsigned char> cell_valid;
+  int table_cols;
+  int table_rows;
+  double max_error;
+};
+
+} // namespace msckf_vio
+
+#endif // MSCKF_VIO_POINT_UNDISTORTER_H
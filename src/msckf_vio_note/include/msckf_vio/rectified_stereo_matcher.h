@@ -0,0 +1,144 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_RECTIFIED_STEREO_MATCHER_H
+#define MSCKF_VIO_RECTIFIED_STEREO_MATCHER_H
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "point_undistorter.h"
+
+namespace msckf_vio {
+
+/*
+ * @brief RectifiedStereoMatcher Matches the points of a
+ *    calibrated stereo rig with a 1-D search along the
+ *    rectified scanlines.
+ *
+ *    The rectification rotates both cameras so that the
+ *    baseline is along the x axis, with a common focal length
+ *    which keeps the whole cam0 image. The maps from the
+ *    rectified pixels to the raw pixels of both cameras are
+ *    computed once, and only the patches around the points
+ *    are resampled. A point is matched by the ZNCC of the
+ *    patches over the disparities on its rectified row, and
+ *    refined with a parabola around the best disparity, so
+ *    the matches are on the epipolar lines by construction.
+ */
+class RectifiedStereoMatcher {
+public:
+  /*
+   * @brief Config Parameters of the disparity search.
+   */
+  struct Config {
+    // Size of the square patches, which is odd.
+    int patch_size;
+    // Range of the disparities in rectified pixels.
+    int min_disparity;
+    int max_disparity;
+    // Minimum ZNCC of a match.
+    double min_zncc;
+    // Other peaks of the ZNCC have to be lower than the best
+    // one by the margin, otherwise the match is ambiguous.
+    double uniqueness_margin;
+    // Minimum standard deviation of the intensity of the cam0
+    // patches, below which the points are not matched.
+    double min_stddev;
+
+    Config():
+      patch_size(9),
+      min_disparity(0),
+      max_disparity(64),
+      min_zncc(0.8),
+      uniqueness_margin(0.05),
+      min_stddev(2.0) {
+      return;
+    }
+  };
+
+  /*
+   * @param cam0_undistorter, cam1_undistorter: models of the
+   *    cameras, which are only used on construction.
+   * @param resolution: size of the cam0 image, which the
+   *    rectified images cover up to twice its size.
+   * @param R_cam0_cam1, t_cam0_cam1: the transformation which
+   *    takes a point in the cam0 frame to the cam1 frame.
+   */
+  RectifiedStereoMatcher(
+      const PointUndistorter& cam0_undistorter,
+      const PointUndistorter& cam1_undistorter,
+      const cv::Vec2i& resolution,
+      const cv::Matx33d& R_cam0_cam1,
+      const cv::Vec3d& t_cam0_cam1,
+      const Config& config = Config());
+
+  /*
+   * @brief match Find the cam1 points of the cam0 points.
+   * @param cam0_img, cam1_img: the raw 8-bit images.
+   * @param cam0_points_undistorted: normalized cam0 points.
+   * @return cam1_points: the matched cam1 pixels.
+   * @return cam1_points_undistorted: normalized cam1 points.
+   * @return inlier_markers: 1 if the point is matched.
+   */
+  void match(const cv::Mat& cam0_img, const cv::Mat& cam1_img,
+      const std::vector<cv::Point2f>& cam0_points_undistorted,
+      std::vector<cv::Point2f>& cam1_points,
+      std::vector<cv::Point2f>& cam1_points_undistorted,
+      std::vector<unsigned char>& inlier_markers);
+
+  /*
+   * @brief rectify Rectified pixel of a normalized point.
+   */
+  cv::Point2d rectify(const cv::Point2f& pt, const int& cam_id) const;
+
+  const Config& getConfig() const {
+    return config;
+  }
+
+  // Focal length of the rectified images.
+  double getFocalLength() const {
+    return focal;
+  }
+
+private:
+  // Resample a patch of the rectified image whose top left
+  // corner is at (x, y), which fails if any pixel is out of
+  // the raw image.
+  bool samplePatch(const cv::Mat& img,
+      const std::vector<cv::Point2f>& map,
+      const int& x, const int& y, const int& width,
+      float* patch) const;
+
+  // Bilinear interpolation of a map at a rectified position.
+  bool interpolateMap(const std::vector<cv::Point2f>& map,
+      const cv::Point2d& pt, cv::Point2f& pt_raw) const;
+
+  Config config;
+  int width;
+  int height;
+
+  // Rotations from the camera frames to the rectified frame,
+  // and the rectified intrinsics.
+  cv::Matx33d R_rect[2];
+  double focal;
+  double cx;
+  double cy;
+
+  // Raw pixels of the rectified pixels, row by row, which
+  // are NaN if they are behind a camera.
+  std::vector<cv::Point2f> maps[2];
+
+  // Buffers of the patches, kept across the calls.
+  std::vector<float> cam0_patch;
+  std::vector<float> cam1_strip;
+  std::vector<float> scores;
+};
+
+} // namespace msckf_vio
+
+#endif // MSCKF_VIO_RECTIFIED_STEREO_MATCHER_H
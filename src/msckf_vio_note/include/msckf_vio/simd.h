@@ -0,0 +1,70 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_SIMD_H
+#define MSCKF_VIO_SIMD_H
+
+/*
+ * Selection of the vectorized kernels, shared by the KLT
+ * tracker, the RANSAC, the FAST detector and the feature
+ * predictor.
+ *
+ * MSCKF_VIO_SIMD_NEON is defined on ARM with NEON, and
+ * MSCKF_VIO_SIMD_NEON64 on AArch64, which also has the double
+ * precision vectors. MSCKF_VIO_SIMD_AVX2 is defined on x86 with
+ * GCC or Clang. The AVX2 kernels are marked with
+ * MSCKF_VIO_AVX2_TARGET, which compiles them for AVX2 and FMA
+ * regardless of the compiler flags, so they may only be called
+ * if simd::supported() is true.
+ */
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MSCKF_VIO_SIMD_NEON
+#if defined(__aarch64__)
+#define MSCKF_VIO_SIMD_NEON64
+#endif
+#elif (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define MSCKF_VIO_SIMD_AVX2
+#define MSCKF_VIO_AVX2_TARGET __attribute__((target("avx2,fma")))
+#endif
+
+namespace msckf_vio {
+namespace simd {
+
+/*
+ * @brief supported Whether the vectorized kernels of the
+ *    platform can run on this cpu.
+ */
+inline bool supported() {
+#if defined(MSCKF_VIO_SIMD_AVX2)
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#elif defined(MSCKF_VIO_SIMD_NEON)
+  return true;
+#else
+  return false;
+#endif
+}
+
+/*
+ * @brief name Name of the vectorized kernels of the platform,
+ *    which is one of "avx2", "neon" and "scalar".
+ */
+inline const char* name() {
+#if defined(MSCKF_VIO_SIMD_AVX2)
+  return "avx2";
+#elif defined(MSCKF_VIO_SIMD_NEON)
+  return "neon";
+#else
+  return "scalar";
+#endif
+}
+
+} // namespace simd
+} // namespace msckf_vio
+
+#endif // MSCKF_VIO_SIMD_H
@@ -0,0 +1,97 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_SPSC_QUEUE_H
+#define MSCKF_VIO_SPSC_QUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstddef>
+
+namespace msckf_vio {
+
+/*
+ * @brief SpscQueue A bounded lock-free queue for exactly one
+ *    producer thread and one consumer thread. The elements
+ *    are moved in and out of a preallocated ring buffer, so
+ *    no memory is allocated after construction.
+ */
+template <typename T, typename Allocator = std::allocator<T> >
+class SpscQueue {
+public:
+  explicit SpscQueue(const size_t& capacity):
+    buffer(capacity+1), head(0), tail(0) {
+    return;
+  }
+
+  // Disable copy and assign constructor
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue operator=(const SpscQueue&) = delete;
+
+  /*
+   * @brief tryPush Move an element into the queue. Only
+   *    called by the producer.
+   * @return False if the queue is full, in which case the
+   *    element is left untouched.
+   */
+  bool tryPush(T& value) {
+    const size_t curr_tail = tail.load(std::memory_order_relaxed);
+    const size_t next_tail = increment(curr_tail);
+    if (next_tail == head.load(std::memory_order_acquire))
+      return false;
+    buffer[curr_tail] = std::move(value);
+    tail.store(next_tail, std::memory_order_release);
+    return true;
+  }
+
+  /*
+   * @brief tryPop Move the oldest element out of the queue.
+   *    Only called by the consumer.
+   * @return False if the queue is empty.
+   */
+  bool tryPop(T& value) {
+    const size_t curr_head = head.load(std::memory_order_relaxed);
+    if (curr_head == tail.load(std::memory_order_acquire))
+      return false;
+    value = std::move(buffer[curr_head]);
+    head.store(increment(curr_head), std::memory_order_release);
+    return true;
+  }
+
+  /*
+   * @brief empty Whether the queue is empty, which may be
+   *    outdated as soon as it returns unless it is called
+   *    by the consumer and returns false.
+   */
+  bool empty() const {
+    return head.load(std::memory_order_acquire) ==
+      tail.load(std::memory_order_acquire);
+  }
+
+  size_t capacity() const {
+    return buffer.size() - 1;
+  }
+
+private:
+  size_t increment(const size_t& index) const {
+    return index+1 == buffer.size() ? 0 : index+1;
+  }
+
+  std::vector<T, Allocator> buffer;
+
+  // The indices are modified by different threads and kept
+  // on separate cache lines to avoid false sharing.
+  char head_padding[64];
+  std::atomic<size_t> head;
+  char tail_padding[64];
+  std::atomic<size_t> tail;
+};
+
+} // namespace msckf_vio
+
+#endif // MSCKF_VIO_SPSC_QUEUE_H
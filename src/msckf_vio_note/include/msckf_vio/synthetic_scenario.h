@@ -0,0 +1,225 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_SYNTHETIC_SCENARIO_H
+#define MSCKF_VIO_SYNTHETIC_SCENARIO_H
+
+#include <vector>
+#include <random>
+
+#include <eigen3/Eigen/Dense>
+#include <eigen3/Eigen/Geometry>
+#include <eigen3/Eigen/StdVector>
+
+#include "imu_state.h"
+#include "feature.hpp"
+
+namespace msckf_vio {
+
+/*
+ * @brief SyntheticScenario Generates IMU measurements and
+ *    stereo feature tracks of a simulated stereo-inertial
+ *    sensor, together with the ground truth.
+ *
+ *    The sensor moves along a Lissajous curve inside a
+ *    cylindrical "room" whose wall is covered with random
+ *    landmarks. The cameras look horizontally towards the
+ *    wall while the heading turns around the vertical axis.
+ *    The motion is blended in smoothly after a static period,
+ *    which is required by the gravity and bias initialization
+ *    of the filter.
+ *
+ *    The feature measurements are in the same form as the
+ *    output of the image processor, i.e. normalized stereo
+ *    coordinates (u0, v0, u1, v1) with a unique feature id.
+ */
+class SyntheticScenario {
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  typedef Feature::FeatureIDType FeatureIDType;
+
+  /*
+   * @brief Config Parameters of the scenario.
+   *    The IMU noise values are continuous-time standard
+   *    deviations, in the same form as the noise parameters
+   *    of the filter.
+   */
+  struct Config {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    // Trajectory
+    double duration;
+    double static_duration;
+    double ramp_duration;
+    Eigen::Vector3d amplitude;
+    Eigen::Vector3d frequency;
+    double yaw_rate;
+    double yaw_amplitude;
+    double yaw_frequency;
+    double tilt_amplitude;
+    double tilt_frequency;
+
+    // Landmarks on the wall of the room
+    int landmark_num;
+    double wall_min_radius;
+    double wall_max_radius;
+    double wall_height;
+
+    // Sensor rates
+    double imu_rate;
+    double frame_rate;
+
+    // IMU noise and bias
+    double gyro_noise;
+    double acc_noise;
+    double gyro_bias_noise;
+    double acc_bias_noise;
+    Eigen::Vector3d initial_gyro_bias;
+    Eigen::Vector3d initial_acc_bias;
+
+    // Cameras. Both cameras share the same pinhole
+    // intrinsics [fu, fv, cu, cv] and resolution.
+    Eigen::Vector4d intrinsics;
+    int image_width;
+    int image_height;
+    double min_depth;
+    // Takes a vector from the IMU frame to the cam0 frame.
+    Eigen::Isometry3d T_imu_cam0;
+    // Takes a vector from the cam0 frame to the cam1 frame.
+    Eigen::Isometry3d T_cam0_cam1;
+
+    // Feature tracks
+    double pixel_noise;
+    int max_feature_num;
+    // A track is given a new id once it reaches this length.
+    // Set to nonpositive for unlimited track length.
+    int max_track_length;
+    // Probability for a track to be lost at each frame.
+    double track_loss_probability;
+
+    unsigned int seed;
+
+    Config();
+  };
+
+  struct ImuSample {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    double time;
+    Eigen::Vector3d angular_velocity;
+    Eigen::Vector3d linear_acceleration;
+  };
+
+  struct FeatureObservation {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    FeatureIDType id;
+    // Index of the observed landmark.
+    int landmark_id;
+    // Normalized coordinates (u0, v0, u1, v1).
+    Eigen::Vector4d measurement;
+  };
+
+  struct StereoFrame {
+    double time;
+    std::vector<FeatureObservation,
+      Eigen::aligned_allocator<FeatureObservation> > features;
+  };
+
+  /*
+   * @brief GroundTruth State of the IMU in the same form
+   *    as IMUState. The orientation takes a vector from the
+   *    world frame to the IMU frame.
+   */
+  struct GroundTruth {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    double time;
+    Eigen::Vector4d orientation;
+    Eigen::Vector3d position;
+    Eigen::Vector3d velocity;
+    Eigen::Vector3d gyro_bias;
+    Eigen::Vector3d acc_bias;
+  };
+
+  typedef std::vector<ImuSample,
+    Eigen::aligned_allocator<ImuSample> > ImuSamples;
+  typedef std::vector<StereoFrame> StereoFrames;
+  typedef std::vector<GroundTruth,
+    Eigen::aligned_allocator<GroundTruth> > GroundTruths;
+  typedef std::vector<Eigen::Vector3d,
+    Eigen::aligned_allocator<Eigen::Vector3d> > Landmarks;
+
+  SyntheticScenario(const Config& config);
+
+  /*
+   * @brief generate Generate the landmarks, the IMU samples,
+   *    the stereo frames and the ground truth. Generating
+   *    again with the same config gives the same scenario.
+   */
+  void generate();
+
+  /*
+   * @brief imuPose Pose of the IMU at the given time.
+   * @return R_w_i: takes a vector from the world frame to
+   *    the IMU frame.
+   * @return t_i_w: position of the IMU in the world frame.
+   */
+  void imuPose(const double& time,
+      Eigen::Matrix3d& R_w_i, Eigen::Vector3d& t_i_w) const;
+
+  /*
+   * @brief imuMotion Velocity and acceleration of the IMU in
+   *    the world frame, and the angular velocity in the IMU
+   *    frame at the given time.
+   */
+  void imuMotion(const double& time,
+      Eigen::Vector3d& velocity, Eigen::Vector3d& acceleration,
+      Eigen::Vector3d& angular_velocity) const;
+
+  const Config& config() const {
+    return scenario_config;
+  }
+  const Landmarks& landmarks() const {
+    return landmark_positions;
+  }
+  const ImuSamples& imuSamples() const {
+    return imu_buffer;
+  }
+  const StereoFrames& stereoFrames() const {
+    return frame_buffer;
+  }
+  const GroundTruths& groundTruth() const {
+    return ground_truth_buffer;
+  }
+
+private:
+  // Pose of cam0 at the given time. R_w_c0 takes a vector
+  // from the world frame to the cam0 frame.
+  void cam0Pose(const double& time,
+      Eigen::Matrix3d& R_w_c0, Eigen::Vector3d& t_c0_w) const;
+
+  void generateLandmarks();
+  void generateImuSamples();
+  void generateStereoFrames();
+
+  // Project a landmark into both cameras. Returns false if
+  // the landmark is not visible in either of the cameras.
+  bool project(const Eigen::Matrix3d& R_w_c0,
+      const Eigen::Vector3d& t_c0_w, const Eigen::Vector3d& p_w,
+      Eigen::Vector4d& z) const;
+
+  Config scenario_config;
+  std::mt19937 random_engine;
+
+  Landmarks landmark_positions;
+  ImuSamples imu_buffer;
+  StereoFrames frame_buffer;
+  GroundTruths ground_truth_buffer;
+};
+
+} // namespace msckf_vio
+
+#endif // MSCKF_VIO_SYNTHETIC_SCENARIO_H
@@ -0,0 +1,100 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_THREAD_POOL_H
+#define MSCKF_VIO_THREAD_POOL_H
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+namespace msckf_vio {
+
+/*
+ * @brief ThreadPool A work-stealing thread pool.
+ *
+ *    Each worker owns a task deque. A task submitted from a
+ *    worker is pushed to the back of the deque of that worker,
+ *    and tasks submitted from other threads are distributed
+ *    over the workers in a round-robin manner. A worker takes
+ *    the latest task from the back of its own deque and steals
+ *    the oldest task from the front of the other deques once
+ *    its own deque is empty.
+ */
+class ThreadPool {
+public:
+  typedef std::function<void()> Task;
+
+  /*
+   * @brief ThreadPool Start the workers.
+   * @param thread_num: number of workers. The number of
+   *    hardware threads is used if it is nonpositive.
+   */
+  ThreadPool(const int& thread_num = 0);
+
+  // Disable copy and assign constructor
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  /*
+   * @brief ~ThreadPool Finish all the submitted tasks and
+   *    stop the workers.
+   */
+  ~ThreadPool();
+
+  /*
+   * @brief submit Add a task to the pool. Tasks may submit
+   *    further tasks.
+   */
+  void submit(const Task& task);
+
+  /*
+   * @brief wait Block until all the submitted tasks, including
+   *    the ones submitted by the tasks, are finished. Should
+   *    not be called from a task.
+   */
+  void wait();
+
+  int threadNum() const {
+    return workers.size();
+  }
+
+private:
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void workerLoop(const int& index);
+
+  // Take the latest task of the given worker.
+  bool popTask(const int& index, Task& task);
+  // Take the oldest task of any other worker.
+  bool stealTask(const int& index, Task& task);
+
+  std::vector<std::unique_ptr<Worker> > workers;
+  std::vector<std::thread> threads;
+  std::atomic<unsigned int> next_worker;
+
+  // Number of the tasks in the deques, and the number
+  // of the tasks which are not finished yet.
+  std::mutex state_mutex;
+  std::condition_variable task_cond;
+  std::condition_variable done_cond;
+  int queued_task_num;
+  int pending_task_num;
+  bool is_stopped;
+};
+
+} // namespace msckf_vio
+
+#endif // MSCKF_VIO_THREAD_POOL_H
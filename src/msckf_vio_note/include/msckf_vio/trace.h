@@ -0,0 +1,159 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_TRACE_H
+#define MSCKF_VIO_TRACE_H
+
+#include <atomic>
+#include <string>
+
+namespace msckf_vio {
+/*
+ * @brief Light-weight begin/end event tracing which can be
+ *    exported in the Chrome trace-event JSON format, e.g.
+ *    to be inspected with chrome://tracing or Perfetto.
+ *
+ *    Every thread records into its own buffer, so recording
+ *    an event never takes a lock. The instrumentation is only
+ *    compiled in with MSCKF_VIO_ENABLE_TRACING. When compiled
+ *    in but not enabled, each trace point costs one relaxed
+ *    atomic load.
+ */
+namespace trace {
+
+/*
+ * @brief Event A single begin ('B') or end ('E') record.
+ *    The name has to be a string literal since only the
+ *    pointer is stored.
+ */
+struct Event {
+  const char* name;
+  long long int frame_id;
+  long long int timestamp_ns;
+  char phase;
+};
+
+// Frame id used for events which do not belong to any frame.
+const long long int kNoFrame = -1;
+
+namespace internal {
+extern std::atomic<bool> enabled;
+} // namespace internal
+
+/*
+ * @brief isEnabled Whether events are being recorded.
+ */
+inline bool isEnabled() {
+  return internal::enabled.load(std::memory_order_relaxed);
+}
+
+/*
+ * @brief enable/disable Start or stop recording events.
+ *    Events recorded so far are kept until clear().
+ */
+void enable();
+void disable();
+
+/*
+ * @brief clear Drop all recorded events. Should only be
+ *    called when no other thread is recording.
+ */
+void clear();
+
+/*
+ * @brief record Append an event to the buffer of the
+ *    calling thread.
+ * @param name: name of the event, a string literal.
+ * @param phase: 'B' for begin and 'E' for end.
+ * @param frame_id: id of the frame the event belongs to.
+ */
+void record(const char* name, const char phase,
+    const long long int frame_id);
+
+/*
+ * @brief write Write all recorded events into a file in
+ *    the Chrome trace-event JSON format.
+ * @param file_name: path of the output file.
+ * @return True if the file is written successfully.
+ */
+bool write(const std::string& file_name);
+
+/*
+ * @brief currentFrame/setCurrentFrame The frame id which
+ *    is attached to the events recorded by the calling
+ *    thread.
+ */
+long long int currentFrame();
+void setCurrentFrame(const long long int frame_id);
+
+/*
+ * @brief FrameScope Attaches the given frame id to all the
+ *    events recorded by this thread within the scope.
+ */
+class FrameScope {
+public:
+  explicit FrameScope(const long long int frame_id):
+    prev_frame_id(currentFrame()) {
+    setCurrentFrame(frame_id);
+  }
+  ~FrameScope() {
+    setCurrentFrame(prev_frame_id);
+  }
+
+  FrameScope(const FrameScope&) = delete;
+  FrameScope operator=(const FrameScope&) = delete;
+
+private:
+  long long int prev_frame_id;
+};
+
+/*
+ * @brief ScopedEvent Records a begin event on construction
+ *    and the matching end event on destruction.
+ */
+class ScopedEvent {
+public:
+  explicit ScopedEvent(const char* event_name):
+    name(event_name), frame_id(kNoFrame), is_recording(isEnabled()) {
+    if (!is_recording) return;
+    frame_id = currentFrame();
+    record(name, 'B', frame_id);
+  }
+  ~ScopedEvent() {
+    if (is_recording) record(name, 'E', frame_id);
+  }
+
+  ScopedEvent(const ScopedEvent&) = delete;
+  ScopedEvent operator=(const ScopedEvent&) = delete;
+
+private:
+  const char* name;
+  long long int frame_id;
+  bool is_recording;
+};
+
+} // namespace trace
+} // namespace msckf_vio
+
+#define MSCKF_VIO_TRACE_CONCAT_IMPL(a, b) a##b
+#define MSCKF_VIO_TRACE_CONCAT(a, b) MSCKF_VIO_TRACE_CONCAT_IMPL(a, b)
+
+#ifdef MSCKF_VIO_ENABLE_TRACING
+// Trace the enclosing scope with the given event name.
+#define MSCKF_VIO_TRACE_SCOPE(name) \
+  ::msckf_vio::trace::ScopedEvent \
+    MSCKF_VIO_TRACE_CONCAT(trace_scoped_event_, __LINE__)(name)
+// Attach the frame id to the events in the enclosing scope.
+#define MSCKF_VIO_TRACE_FRAME(frame_id) \
+  ::msckf_vio::trace::FrameScope \
+    MSCKF_VIO_TRACE_CONCAT(trace_frame_scope_, __LINE__)(frame_id)
+#else
+#define MSCKF_VIO_TRACE_SCOPE(name) do {} while (0)
+#define MSCKF_VIO_TRACE_FRAME(frame_id) do {} while (0)
+#endif
+
+#endif // MSCKF_VIO_TRACE_H
@@ -0,0 +1,129 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_TWO_POINT_RANSAC_H
+#define MSCKF_VIO_TWO_POINT_RANSAC_H
+
+#include <vector>
+#include <random>
+#include <opencv2/core/core.hpp>
+
+namespace msckf_vio {
+
+/*
+ * @brief TwoPointRansac The RANSAC of the translation between
+ *    two frames whose rotation has been compensated, with two
+ *    point pairs for each hypothesis.
+ *
+ *    The number of hypotheses is bounded adaptively with the
+ *    inlier ratio of the best model so far, so frames with
+ *    mostly inliers stop after a few hypotheses. The models
+ *    are scored on the preallocated coefficients of the point
+ *    pairs with AVX2 (selected at runtime) or NEON kernels.
+ *    The random generator is seeded once and kept across the
+ *    calls, so the results are repeatable for a given seed.
+ */
+class TwoPointRansac {
+public:
+  /*
+   * @brief Config Parameters of the RANSAC.
+   */
+  struct Config {
+    // Upper bound of the number of hypotheses.
+    int max_iteration;
+    // Models with less inliers than the ratio of all the
+    // point pairs are rejected.
+    double min_inlier_ratio;
+    // Draw the hypotheses from the point pairs of the best
+    // quality first, growing to all the pairs by the end of
+    // max_iteration hypotheses as in PROSAC.
+    bool use_prosac;
+    unsigned int seed;
+    // Use the vectorized kernels if available.
+    bool use_simd;
+
+    Config():
+      max_iteration(30),
+      min_inlier_ratio(0.2),
+      use_prosac(false),
+      seed(0),
+      use_simd(true) {
+      return;
+    }
+  };
+
+  TwoPointRansac(const Config& config);
+
+  /*
+   * @brief estimate Find the translation model with the most
+   *    inliers among the candidate point pairs.
+   * @param pts1, pts2: normalized points of the previous and
+   *    current frames, with the rotation compensated.
+   * @param candidates: indices of the point pairs which are
+   *    used, at least 2 of them.
+   * @param qualities: quality of each point pair, the higher
+   *    the better, which is only used with use_prosac. The
+   *    pairs are drawn uniformly if it is empty.
+   * @param threshold: acceptable error of the inliers.
+   * @param success_probability: the required probability of
+   *    drawing an all-inlier hypothesis.
+   * @return inlier_markers: 1 for the inliers of the best
+   *    model among the candidates, 0 for the others.
+   * @return Number of the hypotheses.
+   */
+  int estimate(
+      const std::vector<cv::Point2f>& pts1,
+      const std::vector<cv::Point2f>& pts2,
+      const std::vector<int>& candidates,
+      const std::vector<float>& qualities,
+      const double& threshold,
+      const double& success_probability,
+      std::vector<int>& inlier_markers);
+
+  /*
+   * @brief simdName Name of the kernels in use, which is one
+   *    of "avx2", "neon" and "scalar".
+   */
+  const char* simdName() const;
+
+  const Config& getConfig() const {
+    return config;
+  }
+
+  /*
+   * @brief Kernels The scoring kernels of an instruction set.
+   */
+  struct Kernels {
+    // Counts the pairs with the absolute error of the model
+    // below the threshold, with the coefficients of the
+    // translation components in three arrays.
+    int (*count)(const double* coeff_tx, const double* coeff_ty,
+        const double* coeff_tz, const int& size,
+        const double* model, const double& threshold);
+    const char* name;
+  };
+
+private:
+  // Solve the model of two pairs in the candidate buffers.
+  void solveModel(const int& idx1, const int& idx2,
+      double* model) const;
+
+  Config config;
+  Kernels kernels;
+  std::mt19937 random_gen;
+
+  // Buffers of the candidates, kept across the calls. The
+  // candidates are sorted by quality with use_prosac.
+  std::vector<double> coeff_tx;
+  std::vector<double> coeff_ty;
+  std::vector<double> coeff_tz;
+  std::vector<int> indices;
+};
+
+} // namespace msckf_vio
+
+#endif // MSCKF_VIO_TWO_POINT_RANSAC_H
@@ -0,0 +1,107 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_WINDOW_CONTROLLER_H
+#define MSCKF_VIO_WINDOW_CONTROLLER_H
+
+namespace msckf_vio {
+
+/*
+ * @brief WindowController Adapts the size of the sliding
+ *    window to the measured processing time of the frames.
+ *
+ *    The processing time is smoothed with an exponential
+ *    moving average and compared against the time budget
+ *    of a frame every few frames. The window shrinks by two
+ *    camera states, which is the number of states removed by
+ *    one pruning, if the average time is above the budget,
+ *    and grows by one if it is well below the budget. The
+ *    extra states are removed by the normal pruning of the
+ *    filter in the following frames.
+ */
+class WindowController {
+public:
+  /*
+   * @brief Config Parameters of the controller.
+   */
+  struct Config {
+    // Bounds of the window size
+    int min_size;
+    int max_size;
+    // Time budget of a frame as a fraction of the frame
+    // period. The window shrinks above the budget and grows
+    // below grow_ratio times the budget.
+    double time_budget;
+    double grow_ratio;
+    // Number of frames between two decisions
+    int period;
+    // Weight of the latest frame in the moving average
+    double smoothing;
+
+    Config():
+      min_size(10),
+      max_size(40),
+      time_budget(0.8),
+      grow_ratio(0.6),
+      period(10),
+      smoothing(0.1) {
+      return;
+    }
+  };
+
+  enum Decision {
+    SHRINK = -1,
+    KEEP = 0,
+    GROW = 1
+  };
+
+  /*
+   * @brief WindowController
+   * @param config: parameters of the controller.
+   * @param frame_rate: frame rate of the images.
+   * @param initial_size: initial window size, which is
+   *    clamped to the bounds.
+   */
+  WindowController(const Config& config,
+      const double& frame_rate, const int& initial_size);
+
+  /*
+   * @brief update Add the processing time of a frame.
+   * @return True if a decision is made with this frame.
+   */
+  bool update(const double& processing_time);
+
+  int windowSize() const {
+    return window_size;
+  }
+  // Smoothed processing time of a frame in seconds
+  double averageTime() const {
+    return average_time;
+  }
+  // Time budget of a frame in seconds
+  double budgetTime() const {
+    return budget_time;
+  }
+  // The latest decision
+  Decision decision() const {
+    return last_decision;
+  }
+
+private:
+  Config config;
+  double budget_time;
+
+  int window_size;
+  double average_time;
+  int frame_cntr;
+  bool is_first_frame;
+  Decision last_decision;
+};
+
+} // namespace msckf_vio
+
+#endif // MSCKF_VIO_WINDOW_CONTROLLER_H
@@ -0,0 +1,369 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <msckf_vio/checkpoint.h>
+
+using namespace std;
+using namespace Eigen;
+
+namespace msckf_vio {
+
+namespace {
+
+// File layout: header followed by the payload. All the
+// values are stored in the native byte order.
+const char kMagic[8] = {'M', 'S', 'C', 'K', 'F', 'C', 'K', 'P'};
+const uint32_t kVersion = 1;
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t payload_size;
+  uint64_t checksum;
+};
+
+// FNV-1a hash of the payload
+uint64_t checksum(const char* data, const size_t& size) {
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+/*
+ * @brief Serializer Appends values to a byte buffer.
+ */
+class Serializer {
+public:
+  explicit Serializer(vector<char>& data): buffer(data) {}
+
+  template <typename T>
+  void write(const T& value) {
+    const char* begin = reinterpret_cast<const char*>(&value);
+    buffer.insert(buffer.end(), begin, begin+sizeof(T));
+  }
+
+  template <typename Derived>
+  void writeMatrix(const MatrixBase<Derived>& m) {
+    for (int j = 0; j < m.cols(); ++j)
+      for (int i = 0; i < m.rows(); ++i)
+        write<double>(m(i, j));
+  }
+
+private:
+  vector<char>& buffer;
+};
+
+/*
+ * @brief Deserializer Reads values from a byte range.
+ *    Reading past the end fails the deserializer instead
+ *    of reading out of bounds.
+ */
+class Deserializer {
+public:
+  Deserializer(const char* data, const size_t& size):
+    begin(data), end(data+size), is_valid(true) {}
+
+  template <typename T>
+  bool read(T& value) {
+    if (!is_valid || end-begin < static_cast<ptrdiff_t>(sizeof(T)))
+      return is_valid = false;
+    memcpy(&value, begin, sizeof(T));
+    begin += sizeof(T);
+    return true;
+  }
+
+  template <typename Derived>
+  bool readMatrix(MatrixBase<Derived>& m) {
+    for (int j = 0; j < m.cols(); ++j)
+      for (int i = 0; i < m.rows(); ++i)
+        if (!read<double>(m(i, j))) return false;
+    return true;
+  }
+
+  bool valid() const {
+    return is_valid;
+  }
+  bool finished() const {
+    return is_valid && begin == end;
+  }
+
+private:
+  const char* begin;
+  const char* end;
+  bool is_valid;
+};
+
+void serialize(const FilterSnapshot& snapshot, vector<char>& data) {
+  Serializer s(data);
+  s.write<int64_t>(snapshot.next_state_id);
+  s.writeMatrix(snapshot.gravity);
+
+  const IMUState& imu_state = snapshot.imu_state;
+  s.write<int64_t>(imu_state.id);
+  s.write<double>(imu_state.time);
+  s.writeMatrix(imu_state.orientation);
+  s.writeMatrix(imu_state.position);
+  s.writeMatrix(imu_state.velocity);
+  s.writeMatrix(imu_state.gyro_bias);
+  s.writeMatrix(imu_state.acc_bias);
+  s.writeMatrix(imu_state.R_imu_cam0);
+  s.writeMatrix(imu_state.t_cam0_imu);
+  s.writeMatrix(imu_state.orientation_null);
+  s.writeMatrix(imu_state.position_null);
+  s.writeMatrix(imu_state.velocity_null);
+
+  s.write<uint64_t>(snapshot.cam_states.size());
+  for (const auto& item : snapshot.cam_states) {
+    const CAMState& cam_state = item.second;
+    s.write<int64_t>(cam_state.id);
+    s.write<double>(cam_state.time);
+    s.writeMatrix(cam_state.orientation);
+    s.writeMatrix(cam_state.position);
+    s.writeMatrix(cam_state.orientation_null);
+    s.writeMatrix(cam_state.position_null);
+  }
+
+  s.write<uint64_t>(snapshot.state_cov.rows());
+  s.write<uint64_t>(snapshot.state_cov.cols());
+  s.writeMatrix(snapshot.state_cov);
+
+  s.write<uint64_t>(snapshot.map_server.size());
+  for (const auto& item : snapshot.map_server) {
+    const Feature& feature = item.second;
+    s.write<int64_t>(feature.id);
+    s.write<uint8_t>(feature.is_initialized);
+    s.writeMatrix(feature.position);
+    s.write<uint64_t>(feature.observations.size());
+    for (const auto& observation : feature.observations) {
+      s.write<int64_t>(observation.first);
+      s.writeMatrix(observation.second);
+    }
+  }
+  return;
+}
+
+bool deserialize(Deserializer& d, FilterSnapshot& snapshot) {
+  int64_t id = 0;
+  uint64_t size = 0;
+
+  if (!d.read(id)) return false;
+  snapshot.next_state_id = id;
+  d.readMatrix(snapshot.gravity);
+
+  IMUState& imu_state = snapshot.imu_state;
+  if (!d.read(id)) return false;
+  imu_state.id = id;
+  d.read(imu_state.time);
+  d.readMatrix(imu_state.orientation);
+  d.readMatrix(imu_state.position);
+  d.readMatrix(imu_state.velocity);
+  d.readMatrix(imu_state.gyro_bias);
+  d.readMatrix(imu_state.acc_bias);
+  d.readMatrix(imu_state.R_imu_cam0);
+  d.readMatrix(imu_state.t_cam0_imu);
+  d.readMatrix(imu_state.orientation_null);
+  d.readMatrix(imu_state.position_null);
+  d.readMatrix(imu_state.velocity_null);
+
+  snapshot.cam_states.clear();
+  if (!d.read(size)) return false;
+  for (uint64_t i = 0; i < size; ++i) {
+    if (!d.read(id)) return false;
+    CAMState cam_state(id);
+    d.read(cam_state.time);
+    d.readMatrix(cam_state.orientation);
+    d.readMatrix(cam_state.position);
+    d.readMatrix(cam_state.orientation_null);
+    if (!d.readMatrix(cam_state.position_null)) return false;
+    snapshot.cam_states[cam_state.id] = cam_state;
+  }
+
+  // The covariance has to match the state, i.e. 21 entries
+  // for the IMU state and 6 for each camera state.
+  uint64_t rows = 0, cols = 0;
+  if (!d.read(rows) || !d.read(cols)) return false;
+  if (rows != cols || rows != 21+6*snapshot.cam_states.size())
+    return false;
+  snapshot.state_cov.resize(rows, cols);
+  if (!d.readMatrix(snapshot.state_cov)) return false;
+
+  snapshot.map_server.clear();
+  if (!d.read(size)) return false;
+  for (uint64_t i = 0; i < size; ++i) {
+    if (!d.read(id)) return false;
+    Feature feature(id);
+    uint8_t is_initialized = 0;
+    uint64_t observation_num = 0;
+    d.read(is_initialized);
+    d.readMatrix(feature.position);
+    if (!d.read(observation_num)) return false;
+    feature.is_initialized = is_initialized != 0;
+    for (uint64_t j = 0; j < observation_num; ++j) {
+      int64_t state_id = 0;
+      Vector4d observation;
+      d.read(state_id);
+      if (!d.readMatrix(observation)) return false;
+      feature.observations[state_id] = observation;
+    }
+    snapshot.map_server[feature.id] = feature;
+  }
+
+  return d.finished();
+}
+
+bool writeFile(const vector<char>& payload, const string& file_name) {
+  Header header;
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.reserved = 0;
+  header.payload_size = payload.size();
+  header.checksum = checksum(payload.data(), payload.size());
+  const size_t file_size = sizeof(Header) + payload.size();
+
+  // 先写入临时文件再重命名，保证读到的文件总是完整的
+  const string tmp_file_name = file_name + ".tmp";
+  int fd = open(tmp_file_name.c_str(), O_RDWR|O_CREAT|O_TRUNC, 0644);
+  if (fd < 0) return false;
+  if (ftruncate(fd, file_size) != 0) {
+    close(fd);
+    return false;
+  }
+
+  void* addr = mmap(nullptr, file_size,
+      PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) return false;
+
+  char* data = static_cast<char*>(addr);
+  memcpy(data, &header, sizeof(Header));
+  memcpy(data+sizeof(Header), payload.data(), payload.size());
+  const bool is_synced = msync(addr, file_size, MS_SYNC) == 0;
+  munmap(addr, file_size);
+
+  if (!is_synced) return false;
+  return rename(tmp_file_name.c_str(), file_name.c_str()) == 0;
+}
+
+} // namespace
+
+bool saveSnapshot(const FilterSnapshot& snapshot,
+    const string& file_name) {
+  vector<char> payload;
+  serialize(snapshot, payload);
+  return writeFile(payload, file_name);
+}
+
+bool loadSnapshot(const string& file_name,
+    FilterSnapshot& snapshot) {
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 ||
+      file_stat.st_size < static_cast<off_t>(sizeof(Header))) {
+    close(fd);
+    return false;
+  }
+  const size_t file_size = file_stat.st_size;
+
+  void* addr = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) return false;
+
+  const char* data = static_cast<const char*>(addr);
+  Header header;
+  memcpy(&header, data, sizeof(Header));
+  const char* payload = data + sizeof(Header);
+
+  bool is_loaded =
+    memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 &&
+    header.version == kVersion &&
+    header.payload_size == file_size-sizeof(Header) &&
+    header.checksum == checksum(payload, header.payload_size);
+
+  if (is_loaded) {
+    Deserializer d(payload, header.payload_size);
+    is_loaded = deserialize(d, snapshot);
+  }
+
+  munmap(addr, file_size);
+  return is_loaded;
+}
+
+CheckpointWriter::CheckpointWriter(const string& file):
+  file_name(file),
+  has_pending_snapshot(false),
+  is_stopped(false),
+  failed_write_num(0) {
+  writer_thread = thread(&CheckpointWriter::writerLoop, this);
+  return;
+}
+
+CheckpointWriter::~CheckpointWriter() {
+  {
+    lock_guard<mutex> lock(writer_mutex);
+    is_stopped = true;
+  }
+  writer_cond.notify_one();
+  writer_thread.join();
+  return;
+}
+
+void CheckpointWriter::write(FilterSnapshot& snapshot) {
+  {
+    lock_guard<mutex> lock(writer_mutex);
+    pending_snapshot = move(snapshot);
+    has_pending_snapshot = true;
+  }
+  writer_cond.notify_one();
+  return;
+}
+
+int CheckpointWriter::failedWriteNum() const {
+  lock_guard<mutex> lock(writer_mutex);
+  return failed_write_num;
+}
+
+void CheckpointWriter::writerLoop() {
+  FilterSnapshot snapshot;
+  vector<char> payload;
+
+  while (true) {
+    {
+      unique_lock<mutex> lock(writer_mutex);
+      writer_cond.wait(lock, [this]() {
+          return is_stopped || has_pending_snapshot; });
+      if (!has_pending_snapshot) break;
+      snapshot = move(pending_snapshot);
+      has_pending_snapshot = false;
+    }
+
+    // The payload buffer is reused across the snapshots.
+    payload.clear();
+    serialize(snapshot, payload);
+    if (!writeFile(payload, file_name)) {
+      lock_guard<mutex> lock(writer_mutex);
+      ++failed_write_num;
+    }
+  }
+  return;
+}
+
+} // namespace msckf_vio
@@ -0,0 +1,358 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <algorithm>
+
+#include <msckf_vio/simd.h>
+#include <msckf_vio/fast_detector.h>
+
+using namespace std;
+using namespace cv;
+
+namespace msckf_vio {
+
+namespace {
+
+// Radius and size of the Bresenham circle.
+const int kRadius = 3;
+const int kCircleSize = 16;
+// Length of the contiguous arc of FAST-9.
+const int kArcLength = 9;
+
+// The circle in the order of cv::FAST.
+const int kCircle[kCircleSize][2] = {
+  {0, 3}, {1, 3}, {2, 2}, {3, 1}, {3, 0}, {3, -1}, {2, -2}, {1, -3},
+  {0, -3}, {-1, -3}, {-2, -2}, {-3, -1}, {-3, 0}, {-3, 1}, {-2, 2}, {-1, 3}
+};
+
+/**
+ * @brief 角点得分，即该点仍为角点的最大阈值，与cv::FAST相同
+ *
+ * 9个连续像素与中心像素之差的最小值，在所有连续段上取最大值再减1
+ */
+inline int cornerScore(const unsigned char* ptr,
+    const ptrdiff_t* offsets) {
+  const int center = ptr[0];
+  int diffs[kCircleSize+kArcLength-1];
+  for (int k = 0; k < kCircleSize; ++k)
+    diffs[k] = center - ptr[offsets[k]];
+  for (int k = 0; k < kArcLength-1; ++k)
+    diffs[kCircleSize+k] = diffs[k];
+
+  // The darker arcs have positive differences, and the
+  // brighter ones negative.
+  int best = 0;
+  for (int k = 0; k < kCircleSize; ++k) {
+    int min_diff = diffs[k];
+    int max_diff = diffs[k];
+    for (int j = 1; j < kArcLength; ++j) {
+      min_diff = min(min_diff, diffs[k+j]);
+      max_diff = max(max_diff, diffs[k+j]);
+    }
+    best = max(best, max(min_diff, -max_diff));
+  }
+  return best - 1;
+}
+
+/**
+ * @brief 标量的分段测试，先用上下左右四个像素快速排除
+ *
+ * 9个连续像素一定包含圆上相邻的两个方向像素
+ */
+inline bool segmentTestPixel(const unsigned char* ptr,
+    const ptrdiff_t* offsets, const int& threshold) {
+  const int center = ptr[0];
+  bool bright[4];
+  bool dark[4];
+  for (int k = 0; k < 4; ++k) {
+    const int value = ptr[offsets[4*k]];
+    bright[k] = value > center+threshold;
+    dark[k] = value < center-threshold;
+  }
+  bool candidate = false;
+  for (int k = 0; k < 4; ++k) {
+    candidate |= bright[k] && bright[(k+1)%4];
+    candidate |= dark[k] && dark[(k+1)%4];
+  }
+  return candidate && cornerScore(ptr, offsets) >= threshold;
+}
+
+int segmentTestScalar(const unsigned char* ptr,
+    const ptrdiff_t* offsets, const int& width,
+    const int& threshold, unsigned char* mask) {
+  for (int x = 0; x < width; ++x)
+    mask[x] = segmentTestPixel(ptr+x, offsets, threshold) ? 0xff : 0;
+  return width;
+}
+
+#if defined(MSCKF_VIO_SIMD_AVX2)
+
+/**
+ * @brief AVX2实现，每次测试一行中的32个像素
+ *
+ * 无符号比较通过异或0x80转换为有符号比较，饱和加减法处理阈值越界
+ */
+MSCKF_VIO_AVX2_TARGET
+inline __m256i arcMaskAvx2(const __m256i* b) {
+  // A bit is set in a9[k] if the pixels k to k+8 are set.
+  __m256i a2[kCircleSize];
+  __m256i a4[kCircleSize];
+  for (int k = 0; k < kCircleSize; ++k)
+    a2[k] = _mm256_and_si256(b[k], b[(k+1)%kCircleSize]);
+  for (int k = 0; k < kCircleSize; ++k)
+    a4[k] = _mm256_and_si256(a2[k], a2[(k+2)%kCircleSize]);
+  __m256i result = _mm256_setzero_si256();
+  for (int k = 0; k < kCircleSize; ++k) {
+    const __m256i a8 = _mm256_and_si256(a4[k], a4[(k+4)%kCircleSize]);
+    result = _mm256_or_si256(result,
+        _mm256_and_si256(a8, b[(k+8)%kCircleSize]));
+  }
+  return result;
+}
+
+MSCKF_VIO_AVX2_TARGET
+int segmentTestAvx2(const unsigned char* ptr,
+    const ptrdiff_t* offsets, const int& width,
+    const int& threshold, unsigned char* mask) {
+  const __m256i sign = _mm256_set1_epi8(static_cast<char>(0x80));
+  const __m256i t = _mm256_set1_epi8(static_cast<char>(threshold));
+
+  int x = 0;
+  for (; x+32 <= width; x += 32) {
+    const unsigned char* p = ptr + x;
+    const __m256i center = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(p));
+    const __m256i upper = _mm256_xor_si256(
+        _mm256_adds_epu8(center, t), sign);
+    const __m256i lower = _mm256_xor_si256(
+        _mm256_subs_epu8(center, t), sign);
+
+    __m256i bright[kCircleSize];
+    __m256i dark[kCircleSize];
+    for (int k = 0; k < kCircleSize; k += 4) {
+      const __m256i value = _mm256_xor_si256(_mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(p+offsets[k])), sign);
+      bright[k] = _mm256_cmpgt_epi8(value, upper);
+      dark[k] = _mm256_cmpgt_epi8(lower, value);
+    }
+
+    // Quick rejection with the four compass pixels.
+    __m256i candidate = _mm256_setzero_si256();
+    for (int k = 0; k < kCircleSize; k += 4) {
+      const int next = (k+4) % kCircleSize;
+      candidate = _mm256_or_si256(candidate,
+          _mm256_and_si256(bright[k], bright[next]));
+      candidate = _mm256_or_si256(candidate,
+          _mm256_and_si256(dark[k], dark[next]));
+    }
+    if (_mm256_testz_si256(candidate, candidate)) {
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(mask+x),
+          _mm256_setzero_si256());
+      continue;
+    }
+
+    for (int k = 0; k < kCircleSize; ++k) {
+      if (k % 4 == 0) continue;
+      const __m256i value = _mm256_xor_si256(_mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(p+offsets[k])), sign);
+      bright[k] = _mm256_cmpgt_epi8(value, upper);
+      dark[k] = _mm256_cmpgt_epi8(lower, value);
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(mask+x),
+        _mm256_or_si256(arcMaskAvx2(bright), arcMaskAvx2(dark)));
+  }
+  return x;
+}
+
+FastDetector::SegmentTest simdSegmentTest() {
+  return segmentTestAvx2;
+}
+
+#elif defined(MSCKF_VIO_SIMD_NEON)
+
+/**
+ * @brief NEON实现，每次测试一行中的16个像素
+ */
+inline uint8x16_t arcMaskNeon(const uint8x16_t* b) {
+  uint8x16_t a2[kCircleSize];
+  uint8x16_t a4[kCircleSize];
+  for (int k = 0; k < kCircleSize; ++k)
+    a2[k] = vandq_u8(b[k], b[(k+1)%kCircleSize]);
+  for (int k = 0; k < kCircleSize; ++k)
+    a4[k] = vandq_u8(a2[k], a2[(k+2)%kCircleSize]);
+  uint8x16_t result = vdupq_n_u8(0);
+  for (int k = 0; k < kCircleSize; ++k) {
+    const uint8x16_t a8 = vandq_u8(a4[k], a4[(k+4)%kCircleSize]);
+    result = vorrq_u8(result, vandq_u8(a8, b[(k+8)%kCircleSize]));
+  }
+  return result;
+}
+
+inline bool isZeroNeon(const uint8x16_t& v) {
+  const uint8x8_t folded = vorr_u8(vget_low_u8(v), vget_high_u8(v));
+  return vget_lane_u64(vreinterpret_u64_u8(folded), 0) == 0;
+}
+
+int segmentTestNeon(const unsigned char* ptr,
+    const ptrdiff_t* offsets, const int& width,
+    const int& threshold, unsigned char* mask) {
+  const uint8x16_t t = vdupq_n_u8(static_cast<unsigned char>(threshold));
+
+  int x = 0;
+  for (; x+16 <= width; x += 16) {
+    const unsigned char* p = ptr + x;
+    const uint8x16_t center = vld1q_u8(p);
+    const uint8x16_t upper = vqaddq_u8(center, t);
+    const uint8x16_t lower = vqsubq_u8(center, t);
+
+    uint8x16_t bright[kCircleSize];
+    uint8x16_t dark[kCircleSize];
+    for (int k = 0; k < kCircleSize; k += 4) {
+      const uint8x16_t value = vld1q_u8(p+offsets[k]);
+      bright[k] = vcgtq_u8(value, upper);
+      dark[k] = vcltq_u8(value, lower);
+    }
+
+    // Quick rejection with the four compass pixels.
+    uint8x16_t candidate = vdupq_n_u8(0);
+    for (int k = 0; k < kCircleSize; k += 4) {
+      const int next = (k+4) % kCircleSize;
+      candidate = vorrq_u8(candidate, vandq_u8(bright[k], bright[next]));
+      candidate = vorrq_u8(candidate, vandq_u8(dark[k], dark[next]));
+    }
+    if (isZeroNeon(candidate)) {
+      vst1q_u8(mask+x, vdupq_n_u8(0));
+      continue;
+    }
+
+    for (int k = 0; k < kCircleSize; ++k) {
+      if (k % 4 == 0) continue;
+      const uint8x16_t value = vld1q_u8(p+offsets[k]);
+      bright[k] = vcgtq_u8(value, upper);
+      dark[k] = vcltq_u8(value, lower);
+    }
+    vst1q_u8(mask+x, vorrq_u8(arcMaskNeon(bright), arcMaskNeon(dark)));
+  }
+  return x;
+}
+
+FastDetector::SegmentTest simdSegmentTest() {
+  return segmentTestNeon;
+}
+
+#endif
+
+// Min-heap of the corners on the score.
+inline bool isStrongerCorner(const float& score0, const float& score1) {
+  return score0 > score1;
+}
+
+} // namespace
+
+FastDetector::FastDetector(const bool& use_simd):
+  segment_test(segmentTestScalar),
+  name("scalar") {
+#if defined(MSCKF_VIO_SIMD_AVX2) || defined(MSCKF_VIO_SIMD_NEON)
+  if (use_simd && simd::supported()) {
+    segment_test = simdSegmentTest();
+    name = simd::name();
+  }
+#endif
+  return;
+}
+
+int FastDetector::detect(const Mat& img, const Rect& cell,
+    const int& threshold, const unsigned char* occupancy,
+    const int& max_num, vector<Point2f>& points,
+    vector<float>& responses) {
+  // The scores are needed one pixel around the cell for the
+  // suppression. Like cv::FAST, no pixel within the radius
+  // of the circle to the image border is tested.
+  const int x0 = max(cell.x-1, kRadius);
+  const int x1 = min(cell.x+cell.width+1, img.cols-kRadius);
+  const int y0 = max(cell.y-1, kRadius);
+  const int y1 = min(cell.y+cell.height+1, img.rows-kRadius);
+  if (x0 >= x1 || y0 >= y1) return 0;
+
+  const int t = min(max(threshold, 0), 255);
+  ptrdiff_t offsets[kCircleSize];
+  for (int k = 0; k < kCircleSize; ++k)
+    offsets[k] = kCircle[k][1]*static_cast<ptrdiff_t>(img.step[0]) +
+      kCircle[k][0];
+
+  // Three rows of scores with a zero at both ends, of which
+  // the oldest one is replaced by the next row.
+  const int width = x1 - x0;
+  const int row_size = width + 2;
+  scores.assign(3*row_size, 0);
+  mask.resize(width);
+  corners.clear();
+
+  const int cell_x0 = max(cell.x, x0);
+  const int cell_x1 = min(cell.x+cell.width, x1);
+  const auto heap_compare = [](const Corner& c0, const Corner& c1) {
+    return isStrongerCorner(c0.score, c1.score); };
+
+  int corner_num = 0;
+  for (int y = y0; y <= y1; ++y) {
+    // 计算当前行的得分，超出测试区域的行为0
+    unsigned char* curr = &scores[((y-y0)%3)*row_size];
+    std::fill(curr, curr+row_size, 0);
+    if (y < y1) {
+      const unsigned char* ptr = img.ptr<unsigned char>(y) + x0;
+      const int tested = segment_test(ptr, offsets, width, t, &mask[0]);
+      segmentTestScalar(ptr+tested, offsets, width-tested, t, &mask[tested]);
+      for (int i = 0; i < width; ++i) {
+        if (!mask[i]) continue;
+        curr[i+1] = static_cast<unsigned char>(
+            min(255, cornerScore(ptr+i, offsets)));
+      }
+    }
+
+    // 上一行的得分已经完整，做3x3的非极大值抑制
+    const int yc = y - 1;
+    if (yc < y0 || yc < cell.y || yc >= cell.y+cell.height) continue;
+    const unsigned char* prev = &scores[((yc-y0)%3)*row_size];
+    const unsigned char* pprev = &scores[((yc-y0+2)%3)*row_size];
+    const unsigned char* occupancy_row = occupancy ?
+      occupancy + (yc-cell.y)*cell.width : NULL;
+
+    for (int x = cell_x0; x < cell_x1; ++x) {
+      const int i = x - x0 + 1;
+      const unsigned char score = prev[i];
+      if (!score) continue;
+      if (score <= prev[i-1] || score <= prev[i+1] ||
+          score <= pprev[i-1] || score <= pprev[i] || score <= pprev[i+1] ||
+          score <= curr[i-1] || score <= curr[i] || score <= curr[i+1])
+        continue;
+      if (occupancy_row && occupancy_row[x-cell.x]) continue;
+
+      // 只保留得分最高的max_num个角点
+      ++corner_num;
+      if (max_num <= 0) continue;
+      const Corner corner = {static_cast<float>(score), x, yc};
+      if (static_cast<int>(corners.size()) < max_num) {
+        corners.push_back(corner);
+        std::push_heap(corners.begin(), corners.end(), heap_compare);
+      } else if (isStrongerCorner(corner.score, corners.front().score)) {
+        std::pop_heap(corners.begin(), corners.end(), heap_compare);
+        corners.back() = corner;
+        std::push_heap(corners.begin(), corners.end(), heap_compare);
+      }
+    }
+  }
+
+  // The sorted min-heap is in descending order of the scores.
+  std::sort_heap(corners.begin(), corners.end(), heap_compare);
+  for (const auto& corner : corners) {
+    points.push_back(Point2f(corner.x, corner.y));
+    responses.push_back(corner.score);
+  }
+  return corner_num;
+}
+
+} // namespace msckf_vio
@@ -0,0 +1,91 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <algorithm>
+
+#include <msckf_vio/feature_budget_controller.h>
+
+using namespace std;
+
+namespace msckf_vio {
+
+FeatureBudgetController::FeatureBudgetController(
+    const Config& controller_config, const double& frame_rate,
+    const int& initial_fast_threshold,
+    const int& initial_grid_min_feature_num,
+    const int& initial_grid_max_feature_num):
+  config(controller_config),
+  average_feature_num(0.0),
+  average_time(0.0),
+  frame_cntr(0),
+  is_first_frame(true),
+  last_decision(KEEP) {
+  config.min_fast_threshold = max(1, config.min_fast_threshold);
+  config.max_fast_threshold = max(
+      config.min_fast_threshold, config.max_fast_threshold);
+  config.fast_threshold_step = max(1, config.fast_threshold_step);
+  config.min_cell_feature_num = max(1, config.min_cell_feature_num);
+  config.max_cell_feature_num = max(
+      config.min_cell_feature_num, config.max_cell_feature_num);
+  config.period = max(1, config.period);
+  budget_time = config.time_budget / frame_rate;
+
+  fast_threshold = min(max(initial_fast_threshold,
+        config.min_fast_threshold), config.max_fast_threshold);
+  grid_min_feature_num = min(max(initial_grid_min_feature_num,
+        config.min_cell_feature_num), config.max_cell_feature_num);
+  cell_margin = max(0,
+      initial_grid_max_feature_num-initial_grid_min_feature_num);
+  return;
+}
+
+bool FeatureBudgetController::update(
+    const int& feature_num, const double& processing_time) {
+  // 特征数和处理时间的指数滑动平均
+  if (is_first_frame) {
+    average_feature_num = feature_num;
+    average_time = processing_time;
+    is_first_frame = false;
+  } else {
+    average_feature_num = (1.0-config.smoothing)*average_feature_num +
+      config.smoothing*feature_num;
+    average_time = (1.0-config.smoothing)*average_time +
+      config.smoothing*processing_time;
+  }
+
+  if (++frame_cntr < config.period) return false;
+  frame_cntr = 0;
+
+  // 超出时间预算或特征过多时提高阈值并减少每格的特征数，
+  // 特征不足时降低阈值并增加每格的特征数
+  const double target = config.target_feature_num;
+  const int prev_fast_threshold = fast_threshold;
+  const int prev_grid_min_feature_num = grid_min_feature_num;
+  last_decision = KEEP;
+  if (average_time > budget_time ||
+      average_feature_num > (1.0+config.tolerance)*target) {
+    fast_threshold = min(config.max_fast_threshold,
+        fast_threshold+config.fast_threshold_step);
+    grid_min_feature_num = max(config.min_cell_feature_num,
+        grid_min_feature_num-1);
+    last_decision = FEWER;
+  } else if (average_feature_num < (1.0-config.tolerance)*target) {
+    fast_threshold = max(config.min_fast_threshold,
+        fast_threshold-config.fast_threshold_step);
+    grid_min_feature_num = min(config.max_cell_feature_num,
+        grid_min_feature_num+1);
+    last_decision = MORE;
+  }
+
+  // Nothing changes at the bounds.
+  if (fast_threshold == prev_fast_threshold &&
+      grid_min_feature_num == prev_grid_min_feature_num)
+    last_decision = KEEP;
+  return true;
+}
+
+} // namespace msckf_vio
@@ -0,0 +1,208 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <algorithm>
+
+#include <msckf_vio/simd.h>
+#include <msckf_vio/feature_predictor.h>
+
+using namespace std;
+using namespace cv;
+
+namespace msckf_vio {
+
+namespace {
+
+/**
+ * @brief 标量实现，逐点计算单应变换和平移项
+ */
+void warpScalar(const float* H, const float* b,
+    const float* xs, const float* ys, const float* rhos,
+    const int& n, float* out_xs, float* out_ys) {
+  for (int i = 0; i < n; ++i) {
+    const float rho = rhos ? rhos[i] : 0.0f;
+    const float u = H[0]*xs[i] + H[1]*ys[i] + H[2] + rho*b[0];
+    const float v = H[3]*xs[i] + H[4]*ys[i] + H[5] + rho*b[1];
+    const float w = H[6]*xs[i] + H[7]*ys[i] + H[8] + rho*b[2];
+    out_xs[i] = u / w;
+    out_ys[i] = v / w;
+  }
+  return;
+}
+
+#if defined(MSCKF_VIO_SIMD_AVX2)
+
+/**
+ * @brief AVX2实现，每次变换8个点，剩余的点用标量实现
+ */
+MSCKF_VIO_AVX2_TARGET
+void warpAvx2(const float* H, const float* b,
+    const float* xs, const float* ys, const float* rhos,
+    const int& n, float* out_xs, float* out_ys) {
+  __m256 h[9];
+  for (int k = 0; k < 9; ++k) h[k] = _mm256_set1_ps(H[k]);
+  const __m256 b0 = _mm256_set1_ps(b[0]);
+  const __m256 b1 = _mm256_set1_ps(b[1]);
+  const __m256 b2 = _mm256_set1_ps(b[2]);
+
+  int i = 0;
+  for (; i+8 <= n; i += 8) {
+    const __m256 x = _mm256_loadu_ps(xs+i);
+    const __m256 y = _mm256_loadu_ps(ys+i);
+    __m256 u = _mm256_fmadd_ps(h[0], x, _mm256_fmadd_ps(h[1], y, h[2]));
+    __m256 v = _mm256_fmadd_ps(h[3], x, _mm256_fmadd_ps(h[4], y, h[5]));
+    __m256 w = _mm256_fmadd_ps(h[6], x, _mm256_fmadd_ps(h[7], y, h[8]));
+    if (rhos) {
+      const __m256 rho = _mm256_loadu_ps(rhos+i);
+      u = _mm256_fmadd_ps(rho, b0, u);
+      v = _mm256_fmadd_ps(rho, b1, v);
+      w = _mm256_fmadd_ps(rho, b2, w);
+    }
+    _mm256_storeu_ps(out_xs+i, _mm256_div_ps(u, w));
+    _mm256_storeu_ps(out_ys+i, _mm256_div_ps(v, w));
+  }
+
+  warpScalar(H, b, xs+i, ys+i, rhos ? rhos+i : NULL,
+      n-i, out_xs+i, out_ys+i);
+  return;
+}
+
+FeaturePredictor::WarpKernel simdKernel() {
+  return warpAvx2;
+}
+
+#elif defined(MSCKF_VIO_SIMD_NEON)
+
+/**
+ * @brief NEON实现，每次变换4个点，剩余的点用标量实现
+ */
+inline float32x4_t divideNeon(const float32x4_t& a, const float32x4_t& b) {
+#if defined(__aarch64__)
+  return vdivq_f32(a, b);
+#else
+  // Two Newton-Raphson steps of the reciprocal.
+  float32x4_t r = vrecpeq_f32(b);
+  r = vmulq_f32(vrecpsq_f32(b, r), r);
+  r = vmulq_f32(vrecpsq_f32(b, r), r);
+  return vmulq_f32(a, r);
+#endif
+}
+
+void warpNeon(const float* H, const float* b,
+    const float* xs, const float* ys, const float* rhos,
+    const int& n, float* out_xs, float* out_ys) {
+  float32x4_t h[9];
+  for (int k = 0; k < 9; ++k) h[k] = vdupq_n_f32(H[k]);
+
+  int i = 0;
+  for (; i+4 <= n; i += 4) {
+    const float32x4_t x = vld1q_f32(xs+i);
+    const float32x4_t y = vld1q_f32(ys+i);
+    float32x4_t u = vmlaq_f32(vmlaq_f32(h[2], h[1], y), h[0], x);
+    float32x4_t v = vmlaq_f32(vmlaq_f32(h[5], h[4], y), h[3], x);
+    float32x4_t w = vmlaq_f32(vmlaq_f32(h[8], h[7], y), h[6], x);
+    if (rhos) {
+      const float32x4_t rho = vld1q_f32(rhos+i);
+      u = vmlaq_n_f32(u, rho, b[0]);
+      v = vmlaq_n_f32(v, rho, b[1]);
+      w = vmlaq_n_f32(w, rho, b[2]);
+    }
+    vst1q_f32(out_xs+i, divideNeon(u, w));
+    vst1q_f32(out_ys+i, divideNeon(v, w));
+  }
+
+  warpScalar(H, b, xs+i, ys+i, rhos ? rhos+i : NULL,
+      n-i, out_xs+i, out_ys+i);
+  return;
+}
+
+FeaturePredictor::WarpKernel simdKernel() {
+  return warpNeon;
+}
+
+#endif
+
+} // namespace
+
+FeaturePredictor::FeaturePredictor(const bool& use_simd):
+  kernel(warpScalar),
+  name("scalar") {
+#if defined(MSCKF_VIO_SIMD_AVX2) || defined(MSCKF_VIO_SIMD_NEON)
+  if (use_simd && simd::supported()) {
+    kernel = simdKernel();
+    name = simd::name();
+  }
+#endif
+  return;
+}
+
+/**
+ * @brief 批量预测上一帧的点在当前帧中的位置
+ *
+ * 点的坐标先拆分为x和y两个数组，变换后再合并
+ */
+void FeaturePredictor::predict(const vector<Point2f>& points,
+    const vector<float>& inverse_depths,
+    const Matx33f& R_p_c, const Vec3f& t_p_c,
+    const Vec4d& intrinsics,
+    vector<Point2f>& predicted_points) {
+  const int n = points.size();
+  predicted_points.resize(n);
+  if (n == 0) return;
+
+  // 相机内参矩阵K
+  const Matx33f K(
+      intrinsics[0], 0.0, intrinsics[2],
+      0.0, intrinsics[1], intrinsics[3],
+      0.0, 0.0, 1.0);
+
+  // x_c ~ K * (R_p_c * X_p + t_p_c)
+  //     ~ K * R_p_c * K^inv * x_p + rho * K * t_p_c
+  const Matx33f H = K * R_p_c * K.inv();
+  const Vec3f b = K * t_p_c;
+
+  xs.resize(n);
+  ys.resize(n);
+  out_xs.resize(n);
+  out_ys.resize(n);
+  for (int i = 0; i < n; ++i) {
+    xs[i] = points[i].x;
+    ys[i] = points[i].y;
+  }
+
+  const float* rhos = inverse_depths.size() == n ?
+    &inverse_depths[0] : NULL;
+  kernel(H.val, b.val, &xs[0], &ys[0], rhos, n, &out_xs[0], &out_ys[0]);
+
+  for (int i = 0; i < n; ++i)
+    predicted_points[i] = Point2f(out_xs[i], out_ys[i]);
+  return;
+}
+
+/**
+ * @brief 由双目归一化坐标三角化特征点的逆深度
+ *
+ * d * R * f0 + t 投影到cam1的归一化坐标f1，两个方程的最小二乘解
+ */
+float FeaturePredictor::stereoInverseDepth(const Point2f& cam0_point,
+    const Point2f& cam1_point, const Matx33f& R_cam0_cam1,
+    const Vec3f& t_cam0_cam1) {
+  const Vec3f a = R_cam0_cam1 * Vec3f(cam0_point.x, cam0_point.y, 1.0f);
+  const float a0 = a[0] - cam1_point.x*a[2];
+  const float a1 = a[1] - cam1_point.y*a[2];
+  const float b0 = cam1_point.x*t_cam0_cam1[2] - t_cam0_cam1[0];
+  const float b1 = cam1_point.y*t_cam0_cam1[2] - t_cam0_cam1[1];
+
+  // The depth is (a.b)/(a.a), which is negative behind the
+  // cameras and infinite without a parallax.
+  const float ab = a0*b0 + a1*b1;
+  const float aa = a0*a0 + a1*a1;
+  if (ab <= 0.0f) return 0.0f;
+  return aa / ab;
+}
+
+} // namespace msckf_vio
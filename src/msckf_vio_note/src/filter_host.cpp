@@ -0,0 +1,93 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <msckf_vio/filter_host.h>
+
+using namespace std;
+
+namespace msckf_vio {
+
+FilterHost::FilterHost(const int& thread_num, const int& chunk_size):
+  frame_chunk_size(max(1, chunk_size)),
+  thread_pool(thread_num) {
+  return;
+}
+
+int FilterHost::addFilter(const MsckfVio::Config& config) {
+  unique_ptr<Instance> instance(new Instance);
+  instance->filter.reset(new MsckfVio());
+  instance->filter->initialize(config);
+  instance->next_input = 0;
+  instances.push_back(move(instance));
+  return instances.size() - 1;
+}
+
+void FilterHost::pushImu(const int& filter_id,
+    const sensor_msgs::ImuConstPtr& msg) {
+  Input input;
+  input.imu = msg;
+  instances[filter_id]->inputs.push_back(input);
+  return;
+}
+
+void FilterHost::pushFeatures(const int& filter_id,
+    const CameraMeasurementConstPtr& msg) {
+  Input input;
+  input.features = msg;
+  instances[filter_id]->inputs.push_back(input);
+  return;
+}
+
+void FilterHost::run() {
+  for (int i = 0; i < static_cast<int>(instances.size()); ++i)
+    thread_pool.submit([this, i]() { processChunk(i); });
+  thread_pool.wait();
+
+  // 所有输入都已处理，清空队列
+  for (auto& instance : instances) {
+    instance->inputs.clear();
+    instance->next_input = 0;
+  }
+  return;
+}
+
+void FilterHost::processChunk(const int& filter_id) {
+  Instance& instance = *instances[filter_id];
+  MsckfVio& filter = *instance.filter;
+
+  int frame_cntr = 0;
+  while (instance.next_input < static_cast<int>(instance.inputs.size()) &&
+      frame_cntr < frame_chunk_size) {
+    const Input& input = instance.inputs[instance.next_input++];
+    if (input.imu) {
+      filter.processImu(input.imu);
+      continue;
+    }
+
+    filter.processFeatures(input.features);
+    ++frame_cntr;
+
+    // Frames received before the filter is initialized
+    // are dropped by the filter.
+    if (!filter.isRunning()) continue;
+    const IMUState& imu_state = filter.getImuState();
+    Pose pose;
+    pose.time = imu_state.time;
+    pose.orientation = imu_state.orientation;
+    pose.position = imu_state.position;
+    pose.velocity = imu_state.velocity;
+    instance.trajectory.push_back(pose);
+  }
+
+  // Continue with the same instance on this worker. The
+  // other workers may steal it if they run out of work.
+  if (instance.next_input < static_cast<int>(instance.inputs.size()))
+    thread_pool.submit([this, filter_id]() { processChunk(filter_id); });
+  return;
+}
+
+} // namespace msckf_vio
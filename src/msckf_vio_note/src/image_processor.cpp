@@ -9,14 +9,19 @@
 #include <algorithm>
 #include <set>
 #include <eigen3/Eigen/Dense>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
 
 #include <sensor_msgs/image_encodings.h>
-#include <random_numbers/random_numbers.h>
 
 #include <msckf_vio/CameraMeasurement.h>
 #include <msckf_vio/TrackingInfo.h>
 #include <msckf_vio/image_processor.h>
 #include <msckf_vio/utils.h>
+#include <msckf_vio/trace.h>
 
 using namespace std;
 using namespace cv;
@@ -26,15 +31,42 @@ namespace msckf_vio {
 ImageProcessor::ImageProcessor(ros::NodeHandle& n) :
   nh(n),
   is_first_img(true),
+  has_received_img(false),
+  use_feature_budget(false),
+  frame_rate(20.0),
   //img_transport(n),
   stereo_sub(10),
-  prev_features_ptr(new GridFeatures()),
-  curr_features_ptr(new GridFeatures()) {
+  pyramid_worker(new ThreadPool(1)),
+  cam0_velocity_valid(false),
+  cam0_velocity(0.0, 0.0, 0.0),
+  use_pipeline(true),
+  pipeline_queue_size(2),
+  dropped_debug_frames(0),
+  use_backpressure(true),
+  max_frames_in_flight(2),
+  backpressure_timeout(0.5),
+  filter_latency(0.0),
+  skipped_frames(0),
+  enable_tracing(false) {
   return;
 }
 
 ImageProcessor::~ImageProcessor() {
+  // Finish the queued frames and stop the pipeline.
+  if (tracking_thread.joinable()) {
+    frame_queue->close();
+    tracking_thread.join();
+    publishing_thread.join();
+  }
+  if (debug_thread.joinable()) {
+    debug_queue->close();
+    debug_thread.join();
+    ROS_INFO("Dropped %lu debug frames",
+        dropped_debug_frames.load());
+  }
   destroyAllWindows();
+  if (enable_tracing && !trace::write(trace_file))
+    ROS_WARN("Failed to write the trace to %s", trace_file.c_str());
   //ROS_INFO("Feature lifetime statistics:");
   //featureLifetimeStatistics();
   return;
@@ -130,6 +162,114 @@ bool ImageProcessor::loadParameters() {
       processor_config.ransac_threshold, 3);
   nh.param<double>("stereo_threshold",
       processor_config.stereo_threshold, 3);
+  nh.param<bool>("klt/enable",
+      processor_config.use_klt_tracker, true);
+  nh.param<double>("klt/max_residual",
+      processor_config.max_track_residual, 0.0);
+  nh.param<int>("ransac/max_iteration",
+      processor_config.ransac_max_iteration, 30);
+  nh.param<bool>("ransac/prosac",
+      processor_config.use_prosac, false);
+  nh.param<int>("ransac/seed",
+      processor_config.ransac_seed, 0);
+  nh.param<bool>("undistortion/lut",
+      processor_config.use_undistortion_table, true);
+  nh.param<bool>("undistortion/refine",
+      processor_config.refine_undistortion, false);
+  nh.param<double>("undistortion/grid_step",
+      processor_config.undistortion_grid_step, 1.0);
+  nh.param<double>("undistortion/max_error",
+      processor_config.max_undistortion_error, 0.05);
+  nh.param<bool>("stereo/rectified",
+      processor_config.use_rectified_stereo, false);
+  nh.param<int>("stereo/max_disparity",
+      processor_config.stereo_max_disparity, 64);
+  nh.param<int>("stereo/patch_size",
+      processor_config.stereo_patch_size, 9);
+  nh.param<double>("stereo/min_zncc",
+      processor_config.stereo_min_zncc, 0.8);
+
+  // Reduced resolution of the tracking, at most the coarsest
+  // level of the pyramids.
+  nh.param<int>("cam0/processing_level",
+      processor_config.cam0_level, 0);
+  nh.param<int>("cam1/processing_level",
+      processor_config.cam1_level, 0);
+  nh.param<int>("refine_patch_size",
+      processor_config.refine_patch_size, 9);
+  processor_config.cam0_level = min(max(0, processor_config.cam0_level),
+      processor_config.pyramid_levels);
+  processor_config.cam1_level = min(max(0, processor_config.cam1_level),
+      processor_config.pyramid_levels);
+  processor_config.refine_patch_size = min(max(
+        3, processor_config.refine_patch_size), processor_config.patch_size);
+
+  // Prediction of the temporal tracking. The temporal tracker
+  // uses the levels and iterations of the stereo one unless
+  // they are given, and at most the levels of the pyramids.
+  nh.param<bool>("prediction/preintegrate",
+      processor_config.preintegrate_rotation, true);
+  nh.param<bool>("prediction/translation",
+      processor_config.predict_translation, false);
+  nh.param<double>("prediction/max_depth",
+      processor_config.max_prediction_depth, 10.0);
+  nh.param<int>("klt/temporal_pyramid_levels",
+      processor_config.temporal_pyramid_levels, -1);
+  nh.param<int>("klt/temporal_max_iteration",
+      processor_config.temporal_max_iteration, -1);
+  if (processor_config.temporal_pyramid_levels < 0)
+    processor_config.temporal_pyramid_levels =
+      processor_config.pyramid_levels;
+  processor_config.temporal_pyramid_levels = min(
+      processor_config.temporal_pyramid_levels,
+      processor_config.pyramid_levels);
+  if (processor_config.temporal_max_iteration <= 0)
+    processor_config.temporal_max_iteration =
+      processor_config.max_iteration;
+
+  // Pipeline of the front end
+  nh.param<bool>("pipeline/enable", use_pipeline, true);
+  nh.param<int>("pipeline/queue_size", pipeline_queue_size, 2);
+  pipeline_queue_size = max(1, pipeline_queue_size);
+
+  // Backpressure of the filter
+  nh.param<bool>("backpressure/enable", use_backpressure, true);
+  nh.param<int>("backpressure/max_frames_in_flight",
+      max_frames_in_flight, 2);
+  max_frames_in_flight = max(1, max_frames_in_flight);
+  nh.param<double>("backpressure/timeout", backpressure_timeout, 0.5);
+
+  // Feature budget of the front end. The default target is
+  // the middle of the per-cell feature numbers.
+  FeatureBudgetController::Config& budget = feature_budget_config;
+  nh.param<bool>("feature_budget/enable", use_feature_budget, false);
+  nh.param<double>("feature_budget/frame_rate", frame_rate, 20.0);
+  nh.param<int>("feature_budget/target_feature_num",
+      budget.target_feature_num, 0);
+  if (budget.target_feature_num <= 0)
+    budget.target_feature_num =
+      processor_config.grid_row*processor_config.grid_col*(
+          processor_config.grid_min_feature_num+
+          processor_config.grid_max_feature_num) / 2;
+  nh.param<double>("feature_budget/tolerance", budget.tolerance, 0.1);
+  nh.param<double>("feature_budget/time_budget", budget.time_budget, 0.5);
+  nh.param<int>("feature_budget/min_fast_threshold",
+      budget.min_fast_threshold, 5);
+  nh.param<int>("feature_budget/max_fast_threshold",
+      budget.max_fast_threshold, 40);
+  nh.param<int>("feature_budget/fast_threshold_step",
+      budget.fast_threshold_step, 2);
+  nh.param<int>("feature_budget/min_cell_feature_num",
+      budget.min_cell_feature_num, 1);
+  nh.param<int>("feature_budget/max_cell_feature_num",
+      budget.max_cell_feature_num, 8);
+  nh.param<int>("feature_budget/period", budget.period, 5);
+  nh.param<double>("feature_budget/smoothing", budget.smoothing, 0.2);
+
+  // Trace-event export for timeline debugging.
+  nh.param<bool>("trace/enable", enable_tracing, false);
+  nh.param<string>("trace/output_file", trace_file,
+      string("/tmp/image_processor_trace.json"));
 
   ROS_INFO("===========================================");
   ROS_INFO("cam0_resolution: %d, %d",
@@ -179,6 +319,40 @@ bool ImageProcessor::loadParameters() {
       processor_config.ransac_threshold);
   ROS_INFO("stereo_threshold: %f",
       processor_config.stereo_threshold);
+  ROS_INFO("klt tracker: %d (max residual %f)",
+      processor_config.use_klt_tracker,
+      processor_config.max_track_residual);
+  ROS_INFO("ransac: max iteration %d, prosac %d, seed %d",
+      processor_config.ransac_max_iteration,
+      processor_config.use_prosac, processor_config.ransac_seed);
+  ROS_INFO("undistortion table: %d (grid step %f, refine %d, "
+      "max error %f)", processor_config.use_undistortion_table,
+      processor_config.undistortion_grid_step,
+      processor_config.refine_undistortion,
+      processor_config.max_undistortion_error);
+  ROS_INFO("rectified stereo: %d (max disparity %d, patch size %d, "
+      "min zncc %f)", processor_config.use_rectified_stereo,
+      processor_config.stereo_max_disparity,
+      processor_config.stereo_patch_size,
+      processor_config.stereo_min_zncc);
+  ROS_INFO("processing level: cam0 %d, cam1 %d (refine patch size %d)",
+      processor_config.cam0_level, processor_config.cam1_level,
+      processor_config.refine_patch_size);
+  ROS_INFO("prediction: preintegrate %d, translation %d (max depth %f)",
+      processor_config.preintegrate_rotation,
+      processor_config.predict_translation,
+      processor_config.max_prediction_depth);
+  ROS_INFO("temporal tracking: pyramid_levels %d, max_iteration %d",
+      processor_config.temporal_pyramid_levels,
+      processor_config.temporal_max_iteration);
+  ROS_INFO("pipeline: %d (queue size %d)",
+      use_pipeline, pipeline_queue_size);
+  ROS_INFO("backpressure: %d (max frames in flight %d, timeout %f)",
+      use_backpressure, max_frames_in_flight, backpressure_timeout);
+  ROS_INFO("feature budget: %d (target %d features, time budget %f "
+      "at %f Hz)", use_feature_budget, budget.target_feature_num,
+      budget.time_budget, frame_rate);
+  ROS_INFO("trace: %d (%s)", enable_tracing, trace_file.c_str());
   ROS_INFO("===========================================");
   return true;
 }
@@ -193,9 +367,157 @@ bool ImageProcessor::loadParameters() {
       if (!loadParameters()) return false;
       ROS_INFO("Finish loading ROS parameters...");
 
-      // Create feature detector.
-      detector_ptr = FastFeatureDetector::create(
-              processor_config.fast_threshold);
+      // Initialize the thresholds of the feature detector.
+      grid_fast_thresholds.assign(
+          processor_config.grid_row*processor_config.grid_col,
+          processor_config.fast_threshold);
+
+      // The feature budget starts from the loaded detector
+      // threshold and feature numbers.
+      if (use_feature_budget) {
+        feature_budget_controller.reset(new FeatureBudgetController(
+              feature_budget_config, frame_rate,
+              processor_config.fast_threshold,
+              processor_config.grid_min_feature_num,
+              processor_config.grid_max_feature_num));
+        processor_config.fast_threshold =
+          feature_budget_controller->fastThreshold();
+        processor_config.grid_min_feature_num =
+          feature_budget_controller->gridMinFeatureNum();
+        processor_config.grid_max_feature_num =
+          feature_budget_controller->gridMaxFeatureNum();
+      }
+
+      // Create the feature tables. At most grid_max_feature_num
+      // features of a cell are tracked, and grid_min_feature_num
+      // new features are added to a cell. With the feature budget
+      // the tables are reserved for the largest numbers.
+      const int cell_num =
+        processor_config.grid_row*processor_config.grid_col;
+      int feature_capacity = cell_num*(
+          processor_config.grid_max_feature_num+
+          processor_config.grid_min_feature_num);
+      if (feature_budget_controller)
+        feature_capacity = max(feature_capacity, cell_num*(
+              2*feature_budget_config.max_cell_feature_num+
+              processor_config.grid_max_feature_num-
+              processor_config.grid_min_feature_num));
+      prev_features_ptr.reset(new GridFeatures(cell_num, feature_capacity));
+      curr_features_ptr.reset(new GridFeatures(cell_num, feature_capacity));
+
+      // Create the KLT tracker, which tracks the points of
+      // a grid cell as a batch.
+      KltTracker::Config klt_config;
+      klt_config.patch_size = processor_config.patch_size;
+      klt_config.pyramid_levels = processor_config.pyramid_levels;
+      klt_config.max_iteration = processor_config.max_iteration;
+      klt_config.track_precision = processor_config.track_precision;
+      klt_config.cell_width =
+        cam0_resolution[0] / processor_config.grid_col;
+      klt_config.cell_height =
+        cam0_resolution[1] / processor_config.grid_row;
+      klt_tracker.reset(new KltTracker(klt_config));
+
+      KltTracker::Config refine_config = klt_config;
+      refine_config.patch_size = processor_config.refine_patch_size;
+      refine_config.pyramid_levels = 0;
+      refine_klt_tracker.reset(new KltTracker(refine_config));
+
+      KltTracker::Config temporal_config = klt_config;
+      temporal_config.pyramid_levels =
+        processor_config.temporal_pyramid_levels;
+      temporal_config.max_iteration =
+        processor_config.temporal_max_iteration;
+      temporal_klt_tracker.reset(new KltTracker(temporal_config));
+
+      feature_predictor.reset(new FeaturePredictor());
+      ROS_INFO("Feature predictor kernels: %s",
+          feature_predictor->simdName());
+
+      fast_detector.reset(new FastDetector());
+      ROS_INFO("FAST detector kernels: %s", fast_detector->simdName());
+      if (processor_config.use_klt_tracker)
+        ROS_INFO("KLT tracker kernels: %s", klt_tracker->simdName());
+
+      TwoPointRansac::Config ransac_config;
+      ransac_config.max_iteration = processor_config.ransac_max_iteration;
+      ransac_config.use_prosac = processor_config.use_prosac;
+      ransac_config.seed = processor_config.ransac_seed;
+      ransac.reset(new TwoPointRansac(ransac_config));
+      ROS_INFO("RANSAC kernels: %s", ransac->simdName());
+
+      // Create the undistortion tables of the cameras.
+      PointUndistorter::Config undistorter_config;
+      undistorter_config.use_table =
+        processor_config.use_undistortion_table;
+      undistorter_config.refine = processor_config.refine_undistortion;
+      undistorter_config.grid_step =
+        processor_config.undistortion_grid_step;
+      undistorter_config.max_error =
+        processor_config.max_undistortion_error;
+      if (cam0_distortion_model != "radtan" &&
+          cam0_distortion_model != "equidistant")
+        ROS_WARN("The model %s is unrecognized, use radtan instead...",
+            cam0_distortion_model.c_str());
+      if (cam1_distortion_model != "radtan" &&
+          cam1_distortion_model != "equidistant")
+        ROS_WARN("The model %s is unrecognized, use radtan instead...",
+            cam1_distortion_model.c_str());
+      cam0_undistorter.reset(new PointUndistorter(cam0_resolution,
+            cam0_intrinsics, cam0_distortion_model,
+            cam0_distortion_coeffs, undistorter_config));
+      cam1_undistorter.reset(new PointUndistorter(cam1_resolution,
+            cam1_intrinsics, cam1_distortion_model,
+            cam1_distortion_coeffs, undistorter_config));
+      ROS_INFO("Undistortion table errors: cam0 %f px, cam1 %f px",
+          cam0_undistorter->getMaxError(),
+          cam1_undistorter->getMaxError());
+
+      // Precompute the rectification maps of the stereo matching.
+      if (processor_config.use_rectified_stereo) {
+        RectifiedStereoMatcher::Config matcher_config;
+        matcher_config.max_disparity =
+          processor_config.stereo_max_disparity;
+        matcher_config.patch_size =
+          processor_config.stereo_patch_size | 1;
+        matcher_config.min_zncc = processor_config.stereo_min_zncc;
+        stereo_matcher.reset(new RectifiedStereoMatcher(
+              *cam0_undistorter, *cam1_undistorter, cam0_resolution,
+              R_cam1_imu.t() * R_cam0_imu,
+              R_cam1_imu.t() * (t_cam0_imu-t_cam1_imu),
+              matcher_config));
+        ROS_INFO("Rectified focal length: %f",
+            stereo_matcher->getFocalLength());
+      }
+
+      if (enable_tracing) {
+#ifndef MSCKF_VIO_ENABLE_TRACING
+        ROS_WARN("Tracing is requested but not compiled in...");
+#endif
+        trace::enable();
+      }
+
+      // Frames and outputs which have been processed are
+      // recycled, so at most two of them per queue and the
+      // ones being processed are kept.
+      frame_queue.reset(new BoundedQueue<boost::shared_ptr<FrameData> >(
+            pipeline_queue_size));
+      free_frame_queue.reset(new BoundedQueue<boost::shared_ptr<FrameData> >(
+            2*pipeline_queue_size+2));
+      output_queue.reset(new BoundedQueue<boost::shared_ptr<OutputData> >(
+            pipeline_queue_size));
+      free_output_queue.reset(
+          new BoundedQueue<boost::shared_ptr<OutputData> >(
+            2*pipeline_queue_size+2));
+      if (use_pipeline) {
+        tracking_thread = std::thread(&ImageProcessor::trackingLoop, this);
+        publishing_thread = std::thread(&ImageProcessor::publishingLoop, this);
+      }
+
+      // The debug thread runs with or without the pipeline.
+      debug_queue.reset(new BoundedQueue<boost::shared_ptr<DebugData> >(1));
+      free_debug_queue.reset(new BoundedQueue<boost::shared_ptr<DebugData> >(3));
+      debug_thread = std::thread(&ImageProcessor::debugLoop, this);
 
       if (!createRosIO()) return false;
       ROS_INFO("Finish creating ROS IO...");
@@ -223,100 +545,213 @@ bool ImageProcessor::createRosIO() {
   stereo_sub.registerCallback(&ImageProcessor::stereoCallback, this);
   imu_sub = nh.subscribe("imu", 50,
       &ImageProcessor::imuCallback, this);
+  filter_status_sub = nh.subscribe("filter_status", 10,
+      &ImageProcessor::filterStatusCallback, this);
 
   return true;
 }
 
 /**
- * @brief 将imu的消息类型保存在缓冲中
+ * @brief 双目图像的回调函数，流水线的第一级
  *
+ * 构建图像金字塔，然后交给跟踪线程，
+ * 这样当前帧的准备与上一帧的跟踪同时进行
  */
 void ImageProcessor::stereoCallback(
     const sensor_msgs::ImageConstPtr& cam0_img,
     const sensor_msgs::ImageConstPtr& cam1_img) {
+  MSCKF_VIO_TRACE_FRAME(cam0_img->header.stamp.toNSec());
+  MSCKF_VIO_TRACE_SCOPE("ImageProcessor::stereoCallback");
 
   cout << "==================================" << endl;
         cout << "get image here" << endl;
 
+  // Reuse the pyramid buffers of a processed frame.
+  boost::shared_ptr<FrameData> frame;
+  if (!free_frame_queue->tryPop(frame)) frame.reset(new FrameData());
+
   // Get the current image.
   // 两个图像消息类型指针
-  cam0_curr_img_ptr = cv_bridge::toCvShare(cam0_img,
+  frame->cam0_img_ptr = cv_bridge::toCvShare(cam0_img,
       sensor_msgs::image_encodings::MONO8);
-  cam1_curr_img_ptr = cv_bridge::toCvShare(cam1_img,
+  frame->cam1_img_ptr = cv_bridge::toCvShare(cam1_img,
       sensor_msgs::image_encodings::MONO8);
+  has_received_img = true;
+
+  // Build the image pyramids once since they're used at multiple
+  // places.
+  prepareFrame(*frame);
+
+  // The queue blocks while the tracking stage is behind.
+  if (use_pipeline)
+    frame_queue->push(frame);
+  else
+    processFrame(frame);
+
+  return;
+}
 
-  // Build the image pyramids once since they're used at multiple places
-  createImagePyramids();
+/**
+ * @brief 流水线的第二级，在跟踪线程上按顺序处理每一帧
+ *
+ * 跟踪上一帧的特征，双目匹配，添加新特征并分配id
+ */
+void ImageProcessor::processFrame(boost::shared_ptr<FrameData> frame) {
+  MSCKF_VIO_TRACE_FRAME(frame->cam0_img_ptr->header.stamp.toNSec());
+  MSCKF_VIO_TRACE_SCOPE("ImageProcessor::processFrame");
+  const ros::WallTime start_time = ros::WallTime::now();
+
+  // Move the frame into the current images and pyramids. The
+  // frame takes the replaced pyramid buffers for reuse.
+  cam0_curr_img_ptr = frame->cam0_img_ptr;
+  cam1_curr_img_ptr = frame->cam1_img_ptr;
+  std::swap(curr_cam0_pyramid_, frame->cam0_pyramid);
+  std::swap(curr_cam1_pyramid_, frame->cam1_pyramid);
 
   // Detect features in the first frame.
   if (is_first_img) {
     // 第一帧图像用于初始化：提取匹配的特征点
-    ros::Time start_time = ros::Time::now();
     initializeFirstFrame();
       std::cout << "detect first image" << std::endl;
-    //ROS_INFO("Detection time: %f",
-    //    (ros::Time::now()-start_time).toSec());
     is_first_img = false;
-
-    // Draw results.
-    // 将提取到的关键点和图像发布，用于rviz的显示
-    start_time = ros::Time::now();
-    drawFeaturesStereo();
-    //ROS_INFO("Draw features: %f",
-    //    (ros::Time::now()-start_time).toSec());
+    before_tracking = after_tracking = after_matching = after_ransac = 0;
   }
   else {
     // Track the feature in the previous image.
       // 非第一帧关键帧，需要
-    ros::Time start_time = ros::Time::now();
     trackFeatures();
-    //ROS_INFO("Tracking time: %f",
-    //    (ros::Time::now()-start_time).toSec());
 
     // Add new features into the current image.
-    start_time = ros::Time::now();
     addNewFeatures();
-    //ROS_INFO("Addition time: %f",
-    //    (ros::Time::now()-start_time).toSec());
 
     // Add new features into the current image.
-    start_time = ros::Time::now();
     pruneGridFeatures();
-    //ROS_INFO("Prune grid features: %f",
-    //    (ros::Time::now()-start_time).toSec());
-
-    // Draw results.
-    start_time = ros::Time::now();
-    drawFeaturesStereo();
-    //ROS_INFO("Draw features: %f",
-    //    (ros::Time::now()-start_time).toSec());
   }
+  const double frontend_time = (ros::WallTime::now()-start_time).toSec();
 
-  //ros::Time start_time = ros::Time::now();
   //updateFeatureLifetime();
-  //ROS_INFO("Statistics: %f",
-  //    (ros::Time::now()-start_time).toSec());
 
   // Publish features in the current image.
-  ros::Time start_time = ros::Time::now();
-  publish();
-  //ROS_INFO("Publishing: %f",
-  //    (ros::Time::now()-start_time).toSec());
+  // 特征表复制后交给发布线程，跟踪线程继续重用自己的特征表
+  boost::shared_ptr<OutputData> output;
+  if (!free_output_queue->tryPop(output)) output.reset(new OutputData());
+  output->cam0_img_ptr = cam0_curr_img_ptr;
+  output->cam1_img_ptr = cam1_curr_img_ptr;
+  output->prev_features = *prev_features_ptr;
+  output->curr_features = *curr_features_ptr;
+  output->before_tracking = before_tracking;
+  output->after_tracking = after_tracking;
+  output->after_matching = after_matching;
+  output->after_ransac = after_ransac;
+  output->after_detection = curr_features_ptr->size();
+  output->frontend_time = frontend_time;
+  output->fast_threshold = processor_config.fast_threshold;
+  output->grid_min_feature_num = processor_config.grid_min_feature_num;
+  output->grid_max_feature_num = processor_config.grid_max_feature_num;
+  if (use_pipeline) {
+    output_queue->push(output);
+  } else {
+    publishOutput(*output);
+    output->cam0_img_ptr.reset();
+    output->cam1_img_ptr.reset();
+    free_output_queue->tryPush(output);
+  }
+
+  updateFeatureBudget(frontend_time);
 
   // Update the previous image and previous features.
   // 下一时刻的上一时刻相关信息即为当前时刻的信息
   cam0_prev_img_ptr = cam0_curr_img_ptr;
-  prev_features_ptr = curr_features_ptr;
+  std::swap(prev_features_ptr, curr_features_ptr);
   std::swap(prev_cam0_pyramid_, curr_cam0_pyramid_);
 
-  // Initialize the current features to empty vectors.
-  // 将当前时刻的特征点向量中的信息清零
-  curr_features_ptr.reset(new GridFeatures());
-  for (int code = 0; code <
-      processor_config.grid_row*processor_config.grid_col; ++code) {
-    (*curr_features_ptr)[code] = vector<FeatureMetaData>(0);
+  // Clear the current features for reuse.
+  // 将当前时刻的特征表清空，保留其缓冲区
+  curr_features_ptr->clear();
+
+  // Recycle the frame.
+  frame->cam0_img_ptr.reset();
+  frame->cam1_img_ptr.reset();
+  free_frame_queue->tryPush(frame);
+  return;
+}
+
+/**
+ * @brief 流水线的第三级，发布特征，有订阅时将调试图像交给调试线程
+ */
+void ImageProcessor::publishOutput(const OutputData& output) {
+  MSCKF_VIO_TRACE_FRAME(output.cam0_img_ptr->header.stamp.toNSec());
+  MSCKF_VIO_TRACE_SCOPE("ImageProcessor::publishOutput");
+  publish(output);
+  if (debug_stereo_pub.getNumSubscribers() > 0)
+    queueDebugFrame(output);
+  return;
+}
+
+/**
+ * @brief 复制调试图像所需的特征，交给调试线程
+ *
+ * 调试线程只保留最新的一帧，来不及画的帧被丢弃
+ */
+void ImageProcessor::queueDebugFrame(const OutputData& output) {
+  MSCKF_VIO_TRACE_SCOPE("ImageProcessor::queueDebugFrame");
+
+  boost::shared_ptr<DebugData> debug;
+  if (!free_debug_queue->tryPop(debug)) debug.reset(new DebugData());
+  debug->cam0_img_ptr = output.cam0_img_ptr;
+  debug->cam1_img_ptr = output.cam1_img_ptr;
+  debug->prev_ids = output.prev_features.getIds();
+  debug->prev_cam0_points = output.prev_features.getCam0Points();
+  debug->prev_cam1_points = output.prev_features.getCam1Points();
+  debug->curr_ids = output.curr_features.getIds();
+  debug->curr_cam0_points = output.curr_features.getCam0Points();
+  debug->curr_cam1_points = output.curr_features.getCam1Points();
+
+  // Replace the frame which has not been drawn yet.
+  boost::shared_ptr<DebugData> stale;
+  if (debug_queue->tryPop(stale)) {
+    ++dropped_debug_frames;
+    stale->cam0_img_ptr.reset();
+    stale->cam1_img_ptr.reset();
+    free_debug_queue->tryPush(stale);
   }
+  if (!debug_queue->tryPush(debug)) ++dropped_debug_frames;
+  return;
+}
 
+void ImageProcessor::trackingLoop() {
+  boost::shared_ptr<FrameData> frame;
+  while (frame_queue->pop(frame)) processFrame(frame);
+
+  // The publishing stage finishes the remaining outputs.
+  output_queue->close();
+  return;
+}
+
+void ImageProcessor::publishingLoop() {
+  boost::shared_ptr<OutputData> output;
+  while (output_queue->pop(output)) {
+    publishOutput(*output);
+    output->cam0_img_ptr.reset();
+    output->cam1_img_ptr.reset();
+    free_output_queue->tryPush(output);
+  }
+  return;
+}
+
+void ImageProcessor::debugLoop() {
+#ifdef __linux__
+  // The niceness is per thread on Linux.
+  setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+#endif
+
+  boost::shared_ptr<DebugData> debug;
+  while (debug_queue->pop(debug)) {
+    drawFeaturesStereo(*debug);
+    debug->cam0_img_ptr.reset();
+    debug->cam1_img_ptr.reset();
+    free_debug_queue->tryPush(debug);
+  }
   return;
 }
 
@@ -326,36 +761,85 @@ void ImageProcessor::stereoCallback(
  */
 void ImageProcessor::imuCallback(
     const sensor_msgs::ImuConstPtr& msg) {
+  MSCKF_VIO_TRACE_SCOPE("ImageProcessor::imuCallback");
   // Wait for the first image to be set.
   // 第一帧图像设置后再对imu做保存
-  if (is_first_img) return;
+  if (!has_received_img) return;
   // 保存imu的消息类型
+  lock_guard<mutex> lock(imu_mutex);
   imu_msg_buffer.push_back(*msg);
   return;
 }
 
 /**
- * @brief 创建图像金字塔
+ * @brief 滤波器处理完一帧后的确认，移除该帧及之前的在途帧
+ */
+void ImageProcessor::filterStatusCallback(
+    const FilterStatusConstPtr& msg) {
+  lock_guard<mutex> lock(filter_status_mutex);
+  // The frames before the acknowledged one are dropped by
+  // the filter, e.g. on its reset.
+  while (!frames_in_flight.empty() &&
+      frames_in_flight.front() <= msg->header.stamp)
+    frames_in_flight.pop_front();
+  filter_latency = msg->latency;
+  return;
+}
+
+bool ImageProcessor::isFilterReady(const ros::Time& time) {
+  lock_guard<mutex> lock(filter_status_mutex);
+  if (!use_backpressure || filter_status_sub.getNumPublishers() == 0) {
+    frames_in_flight.clear();
+    return true;
+  }
+
+  while (!frames_in_flight.empty() &&
+      (time-frames_in_flight.front()).toSec() > backpressure_timeout)
+    frames_in_flight.pop_front();
+  if (frames_in_flight.size() >= max_frames_in_flight) return false;
+  frames_in_flight.push_back(time);
+  return true;
+}
+
+/**
+ * @brief 构建图像金字塔
  *
- * 调用了OpenCV的函数buildOpticalFlowPyramid构建图像金字塔
+ * 调用了OpenCV的函数buildOpticalFlowPyramid构建图像金字塔，
+ * 两个相机的金字塔互不依赖，cam1在工作线程上构建，cam0在当前线程上构建
  */
-void ImageProcessor::createImagePyramids() {
-  const Mat& curr_cam0_img = cam0_curr_img_ptr->image;
+void ImageProcessor::prepareFrame(FrameData& frame) {
+  MSCKF_VIO_TRACE_SCOPE("ImageProcessor::prepareFrame");
+
+  // The rectified stereo matching reads the raw cam1 image.
+  const Mat& curr_cam1_img = frame.cam1_img_ptr->image;
+  vector<Mat>& cam1_pyramid = frame.cam1_pyramid;
+  if (!processor_config.use_rectified_stereo) {
+    pyramid_worker->submit([this, &curr_cam1_img, &cam1_pyramid]() {
+        MSCKF_VIO_TRACE_SCOPE("ImageProcessor::createCam1Pyramid");
+        buildPyramid(curr_cam1_img, cam1_pyramid);
+      });
+  }
+
+  {
+    MSCKF_VIO_TRACE_SCOPE("ImageProcessor::createCam0Pyramid");
+    buildPyramid(frame.cam0_img_ptr->image, frame.cam0_pyramid);
+  }
+
+  pyramid_worker->wait();
+  return;
+}
 
+void ImageProcessor::buildPyramid(const Mat& img,
+    vector<Mat>& pyramid) const {
   // OpenCV的函数
   // Constructs the image pyramid which can be passed to calcOpticalFlowPyrLK.
+  // 已有的同尺寸层会被重用（包括边界），不会重新分配内存
   buildOpticalFlowPyramid(
-      curr_cam0_img, curr_cam0_pyramid_,
-      Size(processor_config.patch_size, processor_config.patch_size),
-      processor_config.pyramid_levels, true, BORDER_REFLECT_101,
-      BORDER_CONSTANT, false);
-
-  const Mat& curr_cam1_img = cam1_curr_img_ptr->image;
-  buildOpticalFlowPyramid(
-      curr_cam1_img, curr_cam1_pyramid_,
+      img, pyramid,
       Size(processor_config.patch_size, processor_config.patch_size),
       processor_config.pyramid_levels, true, BORDER_REFLECT_101,
       BORDER_CONSTANT, false);
+  return;
 }
 
 /**
@@ -365,88 +849,46 @@ void ImageProcessor::createImagePyramids() {
  *
  */
 void ImageProcessor::initializeFirstFrame() {
-  // Size of each grid.
-  const Mat& img = cam0_curr_img_ptr->image;
-  static int grid_height = img.rows / processor_config.grid_row;
-  static int grid_width = img.cols / processor_config.grid_col;
-
+  MSCKF_VIO_TRACE_SCOPE("ImageProcessor::initializeFirstFrame");
   // Detect new features on the frist image.
-  // 提取FAST关键点
-  vector<KeyPoint> new_features(0);
-  detector_ptr->detect(img, new_features);
+  // 提取FAST关键点，此时所有格子都是空的
+  // FAST关键点位于图像的像素坐标位置
+  vector<cv::Point2f> cam0_points(0);
+  vector<float> responses(0);
+  detectNewFeatures(cam0_points, responses);
 
   // Find the stereo matched points for the newly
   // detected features.
-  // FAST关键点位于图像的像素坐标位置
-  vector<cv::Point2f> cam0_points(new_features.size());
-  for (int i = 0; i < new_features.size(); ++i)
-    cam0_points[i] = new_features[i].pt;
 
   // 光流跟踪匹配两帧的关键点
   // 用外参计算E剔除明显不可能的点
   vector<cv::Point2f> cam1_points(0);
   vector<unsigned char> inlier_markers(0);
-  stereoMatch(cam0_points, cam1_points, inlier_markers);
+  vector<cv::Point2f> cam0_points_undistorted(0);
+  vector<cv::Point2f> cam1_points_undistorted(0);
+  stereoMatch(cam0_points, cam1_points, inlier_markers,
+      cam0_points_undistorted, cam1_points_undistorted);
 
   // 保存符合要求的内点以及响应强度
   vector<cv::Point2f> cam0_inliers(0);
   vector<cv::Point2f> cam1_inliers(0);
+  vector<cv::Point2f> cam0_inliers_undistorted(0);
+  vector<cv::Point2f> cam1_inliers_undistorted(0);
   vector<float> response_inliers(0);
   for (int i = 0; i < inlier_markers.size(); ++i) {
     if (inlier_markers[i] == 0) continue;
     cam0_inliers.push_back(cam0_points[i]);
     cam1_inliers.push_back(cam1_points[i]);
-    response_inliers.push_back(new_features[i].response);
+    cam0_inliers_undistorted.push_back(cam0_points_undistorted[i]);
+    cam1_inliers_undistorted.push_back(cam1_points_undistorted[i]);
+    response_inliers.push_back(responses[i]);
   }
 
   // Group the features into grids
-  // 图像画格子，将特征点分配到各个格子中
-  // GridFeatures为map<int,std::vector<FeatureMetaData>>
-  GridFeatures grid_new_features;
-  for (int code = 0; code <
-      processor_config.grid_row*processor_config.grid_col; ++code)
-      grid_new_features[code] = vector<FeatureMetaData>(0);
-
-  for (int i = 0; i < cam0_inliers.size(); ++i) {
-    const cv::Point2f& cam0_point = cam0_inliers[i];
-    const cv::Point2f& cam1_point = cam1_inliers[i];
-    const float& response = response_inliers[i];
-
-    // 按照特征点位置与格子大小的关系，分别分配到每个格子中
-    int row = static_cast<int>(cam0_point.y / grid_height);
-    int col = static_cast<int>(cam0_point.x / grid_width);
-    int code = row*processor_config.grid_col + col;
-
-    // 格子中的特征点信息保存
-    FeatureMetaData new_feature;
-    new_feature.response = response;
-    new_feature.cam0_point = cam0_point;
-    new_feature.cam1_point = cam1_point;
-    grid_new_features[code].push_back(new_feature);
-  }
-
-  // Sort the new features in each grid based on its response.
-  // 按照特征响应对格子中的所有特征点进行排序
-  for (auto& item : grid_new_features)
-    std::sort(item.second.begin(), item.second.end(),
-        &ImageProcessor::featureCompareByResponse);
-
-  // Collect new features within each grid with high response.
-  // 按照预设的阈值对每个格子保留特征点
-  for (int code = 0; code <
-      processor_config.grid_row*processor_config.grid_col; ++code) {
-    // 将当前的关键点保存到curr_features_ptr
-    vector<FeatureMetaData>& features_this_grid = (*curr_features_ptr)[code];
-    vector<FeatureMetaData>& new_features_this_grid = grid_new_features[code];
-
-    // 按照响应值从大到小取指定的特征点
-    for (int k = 0; k < processor_config.grid_min_feature_num &&
-        k < new_features_this_grid.size(); ++k) {
-      features_this_grid.push_back(new_features_this_grid[k]);
-      features_this_grid.back().id = next_feature_id++;
-      features_this_grid.back().lifetime = 1;
-    }
-  }
+  // 图像画格子，按照响应值为每个格子保留特征点
+  fillGridVacancies(cam0_inliers, cam1_inliers,
+      cam0_inliers_undistorted, cam1_inliers_undistorted,
+      response_inliers);
 
   return;
 }
@@ -454,47 +896,98 @@ void ImageProcessor::initializeFirstFrame() {
 /**
  * @brief 根据单应性原理：已知一个平面的关键点可以得到另一个平面的关键点
  * @param input_pts：上一时刻的第一个相机对应的关键点
+ * @param inverse_depths：关键点在上一时刻相机系下的逆深度，未知时为0或为空
  * @param R_p_c: 利用imu数据计算得到的前后两个时刻图像帧的旋转初值
+ * @param t_p_c: 前后两个时刻图像帧的平移初值
  * @param intrinsics:相机内参
  * @return compensated_pts:根据上一帧图像中的关键点位置预测得到当前帧的关键点位置
  *
  */
 void ImageProcessor::predictFeatureTracking(
     const vector<cv::Point2f>& input_pts,
+    const vector<float>& inverse_depths,
     const cv::Matx33f& R_p_c,
+    const cv::Vec3f& t_p_c,
     const cv::Vec4d& intrinsics,
     vector<cv::Point2f>& compensated_pts) {
-
-  // Return directly if there are no input features.
-  if (input_pts.size() == 0) {
-    compensated_pts.clear();
-    return;
-  }
-  compensated_pts.resize(input_pts.size());
-
-  // Intrinsic matrix.
-  // 相机内参矩阵K
-  cv::Matx33f K(
-      intrinsics[0], 0.0, intrinsics[2],
-      0.0, intrinsics[1], intrinsics[3],
-      0.0, 0.0, 1.0);
+  MSCKF_VIO_TRACE_SCOPE("ImageProcessor::predictFeatureTracking");
 
   // 单应性矩阵的计算，公式推到：
   // x1 = K * X1_c; x2 = K * X2_c
   // x2_c = H * x1_c; X1_C = R_2_1 * X2_c
   // x1 = K * R_1_2 * K^inv * x2 --> H = K * R_1_2 * K^inv
-  // TUDO:这里应该还有平移向量，预测一个值所以可以去掉？
-  cv::Matx33f H = K * R_p_c * K.inv();
-
-  for (int i = 0; i < input_pts.size(); ++i) {
-    cv::Vec3f p1(input_pts[i].x, input_pts[i].y, 1.0f);
-    // 两个平面中的匹配点满足: x2 = H * x1
-    // 归一化后的齐次坐标即另一个平面上匹配点的图像坐标
-    cv::Vec3f p2 = H * p1;
-    compensated_pts[i].x = p2[0] / p2[2];
-    compensated_pts[i].y = p2[1] / p2[2];
+  // 已知逆深度rho时再加上平移项 rho * K * t，所有点一起变换
+  feature_predictor->predict(input_pts, inverse_depths,
+      R_p_c, t_p_c, intrinsics, compensated_pts);
+  return;
+}
+
+/**
+ * @brief 由双目匹配的归一化坐标计算特征点在cam0系下的逆深度
+ */
+void ImageProcessor::stereoInverseDepths(
+    const vector<Point2f>& cam0_points,
+    const vector<Point2f>& cam1_points,
+    vector<float>& inverse_depths) const {
+  const Matx33f R_cam0_cam1 = R_cam1_imu.t() * R_cam0_imu;
+  const Vec3f t_cam0_cam1 = R_cam1_imu.t() * (t_cam0_imu-t_cam1_imu);
+  const float min_inverse_depth =
+    1.0f / processor_config.max_prediction_depth;
+
+  inverse_depths.resize(cam0_points.size());
+  for (int i = 0; i < cam0_points.size(); ++i) {
+    const float rho = FeaturePredictor::stereoInverseDepth(
+        cam0_points[i], cam1_points[i], R_cam0_cam1, t_cam0_cam1);
+    inverse_depths[i] = rho > min_inverse_depth ? rho : 0.0f;
+  }
+  return;
+}
+
+/**
+ * @brief 由前后两帧都能三角化的内点估计cam0的速度（在cam0系下）
+ *
+ * 每个点给出一个平移 t = P_c - R_p_c * P_p，各分量取中值以剔除深度误差大的点
+ */
+void ImageProcessor::updateCameraVelocity(
+    const vector<Point2f>& prev_cam0_points,
+    const vector<Point2f>& prev_cam1_points,
+    const vector<Point2f>& curr_cam0_points,
+    const vector<Point2f>& curr_cam1_points,
+    const vector<int>& inlier_markers,
+    const Matx33f& R_p_c, const double& dtime) {
+  cam0_velocity_valid = false;
+  if (dtime <= 0.0) return;
+
+  vector<float> prev_inverse_depths(0);
+  vector<float> curr_inverse_depths(0);
+  stereoInverseDepths(prev_cam0_points, prev_cam1_points,
+      prev_inverse_depths);
+  stereoInverseDepths(curr_cam0_points, curr_cam1_points,
+      curr_inverse_depths);
+
+  vector<float> translations[3];
+  for (int i = 0; i < inlier_markers.size(); ++i) {
+    if (inlier_markers[i] == 0) continue;
+    if (prev_inverse_depths[i] <= 0.0f ||
+        curr_inverse_depths[i] <= 0.0f) continue;
+    const Vec3f prev_pt = Vec3f(prev_cam0_points[i].x,
+        prev_cam0_points[i].y, 1.0f) * (1.0f/prev_inverse_depths[i]);
+    const Vec3f curr_pt = Vec3f(curr_cam0_points[i].x,
+        curr_cam0_points[i].y, 1.0f) * (1.0f/curr_inverse_depths[i]);
+    const Vec3f t = curr_pt - R_p_c*prev_pt;
+    for (int k = 0; k < 3; ++k) translations[k].push_back(t[k]);
   }
 
+  // Too few features to reject the bad depths.
+  if (translations[0].size() < 10) return;
+
+  for (int k = 0; k < 3; ++k) {
+    vector<float>& values = translations[k];
+    nth_element(values.begin(), values.begin()+values.size()/2,
+        values.end());
+    cam0_velocity[k] = values[values.size()/2] / dtime;
+  }
+  cam0_velocity_valid = true;
   return;
 }
 
@@ -505,12 +998,7 @@ void ImageProcessor::predictFeatureTracking(
  *
  */
 void ImageProcessor::trackFeatures() {
-  // Size of each grid.
-  // 长宽方向的格子的数量
-  static int grid_height =
-    cam0_curr_img_ptr->image.rows / processor_config.grid_row;
-  static int grid_width =
-    cam0_curr_img_ptr->image.cols / processor_config.grid_col;
+  MSCKF_VIO_TRACE_SCOPE("ImageProcessor::trackFeatures");
 
   // Compute a rough relative rotation which takes a vector
   // from the previous frame to the current frame.
@@ -519,21 +1007,17 @@ void ImageProcessor::trackFeatures() {
   Matx33f cam1_R_p_c;
   integrateImuData(cam0_R_p_c, cam1_R_p_c);
 
-  // Organize the features in the previous image.
+  // The features in the previous image, which are already
+  // grouped by the cells.
   // 获取前一时刻的双目图像特征的信息
-  vector<FeatureIDType> prev_ids(0);
-  vector<int> prev_lifetime(0);
-  vector<Point2f> prev_cam0_points(0);
-  vector<Point2f> prev_cam1_points(0);
-
-  for (const auto& item : *prev_features_ptr) {
-    for (const auto& prev_feature : item.second) {
-      prev_ids.push_back(prev_feature.id);
-      prev_lifetime.push_back(prev_feature.lifetime);
-      prev_cam0_points.push_back(prev_feature.cam0_point);
-      prev_cam1_points.push_back(prev_feature.cam1_point);
-    }
-  }
+  const vector<FeatureIDType>& prev_ids = prev_features_ptr->getIds();
+  const vector<int>& prev_lifetime = prev_features_ptr->getLifetimes();
+  const vector<Point2f>& prev_cam0_points =
+    prev_features_ptr->getCam0Points();
+  const vector<Point2f>& prev_cam0_undistorted =
+    prev_features_ptr->getCam0Undistorted();
+  const vector<Point2f>& prev_cam1_undistorted =
+    prev_features_ptr->getCam1Undistorted();
 
   // Number of the features before tracking.
   // 获取前一时刻跟踪匹配成功的关键点对数量
@@ -541,27 +1025,36 @@ void ImageProcessor::trackFeatures() {
 
   // Abort tracking if there is no features in
   // the previous frame.
-  if (prev_ids.size() == 0) return;
+  if (prev_ids.size() == 0) {
+    cam0_velocity_valid = false;
+    return;
+  }
 
   // Track features using LK optical flow method.
   vector<Point2f> curr_cam0_points(0);
   vector<unsigned char> track_inliers(0);
 
+  // The translation is predicted with the velocity of cam0
+  // for the features whose depths are known from the stereo.
+  const double dtime = (cam0_curr_img_ptr->header.stamp-
+      cam0_prev_img_ptr->header.stamp).toSec();
+  vector<float> prev_inverse_depths(0);
+  Vec3f cam0_t_p_c(0.0f, 0.0f, 0.0f);
+  if (processor_config.predict_translation && cam0_velocity_valid) {
+    stereoInverseDepths(prev_cam0_undistorted, prev_cam1_undistorted,
+        prev_inverse_depths);
+    cam0_t_p_c = cam0_velocity * static_cast<float>(dtime);
+  }
+
   // 根据imu计算得到的旋转值以及单应性原理来预测当前帧的关键点位置
-  predictFeatureTracking(prev_cam0_points,
-      cam0_R_p_c, cam0_intrinsics, curr_cam0_points);
+  predictFeatureTracking(prev_cam0_points, prev_inverse_depths,
+      cam0_R_p_c, cam0_t_p_c, cam0_intrinsics, curr_cam0_points);
 
   // LK光流对上一时刻的关键点位置做跟踪匹配
-  calcOpticalFlowPyrLK(
+  trackPoints(*temporal_klt_tracker,
       prev_cam0_pyramid_, curr_cam0_pyramid_,
-      prev_cam0_points, curr_cam0_points,
-      track_inliers, noArray(),
-      Size(processor_config.patch_size, processor_config.patch_size),
-      processor_config.pyramid_levels,
-      TermCriteria(TermCriteria::COUNT+TermCriteria::EPS,
-        processor_config.max_iteration,
-        processor_config.track_precision),
-      cv::OPTFLOW_USE_INITIAL_FLOW);
+      prev_cam0_points, curr_cam0_points, track_inliers,
+      processor_config.cam0_level);
 
   // Mark those tracked points out of the image region
   // as untracked.
@@ -577,8 +1070,8 @@ void ImageProcessor::trackFeatures() {
   // Collect the tracked points.
   vector<FeatureIDType> prev_tracked_ids(0);
   vector<int> prev_tracked_lifetime(0);
-  vector<Point2f> prev_tracked_cam0_points(0);
-  vector<Point2f> prev_tracked_cam1_points(0);
+  vector<Point2f> prev_tracked_cam0_undistorted(0);
+  vector<Point2f> prev_tracked_cam1_undistorted(0);
   vector<Point2f> curr_tracked_cam0_points(0);
 
   // 移除所有track_inliers值为0的关键点
@@ -587,9 +1080,9 @@ void ImageProcessor::trackFeatures() {
   removeUnmarkedElements(
       prev_lifetime, track_inliers, prev_tracked_lifetime);
   removeUnmarkedElements(
-      prev_cam0_points, track_inliers, prev_tracked_cam0_points);
+      prev_cam0_undistorted, track_inliers, prev_tracked_cam0_undistorted);
   removeUnmarkedElements(
-      prev_cam1_points, track_inliers, prev_tracked_cam1_points);
+      prev_cam1_undistorted, track_inliers, prev_tracked_cam1_undistorted);
   removeUnmarkedElements(
       curr_cam0_points, track_inliers, curr_tracked_cam0_points);
 
@@ -618,29 +1111,41 @@ void ImageProcessor::trackFeatures() {
 
   // Step 1: stereo matching.
   // 第一步： 对当前时刻的双目进行匹配
+  // The positions of the current features are final after
+  // the stereo matching, which also returns their normalized
+  // coordinates for the RANSAC and the publisher.
   vector<Point2f> curr_cam1_points(0);
   vector<unsigned char> match_inliers(0);
-  stereoMatch(curr_tracked_cam0_points, curr_cam1_points, match_inliers);
+  vector<Point2f> curr_tracked_cam0_undistorted(0);
+  vector<Point2f> curr_cam1_undistorted(0);
+  stereoMatch(curr_tracked_cam0_points, curr_cam1_points, match_inliers,
+      curr_tracked_cam0_undistorted, curr_cam1_undistorted);
 
   vector<FeatureIDType> prev_matched_ids(0);
   vector<int> prev_matched_lifetime(0);
-  vector<Point2f> prev_matched_cam0_points(0);
-  vector<Point2f> prev_matched_cam1_points(0);
+  vector<Point2f> prev_matched_cam0_undistorted(0);
+  vector<Point2f> prev_matched_cam1_undistorted(0);
   vector<Point2f> curr_matched_cam0_points(0);
   vector<Point2f> curr_matched_cam1_points(0);
+  vector<Point2f> curr_matched_cam0_undistorted(0);
+  vector<Point2f> curr_matched_cam1_undistorted(0);
 
   removeUnmarkedElements(
       prev_tracked_ids, match_inliers, prev_matched_ids);
   removeUnmarkedElements(
       prev_tracked_lifetime, match_inliers, prev_matched_lifetime);
-  removeUnmarkedElements(
-      prev_tracked_cam0_points, match_inliers, prev_matched_cam0_points);
-  removeUnmarkedElements(
-      prev_tracked_cam1_points, match_inliers, prev_matched_cam1_points);
+  removeUnmarkedElements(prev_tracked_cam0_undistorted,
+      match_inliers, prev_matched_cam0_undistorted);
+  removeUnmarkedElements(prev_tracked_cam1_undistorted,
+      match_inliers, prev_matched_cam1_undistorted);
   removeUnmarkedElements(
       curr_tracked_cam0_points, match_inliers, curr_matched_cam0_points);
   removeUnmarkedElements(
       curr_cam1_points, match_inliers, curr_matched_cam1_points);
+  removeUnmarkedElements(curr_tracked_cam0_undistorted,
+      match_inliers, curr_matched_cam0_undistorted);
+  removeUnmarkedElements(curr_cam1_undistorted,
+      match_inliers, curr_matched_cam1_undistorted);
 
   // Number of features left after stereo matching.
   // 当前时刻两个相机匹配得到的关键点对的内点数量
@@ -648,48 +1153,55 @@ void ImageProcessor::trackFeatures() {
 
   // Step 2 and 3: RANSAC on temporal image pairs of cam0 and cam1.
   // 步骤2： 对同一个相机的不同时刻做RANSAC剔除外点
+  // The hypotheses are drawn from the features tracked for
+  // the longest time first with PROSAC.
+  vector<float> ransac_qualities(0);
+  if (processor_config.use_prosac)
+    ransac_qualities.assign(
+        prev_matched_lifetime.begin(), prev_matched_lifetime.end());
+
   vector<int> cam0_ransac_inliers(0);
-  twoPointRansac(prev_matched_cam0_points, curr_matched_cam0_points,
-      cam0_R_p_c, cam0_intrinsics, cam0_distortion_model,
-      cam0_distortion_coeffs, processor_config.ransac_threshold,
+  twoPointRansac(prev_matched_cam0_undistorted,
+      curr_matched_cam0_undistorted, ransac_qualities,
+      cam0_R_p_c, cam0_intrinsics, processor_config.ransac_threshold,
       0.99, cam0_ransac_inliers);
 
   vector<int> cam1_ransac_inliers(0);
-  twoPointRansac(prev_matched_cam1_points, curr_matched_cam1_points,
-      cam1_R_p_c, cam1_intrinsics, cam1_distortion_model,
-      cam1_distortion_coeffs, processor_config.ransac_threshold,
+  twoPointRansac(prev_matched_cam1_undistorted,
+      curr_matched_cam1_undistorted, ransac_qualities,
+      cam1_R_p_c, cam1_intrinsics, processor_config.ransac_threshold,
       0.99, cam1_ransac_inliers);
 
+  // The inliers of both the cameras give the velocity of
+  // cam0 for the prediction of the next frame.
+  if (processor_config.predict_translation) {
+    vector<int> ransac_inliers(cam0_ransac_inliers.size(), 0);
+    for (int i = 0; i < ransac_inliers.size(); ++i)
+      ransac_inliers[i] = cam0_ransac_inliers[i] && cam1_ransac_inliers[i];
+    updateCameraVelocity(prev_matched_cam0_undistorted,
+        prev_matched_cam1_undistorted, curr_matched_cam0_undistorted,
+        curr_matched_cam1_undistorted, ransac_inliers, cam0_R_p_c, dtime);
+  }
+
   // Number of features after ransac.
   after_ransac = 0;
 
   for (int i = 0; i < cam0_ransac_inliers.size(); ++i) {
     if (cam0_ransac_inliers[i] == 0 ||
         cam1_ransac_inliers[i] == 0) continue;
-    int row = static_cast<int>(
-        curr_matched_cam0_points[i].y / grid_height);
-    int col = static_cast<int>(
-        curr_matched_cam0_points[i].x / grid_width);
-    int code = row*processor_config.grid_col + col;
-    (*curr_features_ptr)[code].push_back(FeatureMetaData());
-
-    FeatureMetaData& grid_new_feature = (*curr_features_ptr)[code].back();
-    grid_new_feature.id = prev_matched_ids[i];
-    grid_new_feature.lifetime = ++prev_matched_lifetime[i];
-    grid_new_feature.cam0_point = curr_matched_cam0_points[i];
-    grid_new_feature.cam1_point = curr_matched_cam1_points[i];
+    const int code = cellCode(curr_matched_cam0_points[i]);
+    curr_features_ptr->add(code, prev_matched_ids[i],
+        ++prev_matched_lifetime[i], 0.0f,
+        curr_matched_cam0_points[i], curr_matched_cam1_points[i],
+        curr_matched_cam0_undistorted[i],
+        curr_matched_cam1_undistorted[i]);
 
     ++after_ransac;
   }
 
   // Compute the tracking rate.
-  int prev_feature_num = 0;
-  for (const auto& item : *prev_features_ptr)
-    prev_feature_num += item.second.size();
-
-  int curr_feature_num = 0;
-  for (const auto& item : *curr_features_ptr)
-    curr_feature_num += item.second.size();
+  int prev_feature_num = prev_features_ptr->size();
+  int curr_feature_num = curr_features_ptr->size();
 
   ROS_INFO_THROTTLE(0.5,
       "\033[0;32m candidates: %d; track: %d; match: %d; ransac: %d/%d=%f\033[0m",
@@ -707,54 +1219,166 @@ void ImageProcessor::trackFeatures() {
   return;
 }
 
+/**
+ * @brief LK光流跟踪，使用KltTracker或者OpenCV的实现
+ *
+ * 以IMU或外参预测的位置作为初值，跟踪残差过大的点被标记为外点
+ */
+void ImageProcessor::trackPoints(
+    const KltTracker& tracker,
+    const vector<Mat>& prev_pyramid,
+    const vector<Mat>& curr_pyramid,
+    const vector<Point2f>& prev_points,
+    vector<Point2f>& curr_points,
+    vector<unsigned char>& inlier_markers,
+    const int& level) {
+  MSCKF_VIO_TRACE_SCOPE("ImageProcessor::trackPoints");
+
+  vector<float> residuals(0);
+  if (level <= 0) {
+    lkTrack(tracker, prev_pyramid, curr_pyramid,
+        prev_points, curr_points, inlier_markers, residuals);
+  } else {
+    // Track the points on the pyramids from the reduced level,
+    // whose images and derivatives start at 2*level.
+    // 在降采样的金字塔层上粗跟踪
+    const float scale = 1.0f / (1 << level);
+    const vector<Mat> prev_coarse_pyramid(
+        prev_pyramid.begin()+2*level, prev_pyramid.end());
+    const vector<Mat> curr_coarse_pyramid(
+        curr_pyramid.begin()+2*level, curr_pyramid.end());
+    vector<Point2f> prev_coarse_points(prev_points.size());
+    vector<Point2f> curr_coarse_points(curr_points.size());
+    for (int i = 0; i < prev_points.size(); ++i)
+      prev_coarse_points[i] = prev_points[i] * scale;
+    for (int i = 0; i < curr_points.size(); ++i)
+      curr_coarse_points[i] = curr_points[i] * scale;
+    lkTrack(tracker, prev_coarse_pyramid, curr_coarse_pyramid,
+        prev_coarse_points, curr_coarse_points, inlier_markers, residuals);
+
+    // Refine the tracked points with a small patch on the full
+    // resolution, which also gives the residuals.
+    // 在原分辨率上用小窗口细化跟踪结果
+    curr_points.resize(curr_coarse_points.size());
+    for (int i = 0; i < curr_coarse_points.size(); ++i)
+      curr_points[i] = curr_coarse_points[i] * (1.0f/scale);
+    const vector<Mat> prev_full_pyramid(
+        prev_pyramid.begin(), prev_pyramid.begin()+2);
+    const vector<Mat> curr_full_pyramid(
+        curr_pyramid.begin(), curr_pyramid.begin()+2);
+    vector<unsigned char> refine_markers(0);
+    lkTrack(*refine_klt_tracker, prev_full_pyramid, curr_full_pyramid,
+        prev_points, curr_points, refine_markers, residuals);
+    for (int i = 0; i < inlier_markers.size(); ++i)
+      inlier_markers[i] &= refine_markers[i];
+  }
+
+  // Both trackers report the mean absolute difference
+  // of the patches.
+  if (processor_config.max_track_residual > 0.0) {
+    for (int i = 0; i < inlier_markers.size(); ++i) {
+      if (residuals[i] > processor_config.max_track_residual)
+        inlier_markers[i] = 0;
+    }
+  }
+
+  return;
+}
+
+/**
+ * @brief 用KLT跟踪器或者相同参数的OpenCV光流跟踪金字塔上的点
+ */
+void ImageProcessor::lkTrack(const KltTracker& tracker,
+    const vector<Mat>& prev_pyramid,
+    const vector<Mat>& curr_pyramid,
+    const vector<Point2f>& prev_points,
+    vector<Point2f>& curr_points,
+    vector<unsigned char>& inlier_markers,
+    vector<float>& residuals) const {
+  if (processor_config.use_klt_tracker) {
+    if (!tracker.track(prev_pyramid, curr_pyramid,
+          prev_points, curr_points, inlier_markers, residuals))
+      ROS_ERROR("The pyramids have no derivatives for the KLT tracker...");
+  } else {
+    const KltTracker::Config& config = tracker.getConfig();
+    calcOpticalFlowPyrLK(prev_pyramid, curr_pyramid,
+        prev_points, curr_points,
+        inlier_markers, residuals,
+        Size(config.patch_size, config.patch_size),
+        config.pyramid_levels,
+        TermCriteria(TermCriteria::COUNT+TermCriteria::EPS,
+          config.max_iteration, config.track_precision),
+        cv::OPTFLOW_USE_INITIAL_FLOW);
+  }
+  return;
+}
+
 /**
  * @brief 对两帧图像对做特征匹配，对极几何约束剔除外点
  * @param cam0_points：第一帧图像帧的关键点位置
  * @return cam1_points:第二帧图像中的关键点位置
  * @return inlier_markers:匹配成功返回1，否则为0
+ * @return cam0_points_undistorted, cam1_points_undistorted:
+ *    两个相机中关键点的归一化坐标，匹配后不再变化，存入特征表
  *
  */
 void ImageProcessor::stereoMatch(
     const vector<cv::Point2f>& cam0_points,
     vector<cv::Point2f>& cam1_points,
-    vector<unsigned char>& inlier_markers) {
+    vector<unsigned char>& inlier_markers,
+    vector<cv::Point2f>& cam0_points_undistorted,
+    vector<cv::Point2f>& cam1_points_undistorted) {
+  MSCKF_VIO_TRACE_SCOPE("ImageProcessor::stereoMatch");
 
+  cam0_points_undistorted.clear();
+  cam1_points_undistorted.clear();
   if (cam0_points.size() == 0) return;
 
-  // 对第二帧图像中的特征点位置初始化
-  if(cam1_points.size() == 0) {
-    // Initialize cam1_points by projecting cam0_points to cam1 using the
-    // rotation from stereo extrinsics
-    const cv::Matx33d R_cam0_cam1 = R_cam1_imu.t() * R_cam0_imu;
-    vector<cv::Point2f> cam0_points_undistorted;
-
-    // 第一个摄像头图像中的关键点位置矫正
-    undistortPoints(cam0_points, cam0_intrinsics, cam0_distortion_model,
-                    cam0_distortion_coeffs, cam0_points_undistorted,
-                    R_cam0_cam1);
-//      ROS_INFO_STREAM("Before undistorted: cam0_points[0] = "
-//                              << cam0_points[0].x << " " << cam0_points[0].y);
-//      ROS_INFO_STREAM("After undistorted: cam0_points[0] = "
-//                              << cam0_points_undistorted[0].x << " " << cam0_points_undistorted[0].y);
-    // 第二个摄像头中的关键点位置
-    cam1_points = distortPoints(cam0_points_undistorted, cam1_intrinsics,
-                                cam1_distortion_model, cam1_distortion_coeffs);
-  }
+  // The cam0 points are final, so they are undistorted once
+  // for both the prediction and the epipolar check.
+  // 第一个摄像头图像中的关键点位置矫正
+  const cv::Matx33d R_cam0_cam1 = R_cam1_imu.t() * R_cam0_imu;
+  undistortPoints(
+      *cam0_undistorter, cam0_points, cam0_points_undistorted);
+
+  if (processor_config.use_rectified_stereo) {
+    // Search the disparities along the rectified scanlines,
+    // which also gives the normalized cam1 points.
+    // 校正后沿扫描线搜索视差，直接得到cam1的归一化坐标
+    stereo_matcher->match(cam0_curr_img_ptr->image,
+        cam1_curr_img_ptr->image, cam0_points_undistorted,
+        cam1_points, cam1_points_undistorted, inlier_markers);
+  } else {
+    // 对第二帧图像中的特征点位置初始化
+    if(cam1_points.size() == 0) {
+      // Initialize cam1_points by projecting cam0_points to cam1 using the
+      // rotation from stereo extrinsics
+      vector<cv::Point2f> cam0_points_rotated(cam0_points_undistorted.size());
+      for (int i = 0; i < cam0_points_undistorted.size(); ++i) {
+        const cv::Vec3d pt_h = R_cam0_cam1 * cv::Vec3d(
+            cam0_points_undistorted[i].x, cam0_points_undistorted[i].y, 1.0);
+        cam0_points_rotated[i].x = pt_h[0] / pt_h[2];
+        cam0_points_rotated[i].y = pt_h[1] / pt_h[2];
+      }
 
-  // Track features using LK optical flow method.
-  // 采用LK光流跟踪关键点
-  // 输入两个相机图像对应的金字塔以及第一个相机图像对应的关键点cam0_points
-  // 输出光流跟踪到的第二个相机图像对应的关键点cam1_points
-  // inlier_markers表示cam0_points中的点是否有对应的点
-  calcOpticalFlowPyrLK(curr_cam0_pyramid_, curr_cam1_pyramid_,
-      cam0_points, cam1_points,
-      inlier_markers, noArray(),
-      Size(processor_config.patch_size, processor_config.patch_size),
-      processor_config.pyramid_levels,
-      TermCriteria(TermCriteria::COUNT+TermCriteria::EPS,
-                   processor_config.max_iteration,
-                   processor_config.track_precision),
-      cv::OPTFLOW_USE_INITIAL_FLOW);
+      // 第二个摄像头中的关键点位置
+      cam1_points = distortPoints(cam0_points_rotated, cam1_intrinsics,
+          cam1_distortion_model, cam1_distortion_coeffs);
+    }
+
+    // Track features using LK optical flow method.
+    // 采用LK光流跟踪关键点
+    // 输入两个相机图像对应的金字塔以及第一个相机图像对应的关键点cam0_points
+    // 输出光流跟踪到的第二个相机图像对应的关键点cam1_points
+    // inlier_markers表示cam0_points中的点是否有对应的点
+    trackPoints(*klt_tracker, curr_cam0_pyramid_, curr_cam1_pyramid_,
+        cam0_points, cam1_points, inlier_markers,
+        processor_config.cam1_level);
+
+    // 图像点先去畸变，跟踪后cam1的关键点位置也不再变化
+    undistortPoints(
+        *cam1_undistorter, cam1_points, cam1_points_undistorted);
+  }
 
   // Mark those tracked points out of the image region
   // as untracked.
@@ -768,9 +1392,8 @@ void ImageProcessor::stereoMatch(
       inlier_markers[i] = 0;
   }
 
-  // Compute the relative rotation between the cam0
+  // Compute the relative translation between the cam0
   // frame and cam1 frame.
-  const cv::Matx33d R_cam0_cam1 = R_cam1_imu.t() * R_cam0_imu;
   const cv::Vec3d t_cam0_cam1 = R_cam1_imu.t() * (t_cam0_imu-t_cam1_imu);
   // Compute the essential matrix.
   // 本质矩阵的计算公式：[t]x * R（见多视图几何）
@@ -784,19 +1407,6 @@ void ImageProcessor::stereoMatch(
   // essential matrix.
   // 所有的匹配点应满足对极几何约束，不满足该条件就剔除
 
-  // 图像点先去畸变
-  vector<cv::Point2f> cam0_points_undistorted(0);
-  vector<cv::Point2f> cam1_points_undistorted(0);
-  undistortPoints(
-      cam0_points, cam0_intrinsics, cam0_distortion_model,
-      cam0_distortion_coeffs, cam0_points_undistorted);
-  undistortPoints(
-      cam1_points, cam1_intrinsics, cam1_distortion_model,
-      cam1_distortion_coeffs, cam1_points_undistorted);
-
-//  ROS_INFO_STREAM("undistorted: cam0_points[0] = "
-//                  << cam0_points_undistorted[0].x << " " << cam0_points_undistorted[0].y);
-
   // 将两个相机的fx和fy取平均: f_a = (fx_0+fy_0+fx_1+fy_1)/4.0
   // norm_pixel_unit = 1 / f_a
   double norm_pixel_unit = 4.0 / (
@@ -827,81 +1437,37 @@ void ImageProcessor::stereoMatch(
 }
 
 void ImageProcessor::addNewFeatures() {
-  const Mat& curr_img = cam0_curr_img_ptr->image;
-
-  // Size of each grid.
-  static int grid_height =
-    cam0_curr_img_ptr->image.rows / processor_config.grid_row;
-  static int grid_width =
-    cam0_curr_img_ptr->image.cols / processor_config.grid_col;
+  MSCKF_VIO_TRACE_SCOPE("ImageProcessor::addNewFeatures");
 
-  // Create a mask to avoid redetecting existing features.
-  Mat mask(curr_img.rows, curr_img.cols, CV_8U, Scalar(1));
+  // Detect new features in the cells which need more.
+  vector<cv::Point2f> cam0_points(0);
+  vector<float> responses(0);
+  detectNewFeatures(cam0_points, responses);
 
-  for (const auto& features : *curr_features_ptr) {
-    for (const auto& feature : features.second) {
-      const int y = static_cast<int>(feature.cam0_point.y);
-      const int x = static_cast<int>(feature.cam0_point.x);
-
-      int up_lim = y-2, bottom_lim = y+3,
-          left_lim = x-2, right_lim = x+3;
-      if (up_lim < 0) up_lim = 0;
-      if (bottom_lim > curr_img.rows) bottom_lim = curr_img.rows;
-      if (left_lim < 0) left_lim = 0;
-      if (right_lim > curr_img.cols) right_lim = curr_img.cols;
-
-      Range row_range(up_lim, bottom_lim);
-      Range col_range(left_lim, right_lim);
-      mask(row_range, col_range) = 0;
-    }
-  }
-
-  // Detect new features.
-  vector<KeyPoint> new_features(0);
-  detector_ptr->detect(curr_img, new_features, mask);
-
-  // Collect the new detected features based on the grid.
-  // Select the ones with top response within each grid afterwards.
-  vector<vector<KeyPoint> > new_feature_sieve(
-      processor_config.grid_row*processor_config.grid_col);
-  for (const auto& feature : new_features) {
-    int row = static_cast<int>(feature.pt.y / grid_height);
-    int col = static_cast<int>(feature.pt.x / grid_width);
-    new_feature_sieve[
-      row*processor_config.grid_col+col].push_back(feature);
-  }
-
-  new_features.clear();
-  for (auto& item : new_feature_sieve) {
-    if (item.size() > processor_config.grid_max_feature_num) {
-      std::sort(item.begin(), item.end(),
-          &ImageProcessor::keyPointCompareByResponse);
-      item.erase(
-          item.begin()+processor_config.grid_max_feature_num, item.end());
-    }
-    new_features.insert(new_features.end(), item.begin(), item.end());
-  }
-
-  int detected_new_features = new_features.size();
+  int detected_new_features = cam0_points.size();
 
   // Find the stereo matched points for the newly
   // detected features.
-  vector<cv::Point2f> cam0_points(new_features.size());
-  for (int i = 0; i < new_features.size(); ++i)
-    cam0_points[i] = new_features[i].pt;
 
   vector<cv::Point2f> cam1_points(0);
   vector<unsigned char> inlier_markers(0);
-  stereoMatch(cam0_points, cam1_points, inlier_markers);
+  vector<cv::Point2f> cam0_points_undistorted(0);
+  vector<cv::Point2f> cam1_points_undistorted(0);
+  stereoMatch(cam0_points, cam1_points, inlier_markers,
+      cam0_points_undistorted, cam1_points_undistorted);
 
   vector<cv::Point2f> cam0_inliers(0);
   vector<cv::Point2f> cam1_inliers(0);
+  vector<cv::Point2f> cam0_inliers_undistorted(0);
+  vector<cv::Point2f> cam1_inliers_undistorted(0);
   vector<float> response_inliers(0);
   for (int i = 0; i < inlier_markers.size(); ++i) {
     if (inlier_markers[i] == 0) continue;
     cam0_inliers.push_back(cam0_points[i]);
     cam1_inliers.push_back(cam1_points[i]);
-    response_inliers.push_back(new_features[i].response);
+    cam0_inliers_undistorted.push_back(cam0_points_undistorted[i]);
+    cam1_inliers_undistorted.push_back(cam1_points_undistorted[i]);
+    response_inliers.push_back(responses[i]);
   }
 
   int matched_new_features = cam0_inliers.size();
@@ -912,125 +1478,200 @@ void ImageProcessor::addNewFeatures() {
     ROS_WARN("Images at [%f] seems unsynced...",
         cam0_curr_img_ptr->header.stamp.toSec());
 
-  // Group the features into grids
-  GridFeatures grid_new_features;
-  for (int code = 0; code <
-      processor_config.grid_row*processor_config.grid_col; ++code)
-      grid_new_features[code] = vector<FeatureMetaData>(0);
-
-  for (int i = 0; i < cam0_inliers.size(); ++i) {
-    const cv::Point2f& cam0_point = cam0_inliers[i];
-    const cv::Point2f& cam1_point = cam1_inliers[i];
-    const float& response = response_inliers[i];
-
-    int row = static_cast<int>(cam0_point.y / grid_height);
-    int col = static_cast<int>(cam0_point.x / grid_width);
-    int code = row*processor_config.grid_col + col;
-
-    FeatureMetaData new_feature;
-    new_feature.response = response;
-    new_feature.cam0_point = cam0_point;
-    new_feature.cam1_point = cam1_point;
-    grid_new_features[code].push_back(new_feature);
-  }
+  // Collect new features within each grid with high response.
+  int new_added_feature_num = fillGridVacancies(
+      cam0_inliers, cam1_inliers, cam0_inliers_undistorted,
+      cam1_inliers_undistorted, response_inliers);
 
-  // Sort the new features in each grid based on its response.
-  for (auto& item : grid_new_features)
-    std::sort(item.second.begin(), item.second.end(),
-        &ImageProcessor::featureCompareByResponse);
+  //printf("\033[0;33m detected: %d; matched: %d; new added feature: %d\033[0m\n",
+  //    detected_new_features, matched_new_features, new_added_feature_num);
+
+  return;
+}
+
+/**
+ * @brief 只在特征数量不足的格子中提取FAST角点
+ *
+ * 每个格子使用自己的阈值，并用格子大小的占用图代替整幅图像的mask，
+ * 提取的代价与需要补充的格子数量成正比。检测器一次扫描格子完成
+ * 分段测试、非极大值抑制和按响应值的筛选，直接写入点和响应值的数组
+ */
+void ImageProcessor::detectNewFeatures(
+    vector<cv::Point2f>& new_points, vector<float>& new_responses) {
+  MSCKF_VIO_TRACE_SCOPE("ImageProcessor::detectNewFeatures");
+  // The corners are detected on the processing level of cam0.
+  // Their positions are only as accurate as that level, but
+  // a feature is defined by its patch, which is tracked and
+  // matched at the full resolution.
+  const int level = processor_config.cam0_level;
+  const float scale = 1 << level;
+  const Mat& img = level > 0 ?
+    curr_cam0_pyramid_[2*level] : cam0_curr_img_ptr->image;
+
+  const int min_threshold = max(1, processor_config.fast_threshold/2);
+  vector<unsigned char> occupancy(0);
 
-  int new_added_feature_num = 0;
-  // Collect new features within each grid with high response.
   for (int code = 0; code <
       processor_config.grid_row*processor_config.grid_col; ++code) {
-    vector<FeatureMetaData>& features_this_grid = (*curr_features_ptr)[code];
-    vector<FeatureMetaData>& new_features_this_grid = grid_new_features[code];
+    const int feature_num = curr_features_ptr->cellSize(code);
+    if (feature_num >= processor_config.grid_min_feature_num) continue;
+
+    // The pixels of the level whose full resolution positions
+    // are in the cell, so the corners go into the same cells
+    // as the tracked features.
+    const Rect full_cell = GridFeatures::cellRect(code,
+        cam0_curr_img_ptr->image.cols, cam0_curr_img_ptr->image.rows,
+        processor_config.grid_row, processor_config.grid_col);
+    const int cell_x = static_cast<int>(ceil(full_cell.x/scale));
+    const int cell_y = static_cast<int>(ceil(full_cell.y/scale));
+    const int cell_width = min(img.cols, static_cast<int>(
+          ceil((full_cell.x+full_cell.width)/scale))) - cell_x;
+    const int cell_height = min(img.rows, static_cast<int>(
+          ceil((full_cell.y+full_cell.height)/scale))) - cell_y;
+    if (cell_width <= 0 || cell_height <= 0) continue;
+
+    // Occupy the 5x5 neighbourhood of the existing features,
+    // including the ones in the neighbouring cells.
+    occupancy.assign(cell_width*cell_height, 0);
+    for (const auto& point : curr_features_ptr->getCam0Points()) {
+      const int x = static_cast<int>(point.x/scale) - cell_x;
+      const int y = static_cast<int>(point.y/scale) - cell_y;
+      if (x < -2 || x >= cell_width+2 ||
+          y < -2 || y >= cell_height+2) continue;
+
+      for (int v = max(0, y-2); v < min(cell_height, y+3); ++v)
+        for (int u = max(0, x-2); u < min(cell_width, x+3); ++u)
+          occupancy[v*cell_width+u] = 1;
+    }
 
-    if (features_this_grid.size() >=
-        processor_config.grid_min_feature_num) continue;
+    // The threshold of a cell is bounded by the fast_threshold,
+    // which the feature budget may have lowered.
+    int& threshold = grid_fast_thresholds[code];
+    threshold = min(threshold, processor_config.fast_threshold);
+
+    // The corners with the highest response which are not
+    // occupied, in the descending order of the response.
+    const int first = new_points.size();
+    const int corner_num = fast_detector->detect(img,
+        Rect(cell_x, cell_y, cell_width, cell_height), threshold,
+        &occupancy[0], processor_config.grid_max_feature_num,
+        new_points, new_responses);
+    for (int i = first; i < new_points.size(); ++i)
+      new_points[i] *= scale;
+
+    // Lower the threshold of a cell which cannot fill its
+    // vacancies, and restore it if there are plenty of corners.
+    if (corner_num < processor_config.grid_min_feature_num-feature_num)
+      threshold = max(min_threshold, threshold-1);
+    else if (corner_num > processor_config.grid_max_feature_num)
+      threshold = min(processor_config.fast_threshold, threshold+1);
+  }
 
-    int vacancy_num = processor_config.grid_min_feature_num -
-      features_this_grid.size();
-    for (int k = 0;
-        k < vacancy_num && k < new_features_this_grid.size(); ++k) {
-      features_this_grid.push_back(new_features_this_grid[k]);
-      features_this_grid.back().id = next_feature_id++;
-      features_this_grid.back().lifetime = 1;
+  return;
+}
 
-      ++new_added_feature_num;
-    }
+/**
+ * @brief cam0图像点所在格子的编号，图像边缘的点归入最后一行或一列的格子
+ */
+int ImageProcessor::cellCode(const cv::Point2f& point) const {
+  return GridFeatures::cellCode(point,
+      cam0_curr_img_ptr->image.cols, cam0_curr_img_ptr->image.rows,
+      processor_config.grid_row, processor_config.grid_col);
+}
+
+/**
+ * @brief 将双目匹配的新特征按照格子和响应值排序，补充到特征不足的格子中
+ */
+int ImageProcessor::fillGridVacancies(
+    const vector<cv::Point2f>& cam0_points,
+    const vector<cv::Point2f>& cam1_points,
+    const vector<cv::Point2f>& cam0_points_undistorted,
+    const vector<cv::Point2f>& cam1_points_undistorted,
+    const vector<float>& responses) {
+  // Sort the new features by the cells, and by the response
+  // within each cell.
+  vector<int> codes(cam0_points.size());
+  vector<int> indices(cam0_points.size());
+  for (int i = 0; i < cam0_points.size(); ++i) {
+    codes[i] = cellCode(cam0_points[i]);
+    indices[i] = i;
+  }
+  std::sort(indices.begin(), indices.end(),
+      [&codes, &responses](const int& i, const int& j) {
+        if (codes[i] != codes[j]) return codes[i] < codes[j];
+        return responses[i] > responses[j];
+      });
+
+  // The cell sizes grow with the added features, so a cell
+  // takes the new features until it is filled.
+  int added_feature_num = 0;
+  for (const auto& i : indices) {
+    if (curr_features_ptr->cellSize(codes[i]) >=
+        processor_config.grid_min_feature_num) continue;
+    curr_features_ptr->add(codes[i], next_feature_id++, 1,
+        responses[i], cam0_points[i], cam1_points[i],
+        cam0_points_undistorted[i], cam1_points_undistorted[i]);
+    ++added_feature_num;
   }
 
-  //printf("\033[0;33m detected: %d; matched: %d; new added feature: %d\033[0m\n",
-  //    detected_new_features, matched_new_features, new_added_feature_num);
+  return added_feature_num;
+}
 
+void ImageProcessor::pruneGridFeatures() {
+  MSCKF_VIO_TRACE_SCOPE("ImageProcessor::pruneGridFeatures");
+  // Keep the features with the longest lifetime in the cells
+  // with too many features, which also groups the features
+  // by the cells.
+  curr_features_ptr->pruneCells(processor_config.grid_max_feature_num);
   return;
 }
 
-void ImageProcessor::pruneGridFeatures() {
-  for (auto& item : *curr_features_ptr) {
-    auto& grid_features = item.second;
-    // Continue if the number of features in this grid does
-    // not exceed the upper bound.
-    if (grid_features.size() <=
-        processor_config.grid_max_feature_num) continue;
-    std::sort(grid_features.begin(), grid_features.end(),
-        &ImageProcessor::featureCompareByLifetime);
-    grid_features.erase(grid_features.begin()+
-        processor_config.grid_max_feature_num,
-        grid_features.end());
-  }
+/**
+ * @brief 根据当前帧的特征数和前端处理时间调整FAST阈值和每个格子的特征数
+ */
+void ImageProcessor::updateFeatureBudget(const double& frontend_time) {
+  if (!feature_budget_controller) return;
+  if (!feature_budget_controller->update(
+        curr_features_ptr->size(), frontend_time)) return;
+  if (feature_budget_controller->decision() ==
+      FeatureBudgetController::KEEP) return;
+
+  processor_config.fast_threshold =
+    feature_budget_controller->fastThreshold();
+  processor_config.grid_min_feature_num =
+    feature_budget_controller->gridMinFeatureNum();
+  processor_config.grid_max_feature_num =
+    feature_budget_controller->gridMaxFeatureNum();
+  ROS_DEBUG("Feature budget: fast threshold %d, grid feature num "
+      "%d-%d (%.1f features, %.2f ms)",
+      processor_config.fast_threshold,
+      processor_config.grid_min_feature_num,
+      processor_config.grid_max_feature_num,
+      feature_budget_controller->averageFeatureNum(),
+      feature_budget_controller->averageTime()*1000.0);
   return;
 }
 
 /**
  * @brief 计算原图像帧关键点对应的矫正位置
+ * @param undistorter：相机的去畸变查找表
  * @param pts_in：原图像帧的关键点位置
- * @param intrinsics:内参矩阵
- * @param distortion_model：相机模型
- * @param distortion_coeffs:畸变系数
- * @return pts_out:畸变矫正后的关键点位置
+ * @return pts_out:畸变矫正后的关键点位置（归一化坐标）
  * @param rectification_matrix:矫正矩阵，即两个相机之间的外参数
- * @param new_intrinsics:新的内参矩阵,默认值
  *
  */
 void ImageProcessor::undistortPoints(
+    const PointUndistorter& undistorter,
     const vector<cv::Point2f>& pts_in,
-    const cv::Vec4d& intrinsics,
-    const string& distortion_model,
-    const cv::Vec4d& distortion_coeffs,
     vector<cv::Point2f>& pts_out,
-    const cv::Matx33d &rectification_matrix,
-    const cv::Vec4d &new_intrinsics) {
+    const cv::Matx33d &rectification_matrix) {
+  MSCKF_VIO_TRACE_SCOPE("ImageProcessor::undistortPoints");
 
   if (pts_in.size() == 0) return;
 
-  const cv::Matx33d K(
-      intrinsics[0], 0.0, intrinsics[2],
-      0.0, intrinsics[1], intrinsics[3],
-      0.0, 0.0, 1.0);
-
-  const cv::Matx33d K_new(
-      new_intrinsics[0], 0.0, new_intrinsics[2],
-      0.0, new_intrinsics[1], new_intrinsics[3],
-      0.0, 0.0, 1.0);
-
-  // 畸变模型选择，一般为radtan
-  // 将原图像中的关键点转换为未畸变的关键点
-  // 畸变矫正后的点是归一化(相机坐标系下)的坐标，详见opencv的函数说明
-  if (distortion_model == "radtan") {
-    cv::undistortPoints(pts_in, pts_out, K, distortion_coeffs,
-                        rectification_matrix, K_new);
-  } else if (distortion_model == "equidistant") {
-    cv::fisheye::undistortPoints(pts_in, pts_out, K, distortion_coeffs,
-                                 rectification_matrix, K_new);
-  } else {
-    ROS_WARN_ONCE("The model %s is unrecognized, use radtan instead...",
-                  distortion_model.c_str());
-    cv::undistortPoints(pts_in, pts_out, K, distortion_coeffs,
-                        rectification_matrix, K_new);
-  }
-
+  // 查找表之外的点仍由cv::undistortPoints或
+  // cv::fisheye::undistortPoints求解
+  undistorter.undistort(pts_in, pts_out, rectification_matrix);
   return;
 }
 
@@ -1048,6 +1689,7 @@ vector<cv::Point2f> ImageProcessor::distortPoints(
     const cv::Vec4d& intrinsics,
     const string& distortion_model,
     const cv::Vec4d& distortion_coeffs) {
+  MSCKF_VIO_TRACE_SCOPE("ImageProcessor::distortPoints");
 
   const cv::Matx33d K(intrinsics[0], 0.0, intrinsics[2],
                       0.0, intrinsics[1], intrinsics[3],
@@ -1077,58 +1719,55 @@ vector<cv::Point2f> ImageProcessor::distortPoints(
 }
 
 /**
- * @brief 计算原图像帧关键点对应的矫正位置
- * @param cam0_R_p_c：图像帧中已校正的关键点位置
- * @param cam1_R_p_c:内参矩阵
+ * @brief 积分前后两帧图像之间的陀螺仪数据，得到两帧之间的旋转
+ * @return cam0_R_p_c：上一帧cam0系到当前帧cam0系的旋转
+ * @return cam1_R_p_c：上一帧cam1系到当前帧cam1系的旋转
  *
  */
 void ImageProcessor::integrateImuData(
     Matx33f& cam0_R_p_c, Matx33f& cam1_R_p_c) {
-  // Find the start and the end limit within the imu msg buffer.
-  // 找到上一时刻和当前时刻的imu对应的时间戳
-  auto begin_iter = imu_msg_buffer.begin();
-  while (begin_iter != imu_msg_buffer.end()) {
-    if ((begin_iter->header.stamp-
-          cam0_prev_img_ptr->header.stamp).toSec() < -0.01)
-      ++begin_iter;
-    else
-      break;
-  }
-
-  auto end_iter = begin_iter;
-  while (end_iter != imu_msg_buffer.end()) {
-    if ((end_iter->header.stamp-
-          cam0_curr_img_ptr->header.stamp).toSec() < 0.005)
-      ++end_iter;
-    else
-      break;
+  MSCKF_VIO_TRACE_SCOPE("ImageProcessor::integrateImuData");
+  lock_guard<mutex> lock(imu_mutex);
+  // Find the start and the end limit within the imu msg buffer,
+  // which is ordered by the time stamps.
+  // 二分查找上一时刻和当前时刻的imu对应的位置
+  const ros::Time& prev_stamp = cam0_prev_img_ptr->header.stamp;
+  const ros::Time& curr_stamp = cam0_curr_img_ptr->header.stamp;
+  const auto stamp_less = [](const sensor_msgs::Imu& msg,
+      const ros::Time& stamp) {
+    return msg.header.stamp < stamp;
+  };
+  const auto begin_iter = lower_bound(imu_msg_buffer.begin(),
+      imu_msg_buffer.end(), prev_stamp-ros::Duration(0.01), stamp_less);
+  const auto end_iter = lower_bound(begin_iter,
+      imu_msg_buffer.end(), curr_stamp+ros::Duration(0.005), stamp_less);
+
+  // Rotation which takes a vector from the current IMU
+  // frame to the previous IMU frame.
+  Matx33d imu_R_c_p = Matx33d::eye();
+
+  if (processor_config.preintegrate_rotation) {
+    imu_R_c_p = integrateGyro(begin_iter, end_iter, prev_stamp, curr_stamp);
+  } else {
+    // Compute the mean angular velocity in the IMU frame.
+    // 计算imu系下的平均角速度
+    Vec3d mean_ang_vel(0.0, 0.0, 0.0);
+    for (auto iter = begin_iter; iter < end_iter; ++iter)
+      mean_ang_vel += Vec3d(iter->angular_velocity.x,
+          iter->angular_velocity.y, iter->angular_velocity.z);
+
+    if (end_iter-begin_iter > 0)
+      mean_ang_vel *= 1.0 / (end_iter-begin_iter);
+    const double dtime = (curr_stamp-prev_stamp).toSec();
+    Rodrigues(mean_ang_vel*dtime, imu_R_c_p);
   }
 
-  // Compute the mean angular velocity in the IMU frame.
-  // 计算imu系下的平均角速度
-  Vec3f mean_ang_vel(0.0, 0.0, 0.0);
-  for (auto iter = begin_iter; iter < end_iter; ++iter)
-    mean_ang_vel += Vec3f(iter->angular_velocity.x,
-        iter->angular_velocity.y, iter->angular_velocity.z);
-
-  if (end_iter-begin_iter > 0)
-    mean_ang_vel *= 1.0f / (end_iter-begin_iter);
-
-  // Transform the mean angular velocity from the IMU
-  // frame to the cam0 and cam1 frames.
-  // 将平均角速度从imu系转换到图像坐标系
-  // t()表示转置
-  Vec3f cam0_mean_ang_vel = R_cam0_imu.t() * mean_ang_vel;
-  Vec3f cam1_mean_ang_vel = R_cam1_imu.t() * mean_ang_vel;
-
-  // Compute the relative rotation.
-  // 通过imu来计算前后两个时刻两帧图像之间的旋转
-  double dtime = (cam0_curr_img_ptr->header.stamp-
-      cam0_prev_img_ptr->header.stamp).toSec();
-  Rodrigues(cam0_mean_ang_vel*dtime, cam0_R_p_c);
-  Rodrigues(cam1_mean_ang_vel*dtime, cam1_R_p_c);
-  cam0_R_p_c = cam0_R_p_c.t();
-  cam1_R_p_c = cam1_R_p_c.t();
+  // Transform the relative rotation from the IMU frame to the
+  // cam0 and cam1 frames, and take a vector from the previous
+  // frame to the current frame.
+  // 将旋转从imu系转换到相机坐标系，t()表示转置
+  cam0_R_p_c = R_cam0_imu.t() * imu_R_c_p.t() * R_cam0_imu;
+  cam1_R_p_c = R_cam1_imu.t() * imu_R_c_p.t() * R_cam1_imu;
 
   // Delete the useless and used imu messages.
   // 清除已使用过的imu信息
@@ -1136,6 +1775,34 @@ void ImageProcessor::integrateImuData(
   return;
 }
 
+/**
+ * @brief 逐个积分两帧之间的角速度
+ *
+ * 上一次积分已经删除了上一帧之前的imu信息，所以第一个imu信息
+ * 要从上一帧的时刻开始积分，否则会漏掉中间的一段时间
+ */
+Matx33d ImageProcessor::integrateGyro(
+    const vector<sensor_msgs::Imu>::const_iterator& begin_iter,
+    const vector<sensor_msgs::Imu>::const_iterator& end_iter,
+    const ros::Time& prev_stamp, const ros::Time& curr_stamp) {
+  Matx33d imu_R_c_p = Matx33d::eye();
+  for (auto iter = begin_iter; iter < end_iter; ++iter) {
+    const ros::Time start_stamp = iter == begin_iter ?
+      prev_stamp : max(iter->header.stamp, prev_stamp);
+    const ros::Time end_stamp = iter+1 < end_iter ?
+      min((iter+1)->header.stamp, curr_stamp) : curr_stamp;
+    const double dt = (end_stamp-start_stamp).toSec();
+    if (dt <= 0.0) continue;
+
+    const Vec3d ang_vel(iter->angular_velocity.x,
+        iter->angular_velocity.y, iter->angular_velocity.z);
+    Matx33d dR;
+    Rodrigues(ang_vel*dt, dR);
+    imu_R_c_p = imu_R_c_p * dR;
+  }
+  return imu_R_c_p;
+}
+
 /**
  * @brief 归一化关键点的坐标，计算得到尺度因子
  * @param pts1：上一时刻的关键点位置
@@ -1171,10 +1838,10 @@ void ImageProcessor::rescalePoints(
 
 /**
  * @brief 计算原图像帧关键点对应的矫正位置
- * @param pts1：上一时刻的关键点位置
- * @param pts2:当前时刻跟踪匹配到的关键点位置
+ * @param pts1：上一时刻的关键点归一化坐标
+ * @param pts2:当前时刻跟踪匹配到的关键点归一化坐标
  * @param R_p_c:根据imu信息计算得到的两个时刻相机的相对旋转信息
- * @param distortion_model,intrinsics：相机内参和畸变模型
+ * @param intrinsics：相机内参
  * @param inlier_error：内点可接受的阈值（关键点距离差）
  * @param success_probability：成功的概率
  * @return inlier_markers：内点标志位
@@ -1182,12 +1849,12 @@ void ImageProcessor::rescalePoints(
  */
 void ImageProcessor::twoPointRansac(
     const vector<Point2f>& pts1, const vector<Point2f>& pts2,
+    const vector<float>& qualities,
     const cv::Matx33f& R_p_c, const cv::Vec4d& intrinsics,
-    const std::string& distortion_model,
-    const cv::Vec4d& distortion_coeffs,
     const double& inlier_error,
     const double& success_probability,
     vector<int>& inlier_markers) {
+  MSCKF_VIO_TRACE_SCOPE("ImageProcessor::twoPointRansac");
 
   // Check the size of input point size.
   if (pts1.size() != pts2.size())
@@ -1197,8 +1864,6 @@ void ImageProcessor::twoPointRansac(
   // 平均焦距 f_a = (fx+fy)/2
   // norm_pixel_unit = 1 / f_a 表示一个像素点的归一化坐标值偏差
   double norm_pixel_unit = 2.0 / (intrinsics[0]+intrinsics[1]);
-  int iter_num = static_cast<int>(
-      ceil(log(1-success_probability) / log(1-0.7*0.7)));
 
   // Initially, mark all points as inliers.
   // 对所有的关键点赋予一个判断是否为内点的标志位
@@ -1206,16 +1871,11 @@ void ImageProcessor::twoPointRansac(
   inlier_markers.clear();
   inlier_markers.resize(pts1.size(), 1);
 
-  // Undistort all the points.
-  // 对前后时刻所有的关键点进行去畸变操作
-  vector<Point2f> pts1_undistorted(pts1.size());
-  vector<Point2f> pts2_undistorted(pts2.size());
-  undistortPoints(
-      pts1, intrinsics, distortion_model,
-      distortion_coeffs, pts1_undistorted);
-  undistortPoints(
-      pts2, intrinsics, distortion_model,
-      distortion_coeffs, pts2_undistorted);
+  // The points are already undistorted, and are copied
+  // since they are rotated and rescaled below.
+  // 关键点的归一化坐标已缓存在特征表中
+  vector<Point2f> pts1_undistorted(pts1);
+  vector<Point2f> pts2_undistorted(pts2);
 
 
   // Compenstate the points in the previous image with
@@ -1293,16 +1953,6 @@ void ImageProcessor::twoPointRansac(
   }
 
   // In the case of general motion, the RANSAC model can be applied.
-  // The three column corresponds to tx, ty, and tz respectively.
-  //
-  MatrixXd coeff_t(pts_diff.size(), 3);
-  for (int i = 0; i < pts_diff.size(); ++i) {
-    coeff_t(i, 0) = pts_diff[i].y;
-    coeff_t(i, 1) = -pts_diff[i].x;
-    coeff_t(i, 2) = pts1_undistorted[i].x*pts2_undistorted[i].y -
-      pts1_undistorted[i].y*pts2_undistorted[i].x;
-  }
-
   // 找到被认为是内点的匹配关键点对的索引
   vector<int> raw_inlier_idx;
   for (int i = 0; i < inlier_markers.size(); ++i) {
@@ -1311,139 +1961,13 @@ void ImageProcessor::twoPointRansac(
       raw_inlier_idx.push_back(i);
   }
 
-  //
-  vector<int> best_inlier_set;
-  double best_error = 1e10;
-  // ros包，随机数的生成
-  random_numbers::RandomNumberGenerator random_gen;
-
-  // 执行两点RANSAC
-  for (int iter_idx = 0; iter_idx < iter_num; ++iter_idx) {
-    // Randomly select two point pairs.
-    // Although this is a weird way of selecting two pairs, but it
-    // is able to efficiently avoid selecting repetitive pairs.
-    // 随机选择两个点对pair_idx1和pair_idx2（索引）
-    // 先从保存内点索引的raw_inlier_idx中随机产生一个位置索引
-    // 随机产生一个索引差值
-    int pair_idx1 = raw_inlier_idx[random_gen.uniformInteger(
-        0, raw_inlier_idx.size()-1)];
-    int idx_diff = random_gen.uniformInteger(
-        1, raw_inlier_idx.size()-1);
-    // 产生第二个索引位置
-    // 如果索引pair_idx1加上索引差超过最大值，则减去索引最大值
-    int pair_idx2 = pair_idx1+idx_diff < raw_inlier_idx.size() ?
-      pair_idx1+idx_diff : pair_idx1+idx_diff-raw_inlier_idx.size();
-
-    // Construct the model;
-    //
-    Vector2d coeff_tx(coeff_t(pair_idx1, 0), coeff_t(pair_idx2, 0));
-    Vector2d coeff_ty(coeff_t(pair_idx1, 1), coeff_t(pair_idx2, 1));
-    Vector2d coeff_tz(coeff_t(pair_idx1, 2), coeff_t(pair_idx2, 2));
-    vector<double> coeff_l1_norm(3);
-    coeff_l1_norm[0] = coeff_tx.lpNorm<1>();
-    coeff_l1_norm[1] = coeff_ty.lpNorm<1>();
-    coeff_l1_norm[2] = coeff_tz.lpNorm<1>();
-    int base_indicator = min_element(coeff_l1_norm.begin(),
-        coeff_l1_norm.end())-coeff_l1_norm.begin();
-
-    Vector3d model(0.0, 0.0, 0.0);
-    if (base_indicator == 0) {
-      Matrix2d A;
-      A << coeff_ty, coeff_tz;
-      Vector2d solution = A.inverse() * (-coeff_tx);
-      model(0) = 1.0;
-      model(1) = solution(0);
-      model(2) = solution(1);
-    } else if (base_indicator ==1) {
-      Matrix2d A;
-      A << coeff_tx, coeff_tz;
-      Vector2d solution = A.inverse() * (-coeff_ty);
-      model(0) = solution(0);
-      model(1) = 1.0;
-      model(2) = solution(1);
-    } else {
-      Matrix2d A;
-      A << coeff_tx, coeff_ty;
-      Vector2d solution = A.inverse() * (-coeff_tz);
-      model(0) = solution(0);
-      model(1) = solution(1);
-      model(2) = 1.0;
-    }
-
-    // Find all the inliers among point pairs.
-    VectorXd error = coeff_t * model;
-
-    vector<int> inlier_set;
-    for (int i = 0; i < error.rows(); ++i) {
-      if (inlier_markers[i] == 0) continue;
-      if (std::abs(error(i)) < inlier_error*norm_pixel_unit)
-        inlier_set.push_back(i);
-    }
-
-    // If the number of inliers is small, the current
-    // model is probably wrong.
-    if (inlier_set.size() < 0.2*pts1_undistorted.size())
-      continue;
-
-    // Refit the model using all of the possible inliers.
-    VectorXd coeff_tx_better(inlier_set.size());
-    VectorXd coeff_ty_better(inlier_set.size());
-    VectorXd coeff_tz_better(inlier_set.size());
-    for (int i = 0; i < inlier_set.size(); ++i) {
-      coeff_tx_better(i) = coeff_t(inlier_set[i], 0);
-      coeff_ty_better(i) = coeff_t(inlier_set[i], 1);
-      coeff_tz_better(i) = coeff_t(inlier_set[i], 2);
-    }
-
-    Vector3d model_better(0.0, 0.0, 0.0);
-    if (base_indicator == 0) {
-      MatrixXd A(inlier_set.size(), 2);
-      A << coeff_ty_better, coeff_tz_better;
-      Vector2d solution =
-          (A.transpose() * A).inverse() * A.transpose() * (-coeff_tx_better);
-      model_better(0) = 1.0;
-      model_better(1) = solution(0);
-      model_better(2) = solution(1);
-    } else if (base_indicator ==1) {
-      MatrixXd A(inlier_set.size(), 2);
-      A << coeff_tx_better, coeff_tz_better;
-      Vector2d solution =
-          (A.transpose() * A).inverse() * A.transpose() * (-coeff_ty_better);
-      model_better(0) = solution(0);
-      model_better(1) = 1.0;
-      model_better(2) = solution(1);
-    } else {
-      MatrixXd A(inlier_set.size(), 2);
-      A << coeff_tx_better, coeff_ty_better;
-      Vector2d solution =
-          (A.transpose() * A).inverse() * A.transpose() * (-coeff_tz_better);
-      model_better(0) = solution(0);
-      model_better(1) = solution(1);
-      model_better(2) = 1.0;
-    }
-
-    // Compute the error and upate the best model if possible.
-    VectorXd new_error = coeff_t * model_better;
-
-    double this_error = 0.0;
-    for (const auto& inlier_idx : inlier_set)
-      this_error += std::abs(new_error(inlier_idx));
-    this_error /= inlier_set.size();
-
-    if (inlier_set.size() > best_inlier_set.size()) {
-      best_error = this_error;
-      best_inlier_set = inlier_set;
-    }
-  }
-
-  // Fill in the markers.
-  inlier_markers.clear();
-  inlier_markers.resize(pts1.size(), 0);
-  for (const auto& inlier_idx : best_inlier_set)
-    inlier_markers[inlier_idx] = 1;
+  // 执行两点RANSAC，假设的数量根据内点比例自适应地减少
+  ransac->estimate(
+      pts1_undistorted, pts2_undistorted, raw_inlier_idx, qualities,
+      inlier_error*norm_pixel_unit, success_probability, inlier_markers);
 
   //printf("inlier ratio: %lu/%lu\n",
-  //    best_inlier_set.size(), inlier_markers.size());
+  //    raw_inlier_idx.size(), inlier_markers.size());
 
   return;
 }
@@ -1452,57 +1976,85 @@ void ImageProcessor::twoPointRansac(
  * @brief 用于显示双目图像和特征点，并发布消息
  *
  */
-void ImageProcessor::publish() {
-
-  // Publish features.
-  CameraMeasurementPtr feature_msg_ptr(new CameraMeasurement);
-  feature_msg_ptr->header.stamp = cam0_curr_img_ptr->header.stamp;
-
-  vector<FeatureIDType> curr_ids(0);
-  vector<Point2f> curr_cam0_points(0);
-  vector<Point2f> curr_cam1_points(0);
-
-  // 对当前图像中的特征点进行读取、位置矫正
-  for (const auto& grid_features : (*curr_features_ptr)) {
-    for (const auto& feature : grid_features.second) {
-      curr_ids.push_back(feature.id);
-      curr_cam0_points.push_back(feature.cam0_point);
-      curr_cam1_points.push_back(feature.cam1_point);
+void ImageProcessor::publish(const OutputData& output) {
+  MSCKF_VIO_TRACE_SCOPE("ImageProcessor::publish");
+
+  // The features are tracked on every frame, but the
+  // measurements are skipped while the filter is behind.
+  // 滤波器来不及处理时跳过这一帧的量测，特征跟踪不受影响
+  const ros::Time& time = output.cam0_img_ptr->header.stamp;
+  FeatureFramePtr frame;
+  if (feature_channel) {
+    // 单进程流水线中特征帧通过无锁队列交给滤波器
+    if (feature_channel->acquire(frame)) {
+      frame->time = time;
+      const vector<FeatureIDType>& curr_ids = output.curr_features.getIds();
+      const vector<Point2f>& curr_cam0_points_undistorted =
+        output.curr_features.getCam0Undistorted();
+      const vector<Point2f>& curr_cam1_points_undistorted =
+        output.curr_features.getCam1Undistorted();
+      for (int i = 0; i < curr_ids.size(); ++i)
+        frame->push_back(curr_ids[i],
+            curr_cam0_points_undistorted[i].x,
+            curr_cam0_points_undistorted[i].y,
+            curr_cam1_points_undistorted[i].x,
+            curr_cam1_points_undistorted[i].y);
+      feature_channel->send(frame);
+    } else {
+      ++skipped_frames;
+    }
+  } else if (isFilterReady(time)) {
+    // Publish features.
+    CameraMeasurementPtr feature_msg_ptr(new CameraMeasurement);
+    feature_msg_ptr->header.stamp = time;
+
+    // 特征表中缓存了当前特征点矫正后的归一化坐标
+    const vector<FeatureIDType>& curr_ids = output.curr_features.getIds();
+    const vector<Point2f>& curr_cam0_points_undistorted =
+      output.curr_features.getCam0Undistorted();
+    const vector<Point2f>& curr_cam1_points_undistorted =
+      output.curr_features.getCam1Undistorted();
+
+    // 特征消息包含特征的位置和id
+    for (int i = 0; i < curr_ids.size(); ++i) {
+      feature_msg_ptr->features.push_back(FeatureMeasurement());
+      feature_msg_ptr->features[i].id = curr_ids[i];
+      feature_msg_ptr->features[i].u0 = curr_cam0_points_undistorted[i].x;
+      feature_msg_ptr->features[i].v0 = curr_cam0_points_undistorted[i].y;
+      feature_msg_ptr->features[i].u1 = curr_cam1_points_undistorted[i].x;
+      feature_msg_ptr->features[i].v1 = curr_cam1_points_undistorted[i].y;
     }
-  }
-
-  vector<Point2f> curr_cam0_points_undistorted(0);
-  vector<Point2f> curr_cam1_points_undistorted(0);
 
-  undistortPoints(
-      curr_cam0_points, cam0_intrinsics, cam0_distortion_model,
-      cam0_distortion_coeffs, curr_cam0_points_undistorted);
-  undistortPoints(
-      curr_cam1_points, cam1_intrinsics, cam1_distortion_model,
-      cam1_distortion_coeffs, curr_cam1_points_undistorted);
-
-  // 特征消息包含特征的位置和id
-  for (int i = 0; i < curr_ids.size(); ++i) {
-    feature_msg_ptr->features.push_back(FeatureMeasurement());
-    feature_msg_ptr->features[i].id = curr_ids[i];
-    feature_msg_ptr->features[i].u0 = curr_cam0_points_undistorted[i].x;
-    feature_msg_ptr->features[i].v0 = curr_cam0_points_undistorted[i].y;
-    feature_msg_ptr->features[i].u1 = curr_cam1_points_undistorted[i].x;
-    feature_msg_ptr->features[i].v1 = curr_cam1_points_undistorted[i].y;
+    // topic名字为features
+    feature_pub.publish(feature_msg_ptr);
+  } else {
+    ++skipped_frames;
   }
 
-  // topic名字为features
-  feature_pub.publish(feature_msg_ptr);
-
   // Publish tracking info.
   // topic名字为tracking_info
       // 包含的信息为图像的头、
   TrackingInfoPtr tracking_info_msg_ptr(new TrackingInfo());
-  tracking_info_msg_ptr->header.stamp = cam0_curr_img_ptr->header.stamp;
-  tracking_info_msg_ptr->before_tracking = before_tracking;
-  tracking_info_msg_ptr->after_tracking = after_tracking;
-  tracking_info_msg_ptr->after_matching = after_matching;
-  tracking_info_msg_ptr->after_ransac = after_ransac;
+  tracking_info_msg_ptr->header.stamp = output.cam0_img_ptr->header.stamp;
+  tracking_info_msg_ptr->before_tracking = output.before_tracking;
+  tracking_info_msg_ptr->after_tracking = output.after_tracking;
+  tracking_info_msg_ptr->after_matching = output.after_matching;
+  tracking_info_msg_ptr->after_ransac = output.after_ransac;
+  tracking_info_msg_ptr->queue_depth =
+    frame_queue->size() + output_queue->size();
+  {
+    lock_guard<mutex> lock(filter_status_mutex);
+    tracking_info_msg_ptr->frames_in_flight = frames_in_flight.size();
+    tracking_info_msg_ptr->filter_latency = filter_latency;
+  }
+  tracking_info_msg_ptr->skipped_frames = skipped_frames;
+  tracking_info_msg_ptr->after_detection = output.after_detection;
+  tracking_info_msg_ptr->frontend_time = output.frontend_time;
+  tracking_info_msg_ptr->fast_threshold = output.fast_threshold;
+  tracking_info_msg_ptr->grid_min_feature_num =
+    output.grid_min_feature_num;
+  tracking_info_msg_ptr->grid_max_feature_num =
+    output.grid_max_feature_num;
   tracking_info_pub.publish(tracking_info_msg_ptr);
 
   return;
@@ -1537,22 +2089,18 @@ void ImageProcessor::drawFeaturesMono() {
   }
 
   // Collect features ids in the previous frame.
-  vector<FeatureIDType> prev_ids(0);
-  for (const auto& grid_features : *prev_features_ptr)
-    for (const auto& feature : grid_features.second)
-      prev_ids.push_back(feature.id);
+  const vector<FeatureIDType>& prev_ids = prev_features_ptr->getIds();
 
   // Collect feature points in the previous frame.
   map<FeatureIDType, Point2f> prev_points;
-  for (const auto& grid_features : *prev_features_ptr)
-    for (const auto& feature : grid_features.second)
-      prev_points[feature.id] = feature.cam0_point;
+  for (int i = 0; i < prev_features_ptr->size(); ++i)
+    prev_points[prev_ids[i]] = prev_features_ptr->getCam0Points()[i];
 
   // Collect feature points in the current frame.
   map<FeatureIDType, Point2f> curr_points;
-  for (const auto& grid_features : *curr_features_ptr)
-    for (const auto& feature : grid_features.second)
-      curr_points[feature.id] = feature.cam0_point;
+  for (int i = 0; i < curr_features_ptr->size(); ++i)
+    curr_points[curr_features_ptr->getIds()[i]] =
+      curr_features_ptr->getCam0Points()[i];
 
   // Draw tracked features.
   for (const auto& id : prev_ids) {
@@ -1582,7 +2130,8 @@ void ImageProcessor::drawFeaturesMono() {
  * @brief 用于显示双目图像和特征点，并发布消息
  *
  */
-void ImageProcessor::drawFeaturesStereo() {
+void ImageProcessor::drawFeaturesStereo(const DebugData& debug) {
+  MSCKF_VIO_TRACE_SCOPE("ImageProcessor::drawFeaturesStereo");
 
   // 有订阅的节点
   if(debug_stereo_pub.getNumSubscribers() > 0) {
@@ -1592,18 +2141,18 @@ void ImageProcessor::drawFeaturesStereo() {
     Scalar new_feature(0, 255, 255);
 
     static int grid_height =
-            cam0_curr_img_ptr->image.rows / processor_config.grid_row;
+            debug.cam0_img_ptr->image.rows / processor_config.grid_row;
     static int grid_width =
-            cam0_curr_img_ptr->image.cols / processor_config.grid_col;
+            debug.cam0_img_ptr->image.cols / processor_config.grid_col;
 
     // Create an output image.
     // 输出图像out_img，两个图像合并为一个图像
-    int img_height = cam0_curr_img_ptr->image.rows;
-    int img_width = cam0_curr_img_ptr->image.cols;
+    int img_height = debug.cam0_img_ptr->image.rows;
+    int img_width = debug.cam0_img_ptr->image.cols;
     Mat out_img(img_height, img_width * 2, CV_8UC3);
-    cvtColor(cam0_curr_img_ptr->image,
+    cvtColor(debug.cam0_img_ptr->image,
              out_img.colRange(0, img_width), CV_GRAY2RGB);
-    cvtColor(cam1_curr_img_ptr->image,
+    cvtColor(debug.cam1_img_ptr->image,
              out_img.colRange(img_width, img_width * 2), CV_GRAY2RGB);
 
     // Draw grids on the image.
@@ -1624,32 +2173,25 @@ void ImageProcessor::drawFeaturesStereo() {
       line(out_img, pt1, pt2, Scalar(255, 0, 0));
     }
 
-    // Collect features ids in the previous frame.
-    // 将上一时刻的特征点的id保存（第一帧图像没有）
-    vector<FeatureIDType> prev_ids(0);
-    for (const auto &grid_features : *prev_features_ptr)
-      for (const auto &feature : grid_features.second)
-        prev_ids.push_back(feature.id);
-
     // Collect feature points in the previous frame.
-    // 将上一时刻的特征点位置保存
+    // 将上一时刻的特征点位置保存（第一帧图像没有）
+    const vector<FeatureIDType>& prev_ids = debug.prev_ids;
     map<FeatureIDType, Point2f> prev_cam0_points;
     map<FeatureIDType, Point2f> prev_cam1_points;
-    for (const auto &grid_features : *prev_features_ptr)
-      for (const auto &feature : grid_features.second) {
-        prev_cam0_points[feature.id] = feature.cam0_point;
-        prev_cam1_points[feature.id] = feature.cam1_point;
-      }
+    for (int i = 0; i < prev_ids.size(); ++i) {
+      prev_cam0_points[prev_ids[i]] = debug.prev_cam0_points[i];
+      prev_cam1_points[prev_ids[i]] = debug.prev_cam1_points[i];
+    }
 
     // Collect feature points in the current frame.
     // 当前时刻的关键点
     map<FeatureIDType, Point2f> curr_cam0_points;
     map<FeatureIDType, Point2f> curr_cam1_points;
-    for (const auto &grid_features : *curr_features_ptr)
-      for (const auto &feature : grid_features.second) {
-        curr_cam0_points[feature.id] = feature.cam0_point;
-        curr_cam1_points[feature.id] = feature.cam1_point;
-      }
+    for (int i = 0; i < debug.curr_ids.size(); ++i) {
+      const FeatureIDType& id = debug.curr_ids[i];
+      curr_cam0_points[id] = debug.curr_cam0_points[i];
+      curr_cam1_points[id] = debug.curr_cam1_points[i];
+    }
 
     // Draw tracked features.
     // 画出跟踪的特征点
@@ -1685,7 +2227,8 @@ void ImageProcessor::drawFeaturesStereo() {
     }
 
     // 将用于显示的图像消息发布
-    cv_bridge::CvImage debug_image(cam0_curr_img_ptr->header, "bgr8", out_img);
+    cv_bridge::CvImage debug_image(
+        debug.cam0_img_ptr->header, "bgr8", out_img);
     debug_stereo_pub.publish(debug_image.toImageMsg());
   }
 //    imshow("Feature", out_img);
@@ -1694,15 +2237,11 @@ void ImageProcessor::drawFeaturesStereo() {
 }
 
 void ImageProcessor::updateFeatureLifetime() {
-  for (int code = 0; code <
-      processor_config.grid_row*processor_config.grid_col; ++code) {
-    vector<FeatureMetaData>& features = (*curr_features_ptr)[code];
-    for (const auto& feature : features) {
-      if (feature_lifetime.find(feature.id) == feature_lifetime.end())
-        feature_lifetime[feature.id] = 1;
-      else
-        ++feature_lifetime[feature.id];
-    }
+  for (const auto& id : curr_features_ptr->getIds()) {
+    if (feature_lifetime.find(id) == feature_lifetime.end())
+      feature_lifetime[id] = 1;
+    else
+      ++feature_lifetime[id];
   }
 
   return;
@@ -0,0 +1,795 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+#include <algorithm>
+
+#include <msckf_vio/simd.h>
+#include <msckf_vio/klt_tracker.h>
+
+using namespace std;
+using namespace cv;
+
+namespace msckf_vio {
+
+namespace {
+
+// Precision of the bilinear weights in fixed point, which is
+// the same as cv::calcOpticalFlowPyrLK. The interpolated
+// intensities keep 5 fractional bits to match the scale of
+// the Scharr gradients.
+const int kWeightBits = 14;
+const int kIntensityShift = kWeightBits - 5;
+const float kSumScale = 1.0f / (1 << 20);
+
+inline int descale(const int& x, const int& n) {
+  return (x + (1 << (n-1))) >> n;
+}
+
+/**
+ * @brief 标量实现，S为0时使用运行时的patch大小
+ *
+ * 所有的和都用整数计算，因此与向量化的实现结果完全相同
+ */
+template <int S>
+void patchScalar(const unsigned char* img, const size_t& img_step,
+    const short* grad, const size_t& grad_step,
+    const int* w, const int& runtime_size,
+    int* patch, int* patch_dx, int* patch_dy, long long* sums) {
+  const int size = S > 0 ? S : runtime_size;
+  long long a11 = 0, a12 = 0, a22 = 0;
+
+  for (int y = 0; y < size; ++y) {
+    const unsigned char* src = img + y*img_step;
+    const short* dsrc = grad + y*grad_step;
+    int* ival = patch + y*size;
+    int* ixval = patch_dx + y*size;
+    int* iyval = patch_dy + y*size;
+
+    for (int x = 0; x < size; ++x) {
+      const short* d = dsrc + 2*x;
+      ival[x] = descale(src[x]*w[0] + src[x+1]*w[1] +
+          src[x+img_step]*w[2] + src[x+img_step+1]*w[3],
+          kIntensityShift);
+      ixval[x] = descale(d[0]*w[0] + d[2]*w[1] +
+          d[grad_step]*w[2] + d[grad_step+2]*w[3], kWeightBits);
+      iyval[x] = descale(d[1]*w[0] + d[3]*w[1] +
+          d[grad_step+1]*w[2] + d[grad_step+3]*w[3], kWeightBits);
+
+      a11 += ixval[x]*ixval[x];
+      a12 += ixval[x]*iyval[x];
+      a22 += iyval[x]*iyval[x];
+    }
+  }
+
+  sums[0] = a11;
+  sums[1] = a12;
+  sums[2] = a22;
+  return;
+}
+
+template <int S>
+void mismatchScalar(const unsigned char* img, const size_t& img_step,
+    const int* w, const int& runtime_size,
+    const int* patch, const int* patch_dx, const int* patch_dy,
+    long long* sums) {
+  const int size = S > 0 ? S : runtime_size;
+  long long b1 = 0, b2 = 0;
+
+  for (int y = 0; y < size; ++y) {
+    const unsigned char* src = img + y*img_step;
+    for (int x = 0; x < size; ++x) {
+      const int diff = descale(src[x]*w[0] + src[x+1]*w[1] +
+          src[x+img_step]*w[2] + src[x+img_step+1]*w[3],
+          kIntensityShift) - patch[y*size+x];
+      b1 += diff * patch_dx[y*size+x];
+      b2 += diff * patch_dy[y*size+x];
+    }
+  }
+
+  sums[0] = b1;
+  sums[1] = b2;
+  return;
+}
+
+template <int S>
+long long residualScalar(const unsigned char* img, const size_t& img_step,
+    const int* w, const int& runtime_size, const int* patch) {
+  const int size = S > 0 ? S : runtime_size;
+  long long sum = 0;
+
+  for (int y = 0; y < size; ++y) {
+    const unsigned char* src = img + y*img_step;
+    for (int x = 0; x < size; ++x) {
+      const int diff = descale(src[x]*w[0] + src[x+1]*w[1] +
+          src[x+img_step]*w[2] + src[x+img_step+1]*w[3],
+          kIntensityShift) - patch[y*size+x];
+      sum += abs(diff);
+    }
+  }
+
+  return sum;
+}
+
+template <int S>
+KltTracker::Kernels scalarKernels() {
+  KltTracker::Kernels kernels;
+  kernels.patch = patchScalar<S>;
+  kernels.mismatch = mismatchScalar<S>;
+  kernels.residual = residualScalar<S>;
+  kernels.name = "scalar";
+  return kernels;
+}
+
+#if defined(MSCKF_VIO_SIMD_AVX2)
+
+/**
+ * @brief AVX2实现，每次处理一行中的8个像素
+ *
+ * 行的最后一组与前一组重叠，重叠的像素在求和时被屏蔽，
+ * 因此不会读取patch以外的像素
+ */
+MSCKF_VIO_AVX2_TARGET inline __m256i loadPixels(
+    const unsigned char* src) {
+  return _mm256_cvtepu8_epi32(
+      _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src)));
+}
+
+MSCKF_VIO_AVX2_TARGET inline __m256i interpolatePixels(
+    const unsigned char* src, const size_t& step, const __m256i* w) {
+  __m256i sum = _mm256_mullo_epi32(loadPixels(src), w[0]);
+  sum = _mm256_add_epi32(sum,
+      _mm256_mullo_epi32(loadPixels(src+1), w[1]));
+  sum = _mm256_add_epi32(sum,
+      _mm256_mullo_epi32(loadPixels(src+step), w[2]));
+  sum = _mm256_add_epi32(sum,
+      _mm256_mullo_epi32(loadPixels(src+step+1), w[3]));
+  sum = _mm256_add_epi32(sum,
+      _mm256_set1_epi32(1 << (kIntensityShift-1)));
+  return _mm256_srai_epi32(sum, kIntensityShift);
+}
+
+// Interpolates the (dx, dy) pairs of 8 pixels.
+MSCKF_VIO_AVX2_TARGET inline void interpolateGradients(
+    const short* dsrc, const size_t& step, const __m256i* w,
+    __m256i& dx, __m256i& dy) {
+  const __m256i g00 = _mm256_loadu_si256(
+      reinterpret_cast<const __m256i*>(dsrc));
+  const __m256i g01 = _mm256_loadu_si256(
+      reinterpret_cast<const __m256i*>(dsrc+2));
+  const __m256i g10 = _mm256_loadu_si256(
+      reinterpret_cast<const __m256i*>(dsrc+step));
+  const __m256i g11 = _mm256_loadu_si256(
+      reinterpret_cast<const __m256i*>(dsrc+step+2));
+
+  // The low 16 bits of each pair are dx, and the high 16 bits
+  // are dy.
+  __m256i sum_dx = _mm256_mullo_epi32(
+      _mm256_srai_epi32(_mm256_slli_epi32(g00, 16), 16), w[0]);
+  sum_dx = _mm256_add_epi32(sum_dx, _mm256_mullo_epi32(
+      _mm256_srai_epi32(_mm256_slli_epi32(g01, 16), 16), w[1]));
+  sum_dx = _mm256_add_epi32(sum_dx, _mm256_mullo_epi32(
+      _mm256_srai_epi32(_mm256_slli_epi32(g10, 16), 16), w[2]));
+  sum_dx = _mm256_add_epi32(sum_dx, _mm256_mullo_epi32(
+      _mm256_srai_epi32(_mm256_slli_epi32(g11, 16), 16), w[3]));
+
+  __m256i sum_dy = _mm256_mullo_epi32(_mm256_srai_epi32(g00, 16), w[0]);
+  sum_dy = _mm256_add_epi32(sum_dy,
+      _mm256_mullo_epi32(_mm256_srai_epi32(g01, 16), w[1]));
+  sum_dy = _mm256_add_epi32(sum_dy,
+      _mm256_mullo_epi32(_mm256_srai_epi32(g10, 16), w[2]));
+  sum_dy = _mm256_add_epi32(sum_dy,
+      _mm256_mullo_epi32(_mm256_srai_epi32(g11, 16), w[3]));
+
+  const __m256i round = _mm256_set1_epi32(1 << (kWeightBits-1));
+  dx = _mm256_srai_epi32(_mm256_add_epi32(sum_dx, round), kWeightBits);
+  dy = _mm256_srai_epi32(_mm256_add_epi32(sum_dy, round), kWeightBits);
+  return;
+}
+
+// The 32-bit sums of a row are accumulated in 64 bits, which
+// does not overflow for any patch size.
+MSCKF_VIO_AVX2_TARGET inline __m256i accumulate(
+    const __m256i& sum, const __m256i& row_sum) {
+  return _mm256_add_epi64(_mm256_add_epi64(sum,
+        _mm256_cvtepi32_epi64(_mm256_castsi256_si128(row_sum))),
+      _mm256_cvtepi32_epi64(_mm256_extracti128_si256(row_sum, 1)));
+}
+
+MSCKF_VIO_AVX2_TARGET inline long long horizontalSum(const __m256i& sum) {
+  long long lanes[4];
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), sum);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+// Masks out the first skip lanes.
+MSCKF_VIO_AVX2_TARGET inline __m256i laneMask(const int& skip) {
+  return _mm256_cmpgt_epi32(
+      _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+      _mm256_set1_epi32(skip-1));
+}
+
+MSCKF_VIO_AVX2_TARGET inline void loadWeights(
+    const int* weights, __m256i* w) {
+  for (int i = 0; i < 4; ++i) w[i] = _mm256_set1_epi32(weights[i]);
+  return;
+}
+
+template <int S>
+MSCKF_VIO_AVX2_TARGET void patchAvx2(
+    const unsigned char* img, const size_t& img_step,
+    const short* grad, const size_t& grad_step,
+    const int* weights, const int& runtime_size,
+    int* patch, int* patch_dx, int* patch_dy, long long* sums) {
+  const int size = S > 0 ? S : runtime_size;
+  __m256i w[4];
+  loadWeights(weights, w);
+  __m256i a11 = _mm256_setzero_si256();
+  __m256i a12 = _mm256_setzero_si256();
+  __m256i a22 = _mm256_setzero_si256();
+
+  for (int y = 0; y < size; ++y) {
+    const unsigned char* src = img + y*img_step;
+    const short* dsrc = grad + y*grad_step;
+    __m256i row_a11 = _mm256_setzero_si256();
+    __m256i row_a12 = _mm256_setzero_si256();
+    __m256i row_a22 = _mm256_setzero_si256();
+
+    for (int x = 0; x < size; x += 8) {
+      const int start = min(x, size-8);
+      const __m256i mask = laneMask(x-start);
+
+      const __m256i ival = interpolatePixels(src+start, img_step, w);
+      __m256i ixval, iyval;
+      interpolateGradients(dsrc+2*start, grad_step, w, ixval, iyval);
+      _mm256_storeu_si256(
+          reinterpret_cast<__m256i*>(patch+y*size+start), ival);
+      _mm256_storeu_si256(
+          reinterpret_cast<__m256i*>(patch_dx+y*size+start), ixval);
+      _mm256_storeu_si256(
+          reinterpret_cast<__m256i*>(patch_dy+y*size+start), iyval);
+
+      ixval = _mm256_and_si256(ixval, mask);
+      iyval = _mm256_and_si256(iyval, mask);
+      row_a11 = _mm256_add_epi32(row_a11, _mm256_mullo_epi32(ixval, ixval));
+      row_a12 = _mm256_add_epi32(row_a12, _mm256_mullo_epi32(ixval, iyval));
+      row_a22 = _mm256_add_epi32(row_a22, _mm256_mullo_epi32(iyval, iyval));
+    }
+
+    a11 = accumulate(a11, row_a11);
+    a12 = accumulate(a12, row_a12);
+    a22 = accumulate(a22, row_a22);
+  }
+
+  sums[0] = horizontalSum(a11);
+  sums[1] = horizontalSum(a12);
+  sums[2] = horizontalSum(a22);
+  return;
+}
+
+template <int S>
+MSCKF_VIO_AVX2_TARGET void mismatchAvx2(
+    const unsigned char* img, const size_t& img_step,
+    const int* weights, const int& runtime_size,
+    const int* patch, const int* patch_dx, const int* patch_dy,
+    long long* sums) {
+  const int size = S > 0 ? S : runtime_size;
+  __m256i w[4];
+  loadWeights(weights, w);
+  __m256i b1 = _mm256_setzero_si256();
+  __m256i b2 = _mm256_setzero_si256();
+
+  for (int y = 0; y < size; ++y) {
+    const unsigned char* src = img + y*img_step;
+    __m256i row_b1 = _mm256_setzero_si256();
+    __m256i row_b2 = _mm256_setzero_si256();
+
+    for (int x = 0; x < size; x += 8) {
+      const int start = min(x, size-8);
+      const int offset = y*size + start;
+
+      __m256i diff = _mm256_sub_epi32(
+          interpolatePixels(src+start, img_step, w),
+          _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(patch+offset)));
+      diff = _mm256_and_si256(diff, laneMask(x-start));
+      row_b1 = _mm256_add_epi32(row_b1, _mm256_mullo_epi32(diff,
+            _mm256_loadu_si256(
+              reinterpret_cast<const __m256i*>(patch_dx+offset))));
+      row_b2 = _mm256_add_epi32(row_b2, _mm256_mullo_epi32(diff,
+            _mm256_loadu_si256(
+              reinterpret_cast<const __m256i*>(patch_dy+offset))));
+    }
+
+    b1 = accumulate(b1, row_b1);
+    b2 = accumulate(b2, row_b2);
+  }
+
+  sums[0] = horizontalSum(b1);
+  sums[1] = horizontalSum(b2);
+  return;
+}
+
+template <int S>
+MSCKF_VIO_AVX2_TARGET long long residualAvx2(
+    const unsigned char* img, const size_t& img_step,
+    const int* weights, const int& runtime_size, const int* patch) {
+  const int size = S > 0 ? S : runtime_size;
+  __m256i w[4];
+  loadWeights(weights, w);
+  __m256i sum = _mm256_setzero_si256();
+
+  for (int y = 0; y < size; ++y) {
+    const unsigned char* src = img + y*img_step;
+    __m256i row_sum = _mm256_setzero_si256();
+
+    for (int x = 0; x < size; x += 8) {
+      const int start = min(x, size-8);
+      const __m256i diff = _mm256_sub_epi32(
+          interpolatePixels(src+start, img_step, w),
+          _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(patch+y*size+start)));
+      row_sum = _mm256_add_epi32(row_sum, _mm256_and_si256(
+            _mm256_abs_epi32(diff), laneMask(x-start)));
+    }
+
+    sum = accumulate(sum, row_sum);
+  }
+
+  return horizontalSum(sum);
+}
+
+template <int S>
+KltTracker::Kernels simdKernels() {
+  KltTracker::Kernels kernels;
+  kernels.patch = patchAvx2<S>;
+  kernels.mismatch = mismatchAvx2<S>;
+  kernels.residual = residualAvx2<S>;
+  kernels.name = simd::name();
+  return kernels;
+}
+
+const int kSimdWidth = 8;
+
+#elif defined(MSCKF_VIO_SIMD_NEON)
+
+/**
+ * @brief NEON实现，每次处理一行中的4个像素
+ *
+ * 与AVX2实现相同，行的最后一组与前一组重叠并被屏蔽
+ */
+inline int32x4_t loadPixels(const unsigned char* src) {
+  uint32_t bytes;
+  memcpy(&bytes, src, sizeof(bytes));
+  const uint8x8_t pixels = vreinterpret_u8_u32(vdup_n_u32(bytes));
+  return vreinterpretq_s32_u32(
+      vmovl_u16(vget_low_u16(vmovl_u8(pixels))));
+}
+
+inline int32x4_t interpolatePixels(
+    const unsigned char* src, const size_t& step, const int32x4_t* w) {
+  int32x4_t sum = vmulq_s32(loadPixels(src), w[0]);
+  sum = vmlaq_s32(sum, loadPixels(src+1), w[1]);
+  sum = vmlaq_s32(sum, loadPixels(src+step), w[2]);
+  sum = vmlaq_s32(sum, loadPixels(src+step+1), w[3]);
+  sum = vaddq_s32(sum, vdupq_n_s32(1 << (kIntensityShift-1)));
+  return vshrq_n_s32(sum, kIntensityShift);
+}
+
+// Interpolates the (dx, dy) pairs of 4 pixels.
+inline void interpolateGradients(
+    const short* dsrc, const size_t& step, const int32x4_t* w,
+    int32x4_t& dx, int32x4_t& dy) {
+  const int16x4x2_t g00 = vld2_s16(dsrc);
+  const int16x4x2_t g01 = vld2_s16(dsrc+2);
+  const int16x4x2_t g10 = vld2_s16(dsrc+step);
+  const int16x4x2_t g11 = vld2_s16(dsrc+step+2);
+
+  int32x4_t sum_dx = vmulq_s32(vmovl_s16(g00.val[0]), w[0]);
+  sum_dx = vmlaq_s32(sum_dx, vmovl_s16(g01.val[0]), w[1]);
+  sum_dx = vmlaq_s32(sum_dx, vmovl_s16(g10.val[0]), w[2]);
+  sum_dx = vmlaq_s32(sum_dx, vmovl_s16(g11.val[0]), w[3]);
+
+  int32x4_t sum_dy = vmulq_s32(vmovl_s16(g00.val[1]), w[0]);
+  sum_dy = vmlaq_s32(sum_dy, vmovl_s16(g01.val[1]), w[1]);
+  sum_dy = vmlaq_s32(sum_dy, vmovl_s16(g10.val[1]), w[2]);
+  sum_dy = vmlaq_s32(sum_dy, vmovl_s16(g11.val[1]), w[3]);
+
+  const int32x4_t round = vdupq_n_s32(1 << (kWeightBits-1));
+  dx = vshrq_n_s32(vaddq_s32(sum_dx, round), kWeightBits);
+  dy = vshrq_n_s32(vaddq_s32(sum_dy, round), kWeightBits);
+  return;
+}
+
+inline long long horizontalSum(const int64x2_t& sum) {
+  return vgetq_lane_s64(sum, 0) + vgetq_lane_s64(sum, 1);
+}
+
+// Masks out the first skip lanes.
+inline int32x4_t mask(const int32x4_t& v, const int& skip) {
+  static const int32_t lanes[4] = {0, 1, 2, 3};
+  return vandq_s32(v, vreinterpretq_s32_u32(
+        vcgtq_s32(vld1q_s32(lanes), vdupq_n_s32(skip-1))));
+}
+
+inline void loadWeights(const int* weights, int32x4_t* w) {
+  for (int i = 0; i < 4; ++i) w[i] = vdupq_n_s32(weights[i]);
+  return;
+}
+
+template <int S>
+void patchNeon(const unsigned char* img, const size_t& img_step,
+    const short* grad, const size_t& grad_step,
+    const int* weights, const int& runtime_size,
+    int* patch, int* patch_dx, int* patch_dy, long long* sums) {
+  const int size = S > 0 ? S : runtime_size;
+  int32x4_t w[4];
+  loadWeights(weights, w);
+  int64x2_t a11 = vdupq_n_s64(0);
+  int64x2_t a12 = vdupq_n_s64(0);
+  int64x2_t a22 = vdupq_n_s64(0);
+
+  for (int y = 0; y < size; ++y) {
+    const unsigned char* src = img + y*img_step;
+    const short* dsrc = grad + y*grad_step;
+    int32x4_t row_a11 = vdupq_n_s32(0);
+    int32x4_t row_a12 = vdupq_n_s32(0);
+    int32x4_t row_a22 = vdupq_n_s32(0);
+
+    for (int x = 0; x < size; x += 4) {
+      const int start = min(x, size-4);
+
+      const int32x4_t ival = interpolatePixels(src+start, img_step, w);
+      int32x4_t ixval, iyval;
+      interpolateGradients(dsrc+2*start, grad_step, w, ixval, iyval);
+      vst1q_s32(patch+y*size+start, ival);
+      vst1q_s32(patch_dx+y*size+start, ixval);
+      vst1q_s32(patch_dy+y*size+start, iyval);
+
+      ixval = mask(ixval, x-start);
+      iyval = mask(iyval, x-start);
+      row_a11 = vmlaq_s32(row_a11, ixval, ixval);
+      row_a12 = vmlaq_s32(row_a12, ixval, iyval);
+      row_a22 = vmlaq_s32(row_a22, iyval, iyval);
+    }
+
+    a11 = vpadalq_s32(a11, row_a11);
+    a12 = vpadalq_s32(a12, row_a12);
+    a22 = vpadalq_s32(a22, row_a22);
+  }
+
+  sums[0] = horizontalSum(a11);
+  sums[1] = horizontalSum(a12);
+  sums[2] = horizontalSum(a22);
+  return;
+}
+
+template <int S>
+void mismatchNeon(const unsigned char* img, const size_t& img_step,
+    const int* weights, const int& runtime_size,
+    const int* patch, const int* patch_dx, const int* patch_dy,
+    long long* sums) {
+  const int size = S > 0 ? S : runtime_size;
+  int32x4_t w[4];
+  loadWeights(weights, w);
+  int64x2_t b1 = vdupq_n_s64(0);
+  int64x2_t b2 = vdupq_n_s64(0);
+
+  for (int y = 0; y < size; ++y) {
+    const unsigned char* src = img + y*img_step;
+    int32x4_t row_b1 = vdupq_n_s32(0);
+    int32x4_t row_b2 = vdupq_n_s32(0);
+
+    for (int x = 0; x < size; x += 4) {
+      const int start = min(x, size-4);
+      const int offset = y*size + start;
+
+      const int32x4_t diff = mask(vsubq_s32(
+            interpolatePixels(src+start, img_step, w),
+            vld1q_s32(patch+offset)), x-start);
+      row_b1 = vmlaq_s32(row_b1, diff, vld1q_s32(patch_dx+offset));
+      row_b2 = vmlaq_s32(row_b2, diff, vld1q_s32(patch_dy+offset));
+    }
+
+    b1 = vpadalq_s32(b1, row_b1);
+    b2 = vpadalq_s32(b2, row_b2);
+  }
+
+  sums[0] = horizontalSum(b1);
+  sums[1] = horizontalSum(b2);
+  return;
+}
+
+template <int S>
+long long residualNeon(const unsigned char* img, const size_t& img_step,
+    const int* weights, const int& runtime_size, const int* patch) {
+  const int size = S > 0 ? S : runtime_size;
+  int32x4_t w[4];
+  loadWeights(weights, w);
+  int64x2_t sum = vdupq_n_s64(0);
+
+  for (int y = 0; y < size; ++y) {
+    const unsigned char* src = img + y*img_step;
+    int32x4_t row_sum = vdupq_n_s32(0);
+
+    for (int x = 0; x < size; x += 4) {
+      const int start = min(x, size-4);
+      const int32x4_t diff = vsubq_s32(
+          interpolatePixels(src+start, img_step, w),
+          vld1q_s32(patch+y*size+start));
+      row_sum = vaddq_s32(row_sum, mask(vabsq_s32(diff), x-start));
+    }
+
+    sum = vpadalq_s32(sum, row_sum);
+  }
+
+  return horizontalSum(sum);
+}
+
+template <int S>
+KltTracker::Kernels simdKernels() {
+  KltTracker::Kernels kernels;
+  kernels.patch = patchNeon<S>;
+  kernels.mismatch = mismatchNeon<S>;
+  kernels.residual = residualNeon<S>;
+  kernels.name = simd::name();
+  return kernels;
+}
+
+const int kSimdWidth = 4;
+
+#endif
+
+/**
+ * @brief 根据patch大小选择kernel，15和21的patch使用固定大小的实现
+ */
+KltTracker::Kernels selectKernels(const int& size, const bool& use_simd) {
+#if defined(MSCKF_VIO_SIMD_AVX2) || defined(MSCKF_VIO_SIMD_NEON)
+  if (use_simd && size >= kSimdWidth && simd::supported()) {
+    if (size == 15) return simdKernels<15>();
+    if (size == 21) return simdKernels<21>();
+    return simdKernels<0>();
+  }
+#endif
+  if (size == 15) return scalarKernels<15>();
+  if (size == 21) return scalarKernels<21>();
+  return scalarKernels<0>();
+}
+
+// Bilinear weights in fixed point.
+inline void computeWeights(const float& a, const float& b, int* w) {
+  w[0] = static_cast<int>(lrint((1.0f-a)*(1.0f-b)*(1 << kWeightBits)));
+  w[1] = static_cast<int>(lrint(a*(1.0f-b)*(1 << kWeightBits)));
+  w[2] = static_cast<int>(lrint((1.0f-a)*b*(1 << kWeightBits)));
+  w[3] = (1 << kWeightBits) - w[0] - w[1] - w[2];
+  return;
+}
+
+// The patch may go out of the image by the border of
+// the pyramid, which is at least the patch size.
+inline bool isOutOfImage(const int& x, const int& y,
+    const Mat& img, const int& size) {
+  return x < -size || x >= img.cols || y < -size || y >= img.rows;
+}
+
+// The pointers may go out of the image by the border as well,
+// so the rows are not accessed with Mat::ptr().
+inline const unsigned char* pixelAt(
+    const Mat& img, const int& x, const int& y) {
+  return img.data + y*static_cast<ptrdiff_t>(img.step[0]) + x;
+}
+
+inline const short* gradientAt(
+    const Mat& grad, const int& x, const int& y) {
+  return reinterpret_cast<const short*>(
+      grad.data + y*static_cast<ptrdiff_t>(grad.step[0])) + 2*x;
+}
+
+} // namespace
+
+KltTracker::KltTracker(const Config& c):
+  config(c),
+  kernels(selectKernels(c.patch_size, c.use_simd)) {
+  return;
+}
+
+const char* KltTracker::simdName() const {
+  return kernels.name;
+}
+
+bool KltTracker::track(
+    const vector<Mat>& prev_pyramid,
+    const vector<Mat>& curr_pyramid,
+    const vector<Point2f>& prev_points,
+    vector<Point2f>& curr_points,
+    vector<unsigned char>& status,
+    vector<float>& residuals) const {
+  const int point_num = prev_points.size();
+  status.assign(point_num, 1);
+  residuals.assign(point_num, 0.0f);
+  if (curr_points.size() != prev_points.size())
+    curr_points = prev_points;
+  if (point_num == 0) return true;
+
+  // The pyramids keep the image and the derivatives of
+  // each level next to each other.
+  if (prev_pyramid.size() < 2 || curr_pyramid.size() < 2 ||
+      prev_pyramid[1].type() != CV_16SC2 ||
+      curr_pyramid[1].type() != CV_16SC2) {
+    status.assign(point_num, 0);
+    return false;
+  }
+  const int max_level = min<int>(config.pyramid_levels,
+      min(prev_pyramid.size(), curr_pyramid.size())/2 - 1);
+
+  vector<int> indices(point_num);
+  if (config.cell_width <= 0 || config.cell_height <= 0) {
+    for (int i = 0; i < point_num; ++i) indices[i] = i;
+    trackBatch(prev_pyramid, curr_pyramid, max_level, prev_points,
+        indices.data(), point_num, curr_points, status, residuals);
+    return true;
+  }
+
+  // Group the points by cells with a counting sort, which
+  // keeps the order of the points within a cell.
+  const int cell_rows = prev_pyramid[0].rows/config.cell_height + 1;
+  const int cell_cols = prev_pyramid[0].cols/config.cell_width + 1;
+  vector<int> cell_codes(point_num);
+  vector<int> cell_starts(cell_rows*cell_cols+1, 0);
+  for (int i = 0; i < point_num; ++i) {
+    const int row = max(0, min(cell_rows-1,
+          static_cast<int>(prev_points[i].y) / config.cell_height));
+    const int col = max(0, min(cell_cols-1,
+          static_cast<int>(prev_points[i].x) / config.cell_width));
+    cell_codes[i] = row*cell_cols + col;
+    ++cell_starts[cell_codes[i]+1];
+  }
+  for (int code = 0; code < cell_rows*cell_cols; ++code)
+    cell_starts[code+1] += cell_starts[code];
+
+  vector<int> cell_ends(cell_starts.begin(), cell_starts.end()-1);
+  for (int i = 0; i < point_num; ++i)
+    indices[cell_ends[cell_codes[i]]++] = i;
+
+  for (int code = 0; code < cell_rows*cell_cols; ++code) {
+    const int index_num = cell_starts[code+1] - cell_starts[code];
+    if (index_num == 0) continue;
+    trackBatch(prev_pyramid, curr_pyramid, max_level, prev_points,
+        indices.data()+cell_starts[code], index_num,
+        curr_points, status, residuals);
+  }
+
+  return true;
+}
+
+/**
+ * @brief 从金字塔顶层到底层依次跟踪一批点
+ *
+ * 迭代的步骤与cv::calcOpticalFlowPyrLK相同：在每一层上计算
+ * 上一帧patch的梯度矩阵，然后迭代求解当前帧中点的位移
+ */
+void KltTracker::trackBatch(
+    const vector<Mat>& prev_pyramid,
+    const vector<Mat>& curr_pyramid,
+    const int& max_level,
+    const vector<Point2f>& prev_points,
+    const int* indices, const int& index_num,
+    vector<Point2f>& curr_points,
+    vector<unsigned char>& status,
+    vector<float>& residuals) const {
+  const int size = config.patch_size;
+  const Point2f half_win((size-1)*0.5f, (size-1)*0.5f);
+  const double epsilon = config.track_precision*config.track_precision;
+
+  vector<int> patch(size*size);
+  vector<int> patch_dx(size*size);
+  vector<int> patch_dy(size*size);
+  int weights[4];
+
+  for (int level = max_level; level >= 0; --level) {
+    const Mat& prev_img = prev_pyramid[2*level];
+    const Mat& prev_grad = prev_pyramid[2*level+1];
+    const Mat& curr_img = curr_pyramid[2*level];
+    const size_t grad_step = prev_grad.step[0] / sizeof(short);
+    const float scale = 1.0f / (1 << level);
+
+    for (int k = 0; k < index_num; ++k) {
+      const int i = indices[k];
+
+      Point2f prev_pt(prev_points[i].x*scale, prev_points[i].y*scale);
+      Point2f next_pt = level == max_level ?
+        Point2f(curr_points[i].x*scale, curr_points[i].y*scale) :
+        Point2f(curr_points[i].x*2.0f, curr_points[i].y*2.0f);
+      curr_points[i] = next_pt;
+
+      // Interpolate the patch in the previous image.
+      prev_pt -= half_win;
+      const int prev_x = static_cast<int>(floor(prev_pt.x));
+      const int prev_y = static_cast<int>(floor(prev_pt.y));
+      if (isOutOfImage(prev_x, prev_y, prev_img, size)) {
+        if (level == 0) status[i] = 0;
+        continue;
+      }
+
+      computeWeights(prev_pt.x-prev_x, prev_pt.y-prev_y, weights);
+      long long a_sums[3];
+      kernels.patch(
+          pixelAt(prev_img, prev_x, prev_y), prev_img.step[0],
+          gradientAt(prev_grad, prev_x, prev_y), grad_step, weights, size,
+          patch.data(), patch_dx.data(), patch_dy.data(), a_sums);
+
+      const float a11 = a_sums[0] * kSumScale;
+      const float a12 = a_sums[1] * kSumScale;
+      const float a22 = a_sums[2] * kSumScale;
+      float det = a11*a22 - a12*a12;
+      const float min_eigen = (a22 + a11 - sqrt((a11-a22)*(a11-a22) +
+            4.0f*a12*a12)) / (2*size*size);
+      if (min_eigen < config.min_eigen_threshold || det < FLT_EPSILON) {
+        if (level == 0) status[i] = 0;
+        continue;
+      }
+      det = 1.0f / det;
+
+      // Iterate on the displacement in the current image.
+      next_pt -= half_win;
+      Point2f prev_delta(0.0f, 0.0f);
+      for (int j = 0; j < config.max_iteration; ++j) {
+        const int next_x = static_cast<int>(floor(next_pt.x));
+        const int next_y = static_cast<int>(floor(next_pt.y));
+        if (isOutOfImage(next_x, next_y, curr_img, size)) {
+          if (level == 0) status[i] = 0;
+          break;
+        }
+
+        computeWeights(next_pt.x-next_x, next_pt.y-next_y, weights);
+        long long b_sums[2];
+        kernels.mismatch(
+            pixelAt(curr_img, next_x, next_y), curr_img.step[0],
+            weights, size,
+            patch.data(), patch_dx.data(), patch_dy.data(), b_sums);
+
+        const float b1 = b_sums[0] * kSumScale;
+        const float b2 = b_sums[1] * kSumScale;
+        const Point2f delta(
+            (a12*b2 - a22*b1) * det, (a12*b1 - a11*b2) * det);
+        next_pt += delta;
+        curr_points[i] = next_pt + half_win;
+
+        if (delta.x*delta.x + delta.y*delta.y <= epsilon) break;
+        // Stop if the point oscillates between two positions.
+        if (j > 0 && fabs(delta.x+prev_delta.x) < 0.01 &&
+            fabs(delta.y+prev_delta.y) < 0.01) {
+          curr_points[i] -= Point2f(delta.x*0.5f, delta.y*0.5f);
+          break;
+        }
+        prev_delta = delta;
+      }
+
+      if (level > 0 || status[i] == 0) continue;
+
+      // Residual between the tracked patches.
+      next_pt = curr_points[i] - half_win;
+      const int next_x = static_cast<int>(floor(next_pt.x));
+      const int next_y = static_cast<int>(floor(next_pt.y));
+      if (isOutOfImage(next_x, next_y, curr_img, size)) {
+        status[i] = 0;
+        continue;
+      }
+      computeWeights(next_pt.x-next_x, next_pt.y-next_y, weights);
+      const long long residual = kernels.residual(
+          pixelAt(curr_img, next_x, next_y), curr_img.step[0],
+          weights, size, patch.data());
+      residuals[i] = residual / (32.0f*size*size);
+    }
+  }
+
+  return;
+}
+
+} // namespace msckf_vio
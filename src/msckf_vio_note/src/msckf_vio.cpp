@@ -20,41 +20,95 @@
 
 #include <eigen_conversions/eigen_msg.h>
 #include <tf_conversions/tf_eigen.h>
-#include <sensor_msgs/PointCloud2.h>
-#include <pcl_ros/point_cloud.h>
-#include <pcl/point_types.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <msckf_vio/FilterStatus.h>
 
 #include <msckf_vio/msckf_vio.h>
 #include <msckf_vio/math_utils.hpp>
 #include <msckf_vio/utils.h>
+#include <msckf_vio/trace.h>
 
 using namespace std;
 using namespace Eigen;
 
 namespace msckf_vio{
-// Static member variables in IMUState class.
-StateIDType IMUState::next_id = 0;
-double IMUState::gyro_noise = 0.001;
-double IMUState::acc_noise = 0.01;
-double IMUState::gyro_bias_noise = 0.001;
-double IMUState::acc_bias_noise = 0.01;
-Vector3d IMUState::gravity = Vector3d(0, 0, -GRAVITY_ACCELERATION);
-Isometry3d IMUState::T_imu_body = Isometry3d::Identity();
 
-// Static member variables in CAMState class.
-Isometry3d CAMState::T_cam0_cam1 = Isometry3d::Identity();
-
-// Static member variables in Feature class.
-FeatureIDType Feature::next_id = 0;
-double Feature::observation_noise = 0.01;
-Feature::OptimizationConfig Feature::optimization_config;
-
-map<int, double> MsckfVio::chi_squared_test_table;
+MsckfVio::Config::Config():
+  fixed_frame_id("world"),
+  child_frame_id("robot"),
+  publish_tf(true),
+  feature_cloud_decimation(1),
+  frame_rate(40.0),
+  position_std_threshold(8.0),
+  rotation_threshold(0.2618),
+  translation_threshold(0.4),
+  tracking_rate_threshold(0.5),
+  integrator(CLOSED_FORM),
+  gyro_noise(0.001),
+  acc_noise(0.01),
+  gyro_bias_noise(0.001),
+  acc_bias_noise(0.01),
+  observation_noise(0.01),
+  initial_velocity(Vector3d::Zero()),
+  velocity_cov(0.25),
+  gyro_bias_cov(1e-4),
+  acc_bias_cov(1e-2),
+  extrinsic_rotation_cov(3.0462e-4),
+  extrinsic_translation_cov(1e-4),
+  T_imu_cam0(Isometry3d::Identity()),
+  T_cam0_cam1(Isometry3d::Identity()),
+  T_imu_body(Isometry3d::Identity()),
+  max_cam_state_size(30),
+  adaptive_window(false),
+  enable_tracing(false),
+  trace_file("/tmp/msckf_vio_trace.json"),
+  checkpoint_file("/tmp/msckf_vio_checkpoint.bin"),
+  checkpoint_period(0.0),
+  restore_checkpoint(false),
+  checkpoint_max_age(1.0) {
+  return;
+}
 
 MsckfVio::MsckfVio(ros::NodeHandle& pnh):
+  next_state_id(0),
+  gravity(0.0, 0.0, -GRAVITY_ACCELERATION),
+  imu_buffer_head(0),
   is_gravity_set(false),
   is_first_img(true),
-  nh(pnh) {
+  nh(new ros::NodeHandle(pnh)),
+  subscribe_inputs(true),
+  feature_cloud_cntr(0),
+  critical_time_cntr(0),
+  online_reset_counter(0),
+  enable_tracing(false),
+  last_checkpoint_time(0.0),
+  has_restored_snapshot(false),
+  has_restored_features(false),
+  first_mocap_odom_msg(true) {
+  return;
+}
+
+MsckfVio::MsckfVio():
+  next_state_id(0),
+  gravity(0.0, 0.0, -GRAVITY_ACCELERATION),
+  imu_buffer_head(0),
+  is_gravity_set(false),
+  is_first_img(true),
+  subscribe_inputs(false),
+  feature_cloud_cntr(0),
+  critical_time_cntr(0),
+  online_reset_counter(0),
+  enable_tracing(false),
+  last_checkpoint_time(0.0),
+  has_restored_snapshot(false),
+  has_restored_features(false),
+  first_mocap_odom_msg(true) {
+  return;
+}
+
+MsckfVio::~MsckfVio() {
+  if (enable_tracing && !trace::write(trace_file))
+    ROS_WARN("Failed to write the trace to %s", trace_file.c_str());
   return;
 }
 
@@ -64,36 +118,48 @@ MsckfVio::MsckfVio(ros::NodeHandle& pnh):
  * Imu状态向量和对应协方差的初始值
  */
 bool MsckfVio::loadParameters() {
-  // Frame id
-  nh.param<string>("fixed_frame_id", fixed_frame_id, "world");
-  nh.param<string>("child_frame_id", child_frame_id, "robot");
-  nh.param<bool>("publish_tf", publish_tf, true);
-  nh.param<double>("frame_rate", frame_rate, 40.0);
-  nh.param<double>("position_std_threshold", position_std_threshold, 8.0);
+  Config filter_config;
 
-  nh.param<double>("rotation_threshold", rotation_threshold, 0.2618);
-  nh.param<double>("translation_threshold", translation_threshold, 0.4);
-  nh.param<double>("tracking_rate_threshold", tracking_rate_threshold, 0.5);
+  // Frame id
+  nh->param<string>("fixed_frame_id", filter_config.fixed_frame_id, "world");
+  nh->param<string>("child_frame_id", filter_config.child_frame_id, "robot");
+  nh->param<bool>("publish_tf", filter_config.publish_tf, true);
+  nh->param<int>("feature_cloud_decimation",
+      filter_config.feature_cloud_decimation, 1);
+  nh->param<double>("frame_rate", filter_config.frame_rate, 40.0);
+  nh->param<double>("position_std_threshold",
+      filter_config.position_std_threshold, 8.0);
+
+  nh->param<double>("rotation_threshold",
+      filter_config.rotation_threshold, 0.2618);
+  nh->param<double>("translation_threshold",
+      filter_config.translation_threshold, 0.4);
+  nh->param<double>("tracking_rate_threshold",
+      filter_config.tracking_rate_threshold, 0.5);
+
+  // Integrator of the IMU state, "closed_form" or "rk4".
+  string integrator;
+  nh->param<string>("integrator", integrator, string("closed_form"));
+  if (integrator == "rk4") {
+    filter_config.integrator = RK4;
+  } else {
+    if (integrator != "closed_form")
+      ROS_WARN("Unknown integrator %s, use closed_form instead...",
+          integrator.c_str());
+    filter_config.integrator = CLOSED_FORM;
+  }
 
   // Feature optimization parameters
-  nh.param<double>("feature/config/translation_threshold",
-      Feature::optimization_config.translation_threshold, 0.2);
+  nh->param<double>("feature/config/translation_threshold",
+      filter_config.optimization_config.translation_threshold, 0.2);
 
   // Noise related parameters
   // imu噪声相关的参数
-  nh.param<double>("noise/gyro", IMUState::gyro_noise, 0.001);
-  nh.param<double>("noise/acc", IMUState::acc_noise, 0.01);
-  nh.param<double>("noise/gyro_bias", IMUState::gyro_bias_noise, 0.001);
-  nh.param<double>("noise/acc_bias", IMUState::acc_bias_noise, 0.01);
-  nh.param<double>("noise/feature", Feature::observation_noise, 0.01);
-
-  // Use variance instead of standard deviation.
-  // 采用方差而不是标准差
-  IMUState::gyro_noise *= IMUState::gyro_noise;
-  IMUState::acc_noise *= IMUState::acc_noise;
-  IMUState::gyro_bias_noise *= IMUState::gyro_bias_noise;
-  IMUState::acc_bias_noise *= IMUState::acc_bias_noise;
-  Feature::observation_noise *= Feature::observation_noise;
+  nh->param<double>("noise/gyro", filter_config.gyro_noise, 0.001);
+  nh->param<double>("noise/acc", filter_config.acc_noise, 0.01);
+  nh->param<double>("noise/gyro_bias", filter_config.gyro_bias_noise, 0.001);
+  nh->param<double>("noise/acc_bias", filter_config.acc_bias_noise, 0.01);
+  nh->param<double>("noise/feature", filter_config.observation_noise, 0.01);
 
   // Set the initial IMU state.
   // The intial orientation and position will be set to the origin
@@ -102,12 +168,12 @@ bool MsckfVio::loadParameters() {
   // TODO: is it reasonable to set the initial bias to 0?
   // 设置IMU的初始状态
   // 设置imu速度和偏置的初始状态可以通过参数设定，而方向和位置需要设置为原点
-  nh.param<double>("initial_state/velocity/x",
-      state_server.imu_state.velocity(0), 0.0);
-  nh.param<double>("initial_state/velocity/y",
-      state_server.imu_state.velocity(1), 0.0);
-  nh.param<double>("initial_state/velocity/z",
-      state_server.imu_state.velocity(2), 0.0);
+  nh->param<double>("initial_state/velocity/x",
+      filter_config.initial_velocity(0), 0.0);
+  nh->param<double>("initial_state/velocity/y",
+      filter_config.initial_velocity(1), 0.0);
+  nh->param<double>("initial_state/velocity/z",
+      filter_config.initial_velocity(2), 0.0);
 
   // The initial covariance of orientation and position can be
   // set to 0. But for velocity, bias and extrinsic parameters,
@@ -115,135 +181,170 @@ bool MsckfVio::loadParameters() {
   // 设置imu的初始协方差
   // 方向和位置的协方差可以设置为0
   // 速度，偏置以及外参数应有不确定性（协方差应该给初始值）
-  double gyro_bias_cov, acc_bias_cov, velocity_cov;
-  nh.param<double>("initial_covariance/velocity",
-      velocity_cov, 0.25);
-  nh.param<double>("initial_covariance/gyro_bias",
-      gyro_bias_cov, 1e-4);
-  nh.param<double>("initial_covariance/acc_bias",
-      acc_bias_cov, 1e-2);
-
-  double extrinsic_rotation_cov, extrinsic_translation_cov;
-  nh.param<double>("initial_covariance/extrinsic_rotation_cov",
-      extrinsic_rotation_cov, 3.0462e-4);
-  nh.param<double>("initial_covariance/extrinsic_translation_cov",
-      extrinsic_translation_cov, 1e-4);
-
-  // 连续时间下的状态协方差矩阵初始值P0
-  // 协方差的维度为21*21，其中分别对应对应状态[q b_g v b_a p q_e p_e]
-  state_server.state_cov = MatrixXd::Zero(21, 21);
-  for (int i = 3; i < 6; ++i)
-    state_server.state_cov(i, i) = gyro_bias_cov;
-  for (int i = 6; i < 9; ++i)
-    state_server.state_cov(i, i) = velocity_cov;
-  for (int i = 9; i < 12; ++i)
-    state_server.state_cov(i, i) = acc_bias_cov;
-  for (int i = 15; i < 18; ++i)
-    state_server.state_cov(i, i) = extrinsic_rotation_cov;
-  for (int i = 18; i < 21; ++i)
-    state_server.state_cov(i, i) = extrinsic_translation_cov;
+  nh->param<double>("initial_covariance/velocity",
+      filter_config.velocity_cov, 0.25);
+  nh->param<double>("initial_covariance/gyro_bias",
+      filter_config.gyro_bias_cov, 1e-4);
+  nh->param<double>("initial_covariance/acc_bias",
+      filter_config.acc_bias_cov, 1e-2);
+
+  nh->param<double>("initial_covariance/extrinsic_rotation_cov",
+      filter_config.extrinsic_rotation_cov, 3.0462e-4);
+  nh->param<double>("initial_covariance/extrinsic_translation_cov",
+      filter_config.extrinsic_translation_cov, 1e-4);
 
   // Transformation offsets between the frames involved.
   // 获取cam0与imu之间的外参数
-  Isometry3d T_imu_cam0 = utils::getTransformEigen(nh, "cam0/T_cam_imu");
-  Isometry3d T_cam0_imu = T_imu_cam0.inverse();
-
-  // 相机与Imu之间的外参要估计，将其初值设为配置文件相关的值
-  state_server.imu_state.R_imu_cam0 = T_cam0_imu.linear().transpose();
-  state_server.imu_state.t_cam0_imu = T_cam0_imu.translation();
-  CAMState::T_cam0_cam1 =
-    utils::getTransformEigen(nh, "cam1/T_cn_cnm1");
-  IMUState::T_imu_body =
-    utils::getTransformEigen(nh, "T_imu_body").inverse();
+  filter_config.T_imu_cam0 =
+    utils::getTransformEigen(*nh, "cam0/T_cam_imu");
+  filter_config.T_cam0_cam1 =
+    utils::getTransformEigen(*nh, "cam1/T_cn_cnm1");
+  filter_config.T_imu_body =
+    utils::getTransformEigen(*nh, "T_imu_body").inverse();
 
   // Maximum number of camera states to be stored
   // 滑动窗口大小
-  nh.param<int>("max_cam_state_size", max_cam_state_size, 30);
+  nh->param<int>("max_cam_state_size", filter_config.max_cam_state_size, 30);
+
+  // Adaptive window size
+  nh->param<bool>("adaptive_window/enable",
+      filter_config.adaptive_window, false);
+  nh->param<int>("adaptive_window/min_size",
+      filter_config.window_control.min_size, 10);
+  nh->param<int>("adaptive_window/max_size",
+      filter_config.window_control.max_size, 40);
+  nh->param<double>("adaptive_window/time_budget",
+      filter_config.window_control.time_budget, 0.8);
+  nh->param<double>("adaptive_window/grow_ratio",
+      filter_config.window_control.grow_ratio, 0.6);
+  nh->param<int>("adaptive_window/period",
+      filter_config.window_control.period, 10);
+  nh->param<double>("adaptive_window/smoothing",
+      filter_config.window_control.smoothing, 0.1);
+
+  // Trace-event export for timeline debugging.
+  nh->param<bool>("trace/enable", filter_config.enable_tracing, false);
+  nh->param<string>("trace/output_file", filter_config.trace_file,
+      string("/tmp/msckf_vio_trace.json"));
+
+  // Checkpoint of the filter state for warm restarts.
+  nh->param<string>("checkpoint/file", filter_config.checkpoint_file,
+      string("/tmp/msckf_vio_checkpoint.bin"));
+  nh->param<double>("checkpoint/period",
+      filter_config.checkpoint_period, 0.0);
+  nh->param<bool>("checkpoint/restore",
+      filter_config.restore_checkpoint, false);
+  nh->param<double>("checkpoint/max_age",
+      filter_config.checkpoint_max_age, 1.0);
+
+  applyConfig(filter_config);
 
   ROS_INFO("===========================================");
   ROS_INFO("fixed frame id: %s", fixed_frame_id.c_str());
   ROS_INFO("child frame id: %s", child_frame_id.c_str());
   ROS_INFO("publish tf: %d", publish_tf);
+  ROS_INFO("feature cloud decimation: %d", feature_cloud_decimation);
   ROS_INFO("frame rate: %f", frame_rate);
   ROS_INFO("position std threshold: %f", position_std_threshold);
   ROS_INFO("Keyframe rotation threshold: %f", rotation_threshold);
   ROS_INFO("Keyframe translation threshold: %f", translation_threshold);
   ROS_INFO("Keyframe tracking rate threshold: %f", tracking_rate_threshold);
-  ROS_INFO("gyro noise: %.10f", IMUState::gyro_noise);
-  ROS_INFO("gyro bias noise: %.10f", IMUState::gyro_bias_noise);
-  ROS_INFO("acc noise: %.10f", IMUState::acc_noise);
-  ROS_INFO("acc bias noise: %.10f", IMUState::acc_bias_noise);
-  ROS_INFO("observation noise: %.10f", Feature::observation_noise);
+  ROS_INFO("integrator: %s",
+      config.integrator == RK4 ? "rk4" : "closed_form");
+  ROS_INFO("gyro noise: %.10f", gyro_noise);
+  ROS_INFO("gyro bias noise: %.10f", gyro_bias_noise);
+  ROS_INFO("acc noise: %.10f", acc_noise);
+  ROS_INFO("acc bias noise: %.10f", acc_bias_noise);
+  ROS_INFO("observation noise: %.10f", observation_noise);
   ROS_INFO("initial velocity: %f, %f, %f",
       state_server.imu_state.velocity(0),
       state_server.imu_state.velocity(1),
       state_server.imu_state.velocity(2));
-  ROS_INFO("initial gyro bias cov: %f", gyro_bias_cov);
-  ROS_INFO("initial acc bias cov: %f", acc_bias_cov);
-  ROS_INFO("initial velocity cov: %f", velocity_cov);
+  ROS_INFO("initial gyro bias cov: %f", config.gyro_bias_cov);
+  ROS_INFO("initial acc bias cov: %f", config.acc_bias_cov);
+  ROS_INFO("initial velocity cov: %f", config.velocity_cov);
   ROS_INFO("initial extrinsic rotation cov: %f",
-      extrinsic_rotation_cov);
+      config.extrinsic_rotation_cov);
   ROS_INFO("initial extrinsic translation cov: %f",
-      extrinsic_translation_cov);
+      config.extrinsic_translation_cov);
 
-  cout << T_imu_cam0.linear() << endl;
-  cout << T_imu_cam0.translation().transpose() << endl;
+  cout << config.T_imu_cam0.linear() << endl;
+  cout << config.T_imu_cam0.translation().transpose() << endl;
 
   ROS_INFO("max camera state #: %d", max_cam_state_size);
+  if (window_controller)
+    ROS_INFO("adaptive window: [%d, %d], budget %f sec",
+        config.window_control.min_size, config.window_control.max_size,
+        window_controller->budgetTime());
+  ROS_INFO("trace: %d (%s)", enable_tracing, trace_file.c_str());
+  ROS_INFO("checkpoint period: %f (%s)", config.checkpoint_period,
+      config.checkpoint_file.c_str());
+  ROS_INFO("restore checkpoint: %d", config.restore_checkpoint);
   ROS_INFO("===========================================");
   return true;
 }
 
 /**
- * @brief 创建ROS的相关发布和订阅的主题
+ * @brief 根据配置设置滤波器，配置可以来自ros参数服务器或者直接给定
  *
- * 发布的主题主要包括里程计、地图点云和
- * 订阅的主题主要包括imu数据、图像处理节点发送的和
+ * 设置噪声（方差）、外参数、初始状态和协方差
+ * 初始化卡方检验表
  */
-bool MsckfVio::createRosIO() {
-  odom_pub = nh.advertise<nav_msgs::Odometry>("odom", 10);
-  feature_pub = nh.advertise<sensor_msgs::PointCloud2>(
-      "feature_point_cloud", 10);
+void MsckfVio::applyConfig(const Config& filter_config) {
+  config = filter_config;
 
-  reset_srv = nh.advertiseService("reset",
-      &MsckfVio::resetCallback, this);
+  fixed_frame_id = config.fixed_frame_id;
+  child_frame_id = config.child_frame_id;
+  publish_tf = config.publish_tf;
+  feature_cloud_decimation = max(1, config.feature_cloud_decimation);
+  frame_rate = config.frame_rate;
+  position_std_threshold = config.position_std_threshold;
 
-  imu_sub = nh.subscribe("imu", 100,
-      &MsckfVio::imuCallback, this);
-  feature_sub = nh.subscribe("features", 40,
-      &MsckfVio::featureCallback, this);
+  rotation_threshold = config.rotation_threshold;
+  translation_threshold = config.translation_threshold;
+  tracking_rate_threshold = config.tracking_rate_threshold;
+  optimization_config = config.optimization_config;
 
-  mocap_odom_sub = nh.subscribe("mocap_odom", 10,
-      &MsckfVio::mocapOdomCallback, this);
-  mocap_odom_pub = nh.advertise<nav_msgs::Odometry>("gt_odom", 1);
+  // Use variance instead of standard deviation.
+  // 采用方差而不是标准差
+  gyro_noise = config.gyro_noise * config.gyro_noise;
+  acc_noise = config.acc_noise * config.acc_noise;
+  gyro_bias_noise = config.gyro_bias_noise * config.gyro_bias_noise;
+  acc_bias_noise = config.acc_bias_noise * config.acc_bias_noise;
+  observation_noise = config.observation_noise * config.observation_noise;
 
-  return true;
-}
+  state_server.imu_state.velocity = config.initial_velocity;
 
-/**
- * @brief MSCKF初始化，从launch文件从读入相关参数以及创建ros发布和订阅的主题
- *
- * 载入launch文件中相关参数
- * 初始化状态噪声的偏置
- * 初始化卡方检验表
- * 创建ros发布和订阅的主题
- */
-bool MsckfVio::initialize() {
-  if (!loadParameters()) return false;
-  ROS_INFO("Finish loading ROS parameters...");
+  // 连续时间下的状态协方差矩阵初始值P0
+  resetStateCov();
+
+  // 相机与Imu之间的外参要估计，将其初值设为配置文件相关的值
+  Isometry3d T_cam0_imu = config.T_imu_cam0.inverse();
+  state_server.imu_state.R_imu_cam0 = T_cam0_imu.linear().transpose();
+  state_server.imu_state.t_cam0_imu = T_cam0_imu.translation();
+  T_cam0_cam1 = config.T_cam0_cam1;
+  T_imu_body = config.T_imu_body;
+
+  max_cam_state_size = config.max_cam_state_size;
+  window_controller.reset();
+  if (config.adaptive_window) {
+    window_controller.reset(new WindowController(
+          config.window_control, config.frame_rate, max_cam_state_size));
+    max_cam_state_size = window_controller->windowSize();
+  }
 
   // Initialize state server
   // 连续时间下的噪声矩阵Q
   state_server.continuous_noise_cov =
     Matrix<double, 12, 12>::Zero();
   state_server.continuous_noise_cov.block<3, 3>(0, 0) =
-    Matrix3d::Identity()*IMUState::gyro_noise;
+    Matrix3d::Identity()*gyro_noise;
   state_server.continuous_noise_cov.block<3, 3>(3, 3) =
-    Matrix3d::Identity()*IMUState::gyro_bias_noise;
+    Matrix3d::Identity()*gyro_bias_noise;
   state_server.continuous_noise_cov.block<3, 3>(6, 6) =
-    Matrix3d::Identity()*IMUState::acc_noise;
+    Matrix3d::Identity()*acc_noise;
   state_server.continuous_noise_cov.block<3, 3>(9, 9) =
-    Matrix3d::Identity()*IMUState::acc_bias_noise;
+    Matrix3d::Identity()*acc_bias_noise;
 
   // 初始化卡方检验表，置信水平为0.95 
   // Initialize the chi squared test table with confidence
@@ -255,6 +356,109 @@ bool MsckfVio::initialize() {
       boost::math::quantile(chi_squared_dist, 0.05);
   }
 
+  enable_tracing = config.enable_tracing;
+  trace_file = config.trace_file;
+  if (enable_tracing) {
+#ifndef MSCKF_VIO_ENABLE_TRACING
+    ROS_WARN("Tracing is requested but not compiled in...");
+#endif
+    trace::enable();
+  }
+
+  // 从检查点恢复状态，跳过重力和偏置的初始化
+  if (config.restore_checkpoint) {
+    FilterSnapshot snapshot;
+    if (loadSnapshot(config.checkpoint_file, snapshot)) {
+      ROS_INFO("Loaded the checkpoint %s at time %f",
+          config.checkpoint_file.c_str(), snapshot.imu_state.time);
+      restore(snapshot);
+    } else {
+      ROS_WARN("Failed to load the checkpoint %s...",
+          config.checkpoint_file.c_str());
+    }
+  }
+
+  if (config.checkpoint_period > 0.0)
+    checkpoint_writer.reset(new CheckpointWriter(config.checkpoint_file));
+
+  return;
+}
+
+/**
+ * @brief 重置状态协方差为初始值
+ *
+ * 协方差的维度为21*21，其中分别对应对应状态[q b_g v b_a p q_e p_e]
+ * 方向和位置的协方差为0
+ */
+void MsckfVio::resetStateCov() {
+  state_server.state_cov = MatrixXd::Zero(21, 21);
+  for (int i = 3; i < 6; ++i)
+    state_server.state_cov(i, i) = config.gyro_bias_cov;
+  for (int i = 6; i < 9; ++i)
+    state_server.state_cov(i, i) = config.velocity_cov;
+  for (int i = 9; i < 12; ++i)
+    state_server.state_cov(i, i) = config.acc_bias_cov;
+  for (int i = 15; i < 18; ++i)
+    state_server.state_cov(i, i) = config.extrinsic_rotation_cov;
+  for (int i = 18; i < 21; ++i)
+    state_server.state_cov(i, i) = config.extrinsic_translation_cov;
+  return;
+}
+
+/**
+ * @brief 创建ROS的相关发布和订阅的主题
+ *
+ * 发布的主题主要包括里程计、地图点云和
+ * 订阅的主题主要包括imu数据、图像处理节点发送的和
+ */
+bool MsckfVio::createRosIO() {
+  // The odometry, tf and feature point cloud are published
+  // on the output publisher thread.
+  output_publisher.reset(new OutputPublisher(*nh, fixed_frame_id,
+        child_frame_id, publish_tf, T_imu_body));
+  tf_pub.reset(new tf::TransformBroadcaster());
+
+  // The inputs are fed by the caller on its own thread
+  // without subscribe_inputs, where the reset service and
+  // the mocap callback would race with the filter.
+  if (subscribe_inputs) {
+    reset_srv = nh->advertiseService("reset",
+        &MsckfVio::resetCallback, this);
+
+    imu_sub = nh->subscribe("imu", 100,
+        &MsckfVio::imuCallback, this);
+    feature_sub = nh->subscribe("features", 40,
+        &MsckfVio::featureCallback, this);
+
+    mocap_odom_sub = nh->subscribe("mocap_odom", 10,
+        &MsckfVio::mocapOdomCallback, this);
+  }
+  mocap_odom_pub = nh->advertise<nav_msgs::Odometry>("gt_odom", 1);
+
+  if (window_controller)
+    diagnostics_pub = nh->advertise<diagnostic_msgs::DiagnosticArray>(
+        "/diagnostics", 10);
+
+  // The image processor stops publishing while too many of
+  // its frames are not acknowledged.
+  status_pub = nh->advertise<FilterStatus>("filter_status", 10);
+
+  return true;
+}
+
+/**
+ * @brief MSCKF初始化，从launch文件从读入相关参数以及创建ros发布和订阅的主题
+ *
+ * 载入launch文件中相关参数
+ * 初始化状态噪声的偏置
+ * 初始化卡方检验表
+ * 创建ros发布和订阅的主题
+ */
+bool MsckfVio::initialize(const bool& subscribe) {
+  subscribe_inputs = subscribe;
+  if (!loadParameters()) return false;
+  ROS_INFO("Finish loading ROS parameters...");
+
   // 创建ROS的相关发布和订阅的主题
   if (!createRosIO()) return false;
   ROS_INFO("Finish creating ROS IO...");
@@ -262,6 +466,16 @@ bool MsckfVio::initialize() {
   return true;
 }
 
+/**
+ * @brief 不依赖ROS的初始化，直接使用给定的配置
+ *
+ * 不创建ros发布和订阅的主题，数据通过processImu和processFeatures输入
+ */
+bool MsckfVio::initialize(const Config& filter_config) {
+  applyConfig(filter_config);
+  return true;
+}
+
 /**
  * @brief IMU数据接收触发回调函数，保存Imu数据不立即处理当前数据
  *
@@ -271,6 +485,7 @@ bool MsckfVio::initialize() {
  */
 void MsckfVio::imuCallback(
     const sensor_msgs::ImuConstPtr& msg) {
+  MSCKF_VIO_TRACE_SCOPE("MsckfVio::imuCallback");
 
   // IMU msgs are pushed backed into a buffer instead of
   // being processed immediately. The IMU msgs are processed
@@ -278,14 +493,25 @@ void MsckfVio::imuCallback(
   // easily handle the transfer delay.
   // 保存Imu数据，不立即处理
   // 好处：可以处理传输延时
-  imu_msg_buffer.push_back(*msg);
+  // The msg is converted only once here.
+  ImuSample sample;
+  sample.time = msg->header.stamp.toSec();
+  tf::vectorMsgToEigen(msg->angular_velocity, sample.gyro);
+  tf::vectorMsgToEigen(msg->linear_acceleration, sample.acc);
+  imu_buffer.push_back(sample);
 
   // is_gravity_set表示重力向量是否已被设置，初始值为false
   // 只有在系统开始或者重置情况下会执行，主要的作用是
   if (!is_gravity_set) {
+    // Resume from the restored snapshot if it is recent enough.
+    if (has_restored_snapshot) {
+      has_restored_snapshot = false;
+      if (applySnapshot(msg->header.stamp.toSec())) return;
+    }
+
     // 存储imu数据不足200返回
-    if (imu_msg_buffer.size() < 200) return;
-    //if (imu_msg_buffer.size() < 10) return;
+    if (imu_buffer.size()-imu_buffer_head < 200) return;
+    //if (imu_buffer.size()-imu_buffer_head < 10) return;
     // 
     initializeGravityAndBias();
     // 表示重力向量已被设置，后面除非重置系统，否则不会执行该操作
@@ -308,37 +534,32 @@ void MsckfVio::initializeGravityAndBias() {
   Vector3d sum_linear_acc = Vector3d::Zero();
 
   // 将当前buff中的imu的角速度和线性加速度累加
-  for (const auto& imu_msg : imu_msg_buffer) {
-    Vector3d angular_vel = Vector3d::Zero();
-    Vector3d linear_acc = Vector3d::Zero();
-
-    tf::vectorMsgToEigen(imu_msg.angular_velocity, angular_vel);
-    tf::vectorMsgToEigen(imu_msg.linear_acceleration, linear_acc);
-
-    sum_angular_vel += angular_vel;
-    sum_linear_acc += linear_acc;
+  for (size_t i = imu_buffer_head; i < imu_buffer.size(); ++i) {
+    sum_angular_vel += imu_buffer[i].gyro;
+    sum_linear_acc += imu_buffer[i].acc;
   }
+  const double sample_num = imu_buffer.size() - imu_buffer_head;
 
   // 陀螺仪的偏置为所有初始imu数据的平均值
   state_server.imu_state.gyro_bias =
-    sum_angular_vel / imu_msg_buffer.size();
+    sum_angular_vel / sample_num;
   //IMUState::gravity =
-  //  -sum_linear_acc / imu_msg_buffer.size();
+  //  -sum_linear_acc / sample_num;
   // This is the gravity in the IMU frame.
   Vector3d gravity_imu =
-    sum_linear_acc / imu_msg_buffer.size();
+    sum_linear_acc / sample_num;
 
   // Initialize the initial orientation, so that the estimation
   // is consistent with the inertial frame.
   double gravity_norm = gravity_imu.norm();
   // 重力向量
-  IMUState::gravity = Vector3d(0.0, 0.0, -gravity_norm);
+  gravity = Vector3d(0.0, 0.0, -gravity_norm);
 
   // FromTwoVectors：
   // Returns a quaternion representing a rotation 
   // between the two arbitrary vectors a and b.
   Quaterniond q0_i_w = Quaterniond::FromTwoVectors(
-    gravity_imu, -IMUState::gravity);
+    gravity_imu, -gravity);
   // 得到初始的方向
   state_server.imu_state.orientation =
     rotationToQuaternion(q0_i_w.toRotationMatrix().transpose());
@@ -372,46 +593,23 @@ bool MsckfVio::resetCallback(
   state_server.cam_states.clear();
 
   // Reset the state covariance.
-  double gyro_bias_cov, acc_bias_cov, velocity_cov;
-  nh.param<double>("initial_covariance/velocity",
-      velocity_cov, 0.25);
-  nh.param<double>("initial_covariance/gyro_bias",
-      gyro_bias_cov, 1e-4);
-  nh.param<double>("initial_covariance/acc_bias",
-      acc_bias_cov, 1e-2);
-
-  double extrinsic_rotation_cov, extrinsic_translation_cov;
-  nh.param<double>("initial_covariance/extrinsic_rotation_cov",
-      extrinsic_rotation_cov, 3.0462e-4);
-  nh.param<double>("initial_covariance/extrinsic_translation_cov",
-      extrinsic_translation_cov, 1e-4);
-
-  state_server.state_cov = MatrixXd::Zero(21, 21);
-  for (int i = 3; i < 6; ++i)
-    state_server.state_cov(i, i) = gyro_bias_cov;
-  for (int i = 6; i < 9; ++i)
-    state_server.state_cov(i, i) = velocity_cov;
-  for (int i = 9; i < 12; ++i)
-    state_server.state_cov(i, i) = acc_bias_cov;
-  for (int i = 15; i < 18; ++i)
-    state_server.state_cov(i, i) = extrinsic_rotation_cov;
-  for (int i = 18; i < 21; ++i)
-    state_server.state_cov(i, i) = extrinsic_translation_cov;
+  resetStateCov();
 
   // Clear all exsiting features in the map.
   map_server.clear();
 
   // Clear the IMU msg buffer.
-  imu_msg_buffer.clear();
+  imu_buffer.clear();
+  imu_buffer_head = 0;
 
   // Reset the starting flags.
   is_gravity_set = false;
   is_first_img = true;
 
   // Restart the subscribers.
-  imu_sub = nh.subscribe("imu", 100,
+  imu_sub = nh->subscribe("imu", 100,
       &MsckfVio::imuCallback, this);
-  feature_sub = nh.subscribe("features", 40,
+  feature_sub = nh->subscribe("features", 40,
       &MsckfVio::featureCallback, this);
 
   // TODO: When can the reset fail?
@@ -423,12 +621,32 @@ bool MsckfVio::resetCallback(
 /**
  * @brief image_process的nodelet得到双目数据
  *
+ * 消息转换为结构数组形式的特征帧后处理
  */
 void MsckfVio::featureCallback(
     const CameraMeasurementConstPtr& msg) {
+  feature_msg_frame.clear();
+  feature_msg_frame.time = msg->header.stamp;
+  for (const auto& feature : msg->features)
+    feature_msg_frame.push_back(feature.id,
+        feature.u0, feature.v0, feature.u1, feature.v1);
+  processFeatureFrame(feature_msg_frame);
+  return;
+}
+
+/**
+ * @brief 处理一帧双目特征的量测
+ *
+ */
+void MsckfVio::processFeatureFrame(const FeatureFrame& frame) {
+  MSCKF_VIO_TRACE_FRAME(frame.time.toNSec());
+  MSCKF_VIO_TRACE_SCOPE("MsckfVio::processFeatureFrame");
 
   // Return if the gravity vector has not been set.
-  if (!is_gravity_set) return;
+  if (!is_gravity_set) {
+    publishStatus(frame.time, 0.0);
+    return;
+  }
 
   // Start the system if the first image is received.
   // The frame where the first image is received will be
@@ -436,58 +654,63 @@ void MsckfVio::featureCallback(
   // 第一帧图像帧设置为初始帧
   if (is_first_img) {
     is_first_img = false;
-    state_server.imu_state.time = msg->header.stamp.toSec();
+    state_server.imu_state.time = frame.time.toSec();
   }
 
-  static double max_processing_time = 0.0;
-  static int critical_time_cntr = 0;
-  double processing_start_time = ros::Time::now().toSec();
+  // The processing time is measured in wall time, which is
+  // also valid when the filter runs without ROS.
+  double processing_start_time = ros::WallTime::now().toSec();
 
   // Propogate the IMU state.
   // that are received before the image msg.
-  ros::Time start_time = ros::Time::now();
-  batchImuProcessing(msg->header.stamp.toSec());
+  ros::WallTime start_time = ros::WallTime::now();
+  batchImuProcessing(frame.time.toSec());
   double imu_processing_time = (
-      ros::Time::now()-start_time).toSec();
+      ros::WallTime::now()-start_time).toSec();
 
   // Augment the state vector.
-  start_time = ros::Time::now();
-  stateAugmentation(msg->header.stamp.toSec());
+  start_time = ros::WallTime::now();
+  stateAugmentation(frame.time.toSec());
   double state_augmentation_time = (
-      ros::Time::now()-start_time).toSec();
+      ros::WallTime::now()-start_time).toSec();
 
   // Add new observations for existing features or new
   // features in the map server.
 
-  start_time = ros::Time::now();
-  addFeatureObservations(msg);
+  start_time = ros::WallTime::now();
+  addFeatureObservations(frame);
   double add_observations_time = (
-      ros::Time::now()-start_time).toSec();
+      ros::WallTime::now()-start_time).toSec();
 
   // 为update做准备, 剔除那些不能被三角化,并且观测过于少的特征点
   // Perform measurement update if necessary.
-  start_time = ros::Time::now();
+  start_time = ros::WallTime::now();
   removeLostFeatures();
   double remove_lost_features_time = (
-      ros::Time::now()-start_time).toSec();
+      ros::WallTime::now()-start_time).toSec();
 
-  start_time = ros::Time::now();
+  start_time = ros::WallTime::now();
   pruneCamStateBuffer();
   double prune_cam_states_time = (
-      ros::Time::now()-start_time).toSec();
+      ros::WallTime::now()-start_time).toSec();
 
   // Publish the odometry.
-  start_time = ros::Time::now();
-  publish(msg->header.stamp);
+  start_time = ros::WallTime::now();
+  publish(frame.time);
   double publish_time = (
-      ros::Time::now()-start_time).toSec();
+      ros::WallTime::now()-start_time).toSec();
 
   // Reset the system if necessary.
   onlineReset();
 
-  double processing_end_time = ros::Time::now().toSec();
+  // Queue a checkpoint of the updated state.
+  writeCheckpoint(frame.time.toSec());
+
+  double processing_end_time = ros::WallTime::now().toSec();
   double processing_time =
     processing_end_time - processing_start_time;
+  updateWindowSize(frame.time, processing_time);
+  publishStatus(frame.time, processing_time);
   if (processing_time > 1.0/frame_rate) {
     ++critical_time_cntr;
     ROS_INFO("\033[1;31mTotal processing time %f/%d...\033[0m",
@@ -511,8 +734,6 @@ void MsckfVio::featureCallback(
 
 void MsckfVio::mocapOdomCallback(
     const nav_msgs::OdometryConstPtr& msg) {
-  static bool first_mocap_odom_msg = true;
-
   // If this is the first mocap odometry messsage, set
   // the initial frame.
   if (first_mocap_odom_msg) {
@@ -557,7 +778,7 @@ void MsckfVio::mocapOdomCallback(
   if (publish_tf) {
     tf::Transform T_b_w_gt_tf;
     tf::transformEigenToTF(T_b_w_gt, T_b_w_gt_tf);
-    tf_pub.sendTransform(tf::StampedTransform(
+    tf_pub->sendTransform(tf::StampedTransform(
           T_b_w_gt_tf, msg->header.stamp, fixed_frame_id, child_frame_id+"_mocap"));
   }
 
@@ -585,37 +806,45 @@ void MsckfVio::mocapOdomCallback(
  * imu协方差的传递以及imu与相机位姿之间的协方差更新
  */
 void MsckfVio::batchImuProcessing(const double& time_bound) {
-  // Counter how many IMU msgs in the buffer are used.
-  // 在缓存中保存的imu数量
-  int used_imu_msg_cntr = 0;
-
-  // 对缓存中每个imu数据进行处理
-  // 
-  for (const auto& imu_msg : imu_msg_buffer) {
-    double imu_time = imu_msg.header.stamp.toSec();
-    if (imu_time < state_server.imu_state.time) {
-      ++used_imu_msg_cntr;
-      continue;
-    }
-    if (imu_time > time_bound) break;
-
-    // Convert the msgs.
-    Vector3d m_gyro, m_acc;
-    tf::vectorMsgToEigen(imu_msg.angular_velocity, m_gyro);
-    tf::vectorMsgToEigen(imu_msg.linear_acceleration, m_acc);
-
-    // Execute process model.
-    // 对每个imu数据执行
-    processModel(imu_time, m_gyro, m_acc);
-    ++used_imu_msg_cntr;
+  MSCKF_VIO_TRACE_SCOPE("MsckfVio::batchImuProcessing");
+
+  // Skip the samples before the current state.
+  // 跳过当前状态之前的imu数据
+  size_t begin = imu_buffer_head;
+  while (begin < imu_buffer.size() &&
+      imu_buffer[begin].time < state_server.imu_state.time)
+    ++begin;
+  size_t end = begin;
+  while (end < imu_buffer.size() && imu_buffer[end].time <= time_bound)
+    ++end;
+
+  // Propagate the IMU state over the slice of samples. The
+  // transition matrices of the steps are chained, so that the
+  // covariance between the IMU state and the camera states,
+  // whose size grows with the window, is only propagated once.
+  // 对每个imu数据执行状态传递，相机状态相关的协方差在最后一次性传递
+  const bool has_cam_states = !state_server.cam_states.empty();
+  Matrix<double, 21, 21> Phi;
+  Matrix<double, 21, 21> Phi_slice = Matrix<double, 21, 21>::Identity();
+  for (size_t i = begin; i < end; ++i) {
+    const ImuSample& sample = imu_buffer[i];
+    propagateImuState(sample.time, sample.gyro, sample.acc, Phi);
+    if (has_cam_states) Phi_slice = Phi * Phi_slice;
   }
+  if (has_cam_states && end > begin)
+    propagateCrossCovariance(Phi_slice);
 
   // Set the state ID for the new IMU state.
-  state_server.imu_state.id = IMUState::next_id++;
-
-  // Remove all used IMU msgs.
-  imu_msg_buffer.erase(imu_msg_buffer.begin(),
-      imu_msg_buffer.begin()+used_imu_msg_cntr);
+  state_server.imu_state.id = next_state_id++;
+
+  // Remove all used IMU msgs. The buffer is only compacted once
+  // the used samples make up half of it.
+  imu_buffer_head = end;
+  if (imu_buffer_head*2 >= imu_buffer.size()) {
+    imu_buffer.erase(imu_buffer.begin(),
+        imu_buffer.begin()+imu_buffer_head);
+    imu_buffer_head = 0;
+  }
 
   return;
 }
@@ -633,6 +862,19 @@ void MsckfVio::batchImuProcessing(const double& time_bound) {
 void MsckfVio::processModel(const double& time,
     const Vector3d& m_gyro,
     const Vector3d& m_acc) {
+  MSCKF_VIO_TRACE_SCOPE("MsckfVio::processModel");
+
+  Matrix<double, 21, 21> Phi;
+  propagateImuState(time, m_gyro, m_acc, Phi);
+  if (!state_server.cam_states.empty())
+    propagateCrossCovariance(Phi);
+  return;
+}
+
+void MsckfVio::propagateImuState(const double& time,
+    const Vector3d& m_gyro,
+    const Vector3d& m_acc,
+    Matrix<double, 21, 21>& Phi) {
 
   // Remove the bias from the measured gyro and acceleration
   // 对Imu量测去掉偏置
@@ -645,7 +887,6 @@ void MsckfVio::processModel(const double& time,
   // Compute discrete transition and noise covariance matrix
   // 误差传递方程的两个矩阵: x‘= F * x + G * n
   Matrix<double, 21, 21> F = Matrix<double, 21, 21>::Zero();
-  Matrix<double, 21, 12> G = Matrix<double, 21, 12>::Zero();
 
   // F矩阵的计算详见论文附录A
   // imu_state.orientation为（I_G）^q，即
@@ -657,12 +898,6 @@ void MsckfVio::processModel(const double& time,
       imu_state.orientation).transpose();
   F.block<3, 3>(12, 6) = Matrix3d::Identity();
 
-  G.block<3, 3>(0, 0) = -Matrix3d::Identity();
-  G.block<3, 3>(3, 3) = Matrix3d::Identity();
-  G.block<3, 3>(6, 6) = -quaternionToRotation(
-      imu_state.orientation).transpose();
-  G.block<3, 3>(9, 9) = Matrix3d::Identity();
-
   // Approximate matrix exponential to the 3rd order,
   // which can be considered to be accurate enough assuming
   // dtime is within 0.01s.
@@ -675,13 +910,17 @@ void MsckfVio::processModel(const double& time,
   Matrix<double, 21, 21> Fdt = F * dtime;
   Matrix<double, 21, 21> Fdt_square = Fdt * Fdt;
   Matrix<double, 21, 21> Fdt_cube = Fdt_square * Fdt;
-  Matrix<double, 21, 21> Phi = Matrix<double, 21, 21>::Identity() +
+  Phi = Matrix<double, 21, 21>::Identity() +
     Fdt + 0.5*Fdt_square + (1.0/6.0)*Fdt_cube;
 
-  // Propogate the state using 4th order Runge-Kutta
-  // 采用4阶龙哥库塔数值积分来传递imu状态误差，得到预测的新状态值
+  // Propogate the state using 4th order Runge-Kutta or
+  // the closed-form integration.
+  // 采用4阶龙哥库塔数值积分或者闭式积分来传递imu状态，得到预测的新状态值
   // Modified the q v p
-  predictNewState(dtime, gyro, acc);
+  if (config.integrator == RK4)
+    predictNewState(dtime, gyro, acc);
+  else
+    predictNewStateClosedForm(dtime, gyro, acc);
 
   // Modify the transition matrix
   // For observility constrain
@@ -693,18 +932,18 @@ void MsckfVio::processModel(const double& time,
     quaternionToRotation(imu_state.orientation) * R_kk_1.transpose(); /// ref.1 equation 21.
   /// ref.1 equation (22)-(24)
   /// A* = A-(Au-w)s; s = (u.t * u)^-1 * u.t
-  Vector3d u = R_kk_1 * IMUState::gravity;
+  Vector3d u = R_kk_1 * gravity;
   RowVector3d s = (u.transpose()*u).inverse() * u.transpose();
 
   Matrix3d A1 = Phi.block<3, 3>(6, 0);
   Vector3d w1 = skewSymmetric(
-      imu_state.velocity_null-imu_state.velocity) * IMUState::gravity;
+      imu_state.velocity_null-imu_state.velocity) * gravity;
   Phi.block<3, 3>(6, 0) = A1 - (A1*u-w1)*s;
 
   Matrix3d A2 = Phi.block<3, 3>(12, 0);
   Vector3d w2 = skewSymmetric(
       dtime*imu_state.velocity_null+imu_state.position_null-
-      imu_state.position) * IMUState::gravity;
+      imu_state.position) * gravity;
   Phi.block<3, 3>(12, 0) = A2 - (A2*u-w2)*s;
 
   // Propogate the state covariance matrix.
@@ -712,35 +951,20 @@ void MsckfVio::processModel(const double& time,
   // 连续时间下状态转移矩阵的噪声协方差阵： Qk = 积分（Φ G Q G^T Φ^T dt） （状态转移方程）
   // 离散化噪声协方差: 积分(Qk = Φ G Q G^T Φ^T) dt
   // 卡尔曼滤波器的均方误差为 state_server.state_cov = Φ P Φ^T + Qk
-  Matrix<double, 21, 21> Q = Phi*G*state_server.continuous_noise_cov*
-    G.transpose()*Phi.transpose()*dtime;
-  state_server.state_cov.block<21, 21>(0, 0) =
-    Phi*state_server.state_cov.block<21, 21>(0, 0)*Phi.transpose() + Q;
-
-  // MSCKF的协方差矩阵由四块组成：  imu状态的协方差矩阵块、相机位姿估计的协方差矩阵块、imu状态和相机位姿估计相关性的协方差
-  //          [ P_I_I(k|k)      P_I_C(k|k)]
-  // P_k_k  = [                           ]
-  //          [ P_I_C(k|k).T    P_C_C(k|k)]
-  // 协方差传递如下：
-  //          [ P_I_I(k+1|k)    Φ * P_I_C(k|k)]
-  // P_k_k  = [                           ]
-  //          [ P_I_C(k|k).T * Φ.T  P_C_C(k|k)]
-  if (state_server.cam_states.size() > 0) {
-    //如果state中存在cam状态
-    state_server.state_cov.block(
-        0, 21, 21, state_server.state_cov.cols()-21) =
-      Phi * state_server.state_cov.block(
-        0, 21, 21, state_server.state_cov.cols()-21);
-    state_server.state_cov.block(
-        21, 0, state_server.state_cov.rows()-21, 21) =
-      state_server.state_cov.block(
-        21, 0, state_server.state_cov.rows()-21, 21) * Phi.transpose();
-  }
+  // G = diag(-I, I, -R^T, I) maps the noise to the IMU state.
+  // The noise of each IMU component is isotropic, so G*Q*G^T
+  // is the diagonal of continuous_noise_cov padded with zeros,
+  // independent of the orientation.
+  Matrix<double, 21, 1> GQGt_diag = Matrix<double, 21, 1>::Zero();
+  GQGt_diag.head<12>() = state_server.continuous_noise_cov.diagonal();
+  Matrix<double, 21, 21> Q = Phi*GQGt_diag.asDiagonal()*
+    Phi.transpose()*dtime;
+  Matrix<double, 21, 21> P_imu = state_server.state_cov.block<21, 21>(0, 0);
+  P_imu = Phi*P_imu*Phi.transpose() + Q;
 
   // 为了对称
-  MatrixXd state_cov_fixed = (state_server.state_cov +
-      state_server.state_cov.transpose()) / 2.0;
-  state_server.state_cov = state_cov_fixed;
+  state_server.state_cov.block<21, 21>(0, 0) =
+    (P_imu + P_imu.transpose()) / 2.0;
 
   // Update the state correspondes to null space.
   imu_state.orientation_null = imu_state.orientation;
@@ -752,6 +976,32 @@ void MsckfVio::processModel(const double& time,
   return;
 }
 
+/**
+ * @brief 传递imu状态与相机状态之间的协方差
+ *
+ * MSCKF的协方差矩阵由四块组成：  imu状态的协方差矩阵块、相机位姿估计的协方差矩阵块、imu状态和相机位姿估计相关性的协方差
+ *          [ P_I_I(k|k)      P_I_C(k|k)]
+ * P_k_k  = [                           ]
+ *          [ P_I_C(k|k).T    P_C_C(k|k)]
+ * 协方差传递如下：
+ *          [ P_I_I(k+1|k)    Φ * P_I_C(k|k)]
+ * P_k_k  = [                           ]
+ *          [ P_I_C(k|k).T * Φ.T  P_C_C(k|k)]
+ * Φ可以是多个imu数据的状态转移矩阵的乘积
+ */
+void MsckfVio::propagateCrossCovariance(
+    const Matrix<double, 21, 21>& Phi) {
+  MSCKF_VIO_TRACE_SCOPE("MsckfVio::propagateCrossCovariance");
+
+  const int cam_state_dim = state_server.state_cov.cols() - 21;
+  MatrixXd P_imu_cam = Phi * state_server.state_cov.block(
+      0, 21, 21, cam_state_dim);
+  state_server.state_cov.block(0, 21, 21, cam_state_dim) = P_imu_cam;
+  state_server.state_cov.block(21, 0, cam_state_dim, 21) =
+    P_imu_cam.transpose();
+  return;
+}
+
 /**
  * @brief 将imu的当前状态通过四阶龙哥库塔积分来估计新的imu状态
  *
@@ -762,6 +1012,7 @@ void MsckfVio::processModel(const double& time,
 void MsckfVio::predictNewState(const double& dt,
     const Vector3d& gyro,
     const Vector3d& acc) {
+  MSCKF_VIO_TRACE_SCOPE("MsckfVio::predictNewState");
 
   // TODO: Will performing the forward integration using
   //    the inverse of the quaternion give better accuracy?
@@ -805,25 +1056,25 @@ void MsckfVio::predictNewState(const double& dt,
   // 速度： k1 = f(tn, yn) = R（tn）*a + g
   // 位置： k1 = f(tn, pn) = v
   Vector3d k1_v_dot = quaternionToRotation(q).transpose()*acc +
-    IMUState::gravity;
+    gravity;
   Vector3d k1_p_dot = v;
 
   // k2 = f(tn+dt/2, yn+k1*dt/2) 表示dt/2时刻，状态恒定为yn+k1*dt/2
   Vector3d k1_v = v + k1_v_dot*dt/2;
   Vector3d k2_v_dot = dR_dt2_transpose*acc +
-    IMUState::gravity;
+    gravity;
   Vector3d k2_p_dot = k1_v;
 
   // k3 = f(tn+dt/2, yn+k2*dt/2)  表示dt/2时刻，状态恒定为yn+k2*dt/2
   Vector3d k2_v = v + k2_v_dot*dt/2;
   Vector3d k3_v_dot = dR_dt2_transpose*acc +
-    IMUState::gravity;
+    gravity;
   Vector3d k3_p_dot = k2_v;
 
   // k4 = f(tn+dt, yn+k3*dt)  表示dt时刻，状态恒定为yn+k3*dt
   Vector3d k3_v = v + k3_v_dot*dt;
   Vector3d k4_v_dot = dR_dt_transpose*acc +
-    IMUState::gravity;
+    gravity;
   Vector3d k4_p_dot = k3_v;
 
   // yn+1 = yn + dt/6*(k1+2*k2+2*k3+k4)
@@ -835,11 +1086,52 @@ void MsckfVio::predictNewState(const double& dt,
   return;
 }
 
+/**
+ * @brief 假设一个imu周期内角速度和加速度恒定，在SO(3)上闭式积分得到新的imu状态
+ *
+ * 角速度恒定时 R(t) = R(tn)*Exp(w*t)，于是
+ * v(tn+dt) = v + g*dt + R(tn)*Γ1(w*dt)*a*dt
+ * p(tn+dt) = p + v*dt + 0.5*g*dt^2 + R(tn)*Γ2(w*dt)*a*dt^2
+ * 其中Γ1和Γ2为指数映射的一重和二重积分，见so3Integrals
+ * 只需要一次旋转矩阵的计算，而且没有龙格库塔的截断误差
+ */
+void MsckfVio::predictNewStateClosedForm(const double& dt,
+    const Vector3d& gyro,
+    const Vector3d& acc) {
+  MSCKF_VIO_TRACE_SCOPE("MsckfVio::predictNewStateClosedForm");
+
+  Vector4d& q = state_server.imu_state.orientation;
+  Vector3d& v = state_server.imu_state.velocity;
+  Vector3d& p = state_server.imu_state.position;
+
+  const Vector3d phi = gyro * dt;
+  Matrix3d Gamma1, Gamma2;
+  so3Integrals(phi, Gamma1, Gamma2);
+
+  // Takes a vector from the IMU frame at tn to the world frame.
+  const Matrix3d R_i_w = quaternionToRotation(q).transpose();
+
+  p = p + v*dt + 0.5*gravity*dt*dt + R_i_w*(Gamma2*acc)*dt*dt;
+  v = v + gravity*dt + R_i_w*(Gamma1*acc)*dt;
+
+  // q(tn+dt) = dq ⊗ q(tn), the same rotation as dq_dt in
+  // predictNewState().
+  const double half_angle = 0.5 * phi.norm();
+  Vector4d dq;
+  dq.head<3>() = half_angle > 1e-8 ?
+    Vector3d(0.5*sin(half_angle)/half_angle*phi) : Vector3d(0.5*phi);
+  dq(3) = cos(half_angle);
+  q = quaternionMultiplication(dq, q);
+
+  return;
+}
+
 /**
  * @brief 做了两部分工作：根据已知的imu与相机外参以及Imu运动模型 \n
  * 推测出当前相机的位姿并加入msckf状态向量中； 对系统的协方差矩阵进行增广
  */
 void MsckfVio::stateAugmentation(const double& time) {
+  MSCKF_VIO_TRACE_SCOPE("MsckfVio::stateAugmentation");
 
   const Matrix3d& R_i_c = state_server.imu_state.R_imu_cam0;
   const Vector3d& t_c_i = state_server.imu_state.t_cam0_imu;
@@ -921,30 +1213,50 @@ void MsckfVio::stateAugmentation(const double& time) {
  * @param msg All features on the current image, including tracked ones and newly detected ones.
  * features[] feature: id u0 v0 u1 v1
  */
-void MsckfVio::addFeatureObservations(
-    const CameraMeasurementConstPtr& msg) {
+void MsckfVio::addFeatureObservations(const FeatureFrame& frame) {
+  MSCKF_VIO_TRACE_SCOPE("MsckfVio::addFeatureObservations");
 
   StateIDType state_id = state_server.imu_state.id;
+
+  // If the image processor is restarted together with the
+  // filter, its feature ids start over and can not be
+  // associated with the restored features. In that case all
+  // the ids are smaller than the restored ones, while a running
+  // image processor either keeps tracking some of the restored
+  // features or creates larger ids.
+  if (has_restored_features) {
+    has_restored_features = false;
+    FeatureIDType max_feature_id = -1;
+    for (const auto& id : frame.ids)
+      max_feature_id = max(max_feature_id,
+          static_cast<FeatureIDType>(id));
+    if (!map_server.empty() && frame.size() > 0 &&
+        max_feature_id < map_server.begin()->first) {
+      ROS_WARN("Feature ids restarted, drop %lu restored features...",
+          map_server.size());
+      map_server.clear();
+    }
+  }
+
   int curr_feature_num = map_server.size();
   int tracked_feature_num = 0;
 
   // Add new observations for existing features or new
   // features in the map server.
-  for (const auto& feature : msg->features) {
+  for (int i = 0; i < frame.size(); ++i) {
+    const FeatureIDType id = frame.ids[i];
+    const Vector4d observation(
+        frame.u0[i], frame.v0[i], frame.u1[i], frame.v1[i]);
     // find，返回的是被查找元素的位置，没有则返回map.end()
-    if (map_server.find(feature.id) == map_server.end()) {
+    if (map_server.find(id) == map_server.end()) {
       // This is a new feature.
       // 新的特征点则加入到map中
-      map_server[feature.id] = Feature(feature.id);
-      map_server[feature.id].observations[state_id] = /// observations: state_id(key)-image_coordinates(value) manner.
-        Vector4d(feature.u0, feature.v0,
-            feature.u1, feature.v1);
+      map_server[id] = Feature(id);
+      map_server[id].observations[state_id] = observation; /// observations: state_id(key)-image_coordinates(value) manner.
     } else {
       // This is an old feature.
       // 如果是老的地图点，则跟踪计数器加1
-      map_server[feature.id].observations[state_id] =
-        Vector4d(feature.u0, feature.v0,
-            feature.u1, feature.v1);
+      map_server[id].observations[state_id] = observation;
       ++tracked_feature_num;
     }
   }
@@ -983,9 +1295,9 @@ void MsckfVio::measurementJacobian(
 
   // 右边的相机位姿可通过两个相机的外参计算得到
   // Cam1 pose.
-  Matrix3d R_c0_c1 = CAMState::T_cam0_cam1.linear();
-  Matrix3d R_w_c1 = CAMState::T_cam0_cam1.linear() * R_w_c0;
-  Vector3d t_c1_w = t_c0_w - R_w_c1.transpose()*CAMState::T_cam0_cam1.translation();
+  Matrix3d R_c0_c1 = T_cam0_cam1.linear();
+  Matrix3d R_w_c1 = T_cam0_cam1.linear() * R_w_c0;
+  Vector3d t_c1_w = t_c0_w - R_w_c1.transpose()*T_cam0_cam1.translation();
 
   // 3d feature position in the world frame.
   // And its observation with the stereo cameras.
@@ -1037,9 +1349,9 @@ void MsckfVio::measurementJacobian(
   Matrix<double, 4, 6> A = H_x;
   Matrix<double, 6, 1> u = Matrix<double, 6, 1>::Zero();
   u.block<3, 1>(0, 0) = quaternionToRotation(
-      cam_state.orientation_null) * IMUState::gravity;
+      cam_state.orientation_null) * gravity;
   u.block<3, 1>(3, 0) = skewSymmetric(
-      p_w-cam_state.position_null) * IMUState::gravity;
+      p_w-cam_state.position_null) * gravity;
   H_x = A - A*u*(u.transpose()*u).inverse()*u.transpose();
   H_f = -H_x.block<4, 3>(0, 3);
 
@@ -1063,6 +1375,7 @@ void MsckfVio::featureJacobian(
     const FeatureIDType& feature_id,
     const std::vector<StateIDType>& cam_state_ids,
     MatrixXd& H_x, VectorXd& r) {
+  MSCKF_VIO_TRACE_SCOPE("MsckfVio::featureJacobian");
 
   const auto& feature = map_server[feature_id];
 
@@ -1134,6 +1447,7 @@ void MsckfVio::featureJacobian(
  */
 void MsckfVio::measurementUpdate(
     const MatrixXd& H, const VectorXd& r) {
+  MSCKF_VIO_TRACE_SCOPE("MsckfVio::measurementUpdate");
 
   if (H.rows() == 0 || r.rows() == 0) return;
 
@@ -1190,7 +1504,7 @@ void MsckfVio::measurementUpdate(
   // -> (H_thin*P*H_thin^T + Rn)^T * K^T = H_thin * P^T
   const MatrixXd& P = state_server.state_cov;
   MatrixXd S = H_thin*P*H_thin.transpose() +
-      Feature::observation_noise*MatrixXd::Identity(
+      observation_noise*MatrixXd::Identity(
         H_thin.rows(), H_thin.rows());
   //MatrixXd K_transpose = S.fullPivHouseholderQr().solve(H_thin*P);
   // P^T = P!!!
@@ -1259,7 +1573,7 @@ void MsckfVio::measurementUpdate(
   // Update state covariance.
   MatrixXd I_KH = MatrixXd::Identity(K.rows(), H_thin.cols()) - K*H_thin;
   //state_server.state_cov = I_KH*state_server.state_cov*I_KH.transpose() +
-  //  K*K.transpose()*Feature::observation_noise;
+  //  K*K.transpose()*observation_noise;
   state_server.state_cov = I_KH*state_server.state_cov;
 
   // Fix the covariance to be symmetric
@@ -1278,9 +1592,10 @@ void MsckfVio::measurementUpdate(
  */
 bool MsckfVio::gatingTest(
     const MatrixXd& H, const VectorXd& r, const int& dof) {
+  MSCKF_VIO_TRACE_SCOPE("MsckfVio::gatingTest");
   // 详见论文《Monocular visual inertial odometry on a mobile device》第56页
   MatrixXd P1 = H * state_server.state_cov * H.transpose();
-  MatrixXd P2 = Feature::observation_noise *
+  MatrixXd P2 = observation_noise *
     MatrixXd::Identity(H.rows(), H.rows());
   // gamma为观测和假设之间的差异，计算公式： gamma = r^T *(HPH+state_cov*I)^-1*r
   // 其中(HPH+state_cov*I)^-1*r可以认为是（HPH+state_cov*I)*x = r 的解，所以这里采用Cholesky分解得到
@@ -1303,6 +1618,7 @@ bool MsckfVio::gatingTest(
  *  
  */
 void MsckfVio::removeLostFeatures() {
+  MSCKF_VIO_TRACE_SCOPE("MsckfVio::removeLostFeatures");
 
   // Remove the features that lost track.
   // BTW, find the size the final Jacobian matrix and residual vector.
@@ -1326,11 +1642,13 @@ void MsckfVio::removeLostFeatures() {
     // Check if the feature can be initialized if it
     // has not been.
     if (!feature.is_initialized) {
-      if (!feature.checkMotion(state_server.cam_states)) {
+      if (!feature.checkMotion(
+            state_server.cam_states, optimization_config)) {
         invalid_feature_ids.push_back(feature.id);
         continue;
       } else {
-        if(!feature.initializePosition(state_server.cam_states)) {
+        if(!feature.initializePosition(state_server.cam_states,
+              T_cam0_cam1, optimization_config)) {
           invalid_feature_ids.push_back(feature.id);
           continue;
         }
@@ -1457,6 +1775,7 @@ void MsckfVio::findRedundantCamStates(
  * 2.slideWindow满了的时候
  */
 void MsckfVio::pruneCamStateBuffer() {
+  MSCKF_VIO_TRACE_SCOPE("MsckfVio::pruneCamStateBuffer");
 
   if (state_server.cam_states.size() < max_cam_state_size)
     return;
@@ -1487,7 +1806,8 @@ void MsckfVio::pruneCamStateBuffer() {
 
     if (!feature.is_initialized) {
       // Check if the feature can be initialize.
-      if (!feature.checkMotion(state_server.cam_states)) {
+      if (!feature.checkMotion(
+            state_server.cam_states, optimization_config)) {
         // If the feature cannot be initialized, just remove
         // the observations associated with the camera states
         // to be removed.
@@ -1495,7 +1815,8 @@ void MsckfVio::pruneCamStateBuffer() {
           feature.observations.erase(cam_id);
         continue;
       } else {
-        if(!feature.initializePosition(state_server.cam_states)) {
+        if(!feature.initializePosition(state_server.cam_states,
+              T_cam0_cam1, optimization_config)) {
           for (const auto& cam_id : involved_cam_state_ids)
             feature.observations.erase(cam_id);
           continue;
@@ -1587,11 +1908,11 @@ void MsckfVio::pruneCamStateBuffer() {
 }
 
 void MsckfVio::onlineReset() {
+  MSCKF_VIO_TRACE_SCOPE("MsckfVio::onlineReset");
 
   // Never perform online reset if position std threshold
   // is non-positive.
   if (position_std_threshold <= 0) return;
-  static long long int online_reset_counter = 0;
 
   // Check the uncertainty of positions to determine if
   // the system can be reset.
@@ -1615,114 +1936,184 @@ void MsckfVio::onlineReset() {
   map_server.clear();
 
   // Reset the state covariance.
-  double gyro_bias_cov, acc_bias_cov, velocity_cov;
-  nh.param<double>("initial_covariance/velocity",
-      velocity_cov, 0.25);
-  nh.param<double>("initial_covariance/gyro_bias",
-      gyro_bias_cov, 1e-4);
-  nh.param<double>("initial_covariance/acc_bias",
-      acc_bias_cov, 1e-2);
-
-  double extrinsic_rotation_cov, extrinsic_translation_cov;
-  nh.param<double>("initial_covariance/extrinsic_rotation_cov",
-      extrinsic_rotation_cov, 3.0462e-4);
-  nh.param<double>("initial_covariance/extrinsic_translation_cov",
-      extrinsic_translation_cov, 1e-4);
-
-  state_server.state_cov = MatrixXd::Zero(21, 21);
-  for (int i = 3; i < 6; ++i)
-    state_server.state_cov(i, i) = gyro_bias_cov;
-  for (int i = 6; i < 9; ++i)
-    state_server.state_cov(i, i) = velocity_cov;
-  for (int i = 9; i < 12; ++i)
-    state_server.state_cov(i, i) = acc_bias_cov;
-  for (int i = 15; i < 18; ++i)
-    state_server.state_cov(i, i) = extrinsic_rotation_cov;
-  for (int i = 18; i < 21; ++i)
-    state_server.state_cov(i, i) = extrinsic_translation_cov;
+  resetStateCov();
 
   ROS_WARN("%lld online reset complete...", online_reset_counter);
   return;
 }
 
-void MsckfVio::publish(const ros::Time& time) {
+/**
+ * @brief 每帧处理完后发布滤波器的状态，作为图像处理节点的确认
+ */
+void MsckfVio::publishStatus(const ros::Time& time,
+    const double& processing_time) {
+  if (!nh) return;
+  FilterStatusPtr status_msg_ptr(new FilterStatus());
+  status_msg_ptr->header.stamp = time;
+  status_msg_ptr->is_running = isRunning();
+  status_msg_ptr->processing_time = processing_time;
+  status_msg_ptr->latency = (ros::Time::now()-time).toSec();
+  status_pub.publish(status_msg_ptr);
+  return;
+}
 
-  // Convert the IMU frame to the body frame.
-  const IMUState& imu_state = state_server.imu_state;
-  Eigen::Isometry3d T_i_w = Eigen::Isometry3d::Identity();
-  T_i_w.linear() = quaternionToRotation(
-      imu_state.orientation).transpose();
-  T_i_w.translation() = imu_state.position;
+/**
+ * @brief 根据每帧的处理时间调整滑动窗口的大小
+ *
+ * 多余的相机状态在之后的帧中通过pruneCamStateBuffer移除
+ */
+void MsckfVio::updateWindowSize(const ros::Time& time,
+    const double& processing_time) {
+  if (!window_controller) return;
+  if (!window_controller->update(processing_time)) return;
+
+  const int prev_size = max_cam_state_size;
+  max_cam_state_size = window_controller->windowSize();
+  if (max_cam_state_size != prev_size)
+    ROS_INFO("Window size %d -> %d, average processing time %f sec",
+        prev_size, max_cam_state_size, window_controller->averageTime());
+
+  // Export the decision as diagnostics.
+  if (!nh) return;
+  diagnostic_msgs::DiagnosticStatus status;
+  status.name = "msckf_vio: sliding window";
+  status.hardware_id = child_frame_id;
+  // The window is kept over the budget only at the minimum size.
+  if (window_controller->decision() == WindowController::KEEP &&
+      window_controller->averageTime() > window_controller->budgetTime()) {
+    status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+    status.message = "Over the time budget at the minimum window size";
+  } else {
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.message =
+      window_controller->decision() == WindowController::SHRINK ? "Shrink" :
+      window_controller->decision() == WindowController::GROW ? "Grow" :
+      "Keep";
+  }
 
-  Eigen::Isometry3d T_b_w = IMUState::T_imu_body * T_i_w *
-    IMUState::T_imu_body.inverse();
-  Eigen::Vector3d body_velocity =
-    IMUState::T_imu_body.linear() * imu_state.velocity;
+  diagnostic_msgs::KeyValue key_value;
+  key_value.key = "window size";
+  key_value.value = std::to_string(max_cam_state_size);
+  status.values.push_back(key_value);
+  key_value.key = "camera states";
+  key_value.value = std::to_string(state_server.cam_states.size());
+  status.values.push_back(key_value);
+  key_value.key = "average processing time";
+  key_value.value = std::to_string(window_controller->averageTime());
+  status.values.push_back(key_value);
+  key_value.key = "time budget";
+  key_value.value = std::to_string(window_controller->budgetTime());
+  status.values.push_back(key_value);
+
+  diagnostic_msgs::DiagnosticArray diagnostics_msg;
+  diagnostics_msg.header.stamp = time;
+  diagnostics_msg.status.push_back(status);
+  diagnostics_pub.publish(diagnostics_msg);
+  return;
+}
 
-  // Publish tf
-  if (publish_tf) {
-    tf::Transform T_b_w_tf;
-    tf::transformEigenToTF(T_b_w, T_b_w_tf);
-    tf_pub.sendTransform(tf::StampedTransform(
-          T_b_w_tf, time, fixed_frame_id, child_frame_id));
+void MsckfVio::getSnapshot(FilterSnapshot& snapshot) const {
+  snapshot.next_state_id = next_state_id;
+  snapshot.gravity = gravity;
+  snapshot.imu_state = state_server.imu_state;
+  snapshot.cam_states = state_server.cam_states;
+  snapshot.state_cov = state_server.state_cov;
+  snapshot.map_server = map_server;
+  return;
+}
+
+void MsckfVio::restore(const FilterSnapshot& snapshot) {
+  restored_snapshot = snapshot;
+  has_restored_snapshot = true;
+  return;
+}
+
+/**
+ * @brief 用恢复的快照代替重力和偏置的初始化
+ *
+ * 快照与当前imu数据的时间差超过checkpoint_max_age时丢弃快照
+ */
+bool MsckfVio::applySnapshot(const double& time) {
+  // The IMU msgs between the checkpoint and the restart are
+  // missing, so the state is only propagated over a short gap.
+  const double snapshot_age = time - restored_snapshot.imu_state.time;
+  if (std::abs(snapshot_age) > config.checkpoint_max_age) {
+    ROS_WARN("Discard the checkpoint which is %f sec away "
+        "from the IMU msgs...", snapshot_age);
+    restored_snapshot = FilterSnapshot();
+    return false;
   }
 
-  // Publish the odometry
-  nav_msgs::Odometry odom_msg;
-  odom_msg.header.stamp = time;
-  odom_msg.header.frame_id = fixed_frame_id;
-  odom_msg.child_frame_id = child_frame_id;
-
-  tf::poseEigenToMsg(T_b_w, odom_msg.pose.pose);
-  tf::vectorEigenToMsg(body_velocity, odom_msg.twist.twist.linear);
-
-  // Convert the covariance.
-  Matrix3d P_oo = state_server.state_cov.block<3, 3>(0, 0);
-  Matrix3d P_op = state_server.state_cov.block<3, 3>(0, 12);
-  Matrix3d P_po = state_server.state_cov.block<3, 3>(12, 0);
-  Matrix3d P_pp = state_server.state_cov.block<3, 3>(12, 12);
-  Matrix<double, 6, 6> P_imu_pose = Matrix<double, 6, 6>::Zero();
-  P_imu_pose << P_pp, P_po, P_op, P_oo;
-
-  Matrix<double, 6, 6> H_pose = Matrix<double, 6, 6>::Zero();
-  H_pose.block<3, 3>(0, 0) = IMUState::T_imu_body.linear();
-  H_pose.block<3, 3>(3, 3) = IMUState::T_imu_body.linear();
-  Matrix<double, 6, 6> P_body_pose = H_pose *
-    P_imu_pose * H_pose.transpose();
-
-  for (int i = 0; i < 6; ++i)
-    for (int j = 0; j < 6; ++j)
-      odom_msg.pose.covariance[6*i+j] = P_body_pose(i, j);
-
-  // Construct the covariance for the velocity.
-  Matrix3d P_imu_vel = state_server.state_cov.block<3, 3>(6, 6);
-  Matrix3d H_vel = IMUState::T_imu_body.linear();
-  Matrix3d P_body_vel = H_vel * P_imu_vel * H_vel.transpose();
-  for (int i = 0; i < 3; ++i)
-    for (int j = 0; j < 3; ++j)
-      odom_msg.twist.covariance[i*6+j] = P_body_vel(i, j);
-
-  odom_pub.publish(odom_msg);
-
-  // Publish the 3D positions of the features that
-  // has been initialized.
-  pcl::PointCloud<pcl::PointXYZ>::Ptr feature_msg_ptr(
-      new pcl::PointCloud<pcl::PointXYZ>());
-  feature_msg_ptr->header.frame_id = fixed_frame_id;
-  feature_msg_ptr->height = 1;
-  for (const auto& item : map_server) {
-    const auto& feature = item.second;
-    if (feature.is_initialized) {
-      Vector3d feature_position =
-        IMUState::T_imu_body.linear() * feature.position;
-      feature_msg_ptr->points.push_back(pcl::PointXYZ(
-            feature_position(0), feature_position(1), feature_position(2)));
+  next_state_id = restored_snapshot.next_state_id;
+  gravity = restored_snapshot.gravity;
+  state_server.imu_state = restored_snapshot.imu_state;
+  state_server.cam_states.swap(restored_snapshot.cam_states);
+  state_server.state_cov.swap(restored_snapshot.state_cov);
+  map_server.swap(restored_snapshot.map_server);
+  restored_snapshot = FilterSnapshot();
+
+  // The next frame is processed as usual.
+  is_gravity_set = true;
+  is_first_img = false;
+  has_restored_features = !map_server.empty();
+
+  ROS_INFO("Resumed from the checkpoint with %lu camera states "
+      "and %lu features...", state_server.cam_states.size(),
+      map_server.size());
+  return true;
+}
+
+void MsckfVio::writeCheckpoint(const double& time) {
+  if (!checkpoint_writer) return;
+  if (time-last_checkpoint_time < config.checkpoint_period) return;
+
+  // Only the copy is made on this thread. The snapshot is
+  // serialized and written by the checkpoint writer.
+  FilterSnapshot snapshot;
+  getSnapshot(snapshot);
+  checkpoint_writer->write(snapshot);
+  last_checkpoint_time = time;
+  return;
+}
+
+void MsckfVio::publish(const ros::Time& time) {
+  MSCKF_VIO_TRACE_SCOPE("MsckfVio::publish");
+
+  // Nothing to publish without ROS IO.
+  if (!output_publisher) return;
+
+  // Only the state is copied here. The msgs are
+  // built on the output publisher thread.
+  const IMUState& imu_state = state_server.imu_state;
+  OutputState state;
+  state.time = time;
+  state.orientation = imu_state.orientation;
+  state.position = imu_state.position;
+  state.velocity = imu_state.velocity;
+
+  // Covariance of the position and orientation.
+  const MatrixXd& P = state_server.state_cov;
+  state.pose_cov << P.block<3, 3>(12, 12), P.block<3, 3>(12, 0),
+    P.block<3, 3>(0, 12), P.block<3, 3>(0, 0);
+  state.velocity_cov = P.block<3, 3>(6, 6);
+
+  // Collect the 3D positions of the features that has been
+  // initialized, only when the point cloud is due and has
+  // any subscriber.
+  if (++feature_cloud_cntr >= feature_cloud_decimation) {
+    feature_cloud_cntr = 0;
+    state.has_features = output_publisher->hasFeatureSubscribers();
+  }
+  if (state.has_features) {
+    state.feature_positions.reserve(map_server.size());
+    for (const auto& item : map_server) {
+      const auto& feature = item.second;
+      if (feature.is_initialized)
+        state.feature_positions.push_back(feature.position);
     }
   }
-  feature_msg_ptr->width = feature_msg_ptr->points.size();
-
-  feature_pub.publish(feature_msg_ptr);
 
+  output_publisher->push(state);
   return;
 }
 
@@ -0,0 +1,158 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <nav_msgs/Odometry.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <eigen_conversions/eigen_msg.h>
+#include <tf_conversions/tf_eigen.h>
+#include <pcl_ros/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <msckf_vio/output_publisher.h>
+#include <msckf_vio/math_utils.hpp>
+#include <msckf_vio/trace.h>
+
+using namespace std;
+using namespace Eigen;
+
+namespace msckf_vio {
+
+namespace {
+// Number of states which can be queued. States are dropped
+// if the publisher thread falls this much behind.
+const size_t kStateQueueSize = 8;
+} // namespace
+
+OutputPublisher::OutputPublisher(ros::NodeHandle& nh,
+    const string& fixed_frame,
+    const string& child_frame,
+    const bool& enable_tf,
+    const Isometry3d& T_imu_body_):
+  fixed_frame_id(fixed_frame),
+  child_frame_id(child_frame),
+  publish_tf(enable_tf),
+  T_imu_body(T_imu_body_),
+  state_queue(kStateQueueSize),
+  is_stopped(false) {
+  odom_pub = nh.advertise<nav_msgs::Odometry>("odom", 10);
+  feature_pub = nh.advertise<sensor_msgs::PointCloud2>(
+      "feature_point_cloud", 10);
+  publisher_thread = thread(&OutputPublisher::publisherLoop, this);
+  return;
+}
+
+OutputPublisher::~OutputPublisher() {
+  {
+    lock_guard<mutex> lock(wakeup_mutex);
+    is_stopped = true;
+  }
+  wakeup_cond.notify_one();
+  publisher_thread.join();
+  return;
+}
+
+bool OutputPublisher::push(OutputState& state) {
+  if (!state_queue.tryPush(state)) {
+    ROS_WARN_THROTTLE(1.0, "Output queue is full, drop the state...");
+    return false;
+  }
+
+  // Locking the mutex makes sure the publisher thread is either
+  // before checking the queue or already waiting, so the
+  // notification can not be lost.
+  { lock_guard<mutex> lock(wakeup_mutex); }
+  wakeup_cond.notify_one();
+  return true;
+}
+
+void OutputPublisher::publisherLoop() {
+  OutputState state;
+  while (true) {
+    while (state_queue.tryPop(state)) publish(state);
+
+    unique_lock<mutex> lock(wakeup_mutex);
+    wakeup_cond.wait(lock, [this]() {
+        return is_stopped || !state_queue.empty(); });
+    if (is_stopped && state_queue.empty()) break;
+  }
+  return;
+}
+
+void OutputPublisher::publish(const OutputState& state) {
+  MSCKF_VIO_TRACE_FRAME(state.time.toNSec());
+  MSCKF_VIO_TRACE_SCOPE("OutputPublisher::publish");
+
+  // Convert the IMU frame to the body frame.
+  Eigen::Isometry3d T_i_w = Eigen::Isometry3d::Identity();
+  T_i_w.linear() = quaternionToRotation(
+      state.orientation).transpose();
+  T_i_w.translation() = state.position;
+
+  Eigen::Isometry3d T_b_w = T_imu_body * T_i_w *
+    T_imu_body.inverse();
+  Eigen::Vector3d body_velocity =
+    T_imu_body.linear() * state.velocity;
+
+  // Publish tf
+  if (publish_tf) {
+    tf::Transform T_b_w_tf;
+    tf::transformEigenToTF(T_b_w, T_b_w_tf);
+    tf_pub.sendTransform(tf::StampedTransform(
+          T_b_w_tf, state.time, fixed_frame_id, child_frame_id));
+  }
+
+  // Publish the odometry
+  nav_msgs::Odometry odom_msg;
+  odom_msg.header.stamp = state.time;
+  odom_msg.header.frame_id = fixed_frame_id;
+  odom_msg.child_frame_id = child_frame_id;
+
+  tf::poseEigenToMsg(T_b_w, odom_msg.pose.pose);
+  tf::vectorEigenToMsg(body_velocity, odom_msg.twist.twist.linear);
+
+  // Convert the covariance.
+  Matrix<double, 6, 6> H_pose = Matrix<double, 6, 6>::Zero();
+  H_pose.block<3, 3>(0, 0) = T_imu_body.linear();
+  H_pose.block<3, 3>(3, 3) = T_imu_body.linear();
+  Matrix<double, 6, 6> P_body_pose = H_pose *
+    state.pose_cov * H_pose.transpose();
+
+  for (int i = 0; i < 6; ++i)
+    for (int j = 0; j < 6; ++j)
+      odom_msg.pose.covariance[6*i+j] = P_body_pose(i, j);
+
+  // Construct the covariance for the velocity.
+  Matrix3d H_vel = T_imu_body.linear();
+  Matrix3d P_body_vel = H_vel * state.velocity_cov * H_vel.transpose();
+  for (int i = 0; i < 3; ++i)
+    for (int j = 0; j < 3; ++j)
+      odom_msg.twist.covariance[i*6+j] = P_body_vel(i, j);
+
+  odom_pub.publish(odom_msg);
+
+  if (!state.has_features) return;
+
+  // Publish the 3D positions of the features that
+  // has been initialized.
+  pcl::PointCloud<pcl::PointXYZ>::Ptr feature_msg_ptr(
+      new pcl::PointCloud<pcl::PointXYZ>());
+  feature_msg_ptr->header.frame_id = fixed_frame_id;
+  feature_msg_ptr->height = 1;
+  feature_msg_ptr->points.reserve(state.feature_positions.size());
+  for (const auto& position : state.feature_positions) {
+    Vector3d feature_position = T_imu_body.linear() * position;
+    feature_msg_ptr->points.push_back(pcl::PointXYZ(
+          feature_position(0), feature_position(1), feature_position(2)));
+  }
+  feature_msg_ptr->width = feature_msg_ptr->points.size();
+
+  feature_pub.publish(feature_msg_ptr);
+
+  return;
+}
+
+} // namespace msckf_vio
@@ -0,0 +1,208 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <cmath>
+#include <algorithm>
+#include <opencv2/calib3d.hpp>
+
+#include <msckf_vio/point_undistorter.h>
+
+using namespace std;
+using namespace cv;
+
+namespace msckf_vio {
+
+PointUndistorter::PointUndistorter(const Vec2i& resolution,
+    const Vec4d& k, const string& distortion_model,
+    const Vec4d& d, const Config& c):
+  config(c),
+  intrinsics(k),
+  distortion_coeffs(d),
+  is_equidistant(distortion_model == "equidistant"),
+  table_cols(0),
+  table_rows(0),
+  max_error(0.0) {
+  if (!config.use_table) return;
+
+  // The grid covers the image from the first to the last pixel.
+  const double step = config.grid_step;
+  table_cols = static_cast<int>(ceil((resolution[0]-1) / step)) + 1;
+  table_rows = static_cast<int>(ceil((resolution[1]-1) / step)) + 1;
+
+  vector<Point2f> grid_pts(table_cols*table_rows);
+  for (int row = 0; row < table_rows; ++row)
+    for (int col = 0; col < table_cols; ++col)
+      grid_pts[row*table_cols+col] = Point2f(col*step, row*step);
+  solve(grid_pts, table);
+
+  // Compare the interpolation with the solver at the centers
+  // of the cells, where it is the least accurate.
+  vector<Point2f> center_pts(0);
+  center_pts.reserve((table_cols-1)*(table_rows-1));
+  for (int row = 0; row+1 < table_rows; ++row)
+    for (int col = 0; col+1 < table_cols; ++col)
+      center_pts.push_back(Point2f((col+0.5)*step, (row+0.5)*step));
+  vector<Point2f> solved_pts(0);
+  solve(center_pts, solved_pts);
+
+  // The cells over the tolerance are left to the solver, e.g.
+  // the ones close to 90 degrees of a fisheye lens. The error
+  // is in pixels through the distortion model, since it is
+  // ill-conditioned on the normalized plane at wide angles.
+  cell_valid.assign(center_pts.size(), 0);
+  for (int row = 0; row+1 < table_rows; ++row) {
+    for (int col = 0; col+1 < table_cols; ++col) {
+      const int idx = row*(table_cols-1) + col;
+      const Point2d solved_pixel = project(solved_pts[idx]);
+      const Point2d diff =
+        solved_pixel - project(interpolate(col, row, 0.5, 0.5));
+      const double error = sqrt(diff.dot(diff));
+
+      // Skip the cells where the solver fails as well.
+      const Point2d residual = solved_pixel - Point2d(center_pts[idx]);
+      if (!(residual.dot(residual) < 1.0) ||
+          !(error < config.max_error)) continue;
+      cell_valid[idx] = 1;
+      max_error = max(max_error, error);
+    }
+  }
+
+  return;
+}
+
+void PointUndistorter::undistort(const vector<Point2f>& pts_in,
+    vector<Point2f>& pts_out, const Matx33d& rectification_matrix) const {
+  pts_out.resize(pts_in.size());
+  if (pts_in.size() == 0) return;
+
+  // 表格之外的点交给OpenCV迭代求解
+  vector<int> solver_idx(0);
+  vector<Point2f> solver_pts(0);
+  for (int i = 0; i < pts_in.size(); ++i) {
+    Point2d pt;
+    if (!lookup(pts_in[i], pt)) {
+      solver_idx.push_back(i);
+      solver_pts.push_back(pts_in[i]);
+      continue;
+    }
+    if (config.refine) refine(pts_in[i], pt);
+    pts_out[i] = pt;
+  }
+
+  if (solver_idx.size() > 0) {
+    vector<Point2f> solved_pts(0);
+    solve(solver_pts, solved_pts);
+    for (int i = 0; i < solver_idx.size(); ++i)
+      pts_out[solver_idx[i]] = solved_pts[i];
+  }
+
+  if (rectification_matrix == Matx33d::eye()) return;
+  for (auto& pt : pts_out) {
+    const Vec3d pt_h = rectification_matrix * Vec3d(pt.x, pt.y, 1.0);
+    pt.x = pt_h[0] / pt_h[2];
+    pt.y = pt_h[1] / pt_h[2];
+  }
+
+  return;
+}
+
+bool PointUndistorter::lookup(const Point2f& pt, Point2d& pt_out) const {
+  if (table.empty()) return false;
+
+  // The comparisons are false for NaN as well.
+  const double x = pt.x / config.grid_step;
+  const double y = pt.y / config.grid_step;
+  if (!(x >= 0.0 && y >= 0.0 &&
+        x <= table_cols-1 && y <= table_rows-1)) return false;
+
+  const int col = min(static_cast<int>(x), table_cols-2);
+  const int row = min(static_cast<int>(y), table_rows-2);
+  if (!cell_valid[row*(table_cols-1)+col]) return false;
+  pt_out = interpolate(col, row, x-col, y-row);
+  return true;
+}
+
+Point2d PointUndistorter::interpolate(const int& col, const int& row,
+    const double& a, const double& b) const {
+  const Point2f* p = &table[row*table_cols+col];
+  const Point2d top = Point2d(p[0])*(1.0-a) + Point2d(p[1])*a;
+  const Point2d bottom = Point2d(p[table_cols])*(1.0-a) +
+    Point2d(p[table_cols+1])*a;
+  return top*(1.0-b) + bottom*b;
+}
+
+void PointUndistorter::refine(const Point2f& pt, Point2d& pt_out) const {
+  // Distorted point on the normalized plane.
+  const Point2d target(
+      (pt.x-intrinsics[2]) / intrinsics[0],
+      (pt.y-intrinsics[3]) / intrinsics[1]);
+
+  // Jacobian of the distortion by forward differences.
+  const double h = 1e-6;
+  const Point2d d0 = distort(pt_out);
+  const Point2d dx = (distort(pt_out+Point2d(h, 0.0)) - d0) * (1.0/h);
+  const Point2d dy = (distort(pt_out+Point2d(0.0, h)) - d0) * (1.0/h);
+  const double det = dx.x*dy.y - dy.x*dx.y;
+  if (std::abs(det) < 1e-12) return;
+
+  const Point2d r = target - d0;
+  pt_out.x += (dy.y*r.x - dy.x*r.y) / det;
+  pt_out.y += (-dx.y*r.x + dx.x*r.y) / det;
+  return;
+}
+
+Point2d PointUndistorter::distort(const Point2d& pt) const {
+  const double& k1 = distortion_coeffs[0];
+  const double& k2 = distortion_coeffs[1];
+  const double r2 = pt.x*pt.x + pt.y*pt.y;
+
+  if (is_equidistant) {
+    const double& k3 = distortion_coeffs[2];
+    const double& k4 = distortion_coeffs[3];
+    const double r = sqrt(r2);
+    if (r < 1e-8) return pt;
+    const double theta = atan(r);
+    const double theta2 = theta*theta;
+    const double theta_d = theta * (1.0 + theta2*(k1 + theta2*(
+            k2 + theta2*(k3 + theta2*k4))));
+    return pt * (theta_d/r);
+  }
+
+  // 径向畸变和切向畸变
+  const double& p1 = distortion_coeffs[2];
+  const double& p2 = distortion_coeffs[3];
+  const double radial = 1.0 + r2*(k1 + r2*k2);
+  return Point2d(
+      pt.x*radial + 2.0*p1*pt.x*pt.y + p2*(r2+2.0*pt.x*pt.x),
+      pt.y*radial + p1*(r2+2.0*pt.y*pt.y) + 2.0*p2*pt.x*pt.y);
+}
+
+Point2d PointUndistorter::project(const Point2d& pt) const {
+  const Point2d pt_d = distort(pt);
+  return Point2d(
+      pt_d.x*intrinsics[0] + intrinsics[2],
+      pt_d.y*intrinsics[1] + intrinsics[3]);
+}
+
+void PointUndistorter::solve(const vector<Point2f>& pts_in,
+    vector<Point2f>& pts_out) const {
+  pts_out.clear();
+  if (pts_in.size() == 0) return;
+
+  const Matx33d K(
+      intrinsics[0], 0.0, intrinsics[2],
+      0.0, intrinsics[1], intrinsics[3],
+      0.0, 0.0, 1.0);
+
+  if (is_equidistant)
+    cv::fisheye::undistortPoints(pts_in, pts_out, K, distortion_coeffs);
+  else
+    cv::undistortPoints(pts_in, pts_out, K, distortion_coeffs);
+  return;
+}
+
+} // namespace msckf_vio
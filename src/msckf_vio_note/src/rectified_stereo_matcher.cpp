@@ -0,0 +1,294 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include <msckf_vio/rectified_stereo_matcher.h>
+
+using namespace std;
+using namespace cv;
+
+namespace msckf_vio {
+
+namespace {
+
+Vec3d cross(const Vec3d& a, const Vec3d& b) {
+  return Vec3d(
+      a[1]*b[2] - a[2]*b[1],
+      a[2]*b[0] - a[0]*b[2],
+      a[0]*b[1] - a[1]*b[0]);
+}
+
+Vec3d normalized(const Vec3d& v) {
+  return v * (1.0/sqrt(v.dot(v)));
+}
+
+} // namespace
+
+RectifiedStereoMatcher::RectifiedStereoMatcher(
+    const PointUndistorter& cam0_undistorter,
+    const PointUndistorter& cam1_undistorter,
+    const Vec2i& resolution,
+    const Matx33d& R_cam0_cam1,
+    const Vec3d& t_cam0_cam1,
+    const Config& c):
+  config(c) {
+  // The x axis of the rectified frame is along the baseline,
+  // from cam0 to cam1, and the z axis is close to the mean
+  // of the optical axes.
+  const Vec3d baseline = -(R_cam0_cam1.t() * t_cam0_cam1);
+  const Vec3d mean_axis = Vec3d(0.0, 0.0, 1.0) +
+    R_cam0_cam1.t() * Vec3d(0.0, 0.0, 1.0);
+  const Vec3d e1 = normalized(baseline);
+  const Vec3d e2 = normalized(cross(mean_axis, e1));
+  const Vec3d e3 = cross(e1, e2);
+  R_rect[0] = Matx33d(
+      e1[0], e1[1], e1[2],
+      e2[0], e2[1], e2[2],
+      e3[0], e3[1], e3[2]);
+  R_rect[1] = R_rect[0] * R_cam0_cam1.t();
+
+  // The rectified images keep the focal length of cam0, and
+  // cover the border of the cam0 image, up to twice its size
+  // for the wide angle lenses.
+  const Vec4d& intrinsics = cam0_undistorter.getIntrinsics();
+  focal = 0.5 * (intrinsics[0]+intrinsics[1]);
+  cx = cy = 0.0;
+
+  vector<Point2f> border(0);
+  for (int x = 0; x < resolution[0]; x += 2) {
+    border.push_back(Point2f(x, 0));
+    border.push_back(Point2f(x, resolution[1]-1));
+  }
+  for (int y = 0; y < resolution[1]; y += 2) {
+    border.push_back(Point2f(0, y));
+    border.push_back(Point2f(resolution[0]-1, y));
+  }
+  vector<Point2f> border_undistorted(0);
+  cam0_undistorter.undistort(border, border_undistorted);
+
+  const Point2d center = rectify(Point2f(0.0f, 0.0f), 0);
+  double x_min = center.x, x_max = center.x;
+  double y_min = center.y, y_max = center.y;
+  for (const auto& pt : border_undistorted) {
+    const Point2d pt_rect = rectify(pt, 0);
+    if (!(std::abs(pt_rect.x-center.x) <= resolution[0] &&
+          std::abs(pt_rect.y-center.y) <= resolution[1])) continue;
+    x_min = min(x_min, pt_rect.x);
+    x_max = max(x_max, pt_rect.x);
+    y_min = min(y_min, pt_rect.y);
+    y_max = max(y_max, pt_rect.y);
+  }
+  cx = -floor(x_min);
+  cy = -floor(y_min);
+  width = static_cast<int>(ceil(x_max) - floor(x_min)) + 1;
+  height = static_cast<int>(ceil(y_max) - floor(y_min)) + 1;
+
+  // 预先计算校正图像到原始图像的映射
+  const PointUndistorter* undistorters[2] = {
+    &cam0_undistorter, &cam1_undistorter};
+  const float nan = numeric_limits<float>::quiet_NaN();
+  for (int cam_id = 0; cam_id < 2; ++cam_id) {
+    const Matx33d R_cam_rect = R_rect[cam_id].t();
+    maps[cam_id].resize(width*height);
+    for (int v = 0; v < height; ++v) {
+      for (int u = 0; u < width; ++u) {
+        const Vec3d ray = R_cam_rect *
+          Vec3d((u-cx)/focal, (v-cy)/focal, 1.0);
+        Point2f& pt_raw = maps[cam_id][v*width+u];
+        if (ray[2] <= 1e-6) {
+          pt_raw = Point2f(nan, nan);
+          continue;
+        }
+        pt_raw = undistorters[cam_id]->project(
+            Point2d(ray[0]/ray[2], ray[1]/ray[2]));
+      }
+    }
+  }
+
+  cam0_patch.reserve(config.patch_size*config.patch_size);
+  return;
+}
+
+Point2d RectifiedStereoMatcher::rectify(
+    const Point2f& pt, const int& cam_id) const {
+  const Vec3d pt_rect = R_rect[cam_id] * Vec3d(pt.x, pt.y, 1.0);
+  if (pt_rect[2] <= 1e-6) {
+    const double nan = numeric_limits<double>::quiet_NaN();
+    return Point2d(nan, nan);
+  }
+  return Point2d(
+      focal*pt_rect[0]/pt_rect[2] + cx,
+      focal*pt_rect[1]/pt_rect[2] + cy);
+}
+
+bool RectifiedStereoMatcher::samplePatch(const Mat& img,
+    const vector<Point2f>& map, const int& x, const int& y,
+    const int& patch_width, float* patch) const {
+  const float nan = numeric_limits<float>::quiet_NaN();
+  bool is_valid = true;
+  for (int j = 0; j < config.patch_size; ++j) {
+    const Point2f* map_row = &map[(y+j)*width + x];
+    float* patch_row = patch + j*patch_width;
+    for (int i = 0; i < patch_width; ++i) {
+      const Point2f& pt = map_row[i];
+      // The comparisons are false for NaN as well.
+      if (!(pt.x >= 0.0f && pt.y >= 0.0f &&
+            pt.x < img.cols-1 && pt.y < img.rows-1)) {
+        patch_row[i] = nan;
+        is_valid = false;
+        continue;
+      }
+
+      const int ix = static_cast<int>(pt.x);
+      const int iy = static_cast<int>(pt.y);
+      const float a = pt.x - ix;
+      const float b = pt.y - iy;
+      const uchar* p0 = img.ptr<uchar>(iy) + ix;
+      const uchar* p1 = img.ptr<uchar>(iy+1) + ix;
+      patch_row[i] =
+        (1.0f-b) * ((1.0f-a)*p0[0] + a*p0[1]) +
+        b * ((1.0f-a)*p1[0] + a*p1[1]);
+    }
+  }
+  return is_valid;
+}
+
+bool RectifiedStereoMatcher::interpolateMap(const vector<Point2f>& map,
+    const Point2d& pt, Point2f& pt_raw) const {
+  if (!(pt.x >= 0.0 && pt.y >= 0.0 &&
+        pt.x <= width-1 && pt.y <= height-1)) return false;
+
+  const int x = min(static_cast<int>(pt.x), width-2);
+  const int y = min(static_cast<int>(pt.y), height-2);
+  const float a = pt.x - x;
+  const float b = pt.y - y;
+  const Point2f* p0 = &map[y*width + x];
+  const Point2f* p1 = p0 + width;
+  pt_raw = (p0[0]*(1.0f-a) + p0[1]*a) * (1.0f-b) +
+    (p1[0]*(1.0f-a) + p1[1]*a) * b;
+  return !std::isnan(pt_raw.x);
+}
+
+void RectifiedStereoMatcher::match(
+    const Mat& cam0_img, const Mat& cam1_img,
+    const vector<Point2f>& cam0_points_undistorted,
+    vector<Point2f>& cam1_points,
+    vector<Point2f>& cam1_points_undistorted,
+    vector<unsigned char>& inlier_markers) {
+  const int point_num = cam0_points_undistorted.size();
+  cam1_points.assign(point_num, Point2f(0.0f, 0.0f));
+  cam1_points_undistorted.assign(point_num, Point2f(0.0f, 0.0f));
+  inlier_markers.assign(point_num, 0);
+
+  const int patch_size = config.patch_size;
+  const int half = patch_size / 2;
+  const int pixel_num = patch_size * patch_size;
+  const Matx33d R_cam1_rect = R_rect[1].t();
+  cam0_patch.resize(pixel_num);
+
+  for (int i = 0; i < point_num; ++i) {
+    // 第一个相机的点在校正图像中的位置，patch以最近的像素为中心
+    const Point2d pt0 = rectify(cam0_points_undistorted[i], 0);
+    if (!(pt0.x >= 0.0 && pt0.y >= 0.0 &&
+          pt0.x < width && pt0.y < height)) continue;
+    const int u0 = static_cast<int>(pt0.x + 0.5);
+    const int v0 = static_cast<int>(pt0.y + 0.5);
+    if (u0+half >= width || v0-half < 0 || v0+half >= height) continue;
+
+    // Disparities whose cam1 patches are in the rectified image.
+    const int max_disparity = min(config.max_disparity, u0-half);
+    const int min_disparity = config.min_disparity;
+    if (max_disparity-min_disparity < 2) continue;
+
+    // Zero-mean cam0 patch.
+    if (!samplePatch(cam0_img, maps[0], u0-half, v0-half,
+          patch_size, cam0_patch.data())) continue;
+    float mean = 0.0f;
+    for (const auto& value : cam0_patch) mean += value;
+    mean /= pixel_num;
+    float cam0_var = 0.0f;
+    for (auto& value : cam0_patch) {
+      value -= mean;
+      cam0_var += value * value;
+    }
+    if (cam0_var < config.min_stddev*config.min_stddev*pixel_num)
+      continue;
+
+    // The cam1 strip on the same rectified rows, which covers
+    // the patches of all the disparities.
+    const int strip_x = u0 - max_disparity - half;
+    const int strip_width = max_disparity - min_disparity + patch_size;
+    cam1_strip.resize(patch_size*strip_width);
+    samplePatch(cam1_img, maps[1], strip_x, v0-half,
+        strip_width, cam1_strip.data());
+
+    // ZNCC of each disparity, which is -1 for invalid patches.
+    // 沿校正后的扫描线做一维视差搜索
+    const int disparity_num = max_disparity - min_disparity + 1;
+    scores.assign(disparity_num, -1.0f);
+    for (int k = 0; k < disparity_num; ++k) {
+      const int x = max_disparity - min_disparity - k;
+      float sum = 0.0f, sum_sq = 0.0f, sum_prod = 0.0f;
+      for (int row = 0; row < patch_size; ++row) {
+        const float* b = &cam1_strip[row*strip_width + x];
+        const float* a = &cam0_patch[row*patch_size];
+        for (int col = 0; col < patch_size; ++col) {
+          sum += b[col];
+          sum_sq += b[col] * b[col];
+          sum_prod += a[col] * b[col];
+        }
+      }
+      const float cam1_var = sum_sq - sum*sum/pixel_num;
+      if (!(cam1_var > 1e-3f)) continue;
+      scores[k] = sum_prod / sqrt(cam0_var*cam1_var);
+    }
+
+    const int best_k = max_element(scores.begin(), scores.end()) -
+      scores.begin();
+    const float best_score = scores[best_k];
+    if (best_score < config.min_zncc) continue;
+    // The best match may be beyond the search range.
+    if (best_k == disparity_num-1) continue;
+
+    // Reject the ambiguous matches with another peak.
+    bool is_unique = true;
+    for (int k = 0; k < disparity_num && is_unique; ++k) {
+      if (std::abs(k-best_k) <= 1) continue;
+      if (k > 0 && scores[k] < scores[k-1]) continue;
+      if (k < disparity_num-1 && scores[k] < scores[k+1]) continue;
+      is_unique = scores[k] < best_score-config.uniqueness_margin;
+    }
+    if (!is_unique) continue;
+
+    // Sub-pixel disparity at the vertex of the parabola.
+    double offset = 0.0;
+    if (best_k > 0) {
+      const double s0 = scores[best_k-1];
+      const double s2 = scores[best_k+1];
+      const double curvature = s0 - 2.0*best_score + s2;
+      if (curvature < 0.0)
+        offset = max(-0.5, min(0.5, 0.5*(s0-s2)/curvature));
+    }
+    const double disparity = min_disparity + best_k + offset;
+
+    // The cam1 point is on the same rectified row.
+    const Point2d pt1(pt0.x-disparity, pt0.y);
+    if (!interpolateMap(maps[1], pt1, cam1_points[i])) continue;
+    const Vec3d ray = R_cam1_rect *
+      Vec3d((pt1.x-cx)/focal, (pt1.y-cy)/focal, 1.0);
+    if (ray[2] <= 1e-6) continue;
+    cam1_points_undistorted[i] = Point2f(ray[0]/ray[2], ray[1]/ray[2]);
+    inlier_markers[i] = 1;
+  }
+
+  return;
+}
+
+} // namespace msckf_vio
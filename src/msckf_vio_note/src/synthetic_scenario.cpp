@@ -0,0 +1,336 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <cmath>
+#include <algorithm>
+
+#include <msckf_vio/synthetic_scenario.h>
+#include <msckf_vio/math_utils.hpp>
+
+using namespace std;
+using namespace Eigen;
+
+namespace msckf_vio {
+
+namespace {
+
+// Step size of the numerical differentiation of the trajectory.
+const double kDiffStep = 1e-3;
+
+// Quintic blending from 0 to 1, which has continuous
+// first and second order derivatives at both ends.
+double blend(const double& s) {
+  if (s <= 0.0) return 0.0;
+  if (s >= 1.0) return 1.0;
+  return s*s*s * (10.0 + s*(-15.0 + 6.0*s));
+}
+
+} // namespace
+
+SyntheticScenario::Config::Config():
+  duration(60.0),
+  static_duration(2.0),
+  ramp_duration(2.0),
+  amplitude(Vector3d(2.0, 1.5, 0.3)),
+  frequency(Vector3d(0.05, 0.08, 0.1)),
+  yaw_rate(0.15),
+  yaw_amplitude(0.3),
+  yaw_frequency(0.1),
+  tilt_amplitude(0.1),
+  tilt_frequency(0.2),
+  landmark_num(5000),
+  wall_min_radius(6.0),
+  wall_max_radius(8.0),
+  wall_height(6.0),
+  imu_rate(200.0),
+  frame_rate(20.0),
+  gyro_noise(0.005),
+  acc_noise(0.05),
+  gyro_bias_noise(0.001),
+  acc_bias_noise(0.01),
+  initial_gyro_bias(Vector3d::Zero()),
+  initial_acc_bias(Vector3d::Zero()),
+  intrinsics(Vector4d(458.654, 457.296, 367.215, 248.375)),
+  image_width(752),
+  image_height(480),
+  min_depth(0.3),
+  T_imu_cam0(Isometry3d::Identity()),
+  T_cam0_cam1(Isometry3d::Identity()),
+  pixel_noise(1.0),
+  max_feature_num(300),
+  max_track_length(0),
+  track_loss_probability(0.02),
+  seed(0) {
+  T_cam0_cam1.translation() = Vector3d(-0.11, 0.0, 0.0);
+  return;
+}
+
+SyntheticScenario::SyntheticScenario(const Config& config):
+  scenario_config(config) {
+  return;
+}
+
+void SyntheticScenario::generate() {
+  random_engine.seed(scenario_config.seed);
+  generateLandmarks();
+  generateImuSamples();
+  generateStereoFrames();
+  return;
+}
+
+void SyntheticScenario::cam0Pose(const double& time,
+    Matrix3d& R_w_c0, Vector3d& t_c0_w) const {
+  const Config& config = scenario_config;
+  const double tau = max(time-config.static_duration, 0.0);
+  const double b = blend(tau / config.ramp_duration);
+
+  Vector3d phase = 2.0 * M_PI * config.frequency * tau;
+  t_c0_w = b * config.amplitude.cwiseProduct(Vector3d(
+        sin(phase(0)), sin(phase(1)), sin(phase(2))));
+
+  const double yaw = b * (config.yaw_rate*tau + config.yaw_amplitude*
+      sin(2.0*M_PI*config.yaw_frequency*tau));
+  const double tilt_phase = 2.0 * M_PI * config.tilt_frequency * tau;
+  const double pitch = b * config.tilt_amplitude * sin(tilt_phase);
+  const double roll = b * config.tilt_amplitude * cos(tilt_phase);
+
+  // Takes a vector from the camera frame to a level frame
+  // whose x axis is the optical axis and z axis points up.
+  Matrix3d R_c0_level;
+  R_c0_level << 0.0,  0.0, 1.0,
+               -1.0,  0.0, 0.0,
+                0.0, -1.0, 0.0;
+  const Matrix3d R_level_w = (
+      AngleAxisd(yaw, Vector3d::UnitZ()) *
+      AngleAxisd(pitch, Vector3d::UnitY()) *
+      AngleAxisd(roll, Vector3d::UnitX())).toRotationMatrix();
+  R_w_c0 = (R_level_w * R_c0_level).transpose();
+  return;
+}
+
+void SyntheticScenario::imuPose(const double& time,
+    Matrix3d& R_w_i, Vector3d& t_i_w) const {
+  Matrix3d R_w_c0;
+  Vector3d t_c0_w;
+  cam0Pose(time, R_w_c0, t_c0_w);
+
+  // T_imu_cam0 takes a vector from the IMU frame to the
+  // cam0 frame, so that p_w = R_w_c0^T*(R_i_c0*p_i+t) + t_c0_w.
+  const Isometry3d& T_imu_cam0 = scenario_config.T_imu_cam0;
+  R_w_i = (R_w_c0.transpose() * T_imu_cam0.linear()).transpose();
+  t_i_w = R_w_c0.transpose()*T_imu_cam0.translation() + t_c0_w;
+  return;
+}
+
+void SyntheticScenario::imuMotion(const double& time,
+    Vector3d& velocity, Vector3d& acceleration,
+    Vector3d& angular_velocity) const {
+  Matrix3d R_w_i_prev, R_w_i, R_w_i_next;
+  Vector3d t_i_w_prev, t_i_w, t_i_w_next;
+  imuPose(time-kDiffStep, R_w_i_prev, t_i_w_prev);
+  imuPose(time, R_w_i, t_i_w);
+  imuPose(time+kDiffStep, R_w_i_next, t_i_w_next);
+
+  velocity = (t_i_w_next-t_i_w_prev) / (2.0*kDiffStep);
+  acceleration = (t_i_w_next-2.0*t_i_w+t_i_w_prev) /
+    (kDiffStep*kDiffStep);
+
+  // The angular velocity in the IMU frame satisfies
+  // R_i_w(t+dt) = R_i_w(t) * exp(w*dt).
+  const AngleAxisd delta_rotation(
+      R_w_i_prev * R_w_i_next.transpose());
+  angular_velocity = delta_rotation.angle() *
+    delta_rotation.axis() / (2.0*kDiffStep);
+  return;
+}
+
+void SyntheticScenario::generateLandmarks() {
+  const Config& config = scenario_config;
+  uniform_real_distribution<double> angle_dist(0.0, 2.0*M_PI);
+  uniform_real_distribution<double> radius_dist(
+      config.wall_min_radius, config.wall_max_radius);
+  uniform_real_distribution<double> height_dist(
+      -0.5*config.wall_height, 0.5*config.wall_height);
+
+  landmark_positions.resize(config.landmark_num);
+  for (auto& landmark : landmark_positions) {
+    const double angle = angle_dist(random_engine);
+    const double radius = radius_dist(random_engine);
+    landmark = Vector3d(radius*cos(angle), radius*sin(angle),
+        height_dist(random_engine));
+  }
+  return;
+}
+
+void SyntheticScenario::generateImuSamples() {
+  const Config& config = scenario_config;
+  const Vector3d gravity(0.0, 0.0, -GRAVITY_ACCELERATION);
+  const double dt = 1.0 / config.imu_rate;
+  const int sample_num = static_cast<int>(
+      floor(config.duration*config.imu_rate)) + 1;
+
+  // Discrete-time noise of the measurements and
+  // the random walk of the biases.
+  normal_distribution<double> normal(0.0, 1.0);
+  const double gyro_std = config.gyro_noise / sqrt(dt);
+  const double acc_std = config.acc_noise / sqrt(dt);
+  const double gyro_bias_std = config.gyro_bias_noise * sqrt(dt);
+  const double acc_bias_std = config.acc_bias_noise * sqrt(dt);
+
+  Vector3d gyro_bias = config.initial_gyro_bias;
+  Vector3d acc_bias = config.initial_acc_bias;
+
+  imu_buffer.resize(sample_num);
+  ground_truth_buffer.resize(sample_num);
+  for (int i = 0; i < sample_num; ++i) {
+    const double time = i * dt;
+
+    Matrix3d R_w_i;
+    Vector3d t_i_w;
+    Vector3d velocity, acceleration, angular_velocity;
+    imuPose(time, R_w_i, t_i_w);
+    imuMotion(time, velocity, acceleration, angular_velocity);
+
+    ImuSample& sample = imu_buffer[i];
+    sample.time = time;
+    sample.angular_velocity = angular_velocity + gyro_bias +
+      gyro_std * Vector3d(normal(random_engine),
+          normal(random_engine), normal(random_engine));
+    sample.linear_acceleration = R_w_i*(acceleration-gravity) +
+      acc_bias + acc_std * Vector3d(normal(random_engine),
+          normal(random_engine), normal(random_engine));
+
+    GroundTruth& truth = ground_truth_buffer[i];
+    truth.time = time;
+    truth.orientation = rotationToQuaternion(R_w_i);
+    truth.position = t_i_w;
+    truth.velocity = velocity;
+    truth.gyro_bias = gyro_bias;
+    truth.acc_bias = acc_bias;
+
+    gyro_bias += gyro_bias_std * Vector3d(normal(random_engine),
+        normal(random_engine), normal(random_engine));
+    acc_bias += acc_bias_std * Vector3d(normal(random_engine),
+        normal(random_engine), normal(random_engine));
+  }
+  return;
+}
+
+bool SyntheticScenario::project(const Matrix3d& R_w_c0,
+    const Vector3d& t_c0_w, const Vector3d& p_w,
+    Vector4d& z) const {
+  const Config& config = scenario_config;
+  const Vector3d p_c0 = R_w_c0 * (p_w-t_c0_w);
+  const Vector3d p_c1 = config.T_cam0_cam1 * p_c0;
+  if (p_c0(2) < config.min_depth || p_c1(2) < config.min_depth)
+    return false;
+
+  z = Vector4d(p_c0(0)/p_c0(2), p_c0(1)/p_c0(2),
+      p_c1(0)/p_c1(2), p_c1(1)/p_c1(2));
+
+  // Check if the feature is inside both of the images.
+  for (int i = 0; i < 4; i += 2) {
+    const double u = config.intrinsics(0)*z(i) + config.intrinsics(2);
+    const double v = config.intrinsics(1)*z(i+1) + config.intrinsics(3);
+    if (u < 0.0 || u >= config.image_width ||
+        v < 0.0 || v >= config.image_height)
+      return false;
+  }
+  return true;
+}
+
+void SyntheticScenario::generateStereoFrames() {
+  const Config& config = scenario_config;
+  const int frame_num = static_cast<int>(
+      floor(config.duration*config.frame_rate));
+
+  normal_distribution<double> normal(0.0, 1.0);
+  uniform_real_distribution<double> uniform(0.0, 1.0);
+  const double u_std = config.pixel_noise / config.intrinsics(0);
+  const double v_std = config.pixel_noise / config.intrinsics(1);
+
+  // Current track id and length of each landmark.
+  // A negative id indicates the landmark is not tracked.
+  vector<FeatureIDType> track_ids(landmark_positions.size(), -1);
+  vector<int> track_lengths(landmark_positions.size(), 0);
+  FeatureIDType next_feature_id = 0;
+
+  vector<bool> is_visible(landmark_positions.size(), false);
+  vector<int> candidates(0);
+
+  frame_buffer.resize(frame_num);
+  for (int k = 0; k < frame_num; ++k) {
+    StereoFrame& frame = frame_buffer[k];
+    frame.time = (k+1) / config.frame_rate;
+    frame.features.clear();
+
+    Matrix3d R_w_c0;
+    Vector3d t_c0_w;
+    cam0Pose(frame.time, R_w_c0, t_c0_w);
+
+    Vector4d z;
+    for (int l = 0; l < static_cast<int>(landmark_positions.size()); ++l)
+      is_visible[l] = project(R_w_c0, t_c0_w, landmark_positions[l], z);
+
+    // Keep tracking the landmarks which are still visible.
+    // Lost tracks and tracks reaching the maximum length
+    // are dropped. They can be detected again with new ids.
+    int feature_num = 0;
+    candidates.clear();
+    for (int l = 0; l < static_cast<int>(landmark_positions.size()); ++l) {
+      if (track_ids[l] < 0) {
+        if (is_visible[l]) candidates.push_back(l);
+        continue;
+      }
+      const bool is_lost = uniform(random_engine) <
+        config.track_loss_probability;
+      const bool is_too_long = config.max_track_length > 0 &&
+        track_lengths[l] >= config.max_track_length;
+      if (!is_visible[l] || is_lost || is_too_long ||
+          feature_num >= config.max_feature_num) {
+        track_ids[l] = -1;
+        track_lengths[l] = 0;
+        if (is_visible[l]) candidates.push_back(l);
+        continue;
+      }
+      ++feature_num;
+    }
+
+    // Detect new features among the visible landmarks
+    // in a random order.
+    shuffle(candidates.begin(), candidates.end(), random_engine);
+    for (const auto& l : candidates) {
+      if (feature_num >= config.max_feature_num) break;
+      track_ids[l] = next_feature_id++;
+      track_lengths[l] = 0;
+      ++feature_num;
+    }
+
+    // Generate the measurements of the tracked features.
+    for (int l = 0; l < static_cast<int>(landmark_positions.size()); ++l) {
+      if (track_ids[l] < 0) continue;
+      project(R_w_c0, t_c0_w, landmark_positions[l], z);
+
+      FeatureObservation observation;
+      observation.id = track_ids[l];
+      observation.landmark_id = l;
+      observation.measurement = z + Vector4d(
+          u_std*normal(random_engine), v_std*normal(random_engine),
+          u_std*normal(random_engine), v_std*normal(random_engine));
+      frame.features.push_back(observation);
+      ++track_lengths[l];
+    }
+
+    sort(frame.features.begin(), frame.features.end(),
+        [](const FeatureObservation& lhs, const FeatureObservation& rhs) {
+          return lhs.id < rhs.id;
+        });
+  }
+  return;
+}
+
+} // namespace msckf_vio
@@ -0,0 +1,223 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <vector>
+#include <string>
+
+#include <ros/ros.h>
+#include <sensor_msgs/Imu.h>
+#include <nav_msgs/Odometry.h>
+#include <eigen_conversions/eigen_msg.h>
+
+#include <msckf_vio/CameraMeasurement.h>
+#include <msckf_vio/math_utils.hpp>
+#include <msckf_vio/synthetic_scenario.h>
+#include <msckf_vio/utils.h>
+
+using namespace std;
+using namespace Eigen;
+using namespace msckf_vio;
+
+namespace {
+
+/*
+ * @brief loadConfig Load the scenario from the parameter
+ *    server. The camera parameters are read from the same
+ *    calibration file as the filter if it is loaded.
+ */
+void loadConfig(const ros::NodeHandle& nh,
+    SyntheticScenario::Config& config) {
+  nh.param<double>("duration", config.duration, config.duration);
+  nh.param<double>("static_duration",
+      config.static_duration, config.static_duration);
+  nh.param<double>("yaw_rate", config.yaw_rate, config.yaw_rate);
+
+  nh.param<int>("landmark_num", config.landmark_num, config.landmark_num);
+  nh.param<double>("wall/min_radius",
+      config.wall_min_radius, config.wall_min_radius);
+  nh.param<double>("wall/max_radius",
+      config.wall_max_radius, config.wall_max_radius);
+  nh.param<double>("wall/height", config.wall_height, config.wall_height);
+
+  nh.param<double>("imu_rate", config.imu_rate, config.imu_rate);
+  nh.param<double>("frame_rate", config.frame_rate, config.frame_rate);
+
+  nh.param<double>("noise/gyro", config.gyro_noise, config.gyro_noise);
+  nh.param<double>("noise/acc", config.acc_noise, config.acc_noise);
+  nh.param<double>("noise/gyro_bias",
+      config.gyro_bias_noise, config.gyro_bias_noise);
+  nh.param<double>("noise/acc_bias",
+      config.acc_bias_noise, config.acc_bias_noise);
+  nh.param<double>("noise/pixel", config.pixel_noise, config.pixel_noise);
+
+  nh.param<int>("max_feature_num",
+      config.max_feature_num, config.max_feature_num);
+  nh.param<int>("max_track_length",
+      config.max_track_length, config.max_track_length);
+  nh.param<double>("track_loss_probability",
+      config.track_loss_probability, config.track_loss_probability);
+
+  int seed = static_cast<int>(config.seed);
+  nh.param<int>("seed", seed, seed);
+  config.seed = static_cast<unsigned int>(seed);
+
+  if (nh.hasParam("cam0/T_cam_imu")) {
+    config.T_imu_cam0 = utils::getTransformEigen(nh, "cam0/T_cam_imu");
+    config.T_cam0_cam1 = utils::getTransformEigen(nh, "cam1/T_cn_cnm1");
+
+    vector<double> intrinsics(4);
+    vector<int> resolution(2);
+    nh.getParam("cam0/intrinsics", intrinsics);
+    nh.getParam("cam0/resolution", resolution);
+    config.intrinsics = Vector4d(intrinsics[0], intrinsics[1],
+        intrinsics[2], intrinsics[3]);
+    config.image_width = resolution[0];
+    config.image_height = resolution[1];
+  }
+
+  ROS_INFO("===========================================");
+  ROS_INFO("duration: %f (static %f)",
+      config.duration, config.static_duration);
+  ROS_INFO("landmark #: %d", config.landmark_num);
+  ROS_INFO("imu rate: %f", config.imu_rate);
+  ROS_INFO("frame rate: %f", config.frame_rate);
+  ROS_INFO("gyro noise: %f", config.gyro_noise);
+  ROS_INFO("acc noise: %f", config.acc_noise);
+  ROS_INFO("gyro bias noise: %f", config.gyro_bias_noise);
+  ROS_INFO("acc bias noise: %f", config.acc_bias_noise);
+  ROS_INFO("pixel noise: %f", config.pixel_noise);
+  ROS_INFO("max feature #: %d", config.max_feature_num);
+  ROS_INFO("max track length: %d", config.max_track_length);
+  ROS_INFO("track loss probability: %f", config.track_loss_probability);
+  ROS_INFO("seed: %u", config.seed);
+  ROS_INFO("===========================================");
+  return;
+}
+
+void toImuMsg(const SyntheticScenario::ImuSample& sample,
+    const ros::Time& time, sensor_msgs::Imu& imu_msg) {
+  imu_msg.header.stamp = time;
+  imu_msg.header.frame_id = "imu";
+  tf::vectorEigenToMsg(sample.angular_velocity, imu_msg.angular_velocity);
+  tf::vectorEigenToMsg(sample.linear_acceleration,
+      imu_msg.linear_acceleration);
+  return;
+}
+
+void toCameraMeasurement(const SyntheticScenario::StereoFrame& frame,
+    const ros::Time& time, CameraMeasurement& feature_msg) {
+  feature_msg.header.stamp = time;
+  feature_msg.features.resize(frame.features.size());
+  for (int i = 0; i < static_cast<int>(frame.features.size()); ++i) {
+    const auto& feature = frame.features[i];
+    feature_msg.features[i].id = feature.id;
+    feature_msg.features[i].u0 = feature.measurement(0);
+    feature_msg.features[i].v0 = feature.measurement(1);
+    feature_msg.features[i].u1 = feature.measurement(2);
+    feature_msg.features[i].v1 = feature.measurement(3);
+  }
+  return;
+}
+
+// The ground truth pose of the IMU in the world frame, and
+// its velocity in the IMU frame.
+void toOdometryMsg(const SyntheticScenario::GroundTruth& truth,
+    const ros::Time& time, nav_msgs::Odometry& odom_msg) {
+  odom_msg.header.stamp = time;
+  odom_msg.header.frame_id = "world";
+  odom_msg.child_frame_id = "imu";
+
+  const Matrix3d R_w_i = quaternionToRotation(truth.orientation);
+  Isometry3d T_i_w = Isometry3d::Identity();
+  T_i_w.linear() = R_w_i.transpose();
+  T_i_w.translation() = truth.position;
+  tf::poseEigenToMsg(T_i_w, odom_msg.pose.pose);
+  tf::vectorEigenToMsg(R_w_i*truth.velocity, odom_msg.twist.twist.linear);
+  return;
+}
+
+} // namespace
+
+/*
+ * The node generates a synthetic scenario and plays it back
+ * in real time (scaled by `playback_rate`) on the same topics
+ * as the IMU driver and the image processor, so that the
+ * filter can be run without any dataset.
+ */
+int main(int argc, char** argv) {
+  ros::init(argc, argv, "synthetic_scenario");
+  ros::NodeHandle nh("~");
+
+  SyntheticScenario::Config config;
+  loadConfig(nh, config);
+
+  double playback_rate = 1.0;
+  double start_delay = 1.0;
+  nh.param<double>("playback_rate", playback_rate, 1.0);
+  nh.param<double>("start_delay", start_delay, 1.0);
+  if (playback_rate <= 0.0) {
+    ROS_ERROR("Playback rate should be positive...");
+    return 1;
+  }
+
+  SyntheticScenario scenario(config);
+  scenario.generate();
+  ROS_INFO("Generated %lu imu msgs and %lu stereo frames...",
+      scenario.imuSamples().size(), scenario.stereoFrames().size());
+
+  ros::Publisher imu_pub = nh.advertise<sensor_msgs::Imu>("imu", 200);
+  ros::Publisher feature_pub =
+    nh.advertise<CameraMeasurement>("features", 40);
+  ros::Publisher gt_pub = nh.advertise<nav_msgs::Odometry>(
+      "ground_truth", 200);
+
+  // Give the subscribers some time to connect.
+  ros::WallDuration(start_delay).sleep();
+
+  const auto& imu_samples = scenario.imuSamples();
+  const auto& ground_truth = scenario.groundTruth();
+  const auto& stereo_frames = scenario.stereoFrames();
+  const ros::Time start_time = ros::Time::now();
+  const ros::WallTime start_wall_time = ros::WallTime::now();
+
+  // Publish the IMU msgs and the stereo frames in the order
+  // of their time stamps.
+  int imu_idx = 0;
+  int frame_idx = 0;
+  while (ros::ok() && (imu_idx < static_cast<int>(imu_samples.size()) ||
+        frame_idx < static_cast<int>(stereo_frames.size()))) {
+    const bool is_imu = frame_idx >= static_cast<int>(stereo_frames.size()) ||
+      (imu_idx < static_cast<int>(imu_samples.size()) &&
+       imu_samples[imu_idx].time <= stereo_frames[frame_idx].time);
+    const double time = is_imu ?
+      imu_samples[imu_idx].time : stereo_frames[frame_idx].time;
+
+    const ros::WallTime publish_wall_time =
+      start_wall_time + ros::WallDuration(time/playback_rate);
+    (publish_wall_time-ros::WallTime::now()).sleep();
+    const ros::Time stamp = start_time + ros::Duration(time);
+
+    if (is_imu) {
+      sensor_msgs::Imu imu_msg;
+      toImuMsg(imu_samples[imu_idx], stamp, imu_msg);
+      imu_pub.publish(imu_msg);
+
+      nav_msgs::Odometry odom_msg;
+      toOdometryMsg(ground_truth[imu_idx], stamp, odom_msg);
+      gt_pub.publish(odom_msg);
+      ++imu_idx;
+    } else {
+      CameraMeasurementPtr feature_msg(new CameraMeasurement);
+      toCameraMeasurement(stereo_frames[frame_idx], stamp, *feature_msg);
+      feature_pub.publish(feature_msg);
+      ++frame_idx;
+    }
+  }
+
+  ROS_INFO("Finish playing the synthetic scenario...");
+  return 0;
+}
@@ -0,0 +1,127 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <msckf_vio/thread_pool.h>
+
+using namespace std;
+
+namespace msckf_vio {
+
+namespace {
+// The pool and the index of the worker running on this
+// thread, which are used to submit nested tasks locally.
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local int current_worker = -1;
+} // namespace
+
+ThreadPool::ThreadPool(const int& thread_num):
+  next_worker(0),
+  queued_task_num(0),
+  pending_task_num(0),
+  is_stopped(false) {
+  int worker_num = thread_num;
+  if (worker_num <= 0)
+    worker_num = max(1u, thread::hardware_concurrency());
+
+  for (int i = 0; i < worker_num; ++i)
+    workers.emplace_back(new Worker);
+  for (int i = 0; i < worker_num; ++i)
+    threads.emplace_back(&ThreadPool::workerLoop, this, i);
+  return;
+}
+
+ThreadPool::~ThreadPool() {
+  wait();
+  {
+    lock_guard<mutex> lock(state_mutex);
+    is_stopped = true;
+  }
+  task_cond.notify_all();
+  for (auto& worker_thread : threads)
+    worker_thread.join();
+  return;
+}
+
+void ThreadPool::submit(const Task& task) {
+  // 在工作线程中提交的任务放入本线程的队列，其余的轮流分配
+  const int index = current_pool == this ? current_worker :
+    static_cast<int>(next_worker++ % workers.size());
+
+  {
+    lock_guard<mutex> lock(state_mutex);
+    ++queued_task_num;
+    ++pending_task_num;
+  }
+  {
+    lock_guard<mutex> lock(workers[index]->mutex);
+    workers[index]->tasks.push_back(task);
+  }
+  task_cond.notify_one();
+  return;
+}
+
+void ThreadPool::wait() {
+  unique_lock<mutex> lock(state_mutex);
+  done_cond.wait(lock, [this]() { return pending_task_num == 0; });
+  return;
+}
+
+bool ThreadPool::popTask(const int& index, Task& task) {
+  lock_guard<mutex> lock(workers[index]->mutex);
+  if (workers[index]->tasks.empty()) return false;
+  task = move(workers[index]->tasks.back());
+  workers[index]->tasks.pop_back();
+  return true;
+}
+
+bool ThreadPool::stealTask(const int& index, Task& task) {
+  const int worker_num = workers.size();
+  for (int i = 1; i < worker_num; ++i) {
+    Worker& victim = *workers[(index+i) % worker_num];
+    lock_guard<mutex> lock(victim.mutex);
+    if (victim.tasks.empty()) continue;
+    task = move(victim.tasks.front());
+    victim.tasks.pop_front();
+    return true;
+  }
+  return false;
+}
+
+void ThreadPool::workerLoop(const int& index) {
+  current_pool = this;
+  current_worker = index;
+
+  while (true) {
+    Task task;
+    if (popTask(index, task) || stealTask(index, task)) {
+      {
+        lock_guard<mutex> lock(state_mutex);
+        --queued_task_num;
+      }
+      task();
+      {
+        lock_guard<mutex> lock(state_mutex);
+        if (--pending_task_num == 0) done_cond.notify_all();
+      }
+      continue;
+    }
+
+    // Sleep until there are new tasks. The counter is
+    // increased before a task is pushed, so a worker may
+    // check the deques again before the task arrives.
+    unique_lock<mutex> lock(state_mutex);
+    task_cond.wait(lock, [this]() {
+        return is_stopped || queued_task_num > 0; });
+    if (is_stopped && queued_task_num == 0) break;
+  }
+
+  current_pool = nullptr;
+  current_worker = -1;
+  return;
+}
+
+} // namespace msckf_vio
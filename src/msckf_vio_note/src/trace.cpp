@@ -0,0 +1,165 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <msckf_vio/trace.h>
+
+using namespace std;
+
+namespace msckf_vio {
+namespace trace {
+
+namespace internal {
+std::atomic<bool> enabled(false);
+} // namespace internal
+
+namespace {
+
+// Events are stored in chunks which are allocated on demand
+// by the owner thread. The chunk table itself is fixed so that
+// the writer can read it without synchronizing with the owner.
+const size_t kChunkSize = 1 << 14;
+const size_t kMaxChunkNum = 1 << 10;
+
+/*
+ * @brief ThreadBuffer Event buffer of a single thread. Only
+ *    the owner thread appends to the buffer. The size is
+ *    published with release semantics after each append so
+ *    that the writer sees complete events only.
+ */
+struct ThreadBuffer {
+  ThreadBuffer(const int tid): thread_id(tid), size(0) {
+    for (auto& chunk : chunks) chunk.store(nullptr);
+  }
+  ~ThreadBuffer() {
+    for (auto& chunk : chunks) delete[] chunk.load();
+  }
+
+  int thread_id;
+  std::atomic<size_t> size;
+  std::atomic<Event*> chunks[kMaxChunkNum];
+};
+
+// All the thread buffers ever created. The buffers are owned
+// here so that the events survive the threads recording them.
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<ThreadBuffer> > registry;
+
+thread_local ThreadBuffer* local_buffer = nullptr;
+thread_local long long int local_frame_id = kNoFrame;
+
+ThreadBuffer* threadBuffer() {
+  if (local_buffer) return local_buffer;
+  std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer(
+        static_cast<int>(syscall(SYS_gettid))));
+  local_buffer = buffer.get();
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  registry.push_back(std::move(buffer));
+  return local_buffer;
+}
+
+long long int now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+void enable() {
+  internal::enabled.store(true, std::memory_order_release);
+  return;
+}
+
+void disable() {
+  internal::enabled.store(false, std::memory_order_release);
+  return;
+}
+
+void clear() {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  for (auto& buffer : registry)
+    buffer->size.store(0, std::memory_order_release);
+  return;
+}
+
+long long int currentFrame() {
+  return local_frame_id;
+}
+
+void setCurrentFrame(const long long int frame_id) {
+  local_frame_id = frame_id;
+  return;
+}
+
+void record(const char* name, const char phase,
+    const long long int frame_id) {
+  ThreadBuffer* buffer = threadBuffer();
+  const size_t idx = buffer->size.load(std::memory_order_relaxed);
+  const size_t chunk_idx = idx / kChunkSize;
+
+  // Drop the event if the buffer is exhausted.
+  if (chunk_idx >= kMaxChunkNum) return;
+
+  Event* chunk = buffer->chunks[chunk_idx].load(
+      std::memory_order_relaxed);
+  if (!chunk) {
+    chunk = new Event[kChunkSize];
+    buffer->chunks[chunk_idx].store(chunk, std::memory_order_release);
+  }
+
+  Event& event = chunk[idx % kChunkSize];
+  event.name = name;
+  event.frame_id = frame_id;
+  event.timestamp_ns = now();
+  event.phase = phase;
+
+  buffer->size.store(idx+1, std::memory_order_release);
+  return;
+}
+
+bool write(const std::string& file_name) {
+  FILE* file = fopen(file_name.c_str(), "w");
+  if (!file) return false;
+
+  const int pid = static_cast<int>(getpid());
+  bool is_first_event = true;
+
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  for (const auto& buffer : registry) {
+    const size_t size = buffer->size.load(std::memory_order_acquire);
+    for (size_t i = 0; i < size; ++i) {
+      const Event* chunk = buffer->chunks[i/kChunkSize].load(
+          std::memory_order_acquire);
+      const Event& event = chunk[i % kChunkSize];
+
+      fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"msckf_vio\","
+          "\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d",
+          is_first_event ? "" : ",\n", event.name, event.phase,
+          static_cast<double>(event.timestamp_ns)*1e-3,
+          pid, buffer->thread_id);
+      if (event.frame_id != kNoFrame)
+        fprintf(file, ",\"args\":{\"frame\":%lld}", event.frame_id);
+      fprintf(file, "}");
+      is_first_event = false;
+    }
+  }
+  fprintf(file, "\n]}\n");
+
+  return fclose(file) == 0;
+}
+
+} // namespace trace
+} // namespace msckf_vio
@@ -0,0 +1,281 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <cmath>
+#include <climits>
+#include <algorithm>
+
+#include <msckf_vio/simd.h>
+#include <msckf_vio/two_point_ransac.h>
+
+using namespace std;
+using namespace cv;
+
+namespace msckf_vio {
+
+namespace {
+
+/**
+ * @brief 标量实现，误差的计算顺序与SIMD实现相同
+ */
+int countScalar(const double* coeff_tx, const double* coeff_ty,
+    const double* coeff_tz, const int& size,
+    const double* model, const double& threshold) {
+  int count = 0;
+  for (int i = 0; i < size; ++i) {
+    const double error = coeff_tx[i]*model[0] +
+      coeff_ty[i]*model[1] + coeff_tz[i]*model[2];
+    if (std::abs(error) < threshold) ++count;
+  }
+  return count;
+}
+
+TwoPointRansac::Kernels scalarKernels() {
+  TwoPointRansac::Kernels kernels;
+  kernels.count = countScalar;
+  kernels.name = "scalar";
+  return kernels;
+}
+
+#if defined(MSCKF_VIO_SIMD_AVX2)
+
+/**
+ * @brief AVX2实现，每次计算4个点对的误差
+ */
+MSCKF_VIO_AVX2_TARGET int countAvx2(
+    const double* coeff_tx, const double* coeff_ty,
+    const double* coeff_tz, const int& size,
+    const double* model, const double& threshold) {
+  const __m256d m0 = _mm256_set1_pd(model[0]);
+  const __m256d m1 = _mm256_set1_pd(model[1]);
+  const __m256d m2 = _mm256_set1_pd(model[2]);
+  const __m256d thresh = _mm256_set1_pd(threshold);
+  const __m256d sign = _mm256_set1_pd(-0.0);
+
+  int count = 0;
+  int i = 0;
+  for (; i+4 <= size; i += 4) {
+    __m256d error = _mm256_add_pd(
+        _mm256_mul_pd(_mm256_loadu_pd(coeff_tx+i), m0),
+        _mm256_mul_pd(_mm256_loadu_pd(coeff_ty+i), m1));
+    error = _mm256_add_pd(error,
+        _mm256_mul_pd(_mm256_loadu_pd(coeff_tz+i), m2));
+    const __m256d inlier = _mm256_cmp_pd(
+        _mm256_andnot_pd(sign, error), thresh, _CMP_LT_OQ);
+    count += __builtin_popcount(_mm256_movemask_pd(inlier));
+  }
+
+  return count + countScalar(coeff_tx+i, coeff_ty+i,
+      coeff_tz+i, size-i, model, threshold);
+}
+
+TwoPointRansac::Kernels simdKernels() {
+  TwoPointRansac::Kernels kernels;
+  kernels.count = countAvx2;
+  kernels.name = simd::name();
+  return kernels;
+}
+
+#elif defined(MSCKF_VIO_SIMD_NEON64)
+
+/**
+ * @brief NEON实现，每次计算2个点对的误差
+ *
+ * 双精度的向量运算只有AArch64支持
+ */
+int countNeon(const double* coeff_tx, const double* coeff_ty,
+    const double* coeff_tz, const int& size,
+    const double* model, const double& threshold) {
+  const float64x2_t m0 = vdupq_n_f64(model[0]);
+  const float64x2_t m1 = vdupq_n_f64(model[1]);
+  const float64x2_t m2 = vdupq_n_f64(model[2]);
+  const float64x2_t thresh = vdupq_n_f64(threshold);
+
+  // The lanes of the comparison are all ones for the inliers,
+  // which are subtracted from the counters.
+  int64x2_t counts = vdupq_n_s64(0);
+  int i = 0;
+  for (; i+2 <= size; i += 2) {
+    float64x2_t error = vaddq_f64(
+        vmulq_f64(vld1q_f64(coeff_tx+i), m0),
+        vmulq_f64(vld1q_f64(coeff_ty+i), m1));
+    error = vaddq_f64(error, vmulq_f64(vld1q_f64(coeff_tz+i), m2));
+    const uint64x2_t inlier = vcltq_f64(vabsq_f64(error), thresh);
+    counts = vsubq_s64(counts, vreinterpretq_s64_u64(inlier));
+  }
+
+  const int count = static_cast<int>(
+      vgetq_lane_s64(counts, 0) + vgetq_lane_s64(counts, 1));
+  return count + countScalar(coeff_tx+i, coeff_ty+i,
+      coeff_tz+i, size-i, model, threshold);
+}
+
+TwoPointRansac::Kernels simdKernels() {
+  TwoPointRansac::Kernels kernels;
+  kernels.count = countNeon;
+  kernels.name = simd::name();
+  return kernels;
+}
+
+#endif
+
+TwoPointRansac::Kernels selectKernels(const bool& use_simd) {
+#if defined(MSCKF_VIO_SIMD_AVX2) || defined(MSCKF_VIO_SIMD_NEON64)
+  if (use_simd && simd::supported()) return simdKernels();
+#endif
+  return scalarKernels();
+}
+
+// Number of the hypotheses to draw an all-inlier pair with
+// the given probability at the inlier ratio.
+int iterationBound(const double& inlier_ratio,
+    const double& success_probability) {
+  const double all_inlier = inlier_ratio * inlier_ratio;
+  if (all_inlier >= 1.0) return 1;
+  if (all_inlier <= 0.0) return INT_MAX;
+  const double bound = ceil(
+      log(1.0-success_probability) / log(1.0-all_inlier));
+  return bound < INT_MAX ? max(1, static_cast<int>(bound)) : INT_MAX;
+}
+
+} // namespace
+
+TwoPointRansac::TwoPointRansac(const Config& c):
+  config(c),
+  kernels(selectKernels(c.use_simd)),
+  random_gen(c.seed) {
+  return;
+}
+
+const char* TwoPointRansac::simdName() const {
+  return kernels.name;
+}
+
+void TwoPointRansac::solveModel(const int& idx1, const int& idx2,
+    double* model) const {
+  // Fix the component whose coefficients have the smallest
+  // L1 norm to 1, and solve the other two.
+  const double l1_norm[3] = {
+    std::abs(coeff_tx[idx1]) + std::abs(coeff_tx[idx2]),
+    std::abs(coeff_ty[idx1]) + std::abs(coeff_ty[idx2]),
+    std::abs(coeff_tz[idx1]) + std::abs(coeff_tz[idx2])};
+  const int base = min_element(l1_norm, l1_norm+3) - l1_norm;
+
+  const vector<double>* coeffs[3] = {&coeff_tx, &coeff_ty, &coeff_tz};
+  const vector<double>& a = *coeffs[base == 0 ? 1 : 0];
+  const vector<double>& b = *coeffs[base == 2 ? 1 : 2];
+  const vector<double>& c = *coeffs[base];
+
+  // [a b] * [x y]^T = -c for the two pairs.
+  const double det = a[idx1]*b[idx2] - b[idx1]*a[idx2];
+  const double x = (-c[idx1]*b[idx2] + b[idx1]*c[idx2]) / det;
+  const double y = (-a[idx1]*c[idx2] + c[idx1]*a[idx2]) / det;
+
+  model[base] = 1.0;
+  model[base == 0 ? 1 : 0] = x;
+  model[base == 2 ? 1 : 2] = y;
+  return;
+}
+
+int TwoPointRansac::estimate(
+    const vector<Point2f>& pts1,
+    const vector<Point2f>& pts2,
+    const vector<int>& candidates,
+    const vector<float>& qualities,
+    const double& threshold,
+    const double& success_probability,
+    vector<int>& inlier_markers) {
+  inlier_markers.assign(pts1.size(), 0);
+  const int candidate_num = candidates.size();
+  if (candidate_num < 2) return 0;
+
+  // Order the candidates by quality for PROSAC.
+  indices.assign(candidates.begin(), candidates.end());
+  const bool use_prosac =
+    config.use_prosac && qualities.size() == pts1.size();
+  if (use_prosac)
+    stable_sort(indices.begin(), indices.end(),
+        [&qualities](const int& i, const int& j) {
+          return qualities[i] > qualities[j];
+        });
+
+  // The coefficients of tx, ty and tz in the epipolar
+  // constraint of each candidate.
+  coeff_tx.resize(candidate_num);
+  coeff_ty.resize(candidate_num);
+  coeff_tz.resize(candidate_num);
+  for (int k = 0; k < candidate_num; ++k) {
+    const Point2f& pt1 = pts1[indices[k]];
+    const Point2f& pt2 = pts2[indices[k]];
+    const Point2f pt_diff = pt1 - pt2;
+    coeff_tx[k] = pt_diff.y;
+    coeff_ty[k] = -pt_diff.x;
+    coeff_tz[k] = pt1.x*pt2.y - pt1.y*pt2.x;
+  }
+
+  const int min_inlier_num = static_cast<int>(
+      ceil(config.min_inlier_ratio*pts1.size()));
+  int iteration_bound = config.max_iteration;
+  int best_inlier_num = 0;
+  double best_model[3] = {0.0, 0.0, 0.0};
+
+  int iter_idx = 0;
+  for (; iter_idx < iteration_bound; ++iter_idx) {
+    // With PROSAC, the pairs are drawn from the sample_num
+    // best ones, which grows quadratically with the number of
+    // hypotheses to all of them at max_iteration.
+    int sample_num = candidate_num;
+    if (use_prosac && iter_idx+1 < config.max_iteration) {
+      const double grown = sqrt(static_cast<double>(iter_idx+1) /
+          config.max_iteration) * candidate_num;
+      sample_num = max(2, min(candidate_num,
+            static_cast<int>(ceil(grown))));
+    }
+
+    // Draw two different pairs.
+    uniform_int_distribution<int> first_dist(0, sample_num-1);
+    uniform_int_distribution<int> second_dist(0, sample_num-2);
+    const int idx1 = first_dist(random_gen);
+    int idx2 = second_dist(random_gen);
+    if (idx2 >= idx1) ++idx2;
+
+    double model[3];
+    solveModel(idx1, idx2, model);
+    const int inlier_num = kernels.count(coeff_tx.data(),
+        coeff_ty.data(), coeff_tz.data(), candidate_num,
+        model, threshold);
+
+    // If the number of inliers is small, the current
+    // model is probably wrong.
+    if (inlier_num < min_inlier_num ||
+        inlier_num <= best_inlier_num) continue;
+
+    best_inlier_num = inlier_num;
+    copy(model, model+3, best_model);
+
+    // Update the bound with the inlier ratio of the pairs
+    // which the hypotheses are drawn from.
+    const int sample_inlier_num = sample_num == candidate_num ?
+      inlier_num : kernels.count(coeff_tx.data(), coeff_ty.data(),
+          coeff_tz.data(), sample_num, model, threshold);
+    iteration_bound = min(config.max_iteration, iterationBound(
+          static_cast<double>(sample_inlier_num)/sample_num,
+          success_probability));
+  }
+
+  // Mark the inliers of the best model.
+  if (best_inlier_num == 0) return iter_idx;
+  for (int k = 0; k < candidate_num; ++k) {
+    const double error = coeff_tx[k]*best_model[0] +
+      coeff_ty[k]*best_model[1] + coeff_tz[k]*best_model[2];
+    if (std::abs(error) < threshold) inlier_markers[indices[k]] = 1;
+  }
+
+  return iter_idx;
+}
+
+} // namespace msckf_vio
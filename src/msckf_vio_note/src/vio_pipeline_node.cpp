@@ -0,0 +1,142 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <chrono>
+#include <thread>
+
+#include <ros/ros.h>
+#include <sensor_msgs/Imu.h>
+
+#include <msckf_vio/image_processor.h>
+#include <msckf_vio/msckf_vio.h>
+#include <msckf_vio/feature_frame.h>
+#include <msckf_vio/spsc_queue.h>
+
+using namespace std;
+using namespace msckf_vio;
+
+namespace {
+
+// Number of IMU msgs which can be queued for the filter,
+// i.e. 5 sec at 200 Hz.
+const size_t kImuQueueSize = 1000;
+
+// Longest time the filter waits for a frame before it takes
+// the queued IMU msgs, so that the queue does not overflow
+// without images.
+const chrono::milliseconds kImuDrainPeriod(100);
+
+/*
+ * @brief VioPipeline Runs the image processor and the filter
+ *    in a single process. The features are handed to the
+ *    filter through a FeatureFrameChannel instead of the
+ *    CameraMeasurement msgs, and the filter is fed on its
+ *    own thread. ROS is only used for the images and the
+ *    IMU msgs, and for the outputs.
+ */
+class VioPipeline {
+public:
+  VioPipeline(ros::NodeHandle& pnh):
+    nh(pnh),
+    imu_queue(kImuQueueSize) {
+    return;
+  }
+
+  ~VioPipeline() {
+    // Stop the producer first, then let the filter finish
+    // the queued frames.
+    image_processor.reset();
+    if (channel) channel->close();
+    if (filter_thread.joinable()) filter_thread.join();
+    return;
+  }
+
+  bool initialize() {
+    int frame_num = 4;
+    int max_feature_num = 500;
+    nh.param<int>("pipeline/frame_num", frame_num, 4);
+    nh.param<int>("pipeline/max_feature_num", max_feature_num, 500);
+    ROS_INFO("feature frames: %d (max feature # %d)",
+        frame_num, max_feature_num);
+    channel.reset(new FeatureFrameChannel(
+          max(2, frame_num), max(0, max_feature_num)));
+
+    // The filter takes the parameters of the node and only
+    // publishes the outputs.
+    filter.reset(new MsckfVio(nh));
+    if (!filter->initialize(false)) {
+      ROS_ERROR("Cannot initialize MSCKF VIO...");
+      return false;
+    }
+    imu_sub = nh.subscribe("imu", 100,
+        &VioPipeline::imuCallback, this);
+    filter_thread = thread(&VioPipeline::filterLoop, this);
+
+    ros::NodeHandle processor_nh(nh, "image_processor");
+    image_processor.reset(new ImageProcessor(processor_nh));
+    image_processor->setFeatureChannel(channel);
+    if (!image_processor->initialize()) {
+      ROS_ERROR("Cannot initialize Image Processor...");
+      return false;
+    }
+    return true;
+  }
+
+private:
+  void imuCallback(const sensor_msgs::ImuConstPtr& msg) {
+    sensor_msgs::ImuConstPtr imu_msg = msg;
+    if (!imu_queue.tryPush(imu_msg))
+      ROS_WARN_THROTTLE(1.0, "IMU queue is full, drop the msg...");
+    return;
+  }
+
+  void filterLoop() {
+    // The IMU msgs received before a frame are processed
+    // before it, as the filter buffers them anyway. They are
+    // also taken on every timeout, whether or not a frame
+    // arrived.
+    FeatureFramePtr frame;
+    sensor_msgs::ImuConstPtr imu_msg;
+    while (true) {
+      // All the frames are sent before the channel is closed,
+      // so it is empty if closed before a failed receive.
+      const bool is_closed = channel->isClosed();
+      const bool has_frame = channel->receive(frame, kImuDrainPeriod);
+      while (imu_queue.tryPop(imu_msg)) filter->processImu(imu_msg);
+      if (has_frame) {
+        filter->processFeatures(*frame);
+        channel->release(frame);
+      } else if (is_closed) {
+        break;
+      }
+    }
+    return;
+  }
+
+  ros::NodeHandle nh;
+  ros::Subscriber imu_sub;
+
+  boost::shared_ptr<FeatureFrameChannel> channel;
+  SpscQueue<sensor_msgs::ImuConstPtr> imu_queue;
+
+  MsckfVioPtr filter;
+  ImageProcessorPtr image_processor;
+  thread filter_thread;
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+  ros::init(argc, argv, "vio_pipeline");
+  ros::NodeHandle pnh("~");
+
+  VioPipeline pipeline(pnh);
+  if (!pipeline.initialize()) return 1;
+
+  ros::spin();
+  return 0;
+}
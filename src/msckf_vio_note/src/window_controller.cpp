@@ -0,0 +1,63 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <algorithm>
+
+#include <msckf_vio/window_controller.h>
+
+using namespace std;
+
+namespace msckf_vio {
+
+namespace {
+// Smallest window for which the pruning can find two
+// camera states to be removed.
+const int kMinWindowSize = 6;
+} // namespace
+
+WindowController::WindowController(const Config& controller_config,
+    const double& frame_rate, const int& initial_size):
+  config(controller_config),
+  average_time(0.0),
+  frame_cntr(0),
+  is_first_frame(true),
+  last_decision(KEEP) {
+  config.min_size = max(kMinWindowSize, config.min_size);
+  config.max_size = max(config.min_size, config.max_size);
+  config.period = max(1, config.period);
+  budget_time = config.time_budget / frame_rate;
+  window_size = min(max(initial_size, config.min_size), config.max_size);
+  return;
+}
+
+bool WindowController::update(const double& processing_time) {
+  // 处理时间的指数滑动平均
+  if (is_first_frame) {
+    average_time = processing_time;
+    is_first_frame = false;
+  } else {
+    average_time = (1.0-config.smoothing)*average_time +
+      config.smoothing*processing_time;
+  }
+
+  if (++frame_cntr < config.period) return false;
+  frame_cntr = 0;
+
+  // 超出时间预算时缩小窗口，远低于预算时扩大窗口
+  last_decision = KEEP;
+  if (average_time > budget_time && window_size > config.min_size) {
+    window_size = max(config.min_size, window_size-2);
+    last_decision = SHRINK;
+  } else if (average_time < config.grow_ratio*budget_time &&
+      window_size < config.max_size) {
+    window_size += 1;
+    last_decision = GROW;
+  }
+  return true;
+}
+
+} // namespace msckf_vio
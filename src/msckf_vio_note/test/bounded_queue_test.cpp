@@ -0,0 +1,76 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <thread>
+#include <atomic>
+#include <gtest/gtest.h>
+
+#include <msckf_vio/bounded_queue.h>
+
+using namespace std;
+using namespace msckf_vio;
+
+TEST(BoundedQueueTest, pushAndPop) {
+  BoundedQueue<int> queue(2);
+
+  int value = 1;
+  EXPECT_TRUE(queue.push(value));
+  value = 2;
+  EXPECT_TRUE(queue.tryPush(value));
+  value = 3;
+  EXPECT_FALSE(queue.tryPush(value));
+  EXPECT_EQ(queue.size(), 2u);
+
+  EXPECT_TRUE(queue.pop(value));
+  EXPECT_EQ(value, 1);
+  EXPECT_TRUE(queue.tryPop(value));
+  EXPECT_EQ(value, 2);
+  EXPECT_FALSE(queue.tryPop(value));
+
+  // Closed queues keep the elements but refuse new ones.
+  value = 4;
+  EXPECT_TRUE(queue.push(value));
+  queue.close();
+  EXPECT_FALSE(queue.push(value));
+  EXPECT_TRUE(queue.pop(value));
+  EXPECT_EQ(value, 4);
+  EXPECT_FALSE(queue.pop(value));
+  return;
+}
+
+TEST(BoundedQueueTest, backpressure) {
+  const int value_num = 10000;
+  BoundedQueue<int> queue(4);
+  atomic<int> max_size(0);
+
+  thread producer([&]() {
+      for (int i = 0; i < value_num; ++i) {
+        int value = i;
+        EXPECT_TRUE(queue.push(value));
+        int size = queue.size();
+        if (size > max_size) max_size = size;
+      }
+      queue.close();
+    });
+
+  int next_value = 0;
+  int value = 0;
+  while (queue.pop(value)) {
+    EXPECT_EQ(value, next_value);
+    ++next_value;
+  }
+
+  producer.join();
+  EXPECT_EQ(next_value, value_num);
+  EXPECT_LE(max_size, 4);
+  return;
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
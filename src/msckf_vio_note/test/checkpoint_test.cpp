@@ -0,0 +1,205 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+#include <eigen3/Eigen/Dense>
+#include <gtest/gtest.h>
+#include <eigen_conversions/eigen_msg.h>
+
+#include <msckf_vio/checkpoint.h>
+#include <msckf_vio/msckf_vio.h>
+#include <msckf_vio/synthetic_scenario.h>
+
+using namespace std;
+using namespace Eigen;
+using namespace msckf_vio;
+
+namespace {
+
+const string kCheckpointFile = "/tmp/msckf_vio_checkpoint_test.bin";
+
+// A msg of the scenario, either an IMU msg or a stereo frame.
+struct Input {
+  sensor_msgs::ImuConstPtr imu;
+  CameraMeasurementConstPtr features;
+};
+
+void scenarioInputs(const SyntheticScenario& scenario,
+    vector<Input>& inputs) {
+  const auto& imu_samples = scenario.imuSamples();
+  int imu_idx = 0;
+  for (const auto& frame : scenario.stereoFrames()) {
+    for (; imu_idx < static_cast<int>(imu_samples.size()) &&
+        imu_samples[imu_idx].time <= frame.time; ++imu_idx) {
+      sensor_msgs::ImuPtr imu_msg(new sensor_msgs::Imu);
+      imu_msg->header.stamp.fromSec(imu_samples[imu_idx].time);
+      tf::vectorEigenToMsg(imu_samples[imu_idx].angular_velocity,
+          imu_msg->angular_velocity);
+      tf::vectorEigenToMsg(imu_samples[imu_idx].linear_acceleration,
+          imu_msg->linear_acceleration);
+      Input input;
+      input.imu = imu_msg;
+      inputs.push_back(input);
+    }
+
+    CameraMeasurementPtr feature_msg(new CameraMeasurement);
+    feature_msg->header.stamp.fromSec(frame.time);
+    for (const auto& feature : frame.features) {
+      FeatureMeasurement feature_measurement;
+      feature_measurement.id = feature.id;
+      feature_measurement.u0 = feature.measurement(0);
+      feature_measurement.v0 = feature.measurement(1);
+      feature_measurement.u1 = feature.measurement(2);
+      feature_measurement.v1 = feature.measurement(3);
+      feature_msg->features.push_back(feature_measurement);
+    }
+    Input input;
+    input.features = feature_msg;
+    inputs.push_back(input);
+  }
+  return;
+}
+
+void process(const Input& input, MsckfVio& filter) {
+  if (input.imu) filter.processImu(input.imu);
+  else filter.processFeatures(input.features);
+  return;
+}
+
+MsckfVio::Config filterConfig(
+    const SyntheticScenario::Config& scenario_config) {
+  MsckfVio::Config config;
+  config.publish_tf = false;
+  config.T_imu_cam0 = scenario_config.T_imu_cam0;
+  config.T_cam0_cam1 = scenario_config.T_cam0_cam1;
+  config.max_cam_state_size = 20;
+  return config;
+}
+
+} // namespace
+
+TEST(CheckpointTest, saveAndLoad) {
+  FilterSnapshot snapshot;
+  snapshot.next_state_id = 42;
+  snapshot.imu_state.id = 41;
+  snapshot.imu_state.time = 12.5;
+  snapshot.imu_state.position = Vector3d(1.0, 2.0, 3.0);
+  snapshot.imu_state.R_imu_cam0 = Matrix3d::Identity();
+  snapshot.imu_state.t_cam0_imu = Vector3d(0.1, 0.0, 0.0);
+  for (int i = 0; i < 3; ++i) {
+    CAMState cam_state(38+i);
+    cam_state.time = 12.0 + 0.1*i;
+    cam_state.position = Vector3d::Random();
+    snapshot.cam_states[cam_state.id] = cam_state;
+  }
+  snapshot.state_cov = MatrixXd::Random(39, 39);
+  for (int i = 0; i < 5; ++i) {
+    Feature feature(100+i);
+    feature.is_initialized = i%2 == 0;
+    feature.position = Vector3d::Random();
+    feature.observations[38] = Vector4d::Random();
+    feature.observations[39] = Vector4d::Random();
+    snapshot.map_server[feature.id] = feature;
+  }
+
+  ASSERT_TRUE(saveSnapshot(snapshot, kCheckpointFile));
+  FilterSnapshot loaded_snapshot;
+  ASSERT_TRUE(loadSnapshot(kCheckpointFile, loaded_snapshot));
+
+  EXPECT_EQ(loaded_snapshot.next_state_id, snapshot.next_state_id);
+  EXPECT_EQ(loaded_snapshot.imu_state.id, snapshot.imu_state.id);
+  EXPECT_EQ(loaded_snapshot.imu_state.time, snapshot.imu_state.time);
+  EXPECT_EQ(loaded_snapshot.imu_state.position,
+      snapshot.imu_state.position);
+  EXPECT_EQ(loaded_snapshot.imu_state.t_cam0_imu,
+      snapshot.imu_state.t_cam0_imu);
+  EXPECT_EQ(loaded_snapshot.state_cov, snapshot.state_cov);
+  ASSERT_EQ(loaded_snapshot.cam_states.size(), 3u);
+  for (const auto& item : snapshot.cam_states) {
+    const CAMState& cam_state = loaded_snapshot.cam_states[item.first];
+    EXPECT_EQ(cam_state.time, item.second.time);
+    EXPECT_EQ(cam_state.position, item.second.position);
+  }
+  ASSERT_EQ(loaded_snapshot.map_server.size(), 5u);
+  for (const auto& item : snapshot.map_server) {
+    const Feature& feature = loaded_snapshot.map_server[item.first];
+    EXPECT_EQ(feature.is_initialized, item.second.is_initialized);
+    EXPECT_EQ(feature.position, item.second.position);
+    ASSERT_EQ(feature.observations.size(), 2u);
+    EXPECT_EQ(feature.observations.at(39),
+        item.second.observations.at(39));
+  }
+
+  // A corrupted or missing file is rejected.
+  {
+    fstream file(kCheckpointFile, ios::in|ios::out|ios::binary);
+    file.seekp(-8, ios::end);
+    file.write("\0\0\0\0\0\0\0\0", 8);
+  }
+  EXPECT_FALSE(loadSnapshot(kCheckpointFile, loaded_snapshot));
+  EXPECT_FALSE(loadSnapshot(kCheckpointFile + ".missing",
+        loaded_snapshot));
+  remove(kCheckpointFile.c_str());
+  return;
+}
+
+TEST(CheckpointTest, warmRestart) {
+  SyntheticScenario::Config scenario_config;
+  scenario_config.duration = 6.0;
+  scenario_config.max_feature_num = 100;
+  SyntheticScenario scenario(scenario_config);
+  scenario.generate();
+  vector<Input> inputs;
+  scenarioInputs(scenario, inputs);
+
+  const MsckfVio::Config config = filterConfig(scenario_config);
+  MsckfVio reference_filter;
+  reference_filter.initialize(config);
+
+  // Take a checkpoint after a frame half way through the
+  // scenario, which is written by the background writer.
+  int restart_idx = inputs.size() / 2;
+  while (!inputs[restart_idx-1].features) ++restart_idx;
+  for (int i = 0; i < restart_idx; ++i)
+    process(inputs[i], reference_filter);
+  ASSERT_TRUE(reference_filter.isRunning());
+  {
+    FilterSnapshot snapshot;
+    reference_filter.getSnapshot(snapshot);
+    CheckpointWriter writer(kCheckpointFile);
+    writer.write(snapshot);
+  }
+
+  // The restored filter starts with the next msg.
+  MsckfVio::Config restored_config = config;
+  restored_config.restore_checkpoint = true;
+  restored_config.checkpoint_file = kCheckpointFile;
+  MsckfVio restored_filter;
+  restored_filter.initialize(restored_config);
+
+  for (int i = restart_idx; i < static_cast<int>(inputs.size()); ++i) {
+    process(inputs[i], reference_filter);
+    process(inputs[i], restored_filter);
+    if (!inputs[i].features) continue;
+
+    ASSERT_TRUE(restored_filter.isRunning());
+    EXPECT_EQ(restored_filter.getImuState().position,
+        reference_filter.getImuState().position);
+    EXPECT_EQ(restored_filter.getImuState().orientation,
+        reference_filter.getImuState().orientation);
+  }
+  remove(kCheckpointFile.c_str());
+  return;
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
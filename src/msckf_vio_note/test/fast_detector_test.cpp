@@ -0,0 +1,205 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <gtest/gtest.h>
+
+#include <msckf_vio/fast_detector.h>
+#include "simd_test.h"
+
+using namespace std;
+using namespace cv;
+using namespace msckf_vio;
+
+namespace {
+
+const int kImageRows = 120;
+const int kImageCols = 160;
+
+const int kCircle[16][2] = {
+  {0, 3}, {1, 3}, {2, 2}, {3, 1}, {3, 0}, {3, -1}, {2, -2}, {1, -3},
+  {0, -3}, {-1, -3}, {-2, -2}, {-3, -1}, {-3, 0}, {-3, 1}, {-2, 2}, {-1, 3}
+};
+
+// Random blocks with noise, which have corners and also
+// pixels with saturated thresholds.
+Mat renderImage(const unsigned int& seed) {
+  srand(seed);
+  Mat img(kImageRows, kImageCols, CV_8UC1);
+  vector<int> blocks((kImageRows/8+1)*(kImageCols/8+1));
+  for (auto& block : blocks) block = rand() % 256;
+  for (int y = 0; y < img.rows; ++y)
+    for (int x = 0; x < img.cols; ++x) {
+      const int value = blocks[(y/8)*(kImageCols/8+1)+x/8] + rand()%9 - 4;
+      img.at<unsigned char>(y, x) = static_cast<unsigned char>(
+          min(255, max(0, value)));
+    }
+  return img;
+}
+
+// Reference score of cv::FAST computed by its definition: the
+// largest threshold with which the pixel is still a corner.
+int referenceScore(const Mat& img, const int& x, const int& y) {
+  const int center = img.at<unsigned char>(y, x);
+  int best = -1;
+  for (int t = 0; t < 256; ++t) {
+    bool is_corner = false;
+    for (int start = 0; start < 16 && !is_corner; ++start) {
+      bool bright = true;
+      bool dark = true;
+      for (int j = 0; j < 9; ++j) {
+        const int k = (start+j) % 16;
+        const int value = img.at<unsigned char>(
+            y+kCircle[k][1], x+kCircle[k][0]);
+        bright &= value > center+t;
+        dark &= value < center-t;
+      }
+      is_corner = bright || dark;
+    }
+    if (!is_corner) break;
+    best = t;
+  }
+  return best;
+}
+
+// Reference detection over the whole image with the
+// non-maximal suppression, keeping the corners in the cell.
+void referenceDetect(const Mat& img, const Rect& cell,
+    const int& threshold, vector<Point2f>& points,
+    vector<float>& scores) {
+  vector<int> score_img(img.rows*img.cols, 0);
+  for (int y = 3; y < img.rows-3; ++y)
+    for (int x = 3; x < img.cols-3; ++x) {
+      const int score = referenceScore(img, x, y);
+      if (score >= threshold) score_img[y*img.cols+x] = score;
+    }
+
+  points.clear();
+  scores.clear();
+  for (int y = cell.y; y < cell.y+cell.height; ++y)
+    for (int x = cell.x; x < cell.x+cell.width; ++x) {
+      const int score = score_img[y*img.cols+x];
+      if (score == 0) continue;
+      bool is_max = true;
+      for (int dy = -1; dy <= 1; ++dy)
+        for (int dx = -1; dx <= 1; ++dx) {
+          if (dx == 0 && dy == 0) continue;
+          const int u = x+dx;
+          const int v = y+dy;
+          if (u < 0 || u >= img.cols || v < 0 || v >= img.rows) continue;
+          is_max &= score > score_img[v*img.cols+u];
+        }
+      if (!is_max) continue;
+      points.push_back(Point2f(x, y));
+      scores.push_back(score);
+    }
+  return;
+}
+
+} // namespace
+
+TEST(FastDetectorTest, matchReference) {
+  const Mat img = renderImage(7);
+  FastDetector detector(false);
+  EXPECT_STREQ(detector.simdName(), "scalar");
+
+  // Inner cells, and cells at the borders of the image.
+  for (const Rect& cell : {Rect(40, 30, 40, 30), Rect(0, 0, 40, 30),
+        Rect(120, 90, 40, 30)}) {
+    for (const int threshold : {10, 40}) {
+      vector<Point2f> ref_points;
+      vector<float> ref_scores;
+      referenceDetect(img, cell, threshold, ref_points, ref_scores);
+      ASSERT_GT(ref_points.size(), 0u);
+
+      vector<Point2f> points;
+      vector<float> scores;
+      const int corner_num = detector.detect(img, cell, threshold,
+          NULL, 1000, points, scores);
+      ASSERT_EQ(corner_num, static_cast<int>(ref_points.size()));
+      ASSERT_EQ(points.size(), ref_points.size());
+
+      // The same corners in the descending order of the scores.
+      for (int i = 1; i < scores.size(); ++i)
+        EXPECT_GE(scores[i-1], scores[i]);
+      for (int i = 0; i < ref_points.size(); ++i) {
+        const auto iter = find(points.begin(), points.end(), ref_points[i]);
+        ASSERT_TRUE(iter != points.end());
+        EXPECT_EQ(scores[iter-points.begin()], ref_scores[i]);
+      }
+    }
+  }
+  return;
+}
+
+TEST(FastDetectorTest, topScoresAndOccupancy) {
+  const Mat img = renderImage(11);
+  const Rect cell(32, 24, 64, 48);
+  FastDetector detector;
+
+  vector<Point2f> all_points;
+  vector<float> all_scores;
+  const int corner_num = detector.detect(img, cell, 10,
+      NULL, 1000, all_points, all_scores);
+  ASSERT_GT(corner_num, 5);
+
+  // The strongest corners are kept, after the existing ones.
+  vector<Point2f> points(1, Point2f(-1.0f, -1.0f));
+  vector<float> scores(1, -1.0f);
+  EXPECT_EQ(detector.detect(img, cell, 10, NULL, 5, points, scores),
+      corner_num);
+  ASSERT_EQ(points.size(), 6u);
+  for (int i = 0; i < 5; ++i)
+    EXPECT_EQ(scores[i+1], all_scores[i]);
+
+  // The occupied corners are skipped.
+  vector<unsigned char> occupancy(cell.area(), 0);
+  for (int i = 0; i < 3; ++i) {
+    const Point2f& pt = all_points[i];
+    occupancy[(pt.y-cell.y)*cell.width + pt.x-cell.x] = 1;
+  }
+  points.clear();
+  scores.clear();
+  EXPECT_EQ(detector.detect(img, cell, 10, &occupancy[0], 1000,
+        points, scores), corner_num-3);
+  ASSERT_EQ(points.size(), all_points.size()-3);
+  EXPECT_EQ(scores[0], all_scores[3]);
+  return;
+}
+
+TEST(FastDetectorTest, simdMatchesScalar) {
+  FastDetector simd_detector;
+  FastDetector scalar_detector(false);
+
+  for (const unsigned int seed : {1u, 2u, 3u}) {
+    const Mat img = renderImage(seed);
+    for (const int threshold : {0, 5, 20, 60, 250}) {
+      const Rect cell(0, 0, kImageCols, kImageRows);
+      test::expectSimdMatchesScalar(simd_detector, scalar_detector,
+          [&](FastDetector& detector, vector<double>& outputs) {
+            vector<Point2f> points;
+            vector<float> scores;
+            outputs.push_back(detector.detect(img, cell, threshold,
+                  NULL, 100000, points, scores));
+            outputs.push_back(points.size());
+            for (int i = 0; i < points.size(); ++i) {
+              outputs.push_back(points[i].x);
+              outputs.push_back(points[i].y);
+              outputs.push_back(scores[i]);
+            }
+          });
+    }
+  }
+  return;
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,122 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <algorithm>
+#include <gtest/gtest.h>
+
+#include <msckf_vio/feature_budget_controller.h>
+
+using namespace std;
+using namespace msckf_vio;
+
+namespace {
+
+const int kCellNum = 20;
+
+// Features of a frame with 20 cells, each of which has fewer
+// corners with a higher threshold, scaled by the texture.
+int featureNum(const FeatureBudgetController& controller,
+    const double& texture) {
+  const int corner_num = static_cast<int>(
+      texture * 200.0 / controller.fastThreshold());
+  return kCellNum * min(corner_num, controller.gridMaxFeatureNum());
+}
+
+// Processing time growing linearly with the features.
+double processingTime(const int& feature_num) {
+  return 1e-4 * feature_num;
+}
+
+} // namespace
+
+TEST(FeatureBudgetControllerTest, convergeToTarget) {
+  FeatureBudgetController::Config config;
+  config.target_feature_num = 100;
+  config.time_budget = 1.0;
+
+  // The budget of 1.0/20 = 50ms is not reached below 500
+  // features.
+  FeatureBudgetController controller(config, 20.0, 20, 2, 4);
+  EXPECT_EQ(controller.gridMaxFeatureNum(), 4);
+  EXPECT_DOUBLE_EQ(controller.budgetTime(), 0.05);
+
+  // The initial 80 features are too few in a rich scene.
+  for (int i = 0; i < 500; ++i) {
+    const int feature_num = featureNum(controller, 1.0);
+    controller.update(feature_num, processingTime(feature_num));
+  }
+  EXPECT_NEAR(controller.averageFeatureNum(), 100.0, 20.0);
+  EXPECT_EQ(controller.gridMinFeatureNum(), 3);
+
+  // A dark scene lowers the threshold.
+  const int rich_threshold = controller.fastThreshold();
+  for (int i = 0; i < 500; ++i) {
+    const int feature_num = featureNum(controller, 0.2);
+    controller.update(feature_num, processingTime(feature_num));
+  }
+  EXPECT_LT(controller.fastThreshold(), rich_threshold);
+  EXPECT_NEAR(controller.averageFeatureNum(), 100.0, 20.0);
+  return;
+}
+
+TEST(FeatureBudgetControllerTest, timeBudget) {
+  FeatureBudgetController::Config config;
+  config.target_feature_num = 400;
+  config.time_budget = 0.5;
+  config.period = 5;
+
+  // The budget of 0.5/20 = 25ms only allows 250 features.
+  FeatureBudgetController controller(config, 20.0, 10, 6, 8);
+  for (int i = 0; i < 4; ++i)
+    EXPECT_FALSE(controller.update(400, processingTime(400)));
+  EXPECT_TRUE(controller.update(400, processingTime(400)));
+  EXPECT_EQ(controller.decision(), FeatureBudgetController::FEWER);
+  EXPECT_EQ(controller.fastThreshold(), 12);
+  EXPECT_EQ(controller.gridMinFeatureNum(), 5);
+  EXPECT_EQ(controller.gridMaxFeatureNum(), 7);
+
+  for (int i = 0; i < 500; ++i) {
+    const int feature_num = featureNum(controller, 10.0);
+    controller.update(feature_num, processingTime(feature_num));
+  }
+  EXPECT_LE(controller.averageTime(), 1.1*controller.budgetTime());
+  EXPECT_LT(controller.averageFeatureNum(), 400.0);
+  return;
+}
+
+TEST(FeatureBudgetControllerTest, bounds) {
+  FeatureBudgetController::Config config;
+  config.target_feature_num = 100;
+  config.min_fast_threshold = 5;
+  config.max_fast_threshold = 30;
+  config.min_cell_feature_num = 1;
+  config.max_cell_feature_num = 4;
+  config.period = 1;
+
+  FeatureBudgetController controller(config, 20.0, 50, 0, 2);
+  EXPECT_EQ(controller.fastThreshold(), 30);
+  EXPECT_EQ(controller.gridMinFeatureNum(), 1);
+  EXPECT_EQ(controller.gridMaxFeatureNum(), 3);
+
+  // No features at all.
+  for (int i = 0; i < 100; ++i) controller.update(0, 0.0);
+  EXPECT_EQ(controller.fastThreshold(), 5);
+  EXPECT_EQ(controller.gridMinFeatureNum(), 4);
+  EXPECT_EQ(controller.decision(), FeatureBudgetController::KEEP);
+
+  // Far too many features.
+  for (int i = 0; i < 100; ++i) controller.update(10000, 0.0);
+  EXPECT_EQ(controller.fastThreshold(), 30);
+  EXPECT_EQ(controller.gridMinFeatureNum(), 1);
+  EXPECT_EQ(controller.gridMaxFeatureNum(), 3);
+  return;
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,111 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <set>
+#include <chrono>
+#include <thread>
+#include <gtest/gtest.h>
+
+#include <msckf_vio/feature_frame.h>
+
+using namespace std;
+using namespace msckf_vio;
+
+TEST(FeatureFrameTest, poolIsRecycled) {
+  FeatureFrameChannel channel(4, 100);
+  EXPECT_EQ(channel.frameNum(), 4u);
+
+  FeatureFramePtr frames[4];
+  set<FeatureFrame*> addresses;
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_TRUE(channel.acquire(frames[i]));
+    EXPECT_EQ(frames[i]->size(), 0u);
+    EXPECT_GE(frames[i]->ids.capacity(), 100u);
+    addresses.insert(frames[i].get());
+  }
+  FeatureFramePtr frame;
+  EXPECT_FALSE(channel.acquire(frame));
+
+  frames[0]->push_back(7, 0.1f, 0.2f, 0.3f, 0.4f);
+  channel.send(frames[0]);
+  ASSERT_TRUE(channel.receive(frame));
+  ASSERT_EQ(frame->size(), 1u);
+  EXPECT_EQ(frame->ids[0], 7);
+  EXPECT_EQ(frame->v1[0], 0.4f);
+
+  // The released frame is cleared and acquired again.
+  FeatureFrame* address = frame.get();
+  channel.release(frame);
+  ASSERT_TRUE(channel.acquire(frame));
+  EXPECT_EQ(frame.get(), address);
+  EXPECT_EQ(frame->size(), 0u);
+  EXPECT_EQ(addresses.count(frame.get()), 1u);
+  return;
+}
+
+TEST(FeatureFrameTest, receiveWithTimeout) {
+  FeatureFrameChannel channel(2, 10);
+  FeatureFramePtr frame;
+  EXPECT_FALSE(channel.receive(frame, chrono::milliseconds(1)));
+  EXPECT_FALSE(channel.isClosed());
+
+  ASSERT_TRUE(channel.acquire(frame));
+  frame->push_back(3, 0.0f, 0.0f, 0.0f, 0.0f);
+  channel.send(frame);
+  channel.close();
+  EXPECT_TRUE(channel.isClosed());
+
+  // The queued frame is still received after closing.
+  ASSERT_TRUE(channel.receive(frame, chrono::milliseconds(1)));
+  EXPECT_EQ(frame->ids[0], 3);
+  channel.release(frame);
+  EXPECT_FALSE(channel.receive(frame, chrono::milliseconds(1)));
+  return;
+}
+
+TEST(FeatureFrameTest, concurrentOrderWithSkippedFrames) {
+  const int frame_num = 10000;
+  FeatureFrameChannel channel(4, 10);
+
+  int sent_num = 0;
+  thread producer([&channel, &sent_num]() {
+      for (int i = 0; i < frame_num; ++i) {
+        FeatureFramePtr frame;
+        if (!channel.acquire(frame)) continue;
+        frame->time = ros::Time(1.0 + i*0.01);
+        frame->push_back(i, 0.0f, 0.0f, 0.0f, 0.0f);
+        channel.send(frame);
+        ++sent_num;
+      }
+      channel.close();
+    });
+
+  int received_num = 0;
+  FeatureIDType prev_id = -1;
+  FeatureFramePtr frame;
+  while (channel.receive(frame)) {
+    // A fatal assertion would return with the producer still
+    // joinable.
+    EXPECT_EQ(frame->size(), 1u);
+    if (frame->size() == 1) {
+      EXPECT_GT(frame->ids[0], prev_id);
+      prev_id = frame->ids[0];
+    }
+    ++received_num;
+    channel.release(frame);
+  }
+
+  producer.join();
+  EXPECT_EQ(received_num, sent_num);
+  EXPECT_GT(received_num, 0);
+  return;
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -24,12 +24,6 @@ using namespace std;
 using namespace Eigen;
 using namespace msckf_vio;
 
-// Static member variables in CAMState class
-Isometry3d CAMState::T_cam0_cam1 = Isometry3d::Identity();
-
-// Static member variables in Feature class
-Feature::OptimizationConfig Feature::optimization_config;
-
 TEST(FeatureInitializeTest, sphereDistribution) {
   // Set the real feature at the origin of the world frame.
   Vector3d feature(0.5, 0.0, 0.0);
@@ -107,7 +101,8 @@ TEST(FeatureInitializeTest, sphereDistribution) {
     feature_object.observations[i] = measurements[i];
 
   // Compute the 3d position of the feature.
-  feature_object.initializePosition(cam_states);
+  feature_object.initializePosition(cam_states,
+      Isometry3d::Identity(), Feature::OptimizationConfig());
 
   // Check the difference between the computed 3d
   // feature position and the groud truth.
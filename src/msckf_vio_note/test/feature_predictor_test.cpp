@@ -0,0 +1,152 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <cmath>
+#include <vector>
+#include <cstdlib>
+#include <gtest/gtest.h>
+
+#include <msckf_vio/feature_predictor.h>
+#include "simd_test.h"
+
+using namespace std;
+using namespace cv;
+using namespace msckf_vio;
+
+namespace {
+
+const Vec4d kIntrinsics(450.0, 455.0, 370.0, 240.0);
+
+Matx33f rotation(const float& angle_x, const float& angle_y,
+    const float& angle_z) {
+  const Matx33f Rx(1.0f, 0.0f, 0.0f,
+      0.0f, cos(angle_x), -sin(angle_x),
+      0.0f, sin(angle_x), cos(angle_x));
+  const Matx33f Ry(cos(angle_y), 0.0f, sin(angle_y),
+      0.0f, 1.0f, 0.0f,
+      -sin(angle_y), 0.0f, cos(angle_y));
+  const Matx33f Rz(cos(angle_z), -sin(angle_z), 0.0f,
+      sin(angle_z), cos(angle_z), 0.0f,
+      0.0f, 0.0f, 1.0f);
+  return Rz * Ry * Rx;
+}
+
+// Random 3d points in front of the previous camera, with
+// their pixels and inverse depths.
+void randomPoints(const unsigned int& seed, const int& n,
+    vector<Vec3f>& points, vector<Point2f>& pixels,
+    vector<float>& inverse_depths) {
+  srand(seed);
+  points.clear();
+  pixels.clear();
+  inverse_depths.clear();
+  for (int i = 0; i < n; ++i) {
+    const float x = (rand()%1000)/1000.0f - 0.5f;
+    const float y = (rand()%1000)/1000.0f - 0.5f;
+    const float depth = 1.0f + (rand()%1000)/100.0f;
+    points.push_back(Vec3f(x*depth, y*depth, depth));
+    pixels.push_back(Point2f(kIntrinsics[0]*x+kIntrinsics[2],
+          kIntrinsics[1]*y+kIntrinsics[3]));
+    inverse_depths.push_back(1.0f/depth);
+  }
+  return;
+}
+
+Point2f project(const Vec3f& point) {
+  return Point2f(kIntrinsics[0]*point[0]/point[2]+kIntrinsics[2],
+      kIntrinsics[1]*point[1]/point[2]+kIntrinsics[3]);
+}
+
+} // namespace
+
+TEST(FeaturePredictorTest, predictWithDepth) {
+  vector<Vec3f> points;
+  vector<Point2f> pixels;
+  vector<float> inverse_depths;
+  randomPoints(3, 37, points, pixels, inverse_depths);
+
+  const Matx33f R_p_c = rotation(0.02f, -0.03f, 0.05f);
+  const Vec3f t_p_c(0.05f, -0.02f, 0.1f);
+
+  FeaturePredictor predictor;
+  vector<Point2f> predicted;
+  predictor.predict(pixels, inverse_depths,
+      R_p_c, t_p_c, kIntrinsics, predicted);
+  ASSERT_EQ(predicted.size(), pixels.size());
+  for (int i = 0; i < points.size(); ++i) {
+    const Point2f expected = project(R_p_c*points[i] + t_p_c);
+    EXPECT_NEAR(predicted[i].x, expected.x, 1e-2);
+    EXPECT_NEAR(predicted[i].y, expected.y, 1e-2);
+  }
+
+  // Without the depths, the points at infinity are predicted.
+  predictor.predict(pixels, vector<float>(),
+      R_p_c, t_p_c, kIntrinsics, predicted);
+  ASSERT_EQ(predicted.size(), pixels.size());
+  for (int i = 0; i < points.size(); ++i) {
+    const Point2f expected = project(R_p_c*points[i]);
+    EXPECT_NEAR(predicted[i].x, expected.x, 1e-2);
+    EXPECT_NEAR(predicted[i].y, expected.y, 1e-2);
+  }
+  return;
+}
+
+TEST(FeaturePredictorTest, simdMatchesScalar) {
+  FeaturePredictor simd_predictor;
+  FeaturePredictor scalar_predictor(false);
+
+  // The AVX2 kernel rounds the fused multiply-adds once.
+  const Matx33f R_p_c = rotation(-0.04f, 0.01f, 0.02f);
+  const Vec3f t_p_c(-0.1f, 0.03f, 0.05f);
+  for (const int n : {0, 1, 7, 8, 9, 100}) {
+    vector<Vec3f> points;
+    vector<Point2f> pixels;
+    vector<float> inverse_depths;
+    randomPoints(n, n, points, pixels, inverse_depths);
+
+    test::expectSimdMatchesScalar(simd_predictor, scalar_predictor,
+        [&](FeaturePredictor& predictor, vector<double>& outputs) {
+          vector<Point2f> predicted;
+          predictor.predict(pixels, inverse_depths,
+              R_p_c, t_p_c, kIntrinsics, predicted);
+          outputs.push_back(predicted.size());
+          for (int i = 0; i < predicted.size(); ++i) {
+            outputs.push_back(predicted[i].x);
+            outputs.push_back(predicted[i].y);
+          }
+        }, 1e-3);
+  }
+  return;
+}
+
+TEST(FeaturePredictorTest, stereoInverseDepth) {
+  // Baseline of 0.11m along the x axis of a slightly rotated
+  // cam1, similar to the EuRoC stereo rig.
+  const Matx33f R_cam0_cam1 = rotation(0.002f, -0.003f, 0.001f);
+  const Vec3f t_cam0_cam1(-0.11f, 0.001f, 0.0005f);
+
+  for (const float depth : {0.5f, 3.0f, 20.0f}) {
+    const Vec3f p0(0.3f*depth, -0.2f*depth, depth);
+    const Vec3f p1 = R_cam0_cam1*p0 + t_cam0_cam1;
+    const float rho = FeaturePredictor::stereoInverseDepth(
+        Point2f(p0[0]/p0[2], p0[1]/p0[2]),
+        Point2f(p1[0]/p1[2], p1[1]/p1[2]),
+        R_cam0_cam1, t_cam0_cam1);
+    EXPECT_NEAR(rho, 1.0f/depth, 1e-3);
+  }
+
+  // The point is behind the cameras with the wrong disparity.
+  EXPECT_EQ(FeaturePredictor::stereoInverseDepth(
+        Point2f(0.0f, 0.0f), Point2f(0.05f, 0.0f),
+        Matx33f::eye(), Vec3f(-0.11f, 0.0f, 0.0f)), 0.0f);
+  return;
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,140 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <atomic>
+#include <eigen3/Eigen/Dense>
+#include <gtest/gtest.h>
+#include <eigen_conversions/eigen_msg.h>
+
+#include <msckf_vio/thread_pool.h>
+#include <msckf_vio/filter_host.h>
+#include <msckf_vio/synthetic_scenario.h>
+
+using namespace std;
+using namespace Eigen;
+using namespace msckf_vio;
+
+namespace {
+
+SyntheticScenario::Config scenarioConfig() {
+  SyntheticScenario::Config config;
+  config.duration = 8.0;
+  config.max_feature_num = 100;
+  return config;
+}
+
+MsckfVio::Config filterConfig(
+    const SyntheticScenario::Config& scenario_config) {
+  MsckfVio::Config config;
+  config.publish_tf = false;
+  config.gyro_noise = scenario_config.gyro_noise;
+  config.acc_noise = scenario_config.acc_noise;
+  config.gyro_bias_noise = scenario_config.gyro_bias_noise;
+  config.acc_bias_noise = scenario_config.acc_bias_noise;
+  config.observation_noise = scenario_config.pixel_noise /
+    scenario_config.intrinsics(0);
+  config.T_imu_cam0 = scenario_config.T_imu_cam0;
+  config.T_cam0_cam1 = scenario_config.T_cam0_cam1;
+  config.max_cam_state_size = 20;
+  return config;
+}
+
+// Queue the scenario for the given filter in time order.
+void pushScenario(const SyntheticScenario& scenario,
+    const int& filter_id, FilterHost& host) {
+  const auto& imu_samples = scenario.imuSamples();
+  const auto& stereo_frames = scenario.stereoFrames();
+  int imu_idx = 0;
+  for (const auto& frame : stereo_frames) {
+    for (; imu_idx < static_cast<int>(imu_samples.size()) &&
+        imu_samples[imu_idx].time <= frame.time; ++imu_idx) {
+      sensor_msgs::ImuPtr imu_msg(new sensor_msgs::Imu);
+      imu_msg->header.stamp.fromSec(imu_samples[imu_idx].time);
+      tf::vectorEigenToMsg(imu_samples[imu_idx].angular_velocity,
+          imu_msg->angular_velocity);
+      tf::vectorEigenToMsg(imu_samples[imu_idx].linear_acceleration,
+          imu_msg->linear_acceleration);
+      host.pushImu(filter_id, imu_msg);
+    }
+
+    CameraMeasurementPtr feature_msg(new CameraMeasurement);
+    feature_msg->header.stamp.fromSec(frame.time);
+    for (const auto& feature : frame.features) {
+      FeatureMeasurement feature_measurement;
+      feature_measurement.id = feature.id;
+      feature_measurement.u0 = feature.measurement(0);
+      feature_measurement.v0 = feature.measurement(1);
+      feature_measurement.u1 = feature.measurement(2);
+      feature_measurement.v1 = feature.measurement(3);
+      feature_msg->features.push_back(feature_measurement);
+    }
+    host.pushFeatures(filter_id, feature_msg);
+  }
+  return;
+}
+
+} // namespace
+
+TEST(ThreadPoolTest, nestedTasks) {
+  atomic<int> cntr(0);
+  ThreadPool thread_pool(4);
+  for (int i = 0; i < 100; ++i) {
+    thread_pool.submit([&thread_pool, &cntr]() {
+        for (int j = 0; j < 10; ++j)
+          thread_pool.submit([&cntr]() { ++cntr; });
+        ++cntr;
+      });
+  }
+  thread_pool.wait();
+  EXPECT_EQ(cntr.load(), 1100);
+  return;
+}
+
+TEST(FilterHostTest, independentInstances) {
+  SyntheticScenario scenario(scenarioConfig());
+  scenario.generate();
+  const MsckfVio::Config config = filterConfig(scenario.config());
+
+  // Reference run with a single instance.
+  FilterHost reference_host(1);
+  reference_host.addFilter(config);
+  pushScenario(scenario, 0, reference_host);
+  reference_host.run();
+  const FilterHost::Trajectory& reference =
+    reference_host.trajectory(0);
+  ASSERT_GT(reference.size(), 0u);
+
+  // Instances with the same config running concurrently with
+  // differently configured ones give the same results as the
+  // reference run.
+  MsckfVio::Config other_config = config;
+  other_config.observation_noise *= 4.0;
+  other_config.max_cam_state_size = 10;
+  other_config.T_cam0_cam1.translation() *= 1.01;
+
+  FilterHost host(4, 5);
+  for (int i = 0; i < 6; ++i) {
+    host.addFilter(i%2 == 0 ? config : other_config);
+    pushScenario(scenario, i, host);
+  }
+  host.run();
+
+  for (int i = 0; i < 6; i += 2) {
+    const FilterHost::Trajectory& trajectory = host.trajectory(i);
+    ASSERT_EQ(trajectory.size(), reference.size());
+    for (int k = 0; k < static_cast<int>(reference.size()); ++k) {
+      EXPECT_EQ(trajectory[k].position, reference[k].position);
+      EXPECT_EQ(trajectory[k].orientation, reference[k].orientation);
+    }
+  }
+  return;
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
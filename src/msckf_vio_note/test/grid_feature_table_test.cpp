@@ -0,0 +1,150 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <gtest/gtest.h>
+
+#include <msckf_vio/grid_feature_table.h>
+
+using namespace std;
+using namespace cv;
+using namespace msckf_vio;
+
+TEST(GridFeatureTableTest, bucket) {
+  GridFeatureTable table(4, 16);
+
+  // Features of the cells 2, 0, 2, 3, 0 in this order.
+  const int codes[] = {2, 0, 2, 3, 0};
+  for (int i = 0; i < 5; ++i)
+    table.add(codes[i], i, 1, 0.0f, Point2f(i, 0), Point2f(i, 1),
+        Point2f(i, 2), Point2f(i, 3));
+  EXPECT_FALSE(table.bucketed());
+  EXPECT_EQ(table.size(), 5);
+  EXPECT_EQ(table.cellSize(0), 2);
+  EXPECT_EQ(table.cellSize(1), 0);
+  EXPECT_EQ(table.cellSize(2), 2);
+
+  table.bucket();
+  EXPECT_TRUE(table.bucketed());
+
+  // The order within a cell is kept.
+  const GridFeatureTable::FeatureIDType ids[] = {1, 4, 0, 2, 3};
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_EQ(table.getIds()[i], ids[i]);
+    EXPECT_EQ(table.getCam0Points()[i].x, ids[i]);
+    EXPECT_EQ(table.getCam1Points()[i].x, ids[i]);
+    EXPECT_EQ(table.getCam0Undistorted()[i], Point2f(ids[i], 2));
+    EXPECT_EQ(table.getCam1Undistorted()[i], Point2f(ids[i], 3));
+  }
+  EXPECT_EQ(table.cellBegin(0), 0);
+  EXPECT_EQ(table.cellEnd(0), 2);
+  EXPECT_EQ(table.cellBegin(1), table.cellEnd(1));
+  EXPECT_EQ(table.cellBegin(2), 2);
+  EXPECT_EQ(table.cellEnd(3), 5);
+  return;
+}
+
+TEST(GridFeatureTableTest, pruneCells) {
+  GridFeatureTable table(2, 16);
+
+  const int lifetimes[] = {1, 5, 3, 7, 2, 4};
+  for (int i = 0; i < 6; ++i)
+    table.add(i < 4 ? 0 : 1, i, lifetimes[i], 0.0f,
+        Point2f(i, 0), Point2f(i, 0), Point2f(i, 0), Point2f(i, 0));
+
+  // The cell 0 keeps the two features with the longest
+  // lifetime, and the cell 1 is not crowded.
+  table.pruneCells(2);
+  ASSERT_EQ(table.size(), 4);
+  EXPECT_EQ(table.cellSize(0), 2);
+  EXPECT_EQ(table.cellEnd(0), 2);
+  EXPECT_EQ(table.cellEnd(1), 4);
+
+  const GridFeatureTable::FeatureIDType ids[] = {3, 1, 4, 5};
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_EQ(table.getIds()[i], ids[i]);
+    EXPECT_EQ(table.getLifetimes()[i], lifetimes[ids[i]]);
+  }
+  return;
+}
+
+TEST(GridFeatureTableTest, clearKeepsBuffers) {
+  GridFeatureTable table(2, 8);
+  for (int i = 0; i < 8; ++i)
+    table.add(i%2, i, 1, 0.0f,
+        Point2f(), Point2f(), Point2f(), Point2f());
+  table.pruneCells(3);
+
+  table.clear();
+  EXPECT_EQ(table.size(), 0);
+  EXPECT_EQ(table.cellSize(1), 0);
+  EXPECT_TRUE(table.bucketed());
+
+  // Refilling the table within the capacity does not
+  // grow the buffers.
+  for (int i = 0; i < 8; ++i)
+    table.add(i%2, i, 1, 0.0f,
+        Point2f(), Point2f(), Point2f(), Point2f());
+  table.bucket();
+  EXPECT_EQ(table.getCam0Points().capacity(), 8u);
+  EXPECT_EQ(table.getCam1Undistorted().capacity(), 8u);
+  EXPECT_EQ(table.cellEnd(1), 8);
+  return;
+}
+
+TEST(GridFeatureTableTest, cellCodeAtImageBorders) {
+  // 752 pixels are not divided by 5 columns, and 150 pixel
+  // wide cells leave the pixels 750 and 751 to the last one.
+  const int width = 752;
+  const int height = 480;
+  const int grid_row = 4;
+  const int grid_col = 5;
+  const int cell_num = grid_row*grid_col;
+
+  EXPECT_EQ(GridFeatureTable::cellCode(Point2f(0.0f, 0.0f),
+        width, height, grid_row, grid_col), 0);
+  EXPECT_EQ(GridFeatureTable::cellCode(Point2f(749.9f, 10.0f),
+        width, height, grid_row, grid_col), 4);
+  EXPECT_EQ(GridFeatureTable::cellCode(Point2f(751.0f, 10.0f),
+        width, height, grid_row, grid_col), 4);
+  EXPECT_EQ(GridFeatureTable::cellCode(Point2f(751.0f, 479.0f),
+        width, height, grid_row, grid_col), cell_num-1);
+  EXPECT_EQ(GridFeatureTable::cellCode(Point2f(-0.5f, 479.5f),
+        width, height, grid_row, grid_col), cell_num-grid_col);
+
+  // The last cells take the remaining pixels.
+  const Rect last_cell = GridFeatureTable::cellRect(cell_num-1,
+      width, height, grid_row, grid_col);
+  EXPECT_EQ(last_cell.x, 600);
+  EXPECT_EQ(last_cell.y, 360);
+  EXPECT_EQ(last_cell.width, 152);
+  EXPECT_EQ(last_cell.height, 120);
+  const Rect first_cell = GridFeatureTable::cellRect(0,
+      width, height, grid_row, grid_col);
+  EXPECT_EQ(first_cell.width, 150);
+  EXPECT_EQ(first_cell.height, 120);
+
+  // The features at the borders stay in the table.
+  GridFeatureTable table(cell_num, 4);
+  const Point2f points[] = {Point2f(751.0f, 479.0f),
+    Point2f(750.5f, 100.0f), Point2f(10.0f, 10.0f)};
+  for (int i = 0; i < 3; ++i)
+    table.add(GridFeatureTable::cellCode(points[i],
+          width, height, grid_row, grid_col), i, 1, 0.0f,
+        points[i], points[i], points[i], points[i]);
+  table.bucket();
+  EXPECT_EQ(table.cellSize(cell_num-1), 1);
+  EXPECT_EQ(table.cellSize(grid_col-1), 1);
+  EXPECT_EQ(table.cellSize(grid_col), 0);
+  EXPECT_EQ(table.cellEnd(cell_num-1), 3);
+  EXPECT_EQ(table.getIds()[2], 0u);
+  return;
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,61 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <msckf_vio/image_processor.h>
+
+using namespace std;
+using namespace cv;
+using namespace msckf_vio;
+
+namespace {
+
+// 200Hz gyro samples with a constant rate from the given time.
+vector<sensor_msgs::Imu> constantRateSamples(const double& start_time,
+    const double& end_time, const Vec3d& rate) {
+  vector<sensor_msgs::Imu> imu_msgs;
+  for (double t = start_time; t < end_time; t += 0.005) {
+    sensor_msgs::Imu imu_msg;
+    imu_msg.header.stamp = ros::Time(t);
+    imu_msg.angular_velocity.x = rate[0];
+    imu_msg.angular_velocity.y = rate[1];
+    imu_msg.angular_velocity.z = rate[2];
+    imu_msgs.push_back(imu_msg);
+  }
+  return imu_msgs;
+}
+
+} // namespace
+
+// With a constant rate, the rotation between the images is
+// rate*(curr-prev), whether or not the first sample is before
+// the previous image.
+TEST(ImageProcessorTest, integrateGyroConstantRate) {
+  const Vec3d rate(0.3, -0.2, 0.5);
+  const ros::Time prev_stamp(10.0);
+  const ros::Time curr_stamp(10.05);
+  Matx33d expected_R_c_p;
+  Rodrigues(rate*(curr_stamp-prev_stamp).toSec(), expected_R_c_p);
+
+  for (const double first_time : {9.998, 10.0, 10.003}) {
+    SCOPED_TRACE(first_time);
+    const vector<sensor_msgs::Imu> imu_msgs =
+      constantRateSamples(first_time, 10.055, rate);
+    const Matx33d imu_R_c_p = ImageProcessor::integrateGyro(
+        imu_msgs.begin(), imu_msgs.end(), prev_stamp, curr_stamp);
+    for (int i = 0; i < 9; ++i)
+      EXPECT_NEAR(imu_R_c_p.val[i], expected_R_c_p.val[i], 1e-9);
+  }
+  return;
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
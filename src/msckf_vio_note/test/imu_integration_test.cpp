@@ -0,0 +1,126 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <cmath>
+#include <eigen3/Eigen/Dense>
+#include <eigen3/Eigen/Geometry>
+#include <gtest/gtest.h>
+
+#include <msckf_vio/msckf_vio.h>
+#include <msckf_vio/math_utils.hpp>
+
+using namespace std;
+using namespace Eigen;
+
+namespace msckf_vio {
+
+/*
+ * @brief ImuIntegrationTest Propagates the same IMU state with
+ *    the RK4 and the closed-form integrators of the filter.
+ */
+class ImuIntegrationTest : public testing::Test {
+protected:
+  struct Trajectory {
+    Vector4d orientation;
+    Vector3d velocity;
+    Vector3d position;
+  };
+
+  /*
+   * @brief propagate Integrate 1s of IMU samples every dt.
+   * @param varying: the inputs are sinusoids sampled at the
+   *    beginning of each interval, and constant otherwise.
+   */
+  Trajectory propagate(const MsckfVio::Integrator& integrator,
+      const double& dt, const bool& varying) {
+    MsckfVio vio;
+    IMUState& imu_state = vio.state_server.imu_state;
+    imu_state.orientation = rotationToQuaternion(Matrix3d(
+          AngleAxisd(0.3, Vector3d(1.0, 2.0, 3.0).normalized())));
+    imu_state.velocity = Vector3d(1.0, 0.5, -0.2);
+    imu_state.position = Vector3d(0.0, 0.0, 0.0);
+
+    const int step_num = static_cast<int>(round(1.0/dt));
+    for (int i = 0; i < step_num; ++i) {
+      const double t = i * dt;
+      Vector3d gyro(0.3, -0.2, 0.5);
+      Vector3d acc(0.5, -0.3, 9.9);
+      if (varying) {
+        gyro += Vector3d(0.8*sin(2.0*M_PI*t),
+            0.5*cos(3.0*M_PI*t), 0.6*sin(M_PI*t));
+        acc += Vector3d(2.0*cos(2.0*M_PI*t),
+            1.5*sin(4.0*M_PI*t), 1.0*sin(M_PI*t));
+      }
+
+      if (integrator == MsckfVio::RK4)
+        vio.predictNewState(dt, gyro, acc);
+      else
+        vio.predictNewStateClosedForm(dt, gyro, acc);
+    }
+
+    Trajectory trajectory;
+    trajectory.orientation = imu_state.orientation;
+    trajectory.velocity = imu_state.velocity;
+    trajectory.position = imu_state.position;
+    return trajectory;
+  }
+
+  // Angle of the rotation between the two orientations.
+  static double angleError(const Trajectory& a, const Trajectory& b) {
+    const Matrix3d dR = quaternionToRotation(a.orientation) *
+      quaternionToRotation(b.orientation).transpose();
+    return AngleAxisd(dR).angle();
+  }
+
+  static void expectClose(const Trajectory& a, const Trajectory& b,
+      const double& angle_tolerance, const double& velocity_tolerance,
+      const double& position_tolerance) {
+    EXPECT_LT(angleError(a, b), angle_tolerance);
+    EXPECT_LT((a.velocity-b.velocity).norm(), velocity_tolerance);
+    EXPECT_LT((a.position-b.position).norm(), position_tolerance);
+    return;
+  }
+};
+
+// With constant inputs the closed form is exact, and RK4 with
+// the 200Hz-1kHz IMU rates stays within its truncation error.
+// The tolerances are 1e-10 rad, 1e-8 m/s and 1e-8 m after 1s.
+TEST_F(ImuIntegrationTest, constantInputs) {
+  for (const double dt : {0.005, 0.001}) {
+    SCOPED_TRACE(dt);
+    const Trajectory rk4 = propagate(MsckfVio::RK4, dt, false);
+    const Trajectory closed_form =
+      propagate(MsckfVio::CLOSED_FORM, dt, false);
+    expectClose(rk4, closed_form, 1e-10, 1e-8, 1e-8);
+
+    // The closed form does not depend on the step.
+    const Trajectory fine_closed_form =
+      propagate(MsckfVio::CLOSED_FORM, dt/10.0, false);
+    expectClose(closed_form, fine_closed_form, 1e-10, 1e-8, 1e-8);
+  }
+  return;
+}
+
+// With the inputs held over each interval, both integrators
+// solve the same piecewise constant problem.
+TEST_F(ImuIntegrationTest, timeVaryingInputs) {
+  for (const double dt : {0.005, 0.001}) {
+    SCOPED_TRACE(dt);
+    const Trajectory rk4 = propagate(MsckfVio::RK4, dt, true);
+    const Trajectory closed_form =
+      propagate(MsckfVio::CLOSED_FORM, dt, true);
+    expectClose(rk4, closed_form, 1e-10, 1e-8, 1e-8);
+  }
+  return;
+}
+
+} // namespace msckf_vio
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,287 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <cmath>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <msckf_vio/klt_tracker.h>
+#include "simd_test.h"
+
+using namespace std;
+using namespace cv;
+using namespace msckf_vio;
+
+namespace {
+
+const int kImageRows = 240;
+const int kImageCols = 320;
+const int kBorder = 32;
+
+// Smooth texture which can be shifted by sub-pixels.
+double texture(const double& x, const double& y) {
+  return 128.0 + 40.0*sin(0.21*x + 0.05*y) + 30.0*cos(0.17*y - 0.08*x) +
+    25.0*sin(0.11*x)*cos(0.13*y);
+}
+
+Mat renderImage(const double& shift_x, const double& shift_y) {
+  Mat img(kImageRows, kImageCols, CV_8UC1);
+  for (int y = 0; y < img.rows; ++y)
+    for (int x = 0; x < img.cols; ++x)
+      img.at<unsigned char>(y, x) = static_cast<unsigned char>(
+          lround(texture(x-shift_x, y-shift_y)));
+  return img;
+}
+
+inline int clampIndex(const int& i, const int& size) {
+  return i < 0 ? 0 : (i >= size ? size-1 : i);
+}
+
+// Builds the pyramid in the layout of cv::buildOpticalFlowPyramid
+// with the derivatives: bordered images and Scharr gradients.
+void buildPyramid(const Mat& img, const int& levels,
+    vector<Mat>& pyramid) {
+  pyramid.clear();
+  Mat level_img = img;
+
+  for (int level = 0; level <= levels; ++level) {
+    const int rows = level_img.rows;
+    const int cols = level_img.cols;
+
+    Mat bordered(rows+2*kBorder, cols+2*kBorder, CV_8UC1);
+    for (int y = 0; y < bordered.rows; ++y)
+      for (int x = 0; x < bordered.cols; ++x)
+        bordered.at<unsigned char>(y, x) = level_img.at<unsigned char>(
+            clampIndex(y-kBorder, rows), clampIndex(x-kBorder, cols));
+    pyramid.push_back(bordered(Rect(kBorder, kBorder, cols, rows)));
+
+    Mat grad(rows+2*kBorder, cols+2*kBorder, CV_16SC2, Scalar(0, 0));
+    for (int y = 0; y < rows; ++y) {
+      for (int x = 0; x < cols; ++x) {
+        int p[3][3];
+        for (int i = 0; i < 3; ++i)
+          for (int j = 0; j < 3; ++j)
+            p[i][j] = level_img.at<unsigned char>(
+                clampIndex(y+i-1, rows), clampIndex(x+j-1, cols));
+        short* d = grad.ptr<short>(y+kBorder) + 2*(x+kBorder);
+        d[0] = 3*(p[0][2]+p[2][2]) + 10*p[1][2] -
+          3*(p[0][0]+p[2][0]) - 10*p[1][0];
+        d[1] = 3*(p[2][0]+p[2][2]) + 10*p[2][1] -
+          3*(p[0][0]+p[0][2]) - 10*p[0][1];
+      }
+    }
+    pyramid.push_back(grad(Rect(kBorder, kBorder, cols, rows)));
+
+    Mat next_img(rows/2, cols/2, CV_8UC1);
+    for (int y = 0; y < next_img.rows; ++y)
+      for (int x = 0; x < next_img.cols; ++x)
+        next_img.at<unsigned char>(y, x) = static_cast<unsigned char>((
+            level_img.at<unsigned char>(2*y, 2*x) +
+            level_img.at<unsigned char>(2*y, 2*x+1) +
+            level_img.at<unsigned char>(2*y+1, 2*x) +
+            level_img.at<unsigned char>(2*y+1, 2*x+1) + 2) / 4);
+    level_img = next_img;
+  }
+
+  return;
+}
+
+vector<Point2f> gridPoints() {
+  vector<Point2f> points;
+  for (int y = 40; y < kImageRows-40; y += 30)
+    for (int x = 40; x < kImageCols-40; x += 30)
+      points.push_back(Point2f(x+0.3f, y+0.6f));
+  return points;
+}
+
+} // namespace
+
+TEST(KltTrackerTest, trackShift) {
+  const float shift_x = 5.4f;
+  const float shift_y = -3.7f;
+  vector<Mat> prev_pyramid, curr_pyramid;
+  buildPyramid(renderImage(0.0, 0.0), 3, prev_pyramid);
+  buildPyramid(renderImage(shift_x, shift_y), 3, curr_pyramid);
+  const vector<Point2f> prev_points = gridPoints();
+
+  for (const int patch_size : {15, 21, 17}) {
+    KltTracker::Config config;
+    config.patch_size = patch_size;
+    config.cell_width = 80;
+    config.cell_height = 60;
+    KltTracker tracker(config);
+
+    vector<Point2f> curr_points = prev_points;
+    vector<unsigned char> status;
+    vector<float> residuals;
+    ASSERT_TRUE(tracker.track(prev_pyramid, curr_pyramid,
+          prev_points, curr_points, status, residuals));
+
+    for (int i = 0; i < prev_points.size(); ++i) {
+      ASSERT_EQ(status[i], 1);
+      EXPECT_NEAR(curr_points[i].x, prev_points[i].x+shift_x, 0.1);
+      EXPECT_NEAR(curr_points[i].y, prev_points[i].y+shift_y, 0.1);
+      EXPECT_LT(residuals[i], 2.0);
+    }
+  }
+  return;
+}
+
+TEST(KltTrackerTest, initialFlow) {
+  // Too far to be tracked on a single level without a guess.
+  const float shift_x = 14.3f;
+  const float shift_y = 9.8f;
+  vector<Mat> prev_pyramid, curr_pyramid;
+  buildPyramid(renderImage(0.0, 0.0), 0, prev_pyramid);
+  buildPyramid(renderImage(shift_x, shift_y), 0, curr_pyramid);
+  const vector<Point2f> prev_points = gridPoints();
+
+  KltTracker::Config config;
+  config.pyramid_levels = 0;
+  KltTracker tracker(config);
+
+  vector<Point2f> curr_points(prev_points.size());
+  for (int i = 0; i < prev_points.size(); ++i)
+    curr_points[i] = Point2f(prev_points[i].x+shift_x+0.9f,
+        prev_points[i].y+shift_y-0.7f);
+  vector<unsigned char> status;
+  vector<float> residuals;
+  tracker.track(prev_pyramid, curr_pyramid,
+      prev_points, curr_points, status, residuals);
+
+  for (int i = 0; i < prev_points.size(); ++i) {
+    ASSERT_EQ(status[i], 1);
+    EXPECT_NEAR(curr_points[i].x, prev_points[i].x+shift_x, 0.1);
+    EXPECT_NEAR(curr_points[i].y, prev_points[i].y+shift_y, 0.1);
+  }
+  return;
+}
+
+TEST(KltTrackerTest, residualAndStatus) {
+  vector<Mat> prev_pyramid, curr_pyramid;
+  Mat curr_img = renderImage(2.0, 1.0);
+  // Occlude the first point in the current image.
+  const vector<Point2f> prev_points = gridPoints();
+  const int occluded_x = static_cast<int>(prev_points[0].x) + 2;
+  const int occluded_y = static_cast<int>(prev_points[0].y) + 1;
+  for (int y = -12; y <= 12; ++y)
+    for (int x = -12; x <= 12; ++x)
+      curr_img.at<unsigned char>(occluded_y+y, occluded_x+x) =
+        (x*7+y*13) % 2 ? 0 : 255;
+  buildPyramid(renderImage(0.0, 0.0), 2, prev_pyramid);
+  buildPyramid(curr_img, 2, curr_pyramid);
+
+  KltTracker::Config config;
+  KltTracker tracker(config);
+  vector<Point2f> curr_points = prev_points;
+  // The guess of the last point is far out of the image.
+  curr_points.back() = Point2f(-500.0f, 40.0f);
+  vector<unsigned char> status;
+  vector<float> residuals;
+  tracker.track(prev_pyramid, curr_pyramid,
+      prev_points, curr_points, status, residuals);
+
+  EXPECT_EQ(status.back(), 0);
+  EXPECT_GT(residuals[0], 10.0*residuals[1]);
+  for (int i = 1; i+1 < prev_points.size(); ++i)
+    EXPECT_EQ(status[i], 1);
+
+  // Pyramids without the derivatives are refused.
+  vector<Mat> no_derivatives(1, curr_img);
+  EXPECT_FALSE(tracker.track(no_derivatives, no_derivatives,
+        prev_points, curr_points, status, residuals));
+  return;
+}
+
+TEST(KltTrackerTest, reducedLevelRefinement) {
+  // Tracked on the pyramids from level 1 as the image
+  // processor does with a reduced processing level, and
+  // refined with a small patch on the full resolution.
+  const float shift_x = 9.6f;
+  const float shift_y = -6.2f;
+  vector<Mat> prev_pyramid, curr_pyramid;
+  buildPyramid(renderImage(0.0, 0.0), 3, prev_pyramid);
+  buildPyramid(renderImage(shift_x, shift_y), 3, curr_pyramid);
+  const vector<Point2f> prev_points = gridPoints();
+
+  KltTracker::Config config;
+  KltTracker coarse_tracker(config);
+  config.patch_size = 9;
+  config.pyramid_levels = 0;
+  KltTracker refine_tracker(config);
+
+  const vector<Mat> prev_coarse_pyramid(
+      prev_pyramid.begin()+2, prev_pyramid.end());
+  const vector<Mat> curr_coarse_pyramid(
+      curr_pyramid.begin()+2, curr_pyramid.end());
+  vector<Point2f> prev_coarse_points(prev_points.size());
+  for (int i = 0; i < prev_points.size(); ++i)
+    prev_coarse_points[i] = prev_points[i] * 0.5f;
+  vector<Point2f> curr_coarse_points = prev_coarse_points;
+  vector<unsigned char> status;
+  vector<float> residuals;
+  ASSERT_TRUE(coarse_tracker.track(prev_coarse_pyramid,
+        curr_coarse_pyramid, prev_coarse_points, curr_coarse_points,
+        status, residuals));
+
+  vector<Point2f> curr_points(curr_coarse_points.size());
+  for (int i = 0; i < curr_points.size(); ++i)
+    curr_points[i] = curr_coarse_points[i] * 2.0f;
+  const vector<Mat> prev_full_pyramid(
+      prev_pyramid.begin(), prev_pyramid.begin()+2);
+  const vector<Mat> curr_full_pyramid(
+      curr_pyramid.begin(), curr_pyramid.begin()+2);
+  vector<unsigned char> refine_status;
+  ASSERT_TRUE(refine_tracker.track(prev_full_pyramid, curr_full_pyramid,
+        prev_points, curr_points, refine_status, residuals));
+
+  for (int i = 0; i < prev_points.size(); ++i) {
+    ASSERT_EQ(status[i], 1);
+    ASSERT_EQ(refine_status[i], 1);
+    EXPECT_NEAR(curr_points[i].x, prev_points[i].x+shift_x, 0.1);
+    EXPECT_NEAR(curr_points[i].y, prev_points[i].y+shift_y, 0.1);
+  }
+  return;
+}
+
+TEST(KltTrackerTest, simdMatchesScalar) {
+  vector<Mat> prev_pyramid, curr_pyramid;
+  buildPyramid(renderImage(0.0, 0.0), 3, prev_pyramid);
+  buildPyramid(renderImage(3.3, 2.1), 3, curr_pyramid);
+  const vector<Point2f> prev_points = gridPoints();
+
+  for (const int patch_size : {15, 21, 17}) {
+    KltTracker::Config config;
+    config.patch_size = patch_size;
+    KltTracker simd_tracker(config);
+    config.use_simd = false;
+    KltTracker scalar_tracker(config);
+
+    // The sums are computed with integers, so the results
+    // are exactly the same.
+    test::expectSimdMatchesScalar(simd_tracker, scalar_tracker,
+        [&](KltTracker& tracker, vector<double>& outputs) {
+          vector<Point2f> curr_points = prev_points;
+          vector<unsigned char> status;
+          vector<float> residuals;
+          tracker.track(prev_pyramid, curr_pyramid, prev_points,
+              curr_points, status, residuals);
+          for (int i = 0; i < curr_points.size(); ++i) {
+            outputs.push_back(status[i]);
+            outputs.push_back(curr_points[i].x);
+            outputs.push_back(curr_points[i].y);
+            outputs.push_back(residuals[i]);
+          }
+        });
+  }
+  return;
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -71,6 +71,32 @@ TEST(MathUtilsTest, quaternionMultiplication) {
   return;
 }
 
+TEST(MathUtilsTest, so3Integrals) {
+  // Compare against the numerical integration of the
+  // exponential map with the midpoint rule.
+  const int step_num = 2000;
+  const double angles[] = {0.0, 1e-4, 0.05, 0.0999, 0.1001, 0.5, 3.0};
+  for (const double& angle : angles) {
+    const Vector3d axis = Vector3d(1.0, -2.0, 0.5).normalized();
+    const Vector3d phi = angle * axis;
+
+    Matrix3d Gamma1_num = Matrix3d::Zero();
+    Matrix3d Gamma2_num = Matrix3d::Zero();
+    for (int i = 0; i < step_num; ++i) {
+      const double t = (i+0.5) / step_num;
+      const Matrix3d R = AngleAxisd(t*angle, axis).toRotationMatrix();
+      Gamma1_num += R / step_num;
+      Gamma2_num += (1.0-t) * R / step_num;
+    }
+
+    Matrix3d Gamma1, Gamma2;
+    so3Integrals(phi, Gamma1, Gamma2);
+    EXPECT_LT((Gamma1-Gamma1_num).norm(), 1e-6) << "angle " << angle;
+    EXPECT_LT((Gamma2-Gamma2_num).norm(), 1e-6) << "angle " << angle;
+  }
+  return;
+}
+
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
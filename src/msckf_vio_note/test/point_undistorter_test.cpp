@@ -0,0 +1,183 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <cmath>
+#include <vector>
+#include <random>
+#include <gtest/gtest.h>
+#include <opencv2/calib3d.hpp>
+
+#include <msckf_vio/point_undistorter.h>
+
+using namespace std;
+using namespace cv;
+using namespace msckf_vio;
+
+namespace {
+
+// Calibrations of the EuRoC and TUM VI datasets.
+const Vec2i kRadtanResolution(752, 480);
+const Vec4d kRadtanIntrinsics(458.654, 457.296, 367.215, 248.375);
+const Vec4d kRadtanCoeffs(-0.28340811, 0.07395907,
+    0.00019359, 1.76187114e-05);
+
+const Vec2i kEquidistantResolution(512, 512);
+const Vec4d kEquidistantIntrinsics(190.978, 190.973, 254.932, 256.897);
+const Vec4d kEquidistantCoeffs(0.00348238940, 0.00071503484,
+    -0.00205323614, 0.00020293673);
+
+// Random pixels within the radius from the image center.
+vector<Point2f> randomPixels(const Vec2i& resolution, const int& num,
+    const float& radius = 1e4f) {
+  mt19937 gen(3);
+  uniform_real_distribution<float> x_dist(0.0f, resolution[0]-1);
+  uniform_real_distribution<float> y_dist(0.0f, resolution[1]-1);
+  const Point2f center(resolution[0]/2, resolution[1]/2);
+  vector<Point2f> pts(0);
+  while (pts.size() < num) {
+    const Point2f pt(x_dist(gen), y_dist(gen));
+    const Point2f diff = pt - center;
+    if (diff.dot(diff) < radius*radius) pts.push_back(pt);
+  }
+  return pts;
+}
+
+// Reprojection error in pixels of the radtan model.
+double radtanResidual(const Point2f& pixel, const Point2f& pt) {
+  const double& k1 = kRadtanCoeffs[0];
+  const double& k2 = kRadtanCoeffs[1];
+  const double& p1 = kRadtanCoeffs[2];
+  const double& p2 = kRadtanCoeffs[3];
+  const double x = pt.x, y = pt.y;
+  const double r2 = x*x + y*y;
+  const double radial = 1.0 + k1*r2 + k2*r2*r2;
+  const double xd = x*radial + 2.0*p1*x*y + p2*(r2+2.0*x*x);
+  const double yd = y*radial + p1*(r2+2.0*y*y) + 2.0*p2*x*y;
+  return hypot(xd*kRadtanIntrinsics[0]+kRadtanIntrinsics[2]-pixel.x,
+      yd*kRadtanIntrinsics[1]+kRadtanIntrinsics[3]-pixel.y);
+}
+
+Matx33d cameraMatrix(const Vec4d& intrinsics) {
+  return Matx33d(
+      intrinsics[0], 0.0, intrinsics[2],
+      0.0, intrinsics[1], intrinsics[3],
+      0.0, 0.0, 1.0);
+}
+
+// Largest difference in pixels between two sets of
+// normalized points.
+double maxError(const vector<Point2f>& pts1,
+    const vector<Point2f>& pts2, const Vec4d& intrinsics) {
+  double error = 0.0;
+  for (int i = 0; i < pts1.size(); ++i) {
+    const Point2f diff = pts1[i] - pts2[i];
+    error = max(error, sqrt(diff.dot(diff))*intrinsics[0]);
+  }
+  return error;
+}
+
+} // namespace
+
+TEST(PointUndistorterTest, radtanMatchesOpenCV) {
+  PointUndistorter undistorter(kRadtanResolution,
+      kRadtanIntrinsics, "radtan", kRadtanCoeffs);
+  EXPECT_LT(undistorter.getMaxError(), 0.01);
+
+  const vector<Point2f> pixels = randomPixels(kRadtanResolution, 1000);
+  vector<Point2f> table_pts, solved_pts;
+  undistorter.undistort(pixels, table_pts);
+  undistortPoints(pixels, solved_pts,
+      cameraMatrix(kRadtanIntrinsics), kRadtanCoeffs);
+
+  ASSERT_EQ(table_pts.size(), pixels.size());
+  EXPECT_LT(maxError(table_pts, solved_pts, kRadtanIntrinsics),
+      undistorter.getMaxError()+1e-3);
+  return;
+}
+
+TEST(PointUndistorterTest, equidistantMatchesOpenCV) {
+  PointUndistorter undistorter(kEquidistantResolution,
+      kEquidistantIntrinsics, "equidistant", kEquidistantCoeffs);
+  EXPECT_LE(undistorter.getMaxError(),
+      undistorter.getConfig().max_error);
+
+  // Within the image circle of the lens.
+  const vector<Point2f> pixels =
+    randomPixels(kEquidistantResolution, 1000, 230.0f);
+  vector<Point2f> table_pts, solved_pts;
+  undistorter.undistort(pixels, table_pts);
+  fisheye::undistortPoints(pixels, solved_pts,
+      cameraMatrix(kEquidistantIntrinsics), kEquidistantCoeffs);
+
+  ASSERT_EQ(table_pts.size(), pixels.size());
+  EXPECT_LT(maxError(table_pts, solved_pts, kEquidistantIntrinsics),
+      undistorter.getConfig().max_error);
+  return;
+}
+
+TEST(PointUndistorterTest, coarseGridWithRefinement) {
+  // The Newton step recovers the accuracy of a coarse grid.
+  PointUndistorter::Config config;
+  config.grid_step = 8.0;
+  PointUndistorter interpolated(kRadtanResolution,
+      kRadtanIntrinsics, "radtan", kRadtanCoeffs, config);
+  config.refine = true;
+  PointUndistorter refined(kRadtanResolution,
+      kRadtanIntrinsics, "radtan", kRadtanCoeffs, config);
+
+  const vector<Point2f> pixels =
+    randomPixels(kRadtanResolution, 1000, 300.0f);
+  vector<Point2f> interpolated_pts, refined_pts;
+  interpolated.undistort(pixels, interpolated_pts);
+  refined.undistort(pixels, refined_pts);
+
+  double interpolated_residual = 0.0;
+  double refined_residual = 0.0;
+  for (int i = 0; i < pixels.size(); ++i) {
+    interpolated_residual = max(interpolated_residual,
+        radtanResidual(pixels[i], interpolated_pts[i]));
+    refined_residual = max(refined_residual,
+        radtanResidual(pixels[i], refined_pts[i]));
+  }
+  EXPECT_GT(interpolated_residual, 1e-3);
+  EXPECT_LT(refined_residual, 1e-3);
+  return;
+}
+
+TEST(PointUndistorterTest, outOfGridAndRectification) {
+  PointUndistorter undistorter(kRadtanResolution,
+      kRadtanIntrinsics, "radtan", kRadtanCoeffs);
+  PointUndistorter::Config config;
+  config.use_table = false;
+  PointUndistorter solver(kRadtanResolution,
+      kRadtanIntrinsics, "radtan", kRadtanCoeffs, config);
+  EXPECT_EQ(solver.getMaxError(), 0.0);
+
+  // The points out of the image are solved.
+  const vector<Point2f> pixels = {
+    Point2f(-3.0f, 10.0f), Point2f(100.5f, 200.25f),
+    Point2f(751.0f, 479.0f), Point2f(760.0f, 490.0f)};
+  const double angle = 0.05;
+  const Matx33d R(
+      cos(angle), 0.0, sin(angle),
+      0.0, 1.0, 0.0,
+      -sin(angle), 0.0, cos(angle));
+
+  vector<Point2f> table_pts, solved_pts;
+  undistorter.undistort(pixels, table_pts, R);
+  solver.undistort(pixels, solved_pts, R);
+  EXPECT_LT(maxError(table_pts, solved_pts, kRadtanIntrinsics),
+      undistorter.getMaxError()+1e-3);
+  EXPECT_EQ(table_pts[0], solved_pts[0]);
+  EXPECT_EQ(table_pts[3], solved_pts[3]);
+  return;
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,170 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <cmath>
+#include <vector>
+#include <random>
+#include <gtest/gtest.h>
+
+#include <msckf_vio/rectified_stereo_matcher.h>
+
+using namespace std;
+using namespace cv;
+using namespace msckf_vio;
+
+namespace {
+
+const Vec2i kResolution(640, 480);
+const Vec4d kIntrinsics(400.0, 400.0, 320.0, 240.0);
+const Vec4d kCoeffs(0.0, 0.0, 0.0, 0.0);
+const double kDepth = 2.0;
+
+// Cam1 is on the right of cam0, slightly rotated.
+Matx33d rotation() {
+  const double angle = 0.02;
+  return Matx33d(
+      cos(angle), 0.0, sin(angle),
+      0.0, 1.0, 0.0,
+      -sin(angle), 0.0, cos(angle)) * Matx33d(
+      1.0, 0.0, 0.0,
+      0.0, cos(angle), -sin(angle),
+      0.0, sin(angle), cos(angle));
+}
+
+// Smooth random texture on the plane, with a period of
+// about 4 pixels in the images.
+class Texture {
+public:
+  Texture(): values(kSize*kSize) {
+    mt19937 gen(7);
+    uniform_real_distribution<float> dist(20.0f, 235.0f);
+    for (auto& value : values) value = dist(gen);
+    return;
+  }
+
+  float operator()(const double& x, const double& y) const {
+    const double u = x/kCell + kSize/2;
+    const double v = y/kCell + kSize/2;
+    const int i = static_cast<int>(floor(u));
+    const int j = static_cast<int>(floor(v));
+    if (i < 0 || j < 0 || i >= kSize-1 || j >= kSize-1) return 128.0f;
+    const float a = u - i;
+    const float b = v - j;
+    const float* p0 = &values[j*kSize + i];
+    const float* p1 = p0 + kSize;
+    return (1.0f-b) * ((1.0f-a)*p0[0] + a*p0[1]) +
+      b * ((1.0f-a)*p1[0] + a*p1[1]);
+  }
+
+private:
+  static const int kSize = 1024;
+  static constexpr double kCell = 0.02;
+  vector<float> values;
+};
+
+// Image of the textured plane Z = kDepth in the cam0 frame,
+// seen by a camera whose transformation from cam0 is (R, t).
+Mat render(const Texture& texture, const Matx33d& R, const Vec3d& t) {
+  const Vec3d center = -(R.t() * t);
+  Mat img(kResolution[1], kResolution[0], CV_8UC1);
+  for (int v = 0; v < img.rows; ++v) {
+    for (int u = 0; u < img.cols; ++u) {
+      const Vec3d ray = R.t() * Vec3d(
+          (u-kIntrinsics[2])/kIntrinsics[0],
+          (v-kIntrinsics[3])/kIntrinsics[1], 1.0);
+      const double s = (kDepth-center[2]) / ray[2];
+      img.ptr<uchar>(v)[u] = static_cast<uchar>(
+          texture(center[0]+s*ray[0], center[1]+s*ray[1]) + 0.5f);
+    }
+  }
+  return img;
+}
+
+} // namespace
+
+TEST(RectifiedStereoMatcherTest, matchesTexturedPlane) {
+  const Matx33d R_cam0_cam1 = rotation();
+  const Vec3d t_cam0_cam1 = -(R_cam0_cam1 * Vec3d(0.11, 0.0, 0.0));
+  PointUndistorter cam0(kResolution, kIntrinsics, "radtan", kCoeffs);
+  PointUndistorter cam1(kResolution, kIntrinsics, "radtan", kCoeffs);
+  RectifiedStereoMatcher matcher(cam0, cam1, kResolution,
+      R_cam0_cam1, t_cam0_cam1);
+
+  const Texture texture;
+  const Mat cam0_img = render(texture, Matx33d::eye(), Vec3d(0, 0, 0));
+  const Mat cam1_img = render(texture, R_cam0_cam1, t_cam0_cam1);
+
+  // Points away from the border, whose disparity is 22 pixels.
+  mt19937 gen(5);
+  uniform_real_distribution<float> x_dist(100.0f, 600.0f);
+  uniform_real_distribution<float> y_dist(30.0f, 450.0f);
+  vector<Point2f> cam0_pixels(0);
+  for (int i = 0; i < 300; ++i)
+    cam0_pixels.push_back(Point2f(x_dist(gen), y_dist(gen)));
+  vector<Point2f> cam0_points_undistorted(0);
+  cam0.undistort(cam0_pixels, cam0_points_undistorted);
+
+  vector<Point2f> cam1_points, cam1_points_undistorted;
+  vector<unsigned char> inlier_markers;
+  matcher.match(cam0_img, cam1_img, cam0_points_undistorted,
+      cam1_points, cam1_points_undistorted, inlier_markers);
+  ASSERT_EQ(inlier_markers.size(), cam0_pixels.size());
+
+  int inlier_num = 0;
+  double error_sum = 0.0;
+  for (int i = 0; i < cam0_pixels.size(); ++i) {
+    if (inlier_markers[i] == 0) continue;
+    ++inlier_num;
+
+    const Point2f& pt0 = cam0_points_undistorted[i];
+    const Vec3d pt1 = R_cam0_cam1 *
+      Vec3d(kDepth*pt0.x, kDepth*pt0.y, kDepth) + t_cam0_cam1;
+    const Point2f pixel1(
+        kIntrinsics[0]*pt1[0]/pt1[2] + kIntrinsics[2],
+        kIntrinsics[1]*pt1[1]/pt1[2] + kIntrinsics[3]);
+    const Point2f diff = cam1_points[i] - pixel1;
+    error_sum += sqrt(diff.dot(diff));
+    EXPECT_LT(sqrt(diff.dot(diff)), 0.5) << "point " << i;
+
+    const Point2f diff_undistorted = cam1_points_undistorted[i] -
+      Point2f(pt1[0]/pt1[2], pt1[1]/pt1[2]);
+    EXPECT_LT(sqrt(diff_undistorted.dot(diff_undistorted))*
+        kIntrinsics[0], 0.5) << "point " << i;
+  }
+  EXPECT_GT(inlier_num, 250);
+  EXPECT_LT(error_sum/inlier_num, 0.1);
+  return;
+}
+
+TEST(RectifiedStereoMatcherTest, rejectsUntexturedPatches) {
+  const Matx33d R_cam0_cam1 = rotation();
+  const Vec3d t_cam0_cam1 = -(R_cam0_cam1 * Vec3d(0.11, 0.0, 0.0));
+  PointUndistorter cam0(kResolution, kIntrinsics, "radtan", kCoeffs);
+  PointUndistorter cam1(kResolution, kIntrinsics, "radtan", kCoeffs);
+  RectifiedStereoMatcher matcher(cam0, cam1, kResolution,
+      R_cam0_cam1, t_cam0_cam1);
+
+  const Mat flat_img(kResolution[1], kResolution[0], CV_8UC1, Scalar(128));
+  const vector<Point2f> cam0_pixels = {
+    Point2f(320.0f, 240.0f), Point2f(500.0f, 100.0f)};
+  vector<Point2f> cam0_points_undistorted(0);
+  cam0.undistort(cam0_pixels, cam0_points_undistorted);
+
+  vector<Point2f> cam1_points, cam1_points_undistorted;
+  vector<unsigned char> inlier_markers;
+  matcher.match(flat_img, flat_img, cam0_points_undistorted,
+      cam1_points, cam1_points_undistorted, inlier_markers);
+  ASSERT_EQ(inlier_markers.size(), cam0_pixels.size());
+  EXPECT_EQ(inlier_markers[0], 0);
+  EXPECT_EQ(inlier_markers[1], 0);
+  return;
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
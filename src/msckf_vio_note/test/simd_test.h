@@ -0,0 +1,49 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#ifndef MSCKF_VIO_SIMD_TEST_H
+#define MSCKF_VIO_SIMD_TEST_H
+
+#include <vector>
+#include <gtest/gtest.h>
+
+namespace msckf_vio {
+namespace test {
+
+/*
+ * @brief expectSimdMatchesScalar Runs the same inputs with an
+ *    object using the vectorized kernels and one using the
+ *    scalar kernels, and expects the same outputs.
+ * @param run: run(object, outputs) runs the object and appends
+ *    all its outputs, including the counts, to outputs.
+ * @param tolerance: maximum difference of the outputs, 0 for
+ *    the kernels with exactly the same results.
+ */
+template <class Object, class Run>
+void expectSimdMatchesScalar(Object& simd_object,
+    Object& scalar_object, const Run& run,
+    const double& tolerance = 0.0) {
+  EXPECT_STREQ(scalar_object.simdName(), "scalar");
+
+  std::vector<double> simd_outputs, scalar_outputs;
+  run(simd_object, simd_outputs);
+  run(scalar_object, scalar_outputs);
+  ASSERT_EQ(simd_outputs.size(), scalar_outputs.size());
+  for (int i = 0; i < simd_outputs.size(); ++i) {
+    if (tolerance > 0.0)
+      EXPECT_NEAR(simd_outputs[i], scalar_outputs[i], tolerance)
+        << "output " << i;
+    else
+      EXPECT_EQ(simd_outputs[i], scalar_outputs[i]) << "output " << i;
+  }
+  return;
+}
+
+} // namespace test
+} // namespace msckf_vio
+
+#endif // MSCKF_VIO_SIMD_TEST_H
@@ -0,0 +1,68 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <msckf_vio/spsc_queue.h>
+
+using namespace std;
+using namespace msckf_vio;
+
+TEST(SpscQueueTest, pushAndPop) {
+  SpscQueue<int> queue(2);
+  EXPECT_TRUE(queue.empty());
+
+  int value = 1;
+  EXPECT_TRUE(queue.tryPush(value));
+  value = 2;
+  EXPECT_TRUE(queue.tryPush(value));
+  value = 3;
+  EXPECT_FALSE(queue.tryPush(value));
+
+  EXPECT_TRUE(queue.tryPop(value));
+  EXPECT_EQ(value, 1);
+  EXPECT_TRUE(queue.tryPop(value));
+  EXPECT_EQ(value, 2);
+  EXPECT_FALSE(queue.tryPop(value));
+  EXPECT_TRUE(queue.empty());
+  return;
+}
+
+TEST(SpscQueueTest, concurrentOrder) {
+  const int value_num = 100000;
+  SpscQueue<vector<int> > queue(16);
+
+  thread producer([&queue]() {
+      for (int i = 0; i < value_num; ++i) {
+        vector<int> value(1, i);
+        while (!queue.tryPush(value)) this_thread::yield();
+      }
+    });
+
+  int next_value = 0;
+  vector<int> value;
+  while (next_value < value_num) {
+    if (!queue.tryPop(value)) {
+      this_thread::yield();
+      continue;
+    }
+    ASSERT_EQ(value.size(), 1u);
+    ASSERT_EQ(value[0], next_value);
+    ++next_value;
+  }
+
+  producer.join();
+  EXPECT_TRUE(queue.empty());
+  return;
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
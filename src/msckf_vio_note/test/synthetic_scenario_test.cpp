@@ -0,0 +1,181 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <map>
+#include <eigen3/Eigen/Dense>
+#include <eigen3/Eigen/Geometry>
+#include <gtest/gtest.h>
+#include <msckf_vio/math_utils.hpp>
+#include <msckf_vio/synthetic_scenario.h>
+
+using namespace std;
+using namespace Eigen;
+using namespace msckf_vio;
+
+namespace {
+
+// A noise-free scenario with a camera rotated and shifted
+// w.r.t. the IMU.
+SyntheticScenario::Config noiseFreeConfig() {
+  SyntheticScenario::Config config;
+  config.duration = 10.0;
+  config.gyro_noise = 0.0;
+  config.acc_noise = 0.0;
+  config.gyro_bias_noise = 0.0;
+  config.acc_bias_noise = 0.0;
+  config.initial_gyro_bias = Vector3d(0.01, -0.02, 0.005);
+  config.initial_acc_bias = Vector3d(0.05, 0.02, -0.03);
+  config.pixel_noise = 0.0;
+  config.T_imu_cam0.linear() = AngleAxisd(
+      M_PI_2, Vector3d(1.0, 1.0, 0.0).normalized()).toRotationMatrix();
+  config.T_imu_cam0.translation() = Vector3d(0.05, -0.02, 0.01);
+  return config;
+}
+
+} // namespace
+
+TEST(SyntheticScenarioTest, imuIntegration) {
+  SyntheticScenario scenario(noiseFreeConfig());
+  scenario.generate();
+  const auto& imu_samples = scenario.imuSamples();
+  const auto& ground_truth = scenario.groundTruth();
+  ASSERT_EQ(imu_samples.size(), ground_truth.size());
+
+  // The accelerometer measures the gravity while static.
+  const Matrix3d R_w_i0 = quaternionToRotation(
+      ground_truth[0].orientation);
+  const Vector3d acc0 = imu_samples[0].linear_acceleration -
+    ground_truth[0].acc_bias;
+  EXPECT_NEAR((acc0-R_w_i0*Vector3d(0.0, 0.0, GRAVITY_ACCELERATION)).norm(),
+      0.0, 1e-6);
+
+  // Integrating the bias-corrected measurements should
+  // reproduce the ground truth trajectory.
+  const Vector3d gravity(0.0, 0.0, -GRAVITY_ACCELERATION);
+  Matrix3d R_i_w = R_w_i0.transpose();
+  Vector3d position = ground_truth[0].position;
+  Vector3d velocity = ground_truth[0].velocity;
+  for (int i = 1; i < static_cast<int>(imu_samples.size()); ++i) {
+    const double dt = imu_samples[i].time - imu_samples[i-1].time;
+    const Vector3d gyro0 = imu_samples[i-1].angular_velocity -
+      ground_truth[i-1].gyro_bias;
+    const Vector3d gyro1 = imu_samples[i].angular_velocity -
+      ground_truth[i].gyro_bias;
+    const Vector3d acc0 = imu_samples[i-1].linear_acceleration -
+      ground_truth[i-1].acc_bias;
+    const Vector3d acc1 = imu_samples[i].linear_acceleration -
+      ground_truth[i].acc_bias;
+
+    const Vector3d gyro = 0.5 * (gyro0+gyro1);
+    const Matrix3d R_i_w1 = gyro.norm() < 1e-12 ? R_i_w :
+      Matrix3d(R_i_w * AngleAxisd(
+        gyro.norm()*dt, gyro.normalized()).toRotationMatrix());
+    const Vector3d acc_w0 = R_i_w*acc0 + gravity;
+    const Vector3d acc_w1 = R_i_w1*acc1 + gravity;
+
+    position += velocity*dt + (acc_w0/3.0+acc_w1/6.0)*dt*dt;
+    velocity += 0.5 * (acc_w0+acc_w1) * dt;
+    R_i_w = R_i_w1;
+  }
+
+  const Matrix3d R_w_i = quaternionToRotation(
+      ground_truth.back().orientation);
+  EXPECT_NEAR((position-ground_truth.back().position).norm(), 0.0, 0.05);
+  EXPECT_NEAR((velocity-ground_truth.back().velocity).norm(), 0.0, 0.01);
+  EXPECT_NEAR(AngleAxisd(R_w_i*R_i_w).angle(), 0.0, 1e-3);
+  return;
+}
+
+TEST(SyntheticScenarioTest, stereoMeasurements) {
+  SyntheticScenario scenario(noiseFreeConfig());
+  scenario.generate();
+  const auto& config = scenario.config();
+  const auto& landmarks = scenario.landmarks();
+  const auto& ground_truth = scenario.groundTruth();
+
+  const Matrix3d R_i_c0 = config.T_imu_cam0.linear();
+  const Vector3d t_i_c0 = config.T_imu_cam0.translation();
+
+  // The frames are aligned with the IMU samples.
+  const int step = static_cast<int>(config.imu_rate/config.frame_rate);
+  for (int k = 0; k < static_cast<int>(
+        scenario.stereoFrames().size()); ++k) {
+    const auto& frame = scenario.stereoFrames()[k];
+    const auto& truth = ground_truth[(k+1)*step];
+    ASSERT_NEAR(frame.time, truth.time, 1e-9);
+    EXPECT_GT(frame.features.size(), 0u);
+
+    const Matrix3d R_w_i = quaternionToRotation(truth.orientation);
+    for (const auto& feature : frame.features) {
+      const Vector3d p_i = R_w_i * (
+          landmarks[feature.landmark_id]-truth.position);
+      const Vector3d p_c0 = R_i_c0*p_i + t_i_c0;
+      const Vector3d p_c1 = config.T_cam0_cam1 * p_c0;
+      const Vector4d z(p_c0(0)/p_c0(2), p_c0(1)/p_c0(2),
+          p_c1(0)/p_c1(2), p_c1(1)/p_c1(2));
+      EXPECT_NEAR((z-feature.measurement).norm(), 0.0, 1e-6);
+    }
+  }
+  return;
+}
+
+TEST(SyntheticScenarioTest, featureTracks) {
+  SyntheticScenario::Config config = noiseFreeConfig();
+  config.max_feature_num = 100;
+  config.max_track_length = 5;
+  SyntheticScenario scenario(config);
+  scenario.generate();
+
+  // Each id is tracked in consecutive frames for at most
+  // max_track_length frames and on a single landmark.
+  map<SyntheticScenario::FeatureIDType, int> last_frame;
+  map<SyntheticScenario::FeatureIDType, int> track_length;
+  map<SyntheticScenario::FeatureIDType, int> landmark_ids;
+  for (int k = 0; k < static_cast<int>(
+        scenario.stereoFrames().size()); ++k) {
+    const auto& frame = scenario.stereoFrames()[k];
+    EXPECT_LE(static_cast<int>(frame.features.size()),
+        config.max_feature_num);
+
+    for (const auto& feature : frame.features) {
+      if (last_frame.count(feature.id)) {
+        EXPECT_EQ(last_frame[feature.id], k-1);
+        EXPECT_EQ(landmark_ids[feature.id], feature.landmark_id);
+      }
+      last_frame[feature.id] = k;
+      landmark_ids[feature.id] = feature.landmark_id;
+      EXPECT_LE(++track_length[feature.id], config.max_track_length);
+    }
+  }
+  return;
+}
+
+TEST(SyntheticScenarioTest, repeatability) {
+  SyntheticScenario::Config config;
+  config.duration = 5.0;
+  SyntheticScenario scenario0(config), scenario1(config);
+  scenario0.generate();
+  scenario1.generate();
+
+  ASSERT_EQ(scenario0.imuSamples().size(), scenario1.imuSamples().size());
+  for (int i = 0; i < static_cast<int>(scenario0.imuSamples().size()); ++i)
+    EXPECT_EQ(scenario0.imuSamples()[i].linear_acceleration,
+        scenario1.imuSamples()[i].linear_acceleration);
+
+  ASSERT_EQ(scenario0.stereoFrames().size(),
+      scenario1.stereoFrames().size());
+  for (int k = 0; k < static_cast<int>(
+        scenario0.stereoFrames().size()); ++k)
+    EXPECT_EQ(scenario0.stereoFrames()[k].features.size(),
+        scenario1.stereoFrames()[k].features.size());
+  return;
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,172 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <vector>
+#include <random>
+#include <gtest/gtest.h>
+
+#include <msckf_vio/two_point_ransac.h>
+#include "simd_test.h"
+
+using namespace std;
+using namespace cv;
+using namespace msckf_vio;
+
+namespace {
+
+const double kThreshold = 1e-3;
+
+// Normalized points of a pure translation between two frames,
+// where the outliers are moved in the current frame.
+void generatePoints(const int& point_num, const double& outlier_ratio,
+    vector<Point2f>& pts1, vector<Point2f>& pts2,
+    vector<bool>& is_inlier) {
+  mt19937 gen(7);
+  uniform_real_distribution<double> xy_dist(-1.0, 1.0);
+  uniform_real_distribution<double> depth_dist(2.0, 10.0);
+  uniform_real_distribution<double> offset_dist(0.02, 0.05);
+  const double tx = 0.3, ty = -0.1, tz = 0.2;
+
+  pts1.resize(point_num);
+  pts2.resize(point_num);
+  is_inlier.resize(point_num);
+  for (int i = 0; i < point_num; ++i) {
+    const double z = depth_dist(gen);
+    const double x = xy_dist(gen) * z;
+    const double y = xy_dist(gen) * z;
+    pts1[i] = Point2f(x/z, y/z);
+    pts2[i] = Point2f((x+tx)/(z+tz), (y+ty)/(z+tz));
+
+    is_inlier[i] = i >= outlier_ratio*point_num;
+    if (!is_inlier[i]) {
+      pts2[i].x += offset_dist(gen);
+      pts2[i].y -= offset_dist(gen);
+    }
+  }
+  return;
+}
+
+vector<int> allCandidates(const int& point_num) {
+  vector<int> candidates(point_num);
+  for (int i = 0; i < point_num; ++i) candidates[i] = i;
+  return candidates;
+}
+
+} // namespace
+
+TEST(TwoPointRansacTest, findInliers) {
+  vector<Point2f> pts1, pts2;
+  vector<bool> is_inlier;
+  generatePoints(200, 0.4, pts1, pts2, is_inlier);
+
+  // The first point is not a candidate.
+  vector<int> candidates = allCandidates(pts1.size());
+  candidates.erase(candidates.begin());
+
+  TwoPointRansac::Config config;
+  TwoPointRansac ransac(config);
+  vector<int> inlier_markers;
+  ransac.estimate(pts1, pts2, candidates, vector<float>(),
+      kThreshold, 0.99, inlier_markers);
+
+  ASSERT_EQ(inlier_markers.size(), pts1.size());
+  EXPECT_EQ(inlier_markers[0], 0);
+  int missed_inlier_num = 0;
+  int false_inlier_num = 0;
+  for (int i = 1; i < pts1.size(); ++i) {
+    if (is_inlier[i] && !inlier_markers[i]) ++missed_inlier_num;
+    if (!is_inlier[i] && inlier_markers[i]) ++false_inlier_num;
+  }
+  EXPECT_EQ(missed_inlier_num, 0);
+  EXPECT_LE(false_inlier_num, 2);
+  return;
+}
+
+TEST(TwoPointRansacTest, adaptiveIterations) {
+  vector<Point2f> pts1, pts2;
+  vector<bool> is_inlier;
+  const vector<int> candidates = allCandidates(200);
+  TwoPointRansac::Config config;
+  TwoPointRansac ransac(config);
+  vector<int> inlier_markers;
+
+  // Frames with mostly inliers stop after a few hypotheses.
+  generatePoints(200, 0.0, pts1, pts2, is_inlier);
+  EXPECT_EQ(ransac.estimate(pts1, pts2, candidates, vector<float>(),
+        kThreshold, 0.99, inlier_markers), 1);
+
+  generatePoints(200, 0.1, pts1, pts2, is_inlier);
+  EXPECT_LE(ransac.estimate(pts1, pts2, candidates, vector<float>(),
+        kThreshold, 0.99, inlier_markers), 4);
+
+  // Without an acceptable model, all the hypotheses are drawn.
+  generatePoints(200, 0.9, pts1, pts2, is_inlier);
+  config.min_inlier_ratio = 0.5;
+  TwoPointRansac strict_ransac(config);
+  EXPECT_EQ(strict_ransac.estimate(pts1, pts2, candidates,
+        vector<float>(), kThreshold, 0.99, inlier_markers),
+      config.max_iteration);
+  for (const auto& marker : inlier_markers) EXPECT_EQ(marker, 0);
+  return;
+}
+
+TEST(TwoPointRansacTest, prosac) {
+  vector<Point2f> pts1, pts2;
+  vector<bool> is_inlier;
+  generatePoints(200, 0.6, pts1, pts2, is_inlier);
+  const vector<int> candidates = allCandidates(pts1.size());
+
+  // The inliers have a better quality.
+  vector<float> qualities(pts1.size());
+  for (int i = 0; i < pts1.size(); ++i)
+    qualities[i] = is_inlier[i] ? 10.0f+i%3 : i%5;
+
+  TwoPointRansac::Config config;
+  config.use_prosac = true;
+  TwoPointRansac ransac(config);
+  vector<int> inlier_markers;
+  const int iterations = ransac.estimate(pts1, pts2, candidates,
+      qualities, kThreshold, 0.99, inlier_markers);
+
+  EXPECT_LE(iterations, 5);
+  for (int i = 0; i < pts1.size(); ++i) {
+    if (!is_inlier[i]) continue;
+    EXPECT_EQ(inlier_markers[i], 1);
+  }
+  return;
+}
+
+TEST(TwoPointRansacTest, simdMatchesScalar) {
+  vector<Point2f> pts1, pts2;
+  vector<bool> is_inlier;
+  generatePoints(203, 0.5, pts1, pts2, is_inlier);
+  const vector<int> candidates = allCandidates(pts1.size());
+
+  TwoPointRansac::Config config;
+  TwoPointRansac simd_ransac(config);
+  config.use_simd = false;
+  TwoPointRansac scalar_ransac(config);
+
+  // The same seed draws the same hypotheses, and the
+  // persistent generators continue across the calls.
+  for (int call = 0; call < 3; ++call) {
+    test::expectSimdMatchesScalar(simd_ransac, scalar_ransac,
+        [&](TwoPointRansac& ransac, vector<double>& outputs) {
+          vector<int> markers;
+          outputs.push_back(ransac.estimate(
+                pts1, pts2, candidates, vector<float>(),
+                kThreshold, 0.99, markers));
+          outputs.insert(outputs.end(), markers.begin(), markers.end());
+        });
+  }
+  return;
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,72 @@
+/*
+ * COPYRIGHT AND PERMISSION NOTICE
+ * Penn Software MSCKF_VIO
+ * Copyright (C) 2017 The Trustees of the University of Pennsylvania
+ * All rights reserved.
+ */
+
+#include <gtest/gtest.h>
+
+#include <msckf_vio/window_controller.h>
+
+using namespace msckf_vio;
+
+namespace {
+
+// Processing time growing linearly with the window size.
+double processingTime(const int& window_size) {
+  return 1e-3 * window_size;
+}
+
+} // namespace
+
+TEST(WindowControllerTest, converge) {
+  WindowController::Config config;
+  config.min_size = 10;
+  config.max_size = 40;
+  config.time_budget = 0.8;
+  config.grow_ratio = 0.6;
+
+  // The budget of 0.8/40 = 20ms is exceeded with more than
+  // 20 camera states, and the window grows below 12ms.
+  WindowController controller(config, 40.0, 30);
+  EXPECT_EQ(controller.windowSize(), 30);
+  EXPECT_DOUBLE_EQ(controller.budgetTime(), 0.02);
+
+  for (int i = 0; i < 1000; ++i)
+    controller.update(processingTime(controller.windowSize()));
+  EXPECT_GE(controller.windowSize(), 12);
+  EXPECT_LE(controller.windowSize(), 20);
+  return;
+}
+
+TEST(WindowControllerTest, bounds) {
+  WindowController::Config config;
+  config.min_size = 10;
+  config.max_size = 20;
+  config.period = 5;
+
+  WindowController controller(config, 20.0, 50);
+  EXPECT_EQ(controller.windowSize(), 20);
+
+  // Too slow at any size.
+  for (int i = 0; i < 4; ++i)
+    EXPECT_FALSE(controller.update(1.0));
+  EXPECT_TRUE(controller.update(1.0));
+  EXPECT_EQ(controller.decision(), WindowController::SHRINK);
+  EXPECT_EQ(controller.windowSize(), 18);
+
+  for (int i = 0; i < 100; ++i) controller.update(1.0);
+  EXPECT_EQ(controller.windowSize(), 10);
+  EXPECT_EQ(controller.decision(), WindowController::KEEP);
+
+  // Fast at any size.
+  for (int i = 0; i < 1000; ++i) controller.update(0.0);
+  EXPECT_EQ(controller.windowSize(), 20);
+  return;
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}